@@ -1,3 +1,6 @@
+// pulls in the STBDS_REALLOC / STBDS_FREE hooks
+#include <src/utils.h>
+
 #define STB_DS_IMPLEMENTATION
 #include "stb_ds.h"
 
@@ -1,10 +1,31 @@
 #version 450
 
-layout(location = 0) in vec3 fragColor;
+// TILE_SIZE and TILE_ATLAS_SIZE of tile_cache.h
+const uint TILE_SIZE = 256;
+const uint TILE_ATLAS_SIZE = 4096;
+const uint TILE_ATLAS_COLUMNS = TILE_ATLAS_SIZE / TILE_SIZE;
+const uint NO_TEXTURE = 0xFFFFFFFFu;
+
+layout(set = 0, binding = 0) uniform sampler2D tileAtlas;
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) flat in uint fragTextureIndex;
+layout(location = 2) flat in vec2 fragTextureSize;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
-}
+    // blank paper where no tile is drawn yet
+    if (fragTextureIndex == NO_TEXTURE) {
+        outColor = vec4(1.0);
+        return;
+    }
 
+    vec2 slot = vec2(fragTextureIndex % TILE_ATLAS_COLUMNS, fragTextureIndex / TILE_ATLAS_COLUMNS);
+    vec2 origin = slot * (float(TILE_SIZE) / float(TILE_ATLAS_SIZE));
+
+    // half a texel in from the edges, so filtering never reads the neighbouring slots
+    vec2 halfTexel = vec2(0.5 / float(TILE_ATLAS_SIZE));
+    vec2 uv = clamp(fragTexCoord * fragTextureSize, halfTexel, fragTextureSize - halfTexel);
+    outColor = texture(tileAtlas, origin + uv);
+}
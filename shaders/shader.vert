@@ -1,11 +1,34 @@
 #version 450
 
-layout(location = 0) in vec2 inPosition;
-layout(location = 1) in vec3 inColor;
+// corner of the unit quad
+layout(location = 0) in vec2 inCorner;
 
-layout(location = 0) out vec3 fragColor;
+// page instance, in layout units
+layout(location = 1) in vec2 inPagePosition;
+layout(location = 2) in vec2 inPageSize;
+layout(location = 3) in uint inTextureIndex;
+layout(location = 4) in float inRotation;
+layout(location = 5) in vec2 inTextureSize;
+
+// layout units to clip space, the only thing that changes while scrolling
+layout(push_constant) uniform PageView {
+    vec2 scale;
+    vec2 offset;
+} view;
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) flat out uint fragTextureIndex;
+layout(location = 2) flat out vec2 fragTextureSize;
 
 void main() {
-    gl_Position = vec4(inPosition, 0.0, 1.0);
-    fragColor = inColor;
-}
\ No newline at end of file
+    vec2 position = inPagePosition + inCorner * inPageSize;
+    gl_Position = vec4(position * view.scale + view.offset, 0.0, 1.0);
+
+    // the texture holds the unturned page, its coordinates turn the other way
+    float c = cos(inRotation);
+    float s = sin(inRotation);
+    vec2 centered = inCorner - 0.5;
+    fragTexCoord = vec2(c * centered.x + s * centered.y, c * centered.y - s * centered.x) + 0.5;
+    fragTextureIndex = inTextureIndex;
+    fragTextureSize = inTextureSize;
+}
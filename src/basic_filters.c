@@ -0,0 +1,396 @@
+#include "basic_filters.h"
+#include "buffer_pool.h"
+#include "simd.h"
+
+#include <string.h>
+
+/// OUTPUT WINDOW ///
+
+local void window_init(FilterWindow *w, DecodeSink next) {
+	ASSERT_NOT_NULL(next.fn);
+	*w = (FilterWindow){
+		.next = next,
+		.data = buffer_pool_acquire(INFLATE_WINDOW),
+	};
+}
+
+local void window_free(FilterWindow *w) {
+	buffer_pool_release(w->data);
+	*w = (FilterWindow){ 0 };
+}
+
+local bool window_flush(FilterWindow *w) {
+	if (w->len != 0 && !w->stopped) w->stopped = !w->next.fn(w->next.user_data, w->data, w->len);
+	w->len = 0;
+	return !w->stopped;
+}
+
+// makes room for n more bytes, returns false if the next sink stopped
+local inline bool window_reserve(FilterWindow *w, u32 n) {
+	if (w->len + n > INFLATE_WINDOW) return window_flush(w);
+	return !w->stopped;
+}
+
+local inline void window_put_be32(FilterWindow *w, u32 value) {
+	u8 *p = w->data + w->len;
+	p[0] = (u8)(value >> 24);
+	p[1] = (u8)(value >> 16);
+	p[2] = (u8)(value >> 8);
+	p[3] = (u8)value;
+	w->len += 4;
+}
+
+
+/// ASCII HEX ///
+
+// digit value + 1, 0 for characters that are not hex digits
+local const u8 hex_digits[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+// decodes 16 hex digits into 8 bytes, returns false (and writes nothing) if
+// any of the characters is not a hex digit
+#if PTRAIL_SSE2
+
+local inline bool hex16_simd(const u8 *in, u8 *out) {
+	__m128i c = _mm_loadu_si128((const __m128i *)in);
+	__m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+
+	// signed compares, characters >= 0x80 are outside of both ranges
+	__m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	__m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+	if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xffff) return false;
+
+	__m128i v = _mm_or_si128(
+		_mm_and_si128(is_digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+		_mm_andnot_si128(is_digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+
+	// every 16 bit lane holds (low digit << 8 | high digit)
+	__m128i bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00ff)), 4), _mm_srli_epi16(v, 8));
+	_mm_storel_epi64((__m128i *)out, _mm_packus_epi16(bytes, bytes));
+	return true;
+}
+
+#elif PTRAIL_NEON
+
+local inline bool all_set_neon(uint8x16_t mask) {
+	uint64x2_t m = vreinterpretq_u64_u8(mask);
+	return (vgetq_lane_u64(m, 0) & vgetq_lane_u64(m, 1)) == U64_MAX;
+}
+
+local inline bool hex16_simd(const u8 *in, u8 *out) {
+	uint8x16_t c = vld1q_u8(in);
+	uint8x16_t lower = vorrq_u8(c, vdupq_n_u8(0x20));
+
+	uint8x16_t is_digit = vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+	uint8x16_t is_alpha = vandq_u8(vcgeq_u8(lower, vdupq_n_u8('a')), vcleq_u8(lower, vdupq_n_u8('f')));
+	if (!all_set_neon(vorrq_u8(is_digit, is_alpha))) return false;
+
+	uint8x16_t v = vbslq_u8(is_digit, vsubq_u8(c, vdupq_n_u8('0')), vsubq_u8(lower, vdupq_n_u8('a' - 10)));
+
+	// every 16 bit lane holds (low digit << 8 | high digit)
+	uint16x8_t v16 = vreinterpretq_u16_u8(v);
+	uint16x8_t bytes = vorrq_u16(vshlq_n_u16(vandq_u16(v16, vdupq_n_u16(0x00ff)), 4), vshrq_n_u16(v16, 8));
+	vst1_u8(out, vmovn_u16(bytes));
+	return true;
+}
+
+#endif
+
+void ascii_hex_init(AsciiHexDecoder *d, DecodeSink next) {
+	*d = (AsciiHexDecoder){ .high_nibble = -1 };
+	window_init(&d->out, next);
+}
+
+void ascii_hex_free(AsciiHexDecoder *d) {
+	window_free(&d->out);
+	*d = (AsciiHexDecoder){ 0 };
+}
+
+local bool ascii_hex_write(void *user_data, const u8 *data, u64 len) {
+	AsciiHexDecoder *d = user_data;
+	FilterWindow *out = &d->out;
+	u64 i = 0;
+
+	while (i < len && !d->ended) {
+		if (!window_reserve(out, 16)) return false;
+
+#if PTRAIL_SIMD
+		// blocks without white space are decoded 16 digits at a time
+		if (d->high_nibble < 0) {
+			while (i + 16 <= len && out->len + 8 <= INFLATE_WINDOW && hex16_simd(data + i, out->data + out->len)) {
+				i += 16;
+				out->len += 8;
+			}
+			if (!window_reserve(out, 16)) return false;
+		}
+#endif
+
+		u64 end = MIN(len, i + 16);
+		for (; i < end; i++) {
+			u8 c = data[i];
+			u8 digit = hex_digits[c];
+
+			if (digit != 0) {
+				if (d->high_nibble < 0) {
+					d->high_nibble = digit - 1;
+				}
+				else {
+					out->data[out->len++] = (u8)(d->high_nibble << 4 | (digit - 1));
+					d->high_nibble = -1;
+				}
+			}
+			else if (c == '>') {
+				d->ended = true;
+				break;
+			}
+			else if (d->high_nibble < 0) {
+				// back to the vectorized loop after white space
+				i += 1;
+				break;
+			}
+		}
+	}
+
+	return !out->stopped;
+}
+
+DecodeSink ascii_hex_sink(AsciiHexDecoder *d) {
+	return (DecodeSink){ .fn = ascii_hex_write, .user_data = d };
+}
+
+bool ascii_hex_finish(AsciiHexDecoder *d) {
+	FilterWindow *out = &d->out;
+
+	if (d->high_nibble >= 0) {
+		if (!window_reserve(out, 1)) return false;
+		out->data[out->len++] = (u8)(d->high_nibble << 4);
+		d->high_nibble = -1;
+	}
+
+	return window_flush(out);
+}
+
+
+/// ASCII85 ///
+
+// the groups of 5 digits are decoded with the characters still offset by '!',
+// which adds this to every value (mod 2^32)
+#define A85_BIAS ((u32)'!' * (85u * 85 * 85 * 85 + 85 * 85 * 85 + 85 * 85 + 85 + 1))
+
+// decodes 4 complete groups (20 characters) into 16 bytes, returns false (and writes nothing)
+// if any of the characters is not a digit. the digits of one group are in one 32 bit lane
+#if PTRAIL_SSE2
+
+local inline __m128i a85_digits(const u8 *in, u32 k) {
+	return _mm_setr_epi32(in[k], in[5 + k], in[10 + k], in[15 + k]);
+}
+
+local inline __m128i mul85(__m128i x) {
+	// 85 = 64 + 16 + 4 + 1, SSE2 has no 32 bit multiply
+	return _mm_add_epi32(_mm_add_epi32(x, _mm_slli_epi32(x, 2)), _mm_add_epi32(_mm_slli_epi32(x, 4), _mm_slli_epi32(x, 6)));
+}
+
+local inline bool a85_20_simd(const u8 *in, u8 *out) {
+	__m128i low = _mm_set1_epi8('!' - 1);
+	__m128i high = _mm_set1_epi8('u' + 1);
+	__m128i a = _mm_loadu_si128((const __m128i *)in);
+	__m128i b = _mm_loadu_si128((const __m128i *)(in + 4));
+
+	__m128i valid = _mm_and_si128(
+		_mm_and_si128(_mm_cmpgt_epi8(a, low), _mm_cmplt_epi8(a, high)),
+		_mm_and_si128(_mm_cmpgt_epi8(b, low), _mm_cmplt_epi8(b, high)));
+	if (_mm_movemask_epi8(valid) != 0xffff) return false;
+
+	__m128i v = a85_digits(in, 0);
+	for (u32 k = 1; k < 5; k++) {
+		v = _mm_add_epi32(mul85(v), a85_digits(in, k));
+	}
+	v = _mm_sub_epi32(v, _mm_set1_epi32((i32)A85_BIAS));
+
+	// big endian output, swap the bytes of every 16 bit half and then the halves
+	v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	v = _mm_shufflelo_epi16(v, 0xb1);
+	v = _mm_shufflehi_epi16(v, 0xb1);
+	_mm_storeu_si128((__m128i *)out, v);
+	return true;
+}
+
+#elif PTRAIL_NEON
+
+local inline uint32x4_t a85_digits(const u8 *in, u32 k) {
+	u32 digits[4] = { in[k], in[5 + k], in[10 + k], in[15 + k] };
+	return vld1q_u32(digits);
+}
+
+local inline bool a85_20_simd(const u8 *in, u8 *out) {
+	uint8x16_t low = vdupq_n_u8('!');
+	uint8x16_t high = vdupq_n_u8('u');
+	uint8x16_t a = vld1q_u8(in);
+	uint8x16_t b = vld1q_u8(in + 4);
+
+	uint8x16_t valid = vandq_u8(
+		vandq_u8(vcgeq_u8(a, low), vcleq_u8(a, high)),
+		vandq_u8(vcgeq_u8(b, low), vcleq_u8(b, high)));
+	if (!all_set_neon(valid)) return false;
+
+	uint32x4_t v = a85_digits(in, 0);
+	for (u32 k = 1; k < 5; k++) {
+		v = vmlaq_n_u32(a85_digits(in, k), v, 85);
+	}
+	v = vsubq_u32(v, vdupq_n_u32(A85_BIAS));
+
+	vst1q_u8(out, vrev32q_u8(vreinterpretq_u8_u32(v)));
+	return true;
+}
+
+#endif
+
+void ascii85_init(Ascii85Decoder *d, DecodeSink next) {
+	*d = (Ascii85Decoder){ 0 };
+	window_init(&d->out, next);
+}
+
+void ascii85_free(Ascii85Decoder *d) {
+	window_free(&d->out);
+	*d = (Ascii85Decoder){ 0 };
+}
+
+local bool ascii85_write(void *user_data, const u8 *data, u64 len) {
+	Ascii85Decoder *d = user_data;
+	FilterWindow *out = &d->out;
+	u64 i = 0;
+
+	while (i < len && !d->ended) {
+		// 16 characters decode to at most 64 bytes (all 'z')
+		if (!window_reserve(out, 64)) return false;
+
+#if PTRAIL_SIMD
+		// runs of complete groups without white space or 'z' are decoded 4 groups at a time
+		if (d->n_digits == 0) {
+			while (i + 20 <= len && out->len + 16 <= INFLATE_WINDOW && a85_20_simd(data + i, out->data + out->len)) {
+				i += 20;
+				out->len += 16;
+			}
+			if (!window_reserve(out, 64)) return false;
+		}
+#endif
+
+		u64 end = MIN(len, i + 16);
+		for (; i < end; i++) {
+			u8 c = data[i];
+
+			if (c >= '!' && c <= 'u') {
+				d->value = d->value * 85 + (c - '!');
+				d->n_digits += 1;
+
+				if (d->n_digits == 5) {
+					window_put_be32(out, d->value);
+					d->value = 0;
+					d->n_digits = 0;
+				}
+			}
+			else if (c == 'z' && d->n_digits == 0) {
+				window_put_be32(out, 0);
+			}
+			else if (c == '~') {
+				d->ended = true;
+				break;
+			}
+			else if (d->n_digits == 0) {
+				// back to the vectorized loop after white space
+				i += 1;
+				break;
+			}
+		}
+	}
+
+	return !out->stopped;
+}
+
+DecodeSink ascii85_sink(Ascii85Decoder *d) {
+	return (DecodeSink){ .fn = ascii85_write, .user_data = d };
+}
+
+bool ascii85_finish(Ascii85Decoder *d) {
+	FilterWindow *out = &d->out;
+
+	// a final group of n digits is padded with 'u' and decodes to n - 1 bytes, a single digit is invalid
+	if (d->n_digits >= 2) {
+		if (!window_reserve(out, 4)) return false;
+
+		u32 n_bytes = d->n_digits - 1;
+		u32 value = d->value;
+		for (u32 k = d->n_digits; k < 5; k++) {
+			value = value * 85 + ('u' - '!');
+		}
+
+		window_put_be32(out, value);
+		out->len -= 4 - n_bytes;
+	}
+	d->value = 0;
+	d->n_digits = 0;
+
+	return window_flush(out);
+}
+
+
+/// RUN LENGTH ///
+
+void run_length_init(RunLengthDecoder *d, DecodeSink next) {
+	*d = (RunLengthDecoder){ 0 };
+	window_init(&d->out, next);
+}
+
+void run_length_free(RunLengthDecoder *d) {
+	window_free(&d->out);
+	*d = (RunLengthDecoder){ 0 };
+}
+
+local bool run_length_write(void *user_data, const u8 *data, u64 len) {
+	RunLengthDecoder *d = user_data;
+	FilterWindow *out = &d->out;
+	u64 i = 0;
+
+	while (i < len && !d->ended) {
+		if (d->literal_len != 0) {
+			if (out->len == INFLATE_WINDOW && !window_flush(out)) return false;
+
+			u32 n = (u32)MIN(MIN((u64)d->literal_len, len - i), (u64)(INFLATE_WINDOW - out->len));
+			memcpy(out->data + out->len, data + i, n);
+			out->len += n;
+			d->literal_len -= n;
+			i += n;
+		}
+		else if (d->repeat_len != 0) {
+			if (!window_reserve(out, d->repeat_len)) return false;
+
+			memset(out->data + out->len, data[i], d->repeat_len);
+			out->len += d->repeat_len;
+			d->repeat_len = 0;
+			i += 1;
+		}
+		else {
+			u8 length = data[i];
+			i += 1;
+
+			// 0 - 127: copy the next length + 1 bytes, 129 - 255: repeat the next byte 257 - length times
+			if (length < 128) d->literal_len = length + 1;
+			else if (length > 128) d->repeat_len = 257 - length;
+			else d->ended = true;
+		}
+	}
+
+	return !out->stopped;
+}
+
+DecodeSink run_length_sink(RunLengthDecoder *d) {
+	return (DecodeSink){ .fn = run_length_write, .user_data = d };
+}
+
+bool run_length_finish(RunLengthDecoder *d) {
+	return window_flush(&d->out);
+}
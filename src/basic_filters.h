@@ -0,0 +1,54 @@
+#pragma once
+
+#include "decompress.h"
+
+// streaming decoders for ASCIIHexDecode, ASCII85Decode and RunLengthDecode.
+// the encoded data can be split at any byte, decoded data is passed on in windows of INFLATE_WINDOW bytes.
+// characters that are not part of the encoding are skipped like white space
+
+// decoded output that is collected until the window is full
+typedef struct FilterWindow {
+    DecodeSink next;
+    u8 *data;
+    u32 len;
+    bool stopped; // the next sink stopped decoding
+} FilterWindow;
+
+typedef struct AsciiHexDecoder {
+    FilterWindow out;
+    i32 high_nibble; // first digit of an incomplete byte, -1 if there is none
+    bool ended;      // reached the '>' end marker
+} AsciiHexDecoder;
+
+void ascii_hex_init(AsciiHexDecoder *d, DecodeSink next);
+DecodeSink ascii_hex_sink(AsciiHexDecoder *d);
+// passes on a pending final digit (as if followed by 0) and the remaining output,
+// returns false if the next sink stopped
+bool ascii_hex_finish(AsciiHexDecoder *d);
+void ascii_hex_free(AsciiHexDecoder *d);
+
+typedef struct Ascii85Decoder {
+    FilterWindow out;
+    u32 value;    // digits of the current group
+    u32 n_digits;
+    bool ended;   // reached the '~>' end marker
+} Ascii85Decoder;
+
+void ascii85_init(Ascii85Decoder *d, DecodeSink next);
+DecodeSink ascii85_sink(Ascii85Decoder *d);
+// decodes an incomplete final group and passes on the remaining output, returns false if the next sink stopped
+bool ascii85_finish(Ascii85Decoder *d);
+void ascii85_free(Ascii85Decoder *d);
+
+typedef struct RunLengthDecoder {
+    FilterWindow out;
+    u32 literal_len; // bytes left of the current literal run
+    u32 repeat_len;  // length of a repeat run whose byte is still missing, 0 if there is none
+    bool ended;      // reached the 128 end marker
+} RunLengthDecoder;
+
+void run_length_init(RunLengthDecoder *d, DecodeSink next);
+DecodeSink run_length_sink(RunLengthDecoder *d);
+// passes on the remaining output, returns false if the next sink stopped
+bool run_length_finish(RunLengthDecoder *d);
+void run_length_free(RunLengthDecoder *d);
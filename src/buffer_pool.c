@@ -0,0 +1,112 @@
+#include "buffer_pool.h"
+#include "memory.h"
+
+#include <string.h>
+#include <stdatomic.h>
+
+#define N_SIZE_CLASSES (BUFFER_POOL_MAX_CLASS - BUFFER_POOL_MIN_CLASS + 1)
+
+// released buffers are kept in an intrusive singly linked list
+typedef struct FreeBuffer {
+	struct FreeBuffer *next;
+} FreeBuffer;
+
+typedef struct SizeClass {
+	FreeBuffer *free_list;
+	u32 count;
+} SizeClass;
+
+local SizeClass size_classes[N_SIZE_CLASSES];
+local atomic_flag pool_lock = ATOMIC_FLAG_INIT;
+
+local inline void lock_pool(void) {
+	while (atomic_flag_test_and_set_explicit(&pool_lock, memory_order_acquire));
+}
+
+local inline void unlock_pool(void) {
+	atomic_flag_clear_explicit(&pool_lock, memory_order_release);
+}
+
+// smallest class that fits size, N_SIZE_CLASSES if it is too large to be pooled
+local inline u32 size_class_index(u64 size) {
+	u32 index = 0;
+	while (index < N_SIZE_CLASSES && (1ull << (index + BUFFER_POOL_MIN_CLASS)) < size) {
+		index += 1;
+	}
+	return index;
+}
+
+local inline u64 size_class_bytes(u32 index) {
+	return 1ull << (index + BUFFER_POOL_MIN_CLASS);
+}
+
+u8 *buffer_pool_acquire(u64 min_size) {
+	u32 index = size_class_index(min_size);
+	if (index == N_SIZE_CLASSES) return mem_alloc(MEM_TAG_DECODE, min_size);
+
+	SizeClass *sc = &size_classes[index];
+	FreeBuffer *buffer = NULL;
+
+	lock_pool();
+	if (sc->free_list) {
+		buffer = sc->free_list;
+		sc->free_list = buffer->next;
+		sc->count -= 1;
+	}
+	unlock_pool();
+
+	if (buffer) return (u8 *)buffer;
+	return mem_alloc(MEM_TAG_DECODE, size_class_bytes(index));
+}
+
+u8 *buffer_pool_grow(u8 *ptr, u64 used, u64 min_size) {
+	if (ptr && mem_size(ptr) >= min_size) return ptr;
+
+	u8 *new_ptr = buffer_pool_acquire(min_size);
+	if (ptr) {
+		memcpy(new_ptr, ptr, used);
+		buffer_pool_release(ptr);
+	}
+	return new_ptr;
+}
+
+void buffer_pool_release(u8 *ptr) {
+	if (!ptr) return;
+
+	u64 size = mem_size(ptr);
+	u32 index = size_class_index(size);
+	if (index == N_SIZE_CLASSES || size_class_bytes(index) != size) {
+		mem_free(ptr);
+		return;
+	}
+
+	SizeClass *sc = &size_classes[index];
+	bool cached = false;
+
+	lock_pool();
+	if ((u64)(sc->count + 1) * size <= BUFFER_POOL_MAX_CACHED_BYTES) {
+		FreeBuffer *buffer = (FreeBuffer *)ptr;
+		buffer->next = sc->free_list;
+		sc->free_list = buffer;
+		sc->count += 1;
+		cached = true;
+	}
+	unlock_pool();
+
+	if (!cached) mem_free(ptr);
+}
+
+void buffer_pool_trim(void) {
+	for (u32 i = 0; i < N_SIZE_CLASSES; i++) {
+		lock_pool();
+		FreeBuffer *buffer = size_classes[i].free_list;
+		size_classes[i] = (SizeClass){ 0 };
+		unlock_pool();
+
+		while (buffer) {
+			FreeBuffer *next = buffer->next;
+			mem_free(buffer);
+			buffer = next;
+		}
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "utils.h"
+
+// power of two size classes from 4 KiB to 64 MiB, larger buffers are not pooled
+#define BUFFER_POOL_MIN_CLASS 12
+#define BUFFER_POOL_MAX_CLASS 26
+
+// upper bound of the bytes kept in the free list of a single size class
+#define BUFFER_POOL_MAX_CACHED_BYTES (32ull << 20)
+
+// returns a buffer (allocated with mem_alloc, tagged MEM_TAG_DECODE) of at least min_size bytes.
+// the actual capacity is mem_size(ptr)
+u8 *buffer_pool_acquire(u64 min_size);
+// grows ptr to at least min_size bytes, keeping the first used bytes
+u8 *buffer_pool_grow(u8 *ptr, u64 used, u64 min_size);
+// returns ptr to its size class, or frees it if it does not fit one
+void buffer_pool_release(u8 *ptr);
+// frees all cached buffers
+void buffer_pool_trim(void);
@@ -0,0 +1,567 @@
+#include "ccitt.h"
+#include "buffer_pool.h"
+#include "memory.h"
+
+#include <string.h>
+
+// longest supported row, bounds the changing element arrays
+#define CCITT_MAX_COLUMNS (1u << 20)
+// rows the output has room for when /Rows is missing
+#define CCITT_INITIAL_ROWS 256
+// largest output allocated before any row was decoded
+#define CCITT_MAX_INITIAL_SIZE (16ull << 20)
+
+local u32 parms_u32(const Dictionary *parms, const char *key, u32 default_value) {
+	i64 value = find_dict_int(parms, key, default_value);
+	ASSERT_MSG(value >= 0 && value <= U32_MAX, "/%s out of range: %lli", key, (long long)value);
+	return (u32)value;
+}
+
+CCITTParams ccitt_params_from_dict(const Dictionary *parms) {
+	CCITTParams params = {
+		.k = (i32)CLAMP(find_dict_int(parms, "K", 0), 1, -1),
+		.columns = parms_u32(parms, "Columns", 1728),
+		.rows = parms_u32(parms, "Rows", 0),
+		.black_is_1 = find_dict_bool(parms, "BlackIs1", false),
+		.encoded_byte_align = find_dict_bool(parms, "EncodedByteAlign", false),
+	};
+
+	ASSERT_MSG(params.columns >= 1 && params.columns <= CCITT_MAX_COLUMNS, "invalid /Columns: %u", params.columns);
+	return params;
+}
+
+u32 ccitt_row_stride(CCITTParams params) {
+	return (params.columns + 7) / 8;
+}
+
+
+/// CODE TABLES ///
+
+typedef struct CCITTCode {
+	u16 code;
+	u8 len;
+	u16 run;
+} CCITTCode;
+
+// T.4 terminating (0 - 63) and make up codes (64 - 1728)
+local const CCITTCode white_codes[] = {
+	{ 0x35, 8, 0 }, { 0x07, 6, 1 }, { 0x07, 4, 2 }, { 0x08, 4, 3 }, { 0x0b, 4, 4 }, { 0x0c, 4, 5 },
+	{ 0x0e, 4, 6 }, { 0x0f, 4, 7 }, { 0x13, 5, 8 }, { 0x14, 5, 9 }, { 0x07, 5, 10 }, { 0x08, 5, 11 },
+	{ 0x08, 6, 12 }, { 0x03, 6, 13 }, { 0x34, 6, 14 }, { 0x35, 6, 15 }, { 0x2a, 6, 16 }, { 0x2b, 6, 17 },
+	{ 0x27, 7, 18 }, { 0x0c, 7, 19 }, { 0x08, 7, 20 }, { 0x17, 7, 21 }, { 0x03, 7, 22 }, { 0x04, 7, 23 },
+	{ 0x28, 7, 24 }, { 0x2b, 7, 25 }, { 0x13, 7, 26 }, { 0x24, 7, 27 }, { 0x18, 7, 28 }, { 0x02, 8, 29 },
+	{ 0x03, 8, 30 }, { 0x1a, 8, 31 }, { 0x1b, 8, 32 }, { 0x12, 8, 33 }, { 0x13, 8, 34 }, { 0x14, 8, 35 },
+	{ 0x15, 8, 36 }, { 0x16, 8, 37 }, { 0x17, 8, 38 }, { 0x28, 8, 39 }, { 0x29, 8, 40 }, { 0x2a, 8, 41 },
+	{ 0x2b, 8, 42 }, { 0x2c, 8, 43 }, { 0x2d, 8, 44 }, { 0x04, 8, 45 }, { 0x05, 8, 46 }, { 0x0a, 8, 47 },
+	{ 0x0b, 8, 48 }, { 0x52, 8, 49 }, { 0x53, 8, 50 }, { 0x54, 8, 51 }, { 0x55, 8, 52 }, { 0x24, 8, 53 },
+	{ 0x25, 8, 54 }, { 0x58, 8, 55 }, { 0x59, 8, 56 }, { 0x5a, 8, 57 }, { 0x5b, 8, 58 }, { 0x4a, 8, 59 },
+	{ 0x4b, 8, 60 }, { 0x32, 8, 61 }, { 0x33, 8, 62 }, { 0x34, 8, 63 },
+
+	{ 0x1b, 5, 64 }, { 0x12, 5, 128 }, { 0x17, 6, 192 }, { 0x37, 7, 256 }, { 0x36, 8, 320 }, { 0x37, 8, 384 },
+	{ 0x64, 8, 448 }, { 0x65, 8, 512 }, { 0x68, 8, 576 }, { 0x67, 8, 640 }, { 0xcc, 9, 704 }, { 0xcd, 9, 768 },
+	{ 0xd2, 9, 832 }, { 0xd3, 9, 896 }, { 0xd4, 9, 960 }, { 0xd5, 9, 1024 }, { 0xd6, 9, 1088 },
+	{ 0xd7, 9, 1152 }, { 0xd8, 9, 1216 }, { 0xd9, 9, 1280 }, { 0xda, 9, 1344 }, { 0xdb, 9, 1408 },
+	{ 0x98, 9, 1472 }, { 0x99, 9, 1536 }, { 0x9a, 9, 1600 }, { 0x18, 6, 1664 }, { 0x9b, 9, 1728 },
+};
+
+local const CCITTCode black_codes[] = {
+	{ 0x37, 10, 0 }, { 0x02, 3, 1 }, { 0x03, 2, 2 }, { 0x02, 2, 3 }, { 0x03, 3, 4 }, { 0x03, 4, 5 },
+	{ 0x02, 4, 6 }, { 0x03, 5, 7 }, { 0x05, 6, 8 }, { 0x04, 6, 9 }, { 0x04, 7, 10 }, { 0x05, 7, 11 },
+	{ 0x07, 7, 12 }, { 0x04, 8, 13 }, { 0x07, 8, 14 }, { 0x18, 9, 15 }, { 0x17, 10, 16 }, { 0x18, 10, 17 },
+	{ 0x08, 10, 18 }, { 0x67, 11, 19 }, { 0x68, 11, 20 }, { 0x6c, 11, 21 }, { 0x37, 11, 22 }, { 0x28, 11, 23 },
+	{ 0x17, 11, 24 }, { 0x18, 11, 25 }, { 0xca, 12, 26 }, { 0xcb, 12, 27 }, { 0xcc, 12, 28 }, { 0xcd, 12, 29 },
+	{ 0x68, 12, 30 }, { 0x69, 12, 31 }, { 0x6a, 12, 32 }, { 0x6b, 12, 33 }, { 0xd2, 12, 34 }, { 0xd3, 12, 35 },
+	{ 0xd4, 12, 36 }, { 0xd5, 12, 37 }, { 0xd6, 12, 38 }, { 0xd7, 12, 39 }, { 0x6c, 12, 40 }, { 0x6d, 12, 41 },
+	{ 0xda, 12, 42 }, { 0xdb, 12, 43 }, { 0x54, 12, 44 }, { 0x55, 12, 45 }, { 0x56, 12, 46 }, { 0x57, 12, 47 },
+	{ 0x64, 12, 48 }, { 0x65, 12, 49 }, { 0x52, 12, 50 }, { 0x53, 12, 51 }, { 0x24, 12, 52 }, { 0x37, 12, 53 },
+	{ 0x38, 12, 54 }, { 0x27, 12, 55 }, { 0x28, 12, 56 }, { 0x58, 12, 57 }, { 0x59, 12, 58 }, { 0x2b, 12, 59 },
+	{ 0x2c, 12, 60 }, { 0x5a, 12, 61 }, { 0x66, 12, 62 }, { 0x67, 12, 63 },
+
+	{ 0x0f, 10, 64 }, { 0xc8, 12, 128 }, { 0xc9, 12, 192 }, { 0x5b, 12, 256 }, { 0x33, 12, 320 },
+	{ 0x34, 12, 384 }, { 0x35, 12, 448 }, { 0x6c, 13, 512 }, { 0x6d, 13, 576 }, { 0x4a, 13, 640 },
+	{ 0x4b, 13, 704 }, { 0x4c, 13, 768 }, { 0x4d, 13, 832 }, { 0x72, 13, 896 }, { 0x73, 13, 960 },
+	{ 0x74, 13, 1024 }, { 0x75, 13, 1088 }, { 0x76, 13, 1152 }, { 0x77, 13, 1216 }, { 0x52, 13, 1280 },
+	{ 0x53, 13, 1344 }, { 0x54, 13, 1408 }, { 0x55, 13, 1472 }, { 0x5a, 13, 1536 }, { 0x5b, 13, 1600 },
+	{ 0x64, 13, 1664 }, { 0x65, 13, 1728 },
+};
+
+// make up codes shared by both colors
+local const CCITTCode extended_codes[] = {
+	{ 0x08, 11, 1792 }, { 0x0c, 11, 1856 }, { 0x0d, 11, 1920 }, { 0x12, 12, 1984 }, { 0x13, 12, 2048 },
+	{ 0x14, 12, 2112 }, { 0x15, 12, 2176 }, { 0x16, 12, 2240 }, { 0x17, 12, 2304 }, { 0x1c, 12, 2368 },
+	{ 0x1d, 12, 2432 }, { 0x1e, 12, 2496 }, { 0x1f, 12, 2560 },
+};
+
+#define CCITT_EOL 0x001     // 12 bits
+#define CCITT_EOL_LEN 12
+#define CCITT_EOFB 0x001001 // two EOLs, end of a Group 4 block
+
+// run table entries are (run << 4 | code length), 0 for invalid codes
+#define RUN_ENTRY(run, len) ((u16)((run) << 4 | (len)))
+#define RUN_EOL 0xfff
+
+// white codes longer than 9 bits start with 7 zeros and black codes longer than 7 bits with 4 zeros.
+// the first level is indexed by the leading bits, codes with the zero prefix by the remaining ones
+#define WHITE_BITS 12
+#define WHITE_L1_BITS 9
+#define WHITE_ZEROS 7
+#define BLACK_BITS 13
+#define BLACK_L1_BITS 7
+#define BLACK_ZEROS 4
+
+enum CCITTMode {
+	MODE_INVALID,
+	MODE_PASS,
+	MODE_HORIZONTAL,
+	MODE_VERTICAL_L3,
+	MODE_VERTICAL_L2,
+	MODE_VERTICAL_L1,
+	MODE_VERTICAL_0,
+	MODE_VERTICAL_R1,
+	MODE_VERTICAL_R2,
+	MODE_VERTICAL_R3,
+	MODE_EXTENSION,
+};
+
+#define MODE_BITS 7
+
+local const struct { u8 code; u8 len; u8 mode; } mode_codes[] = {
+	{ 0x01, 4, MODE_PASS }, { 0x01, 3, MODE_HORIZONTAL }, { 0x01, 1, MODE_VERTICAL_0 },
+	{ 0x03, 3, MODE_VERTICAL_R1 }, { 0x03, 6, MODE_VERTICAL_R2 }, { 0x03, 7, MODE_VERTICAL_R3 },
+	{ 0x02, 3, MODE_VERTICAL_L1 }, { 0x02, 6, MODE_VERTICAL_L2 }, { 0x02, 7, MODE_VERTICAL_L3 },
+	{ 0x01, 7, MODE_EXTENSION },
+};
+
+typedef struct CCITTTables {
+	u16 white[1 << WHITE_L1_BITS];
+	u16 white_zeros[1 << (WHITE_BITS - WHITE_ZEROS)];
+	u16 black[1 << BLACK_L1_BITS];
+	u16 black_zeros[1 << (BLACK_BITS - BLACK_ZEROS)];
+	u8 modes[1 << MODE_BITS]; // (mode << 4 | code length)
+	u64 expand[256];          // 8 bytes of 0 or 255 for every packed byte
+	bool built;
+} CCITTTables;
+
+local thread_local CCITTTables tables;
+
+local void fill_entries(u16 *table, u32 index, u32 count, u16 entry) {
+	for (u32 i = 0; i < count; i++) {
+		ASSERT(table[index + i] == 0);
+		table[index + i] = entry;
+	}
+}
+
+local void add_run_code(u16 *l1, u32 l1_bits, u16 *zeros, u32 max_bits, u32 n_zeros, CCITTCode c) {
+	u16 entry = RUN_ENTRY(c.run, c.len);
+	if (c.len > n_zeros && (c.code >> (c.len - n_zeros)) == 0) {
+		fill_entries(zeros, (u32)c.code << (max_bits - c.len), 1u << (max_bits - c.len), entry);
+	}
+	else {
+		ASSERT(c.len <= l1_bits);
+		fill_entries(l1, (u32)c.code << (l1_bits - c.len), 1u << (l1_bits - c.len), entry);
+	}
+}
+
+local const CCITTTables *get_tables(void) {
+	CCITTTables *t = &tables;
+	if (t->built) return t;
+
+	for (u32 i = 0; i < COUNT_OF(white_codes); i++) {
+		add_run_code(t->white, WHITE_L1_BITS, t->white_zeros, WHITE_BITS, WHITE_ZEROS, white_codes[i]);
+	}
+	for (u32 i = 0; i < COUNT_OF(black_codes); i++) {
+		add_run_code(t->black, BLACK_L1_BITS, t->black_zeros, BLACK_BITS, BLACK_ZEROS, black_codes[i]);
+	}
+	for (u32 i = 0; i < COUNT_OF(extended_codes); i++) {
+		add_run_code(t->white, WHITE_L1_BITS, t->white_zeros, WHITE_BITS, WHITE_ZEROS, extended_codes[i]);
+		add_run_code(t->black, BLACK_L1_BITS, t->black_zeros, BLACK_BITS, BLACK_ZEROS, extended_codes[i]);
+	}
+	add_run_code(t->white, WHITE_L1_BITS, t->white_zeros, WHITE_BITS, WHITE_ZEROS,
+		(CCITTCode){ CCITT_EOL, CCITT_EOL_LEN, RUN_EOL });
+
+	for (u32 i = 0; i < COUNT_OF(mode_codes); i++) {
+		u32 shift = MODE_BITS - mode_codes[i].len;
+		for (u32 j = 0; j < (1u << shift); j++) {
+			t->modes[(mode_codes[i].code << shift) + j] = (u8)(mode_codes[i].mode << 4 | mode_codes[i].len);
+		}
+	}
+
+	for (u32 b = 0; b < 256; b++) {
+		u8 bytes[8];
+		for (u32 i = 0; i < 8; i++) bytes[i] = (b >> (7 - i)) & 1 ? 0xff : 0;
+		memcpy(&t->expand[b], bytes, 8);
+	}
+
+	t->built = true;
+	return t;
+}
+
+
+/// BIT READER ///
+
+// bits are kept left aligned in a 64 bit word, the data is followed by zero bits
+typedef struct BitReader {
+	const u8 *data;
+	u64 len;
+	u64 pos;    // next byte to load
+	u64 bits;
+	u32 n_bits;
+} BitReader;
+
+local inline u64 load_be64(const u8 *p) {
+	u64 v = 0;
+	for (u32 i = 0; i < 8; i++) v = v << 8 | p[i];
+	return v;
+}
+
+// guarantees at least 32 bits in the word, enough for any code and the EOFB
+local inline void refill(BitReader *r) {
+	if (r->n_bits >= 32) return;
+
+	if (r->pos + 8 <= r->len) {
+		// the bytes past n_bits are loaded again by the next refill, or-ing in the same bits
+		r->bits |= load_be64(r->data + r->pos) >> r->n_bits;
+		u32 n_bytes = (63 - r->n_bits) >> 3;
+		r->pos += n_bytes;
+		r->n_bits += n_bytes * 8;
+		return;
+	}
+
+	while (r->n_bits < 56) {
+		u64 byte = r->pos < r->len ? r->data[r->pos] : 0;
+		r->bits |= byte << (56 - r->n_bits);
+		r->pos += 1;
+		r->n_bits += 8;
+	}
+}
+
+local inline u32 peek_bits(const BitReader *r, u32 n) {
+	return (u32)(r->bits >> (64 - n));
+}
+
+local inline void skip_bits(BitReader *r, u32 n) {
+	r->bits <<= n;
+	r->n_bits -= n;
+}
+
+local inline u64 bits_left(const BitReader *r) {
+	u64 consumed = r->pos * 8 - r->n_bits;
+	return consumed < r->len * 8 ? r->len * 8 - consumed : 0;
+}
+
+local void align_to_byte(BitReader *r) {
+	skip_bits(r, r->n_bits % 8);
+}
+
+// skips fill bits and an EOL, returns false (and reads nothing) if there is none
+local bool skip_eol(BitReader *r) {
+	refill(r);
+	u32 next = peek_bits(r, CCITT_EOL_LEN);
+	if (next == CCITT_EOL) {
+		skip_bits(r, CCITT_EOL_LEN);
+		return true;
+	}
+	if (next != 0) return false;
+
+	// no code starts with 12 zeros, so these are fill bits in front of an EOL
+	while (bits_left(r) > 0) {
+		refill(r);
+		u32 bit = peek_bits(r, 1);
+		skip_bits(r, 1);
+		if (bit) return true;
+	}
+	return false;
+}
+
+
+/// DECODING ///
+
+typedef struct CCITTDecoder {
+	CCITTParams params;
+	const CCITTTables *tables;
+	BitReader reader;
+	// changing elements of the current and the reference row, followed by columns as sentinels
+	i32 *change_buffer; // pooled, holds both rows
+	i32 *changes;
+	i32 *ref;
+	u32 n_changes;
+	u32 n_ref; // changes of the reference row, the sentinels included
+	u32 max_changes;
+	bool eol_rows; // the first row starts with an EOL
+} CCITTDecoder;
+
+enum { WHITE, BLACK };
+
+// reads the make up codes and the terminating code of a run, -1 for invalid codes
+local i32 read_run(CCITTDecoder *d, u32 color) {
+	const CCITTTables *t = d->tables;
+	BitReader *r = &d->reader;
+	i32 total = 0;
+
+	for (;;) {
+		refill(r);
+
+		u16 entry = 0;
+		if (color == WHITE) {
+			u32 v = peek_bits(r, WHITE_BITS);
+			entry = v < (1u << (WHITE_BITS - WHITE_ZEROS)) ? t->white_zeros[v] : t->white[v >> (WHITE_BITS - WHITE_L1_BITS)];
+		}
+		else {
+			u32 v = peek_bits(r, BLACK_BITS);
+			entry = v < (1u << (BLACK_BITS - BLACK_ZEROS)) ? t->black_zeros[v] : t->black[v >> (BLACK_BITS - BLACK_L1_BITS)];
+		}
+
+		u32 run = entry >> 4;
+		if (entry == 0 || run == RUN_EOL) return -1;
+		skip_bits(r, entry & 0xf);
+
+		total += (i32)run;
+		if (run < 64) return total;
+		if (total > (i32)d->params.columns) return -1;
+	}
+}
+
+local inline bool push_change(CCITTDecoder *d, i32 pos) {
+	if (d->n_changes >= d->max_changes) return false;
+	d->changes[d->n_changes++] = pos;
+	return true;
+}
+
+// Modified Huffman row, alternating white and black runs
+local bool decode_row_1d(CCITTDecoder *d) {
+	i32 columns = (i32)d->params.columns;
+	i32 a0 = 0;
+	u32 color = WHITE;
+
+	while (a0 < columns) {
+		i32 run = read_run(d, color);
+		if (run < 0 || a0 + run > columns) return false;
+
+		a0 += run;
+		if (!push_change(d, a0)) return false;
+		color ^= 1;
+	}
+	return true;
+}
+
+// READ row coded relative to the reference row. b1 is the first change on the reference row right of a0
+// that goes to the opposite of the current color, changes at even indices go to black
+local bool decode_row_2d(CCITTDecoder *d) {
+	const CCITTTables *t = d->tables;
+	BitReader *r = &d->reader;
+	const i32 *ref = d->ref;
+	i32 columns = (i32)d->params.columns;
+
+	i32 a0 = -1;
+	u32 color = WHITE;
+	u32 bi = 0;
+
+	while (a0 < columns) {
+		// the sentinels stop this on valid rows, corrupt ones fail instead of reading past them
+		while (bi < d->n_ref && (ref[bi] <= a0 || (bi & 1) != color)) bi++;
+		if (bi >= d->n_ref) return false;
+		i32 b1 = ref[bi];
+
+		refill(r);
+		u8 entry = t->modes[peek_bits(r, MODE_BITS)];
+		u32 mode = entry >> 4;
+		skip_bits(r, entry & 0xf);
+
+		switch (mode) {
+		case MODE_PASS: {
+			if (bi + 1 >= d->n_ref) return false;
+			a0 = ref[bi + 1];
+			bi += 2;
+			break;
+		}
+
+		case MODE_HORIZONTAL: {
+			i32 start = MAX(a0, 0);
+			i32 run1 = read_run(d, color);
+			if (run1 < 0) return false;
+			i32 run2 = read_run(d, color ^ 1);
+			if (run2 < 0 || start + run1 + run2 > columns) return false;
+
+			if (!push_change(d, start + run1) || !push_change(d, start + run1 + run2)) return false;
+			a0 = start + run1 + run2;
+			break;
+		}
+
+		case MODE_VERTICAL_L3:
+		case MODE_VERTICAL_L2:
+		case MODE_VERTICAL_L1:
+		case MODE_VERTICAL_0:
+		case MODE_VERTICAL_R1:
+		case MODE_VERTICAL_R2:
+		case MODE_VERTICAL_R3: {
+			i32 a1 = b1 + (i32)mode - MODE_VERTICAL_0;
+			if (a1 < MAX(a0, 0) || a1 > columns) return false;
+
+			if (!push_change(d, a1)) return false;
+			a0 = a1;
+			color ^= 1;
+			// b1 of the next code can be the change right before this one
+			if (bi > 0) bi--;
+			break;
+		}
+
+		default: return false; // uncompressed mode extensions and invalid codes
+		}
+	}
+	return true;
+}
+
+local inline void fill_bits(u8 *row, u32 start, u32 end, bool set) {
+	if (start >= end) return;
+
+	u32 first = start >> 3;
+	u32 last = (end - 1) >> 3;
+	u8 head = (u8)(0xff >> (start & 7));
+	u8 tail = (u8)(0xff << (7 - ((end - 1) & 7)));
+
+	if (first == last) {
+		u8 mask = head & tail;
+		row[first] = set ? row[first] | mask : row[first] & ~mask;
+		return;
+	}
+
+	row[first] = set ? row[first] | head : row[first] & ~head;
+	if (last > first + 1) memset(row + first + 1, set ? 0xff : 0, last - first - 1);
+	row[last] = set ? row[last] | tail : row[last] & ~tail;
+}
+
+// packs the black runs between the changing elements into the row
+local void write_row(const CCITTDecoder *d, u8 *row) {
+	bool black_is_1 = d->params.black_is_1;
+	memset(row, black_is_1 ? 0 : 0xff, ccitt_row_stride(d->params));
+
+	for (u32 i = 0; i + 1 < d->n_changes; i += 2) {
+		fill_bits(row, (u32)d->changes[i], (u32)d->changes[i + 1], black_is_1);
+	}
+	if (d->n_changes % 2 == 1) {
+		fill_bits(row, (u32)d->changes[d->n_changes - 1], d->params.columns, black_is_1);
+	}
+}
+
+// skips an EOL that starts exactly at the current bit
+local bool skip_exact_eol(BitReader *r) {
+	refill(r);
+	if (peek_bits(r, CCITT_EOL_LEN) != CCITT_EOL) return false;
+	skip_bits(r, CCITT_EOL_LEN);
+	return true;
+}
+
+// checks for the end of the data in front of a row and skips a leading EOL,
+// returns false if there are no more rows
+local bool start_row(CCITTDecoder *d, bool first_row) {
+	BitReader *r = &d->reader;
+	if (bits_left(r) == 0) return false;
+
+	if (d->params.k < 0) {
+		if (d->params.encoded_byte_align) align_to_byte(r);
+		// no row starts with an EOL, so EOFB ends the data even without /EndOfBlock
+		refill(r);
+		return bits_left(r) > 0 && peek_bits(r, 24) != CCITT_EOFB;
+	}
+
+	// with EOLs the fill bits for /EncodedByteAlign come before the EOL, so it ends on a byte boundary.
+	// without them the zero padding can look like fill bits and only an EOL right at the boundary is one
+	bool has_eol = false;
+	if (first_row || d->eol_rows) {
+		has_eol = skip_eol(r);
+		if (first_row) d->eol_rows = has_eol;
+	}
+	else {
+		if (d->params.encoded_byte_align) align_to_byte(r);
+		has_eol = skip_exact_eol(r);
+	}
+
+	if (has_eol) {
+		// return to control, a second EOL (after the tag bit in mixed coding)
+		refill(r);
+		if (peek_bits(r, CCITT_EOL_LEN) == CCITT_EOL) return false;
+		if (d->params.k > 0 && peek_bits(r, CCITT_EOL_LEN + 1) == (1u << CCITT_EOL_LEN | CCITT_EOL)) return false;
+	}
+	return bits_left(r) > 0;
+}
+
+Buffer ccitt_decode(const u8 *data, u64 len, CCITTParams params) {
+	u32 stride = ccitt_row_stride(params);
+	u32 max_changes = 2 * params.columns + 8;
+
+	CCITTDecoder d = {
+		.params = params,
+		.tables = get_tables(),
+		.reader = { .data = data, .len = len },
+		.change_buffer = (i32 *)buffer_pool_acquire(2ull * max_changes * sizeof(i32)),
+		// room for the sentinels after the last change
+		.max_changes = max_changes - 4,
+	};
+	d.changes = d.change_buffer;
+	d.ref = d.change_buffer + max_changes;
+
+	// the row above the first one is white
+	for (u32 i = 0; i < 4; i++) d.ref[i] = (i32)params.columns;
+	d.n_ref = 4;
+
+	// /Rows comes from the file, the output starts bounded and grows with the decoded rows
+	u64 capacity = (u64)stride * (params.rows ? params.rows : CCITT_INITIAL_ROWS);
+	u8 *out = buffer_pool_acquire(MAX(MIN(capacity, CCITT_MAX_INITIAL_SIZE), stride));
+	u32 n_rows = 0;
+
+	while (params.rows == 0 || n_rows < params.rows) {
+		if (!start_row(&d, n_rows == 0)) break;
+
+		bool one_d = params.k == 0;
+		if (params.k > 0) {
+			// the tag bit after the EOL selects the coding of the row
+			refill(&d.reader);
+			one_d = peek_bits(&d.reader, 1) == 1;
+			skip_bits(&d.reader, 1);
+		}
+
+		d.n_changes = 0;
+		if (!(one_d ? decode_row_1d(&d) : decode_row_2d(&d))) break;
+
+		if ((u64)(n_rows + 1) * stride > mem_size(out)) {
+			out = buffer_pool_grow(out, (u64)n_rows * stride, 2 * mem_size(out));
+		}
+		write_row(&d, out + (u64)n_rows * stride);
+		n_rows += 1;
+
+		for (u32 i = 0; i < 4; i++) d.changes[d.n_changes + i] = (i32)params.columns;
+		d.n_ref = d.n_changes + 4;
+		i32 *tmp = d.ref;
+		d.ref = d.changes;
+		d.changes = tmp;
+	}
+
+	// with a known row count the rows after a corrupt one are white. every row takes at least one bit
+	// (a V0 code), a /Rows beyond that does not describe this data and only the decoded rows are kept
+	if (params.rows != 0 && n_rows < params.rows && params.rows <= len * 8) {
+		if ((u64)params.rows * stride > mem_size(out)) {
+			out = buffer_pool_grow(out, (u64)n_rows * stride, (u64)params.rows * stride);
+		}
+		memset(out + (u64)n_rows * stride, params.black_is_1 ? 0 : 0xff, (u64)(params.rows - n_rows) * stride);
+		n_rows = params.rows;
+	}
+
+	buffer_pool_release((u8 *)d.change_buffer);
+	return (Buffer){ .data = out, .size = (u64)n_rows * stride };
+}
+
+void ccitt_expand_to_8bit(const u8 *packed, u32 columns, u32 rows, u8 *out) {
+	const CCITTTables *t = get_tables();
+	u32 stride = (columns + 7) / 8;
+	u32 full = columns / 8;
+
+	for (u32 y = 0; y < rows; y++) {
+		const u8 *in = packed + (u64)y * stride;
+		u8 *dst = out + (u64)y * columns;
+
+		for (u32 i = 0; i < full; i++) {
+			memcpy(dst + 8 * i, &t->expand[in[i]], 8);
+		}
+		if (columns % 8 != 0) memcpy(dst + 8 * full, &t->expand[in[full]], columns % 8);
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "decompress.h"
+
+// CCITTFaxDecode: Group 3 (1D and mixed 1D/2D) and Group 4 fax data.
+// rows are decoded as lists of changing elements (the positions where the color changes), runs are
+// looked up in two level tables, so a code costs one or two table reads. every decoded row is written
+// packed with 1 bit per pixel, 0 is black unless /BlackIs1 is set
+
+typedef struct CCITTParams {
+    i32 k; // -1 Group 4, 0 Group 3 1D, 1 Group 3 mixed 1D/2D
+    u32 columns;
+    u32 rows;           // 0 if unknown, rows are decoded until the end of the data
+    bool black_is_1;
+    bool encoded_byte_align;
+} CCITTParams;
+
+// reads /K, /Columns, /Rows, /BlackIs1 and /EncodedByteAlign, missing entries get
+// their default value. parms can be NULL
+CCITTParams ccitt_params_from_dict(const Dictionary *parms);
+
+// bytes of a packed row
+u32 ccitt_row_stride(CCITTParams params);
+
+// decodes the fax data into packed rows from the buffer pool. decoding stops at the end of the data or
+// at the first corrupt row, the rows before it are kept (and with /Rows the rest of the page is white)
+Buffer ccitt_decode(const u8 *data, u64 len, CCITTParams params);
+
+// expands packed 1 bit rows into one byte per pixel (0 or 255), out has rows * columns bytes
+void ccitt_expand_to_8bit(const u8 *packed, u32 columns, u32 rows, u8 *out);
@@ -0,0 +1,894 @@
+#include "color.h"
+#include "simd.h"
+#include "threads.h"
+
+#include <string.h>
+#include <math.h>
+
+// pixels converted per step of a row, samples that need remapping first are staged on the stack
+#define COLOR_CHUNK_PIXELS 256
+// output rows converted by one parallel_for index
+#define COLOR_BAND_ROWS 64
+
+typedef struct ConvertJob {
+	const ColorConverter *cc;
+	const u8 *samples;
+	u64 in_stride;
+	ImageRegion region; // of the samples
+	RawImage *image;
+} ConvertJob;
+
+// naive conversion, every ink darkens the color it absorbs together with black
+local inline void cmyk_to_rgb(u8 *rgb, u8 c, u8 m, u8 y, u8 k) {
+	u32 white = 255u - k;
+	rgb[0] = div255((255u - c) * white);
+	rgb[1] = div255((255u - m) * white);
+	rgb[2] = div255((255u - y) * white);
+}
+
+local inline u32 pack_rgba(u8 r, u8 g, u8 b) {
+	u8 rgba[4] = { r, g, b, 255 };
+	u32 pixel;
+	memcpy(&pixel, rgba, 4);
+	return pixel;
+}
+
+/// 16 BIT SAMPLES ///
+
+// big endian 16 bit samples to 8 bit ones, rounded: (v - (v >> 8) + 128) >> 8 = hi + ((lo + 128 - hi) >> 8)
+
+local void narrow16_scalar(u8 *out, const u8 *in, u32 count, u32 start) {
+	for (u32 i = start; i < count; i++) {
+		i32 hi = in[2 * i];
+		i32 lo = in[2 * i + 1];
+		out[i] = (u8)(hi + ((lo + 128 - hi) >> 8));
+	}
+}
+
+#if PTRAIL_SSE2
+
+local u32 narrow16_simd(u8 *out, const u8 *in, u32 count) {
+	__m128i low_bytes = _mm_set1_epi16(0x00ff);
+	__m128i half = _mm_set1_epi16(128);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+		__m128i hi = _mm_and_si128(v, low_bytes);
+		__m128i lo = _mm_srli_epi16(v, 8);
+		__m128i carry = _mm_srai_epi16(_mm_sub_epi16(_mm_add_epi16(lo, half), hi), 8);
+		__m128i r = _mm_add_epi16(hi, carry);
+		_mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(r, r));
+	}
+	return i;
+}
+
+#elif PTRAIL_NEON
+
+local u32 narrow16_simd(u8 *out, const u8 *in, u32 count) {
+	int16x8_t half = vdupq_n_s16(128);
+	u32 i = 0;
+	for (; i + 16 <= count; i += 16) {
+		uint8x16x2_t v = vld2q_u8(in + 2 * i); // high bytes, low bytes
+		int16x8_t hi0 = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(v.val[0])));
+		int16x8_t hi1 = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(v.val[0])));
+		int16x8_t d0 = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(v.val[1]), vget_low_u8(v.val[0])));
+		int16x8_t d1 = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(v.val[1]), vget_high_u8(v.val[0])));
+		int16x8_t r0 = vaddq_s16(hi0, vshrq_n_s16(vaddq_s16(d0, half), 8));
+		int16x8_t r1 = vaddq_s16(hi1, vshrq_n_s16(vaddq_s16(d1, half), 8));
+		vst1q_u8(out + i, vcombine_u8(vqmovun_s16(r0), vqmovun_s16(r1)));
+	}
+	return i;
+}
+
+#endif
+
+void narrow_samples16(u8 *out, const u8 *in, u32 count) {
+	u32 i = 0;
+#if PTRAIL_SIMD
+	i = narrow16_simd(out, in, count);
+#endif
+	narrow16_scalar(out, in, count, i);
+}
+
+/// PACKED SAMPLES ///
+
+// samples of 1, 2 and 4 bits are packed from the most significant bit of a byte. scaling multiplies
+// them by 255 / (2^bits - 1), which is a bit replication
+
+local inline u8 packed_sample(const u8 *row, u64 index, u32 bits) {
+	u64 bit = index * bits;
+	return (u8)((row[bit >> 3] >> (8 - bits - (bit & 7))) & ((1u << bits) - 1));
+}
+
+local inline u8 scale_sample(u8 value, u32 bits) {
+	switch (bits) {
+	case 1: return (u8)(0 - value);
+	case 2: return (u8)(value * 0x55);
+	case 4: return (u8)(value * 0x11);
+	default: return value;
+	}
+}
+
+local void unpack_scalar(u8 *out, const u8 *row, u64 first, u32 count, u32 bits, bool scale, u32 start) {
+	for (u32 i = start; i < count; i++) {
+		u8 value = packed_sample(row, first + i, bits);
+		out[i] = scale ? scale_sample(value, bits) : value;
+	}
+}
+
+#if PTRAIL_SSE2
+
+// 2 bytes of 1 bit samples are spread over 16 lanes, every lane tests its own bit
+local u32 unpack1_simd(u8 *out, const u8 *in, u32 count, bool scale) {
+	__m128i bits = _mm_setr_epi8(
+		(char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+		(char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	__m128i value = _mm_set1_epi8(scale ? (char)0xff : 1);
+	u32 i = 0;
+	for (; i + 16 <= count; i += 16) {
+		u16 pair;
+		memcpy(&pair, in + i / 8, 2);
+		__m128i v = _mm_cvtsi32_si128(pair);
+		v = _mm_unpacklo_epi8(v, v);
+		v = _mm_unpacklo_epi16(v, v);
+		v = _mm_unpacklo_epi32(v, v);
+		__m128i set = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+		_mm_storeu_si128((__m128i *)(out + i), _mm_and_si128(set, value));
+	}
+	return i;
+}
+
+// the high and low nibbles of 8 bytes are interleaved into 16 lanes
+local u32 unpack4_simd(u8 *out, const u8 *in, u32 count, bool scale) {
+	__m128i low_nibbles = _mm_set1_epi8(0x0f);
+	u32 i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i v = _mm_loadl_epi64((const __m128i *)(in + i / 2));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_nibbles);
+		__m128i lo = _mm_and_si128(v, low_nibbles);
+		__m128i samples = _mm_unpacklo_epi8(hi, lo);
+		if (scale) samples = _mm_or_si128(samples, _mm_slli_epi16(samples, 4));
+		_mm_storeu_si128((__m128i *)(out + i), samples);
+	}
+	return i;
+}
+
+#elif PTRAIL_NEON
+
+local u32 unpack1_simd(u8 *out, const u8 *in, u32 count, bool scale) {
+	static const u8 bit_values[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+	uint8x16_t bits = vcombine_u8(vld1_u8(bit_values), vld1_u8(bit_values));
+	uint8x16_t value = vdupq_n_u8(scale ? 0xff : 1);
+	u32 i = 0;
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t v = vcombine_u8(vdup_n_u8(in[i / 8]), vdup_n_u8(in[i / 8 + 1]));
+		vst1q_u8(out + i, vandq_u8(vtstq_u8(v, bits), value));
+	}
+	return i;
+}
+
+local u32 unpack4_simd(u8 *out, const u8 *in, u32 count, bool scale) {
+	u32 i = 0;
+	for (; i + 16 <= count; i += 16) {
+		uint8x8_t v = vld1_u8(in + i / 2);
+		uint8x8x2_t samples = vzip_u8(vshr_n_u8(v, 4), vand_u8(v, vdup_n_u8(0x0f)));
+		uint8x16_t r = vcombine_u8(samples.val[0], samples.val[1]);
+		if (scale) r = vorrq_u8(r, vshlq_n_u8(r, 4));
+		vst1q_u8(out + i, r);
+	}
+	return i;
+}
+
+#endif
+
+void unpack_samples(u8 *out, const u8 *row, u64 first, u32 count, u32 bits, bool scale) {
+	ASSERT_MSG(bits == 1 || bits == 2 || bits == 4, "can't unpack %u bit samples", bits);
+
+	// up to the first sample at a byte boundary
+	u32 samples_per_byte = 8 / bits;
+	u32 head = MIN((u32)((samples_per_byte - first % samples_per_byte) % samples_per_byte), count);
+	unpack_scalar(out, row, first, head, bits, scale, 0);
+
+	u32 i = head;
+#if PTRAIL_SIMD
+	const u8 *aligned = row + (first + head) / samples_per_byte;
+	if (bits == 1) i += unpack1_simd(out + head, aligned, count - head, scale);
+	else if (bits == 4) i += unpack4_simd(out + head, aligned, count - head, scale);
+#endif
+	unpack_scalar(out, row, first, count, bits, scale, i);
+}
+
+/// GRAY ///
+
+local void gray_scalar(u8 *out, const u8 *in, u32 count, u8 invert, u32 start) {
+	for (u32 x = start; x < count; x++) {
+		u8 g = in[x] ^ invert;
+		u32 pixel = pack_rgba(g, g, g);
+		memcpy(out + 4 * x, &pixel, 4);
+	}
+}
+
+#if PTRAIL_SSE2
+
+local u32 gray_simd(u8 *out, const u8 *in, u32 count, u8 invert) {
+	__m128i flip = _mm_set1_epi8((char)invert);
+	__m128i alpha = _mm_set1_epi8((char)0xff);
+	u32 x = 0;
+	for (; x + 16 <= count; x += 16) {
+		__m128i g = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + x)), flip);
+		__m128i gg_lo = _mm_unpacklo_epi8(g, g);
+		__m128i gg_hi = _mm_unpackhi_epi8(g, g);
+		__m128i ga_lo = _mm_unpacklo_epi8(g, alpha);
+		__m128i ga_hi = _mm_unpackhi_epi8(g, alpha);
+		_mm_storeu_si128((__m128i *)(out + 4 * x), _mm_unpacklo_epi16(gg_lo, ga_lo));
+		_mm_storeu_si128((__m128i *)(out + 4 * x + 16), _mm_unpackhi_epi16(gg_lo, ga_lo));
+		_mm_storeu_si128((__m128i *)(out + 4 * x + 32), _mm_unpacklo_epi16(gg_hi, ga_hi));
+		_mm_storeu_si128((__m128i *)(out + 4 * x + 48), _mm_unpackhi_epi16(gg_hi, ga_hi));
+	}
+	return x;
+}
+
+#elif PTRAIL_NEON
+
+local u32 gray_simd(u8 *out, const u8 *in, u32 count, u8 invert) {
+	uint8x16_t flip = vdupq_n_u8(invert);
+	u32 x = 0;
+	for (; x + 16 <= count; x += 16) {
+		uint8x16_t g = veorq_u8(vld1q_u8(in + x), flip);
+		uint8x16x4_t rgba = { { g, g, g, vdupq_n_u8(255) } };
+		vst4q_u8(out + 4 * x, rgba);
+	}
+	return x;
+}
+
+#endif
+
+local void gray_to_rgba(u8 *out, const u8 *in, u32 count, u8 invert) {
+	u32 x = 0;
+#if PTRAIL_SIMD
+	x = gray_simd(out, in, count, invert);
+#endif
+	gray_scalar(out, in, count, invert, x);
+}
+
+/// RGB ///
+
+local void rgb_scalar(u8 *out, const u8 *in, u32 count, const u8 *invert, u32 start) {
+	for (u32 x = start; x < count; x++) {
+		const u8 *p = in + 3 * x;
+		u32 pixel = pack_rgba(p[0] ^ invert[0], p[1] ^ invert[1], p[2] ^ invert[2]);
+		memcpy(out + 4 * x, &pixel, 4);
+	}
+}
+
+// SSE2 has no byte shuffle, the scalar loop is as fast as unpacking 3 byte pixels with shifts
+#define RGB_SIMD (PTRAIL_AVX2 || PTRAIL_NEON)
+
+#if PTRAIL_AVX2
+
+local u32 rgb_simd(u8 *out, const u8 *in, u32 count, const u8 *invert) {
+	__m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	__m128i flip = _mm_setr_epi8((char)invert[0], (char)invert[1], (char)invert[2], (char)0xff,
+		(char)invert[0], (char)invert[1], (char)invert[2], (char)0xff,
+		(char)invert[0], (char)invert[1], (char)invert[2], (char)0xff,
+		(char)invert[0], (char)invert[1], (char)invert[2], (char)0xff);
+	u32 x = 0;
+	// 16 bytes are loaded for the 12 of 4 pixels
+	for (; x + 6 <= count; x += 4) {
+		__m128i rgb = _mm_loadu_si128((const __m128i *)(in + 3 * x));
+		// the shuffle zeroes the alpha bytes, the flip sets them
+		_mm_storeu_si128((__m128i *)(out + 4 * x), _mm_xor_si128(_mm_shuffle_epi8(rgb, spread), flip));
+	}
+	return x;
+}
+
+#elif PTRAIL_NEON
+
+local u32 rgb_simd(u8 *out, const u8 *in, u32 count, const u8 *invert) {
+	u32 x = 0;
+	for (; x + 16 <= count; x += 16) {
+		uint8x16x3_t rgb = vld3q_u8(in + 3 * x);
+		uint8x16x4_t rgba = { {
+			veorq_u8(rgb.val[0], vdupq_n_u8(invert[0])),
+			veorq_u8(rgb.val[1], vdupq_n_u8(invert[1])),
+			veorq_u8(rgb.val[2], vdupq_n_u8(invert[2])),
+			vdupq_n_u8(255),
+		} };
+		vst4q_u8(out + 4 * x, rgba);
+	}
+	return x;
+}
+
+#endif
+
+local void rgb_to_rgba(u8 *out, const u8 *in, u32 count, const u8 *invert) {
+	u32 x = 0;
+#if RGB_SIMD
+	x = rgb_simd(out, in, count, invert);
+#endif
+	rgb_scalar(out, in, count, invert, x);
+}
+
+/// CMYK ///
+
+local void cmyk_scalar(u8 *out, const u8 *in, u32 count, const u8 *invert, u32 start) {
+	for (u32 x = start; x < count; x++) {
+		const u8 *p = in + 4 * x;
+		u8 rgb[3];
+		cmyk_to_rgb(rgb, p[0] ^ invert[0], p[1] ^ invert[1], p[2] ^ invert[2], p[3] ^ invert[3]);
+		u32 pixel = pack_rgba(rgb[0], rgb[1], rgb[2]);
+		memcpy(out + 4 * x, &pixel, 4);
+	}
+}
+
+// the complements of the inks are multiplied in 16 bit lanes, the black one is broadcast over its pixel.
+// the product of black with itself lands in the alpha lane and is overwritten
+
+#if PTRAIL_AVX2
+
+local inline __m256i div255_epi16_avx2(__m256i x) {
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+local inline __m256i cmyk_pixels_avx2(__m256i cmyk) {
+	__m256i k = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(cmyk, 0xff), 0xff);
+	return div255_epi16_avx2(_mm256_mullo_epi16(cmyk, k));
+}
+
+local u32 cmyk_simd(u8 *out, const u8 *in, u32 count, const u8 *invert) {
+	u32 flip_bytes;
+	u8 flip_components[4] = { invert[0] ^ 0xff, invert[1] ^ 0xff, invert[2] ^ 0xff, invert[3] ^ 0xff };
+	memcpy(&flip_bytes, flip_components, 4);
+	__m256i flip = _mm256_set1_epi32((i32)flip_bytes);
+	__m256i alpha = _mm256_set1_epi32((i32)0xff000000);
+	__m256i zero = _mm256_setzero_si256();
+
+	u32 x = 0;
+	for (; x + 8 <= count; x += 8) {
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(in + 4 * x)), flip);
+		__m256i lo = cmyk_pixels_avx2(_mm256_unpacklo_epi8(v, zero));
+		__m256i hi = cmyk_pixels_avx2(_mm256_unpackhi_epi8(v, zero));
+		// unpack and pack work within 128 bit lanes, so the pixels come back in order
+		_mm256_storeu_si256((__m256i *)(out + 4 * x), _mm256_or_si256(_mm256_packus_epi16(lo, hi), alpha));
+	}
+	return x;
+}
+
+#elif PTRAIL_SSE2
+
+local inline __m128i div255_epi16(__m128i x) {
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+local inline __m128i cmyk_pixels(__m128i cmyk) {
+	__m128i k = _mm_shufflehi_epi16(_mm_shufflelo_epi16(cmyk, 0xff), 0xff);
+	return div255_epi16(_mm_mullo_epi16(cmyk, k));
+}
+
+local u32 cmyk_simd(u8 *out, const u8 *in, u32 count, const u8 *invert) {
+	u32 flip_bytes;
+	u8 flip_components[4] = { invert[0] ^ 0xff, invert[1] ^ 0xff, invert[2] ^ 0xff, invert[3] ^ 0xff };
+	memcpy(&flip_bytes, flip_components, 4);
+	__m128i flip = _mm_set1_epi32((i32)flip_bytes);
+	__m128i alpha = _mm_set1_epi32((i32)0xff000000);
+	__m128i zero = _mm_setzero_si128();
+
+	u32 x = 0;
+	for (; x + 4 <= count; x += 4) {
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 4 * x)), flip);
+		__m128i lo = cmyk_pixels(_mm_unpacklo_epi8(v, zero));
+		__m128i hi = cmyk_pixels(_mm_unpackhi_epi8(v, zero));
+		_mm_storeu_si128((__m128i *)(out + 4 * x), _mm_or_si128(_mm_packus_epi16(lo, hi), alpha));
+	}
+	return x;
+}
+
+#elif PTRAIL_NEON
+
+// rounded x / 255 of 16 bit products
+local inline uint8x8_t div255_u16(uint16x8_t x) {
+	return vrshrn_n_u16(vrsraq_n_u16(x, x, 8), 8);
+}
+
+local inline uint8x16_t ink_times_white(uint8x16_t ink, uint8x16_t white) {
+	uint8x8_t lo = div255_u16(vmull_u8(vget_low_u8(ink), vget_low_u8(white)));
+	uint8x8_t hi = div255_u16(vmull_u8(vget_high_u8(ink), vget_high_u8(white)));
+	return vcombine_u8(lo, hi);
+}
+
+local u32 cmyk_simd(u8 *out, const u8 *in, u32 count, const u8 *invert) {
+	u32 x = 0;
+	for (; x + 16 <= count; x += 16) {
+		uint8x16x4_t cmyk = vld4q_u8(in + 4 * x);
+		// complements of the inks
+		uint8x16_t c = veorq_u8(cmyk.val[0], vdupq_n_u8(invert[0] ^ 0xff));
+		uint8x16_t m = veorq_u8(cmyk.val[1], vdupq_n_u8(invert[1] ^ 0xff));
+		uint8x16_t y = veorq_u8(cmyk.val[2], vdupq_n_u8(invert[2] ^ 0xff));
+		uint8x16_t white = veorq_u8(cmyk.val[3], vdupq_n_u8(invert[3] ^ 0xff));
+		uint8x16x4_t rgba = { {
+			ink_times_white(c, white),
+			ink_times_white(m, white),
+			ink_times_white(y, white),
+			vdupq_n_u8(255),
+		} };
+		vst4q_u8(out + 4 * x, rgba);
+	}
+	return x;
+}
+
+#endif
+
+local void cmyk_to_rgba(u8 *out, const u8 *in, u32 count, const u8 *invert) {
+	u32 x = 0;
+#if PTRAIL_SIMD
+	x = cmyk_simd(out, in, count, invert);
+#endif
+	cmyk_scalar(out, in, count, invert, x);
+}
+
+/// INDEXED ///
+
+local void palette_scalar(u8 *out, const u8 *in, const u32 *palette, u32 count, u32 start) {
+	for (u32 x = start; x < count; x++) {
+		memcpy(out + 4 * x, &palette[in[x]], 4);
+	}
+}
+
+// only AVX2 can gather, elsewhere the table lookups are as fast as it gets
+#if PTRAIL_AVX2
+
+local u32 palette_simd(u8 *out, const u8 *in, const u32 *palette, u32 count) {
+	u32 x = 0;
+	for (; x + 8 <= count; x += 8) {
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in + x)));
+		__m256i rgba = _mm256_i32gather_epi32((const int *)palette, index, 4);
+		_mm256_storeu_si256((__m256i *)(out + 4 * x), rgba);
+	}
+	return x;
+}
+
+#endif
+
+local void palette_to_rgba(u8 *out, const u8 *in, const u32 *palette, u32 count) {
+	u32 x = 0;
+#if PTRAIL_AVX2
+	x = palette_simd(out, in, palette, count);
+#endif
+	palette_scalar(out, in, palette, count, x);
+}
+
+/// TWO COLORS ///
+
+// 1 bit samples straight to RGBA, every bit picks one of two colors. used for bilevel images and stencil masks
+
+local void bits_scalar(u8 *out, const u8 *row, u64 first, u32 count, u32 color0, u32 color1, u32 start) {
+	for (u32 x = start; x < count; x++) {
+		u32 pixel = packed_sample(row, first + x, 1) ? color1 : color0;
+		memcpy(out + 4 * x, &pixel, 4);
+	}
+}
+
+#if PTRAIL_SSE2
+
+local u32 bits_simd(u8 *out, const u8 *in, u32 count, u32 color0, u32 color1) {
+	__m128i bits_hi = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+	__m128i bits_lo = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+	__m128i c1 = _mm_set1_epi32((i32)color1);
+	__m128i diff = _mm_set1_epi32((i32)(color0 ^ color1));
+	__m128i zero = _mm_setzero_si128();
+	u32 x = 0;
+	for (; x + 8 <= count; x += 8) {
+		__m128i v = _mm_set1_epi32(in[x / 8]);
+		// lanes whose bit is clear switch to color0
+		__m128i clear_hi = _mm_cmpeq_epi32(_mm_and_si128(v, bits_hi), zero);
+		__m128i clear_lo = _mm_cmpeq_epi32(_mm_and_si128(v, bits_lo), zero);
+		_mm_storeu_si128((__m128i *)(out + 4 * x), _mm_xor_si128(c1, _mm_and_si128(clear_hi, diff)));
+		_mm_storeu_si128((__m128i *)(out + 4 * x + 16), _mm_xor_si128(c1, _mm_and_si128(clear_lo, diff)));
+	}
+	return x;
+}
+
+#elif PTRAIL_NEON
+
+local u32 bits_simd(u8 *out, const u8 *in, u32 count, u32 color0, u32 color1) {
+	static const u32 bit_values[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+	uint32x4_t bits_hi = vld1q_u32(bit_values);
+	uint32x4_t bits_lo = vld1q_u32(bit_values + 4);
+	uint32x4_t c0 = vdupq_n_u32(color0);
+	uint32x4_t c1 = vdupq_n_u32(color1);
+	u32 x = 0;
+	for (; x + 8 <= count; x += 8) {
+		uint32x4_t v = vdupq_n_u32(in[x / 8]);
+		vst1q_u8(out + 4 * x, vreinterpretq_u8_u32(vbslq_u32(vtstq_u32(v, bits_hi), c1, c0)));
+		vst1q_u8(out + 4 * x + 16, vreinterpretq_u8_u32(vbslq_u32(vtstq_u32(v, bits_lo), c1, c0)));
+	}
+	return x;
+}
+
+#endif
+
+local void bits_to_rgba(u8 *out, const u8 *row, u64 first, u32 count, u32 color0, u32 color1) {
+	u32 head = MIN((u32)((8 - first % 8) % 8), count);
+	bits_scalar(out, row, first, head, color0, color1, 0);
+
+	u32 x = head;
+#if PTRAIL_SIMD
+	x += bits_simd(out + 4 * head, row + (first + head) / 8, count - head, color0, color1);
+#endif
+	bits_scalar(out, row, first, count, color0, color1, x);
+}
+
+/// CONVERTER ///
+
+u32 color_space_components(enum ColorSpace space) {
+	switch (space) {
+	case COLOR_SPACE_GRAY: return 1;
+	case COLOR_SPACE_RGB: return 3;
+	case COLOR_SPACE_CMYK: return 4;
+	case COLOR_SPACE_INDEXED: return 1;
+
+	default: PANIC("unknown ColorSpace: %u", space);
+	}
+}
+
+// sample value after the /Decode range [d_min, d_max], scaled to max
+local inline f32 decode_sample(u32 sample, u32 max_sample, f32 d_min, f32 d_max) {
+	return d_min + (f32)sample * (d_max - d_min) / (f32)max_sample;
+}
+
+local inline u8 clamp_u8(f32 value) {
+	return (u8)CLAMP(lrintf(value), 255, 0);
+}
+
+// RGBA of a color of the base space of an Indexed image
+local u32 base_color_rgba(enum ColorSpace base, const u8 *color) {
+	switch (base) {
+	case COLOR_SPACE_GRAY: return pack_rgba(color[0], color[0], color[0]);
+	case COLOR_SPACE_RGB: return pack_rgba(color[0], color[1], color[2]);
+	case COLOR_SPACE_CMYK: {
+		u8 rgb[3];
+		cmyk_to_rgb(rgb, color[0], color[1], color[2], color[3]);
+		return pack_rgba(rgb[0], rgb[1], rgb[2]);
+	}
+
+	default: PANIC("invalid Indexed base: %s", color_space_to_str(base));
+	}
+}
+
+// RGBA of every sample value of an image with a single component
+local void build_palette(ColorConverter *cc, const ImageColor *color) {
+	u32 max_sample = (1u << MIN(color->bits_per_component, 8)) - 1;
+	f32 d_min = color->has_decode ? color->decode[0] : 0.0f;
+	f32 d_max = color->has_decode ? color->decode[1] : 1.0f;
+
+	for (u32 sample = 0; sample <= max_sample; sample++) {
+		if (color->image_mask) {
+			// samples of 0 paint, a /Decode [1 0] paints with the samples of 1. the rest stays transparent
+			bool paint = (sample == 0) != (d_min == 1.0f);
+			cc->palette[sample] = paint ? pack_rgba(color->mask_color[0], color->mask_color[1], color->mask_color[2]) : 0;
+		}
+		else if (color->space == COLOR_SPACE_INDEXED) {
+			ASSERT_MSG(color->hival < COLOR_MAX_PALETTE, "Indexed hival out of range: %u", color->hival);
+			u32 index = sample;
+			if (color->has_decode) index = (u32)CLAMP(lrintf(decode_sample(sample, max_sample, d_min, d_max)), (long)color->hival, 0L);
+			index = MIN(index, color->hival);
+			cc->palette[sample] = base_color_rgba(color->base, color->lookup + (u64)index * color_space_components(color->base));
+		}
+		else {
+			u8 gray = clamp_u8(255.0f * decode_sample(sample, max_sample, d_min, d_max));
+			cc->palette[sample] = pack_rgba(gray, gray, gray);
+		}
+	}
+}
+
+void color_converter_init(ColorConverter *cc, const ImageColor *color) {
+	u32 bits = color->bits_per_component;
+	ASSERT_MSG(bits == 1 || bits == 2 || bits == 4 || bits == 8 || bits == 16, "unsupported /BitsPerComponent: %u", bits);
+
+	*cc = (ColorConverter){
+		.space = color->space,
+		.n_components = color->image_mask ? 1 : color_space_components(color->space),
+		.bits_per_component = bits,
+	};
+
+	// images with one component of up to 8 bits are converted with a table lookup per pixel
+	if (color->image_mask || color->space == COLOR_SPACE_INDEXED || (cc->n_components == 1 && bits < 8)) {
+		ASSERT_MSG(bits <= 8, "%s image with %u bits per component", color_space_to_str(color->space), bits);
+		ASSERT_MSG(!color->image_mask || bits == 1, "/ImageMask with %u bits per component", bits);
+		cc->use_palette = true;
+		build_palette(cc, color);
+		return;
+	}
+	if (!color->has_decode) return;
+
+	for (u32 c = 0; c < cc->n_components; c++) {
+		f32 d_min = color->decode[2 * c];
+		f32 d_max = color->decode[2 * c + 1];
+		if (d_min == 0.0f && d_max == 1.0f) continue;
+		if (d_min == 1.0f && d_max == 0.0f) cc->invert[c] = 0xff;
+		else cc->use_lut = true;
+	}
+
+	// the tables cover the inverted components too. samples of less than 8 bits are scaled up
+	// before the lookup, so the tables are indexed by 8 bit values in every case
+	if (cc->use_lut) {
+		memset(cc->invert, 0, sizeof(cc->invert));
+		for (u32 c = 0; c < cc->n_components; c++) {
+			for (u32 sample = 0; sample < 256; sample++) {
+				cc->lut[c][sample] = clamp_u8(255.0f * decode_sample(sample, 255, color->decode[2 * c], color->decode[2 * c + 1]));
+			}
+		}
+	}
+}
+
+local void apply_lut(const ColorConverter *cc, u8 *out, const u8 *in, u32 count) {
+	u32 n = cc->n_components;
+	for (u32 x = 0; x < count; x++) {
+		for (u32 c = 0; c < n; c++) {
+			out[x * n + c] = cc->lut[c][in[x * n + c]];
+		}
+	}
+}
+
+void color_convert_span(const ColorConverter *cc, u8 *out, const u8 *row, u32 first, u32 width) {
+	u8 staged[COLOR_CHUNK_PIXELS * COLOR_MAX_COMPONENTS];
+	u32 n = cc->n_components;
+	u32 bits = cc->bits_per_component;
+
+	for (u32 x = 0; x < width; x += COLOR_CHUNK_PIXELS) {
+		u32 count = MIN(width - x, COLOR_CHUNK_PIXELS);
+		u64 sample = (u64)(first + x) * n;
+		u8 *dst = out + (u64)x * 4;
+
+		if (bits == 1 && cc->use_palette) {
+			bits_to_rgba(dst, row, sample, count, cc->palette[0], cc->palette[1]);
+			continue;
+		}
+
+		const u8 *samples = row + sample * bits / 8;
+		if (bits < 8) {
+			unpack_samples(staged, row, sample, count * n, bits, !cc->use_palette);
+			samples = staged;
+		}
+		else if (bits == 16) {
+			narrow_samples16(staged, samples, count * n);
+			samples = staged;
+		}
+		if (cc->use_lut) {
+			apply_lut(cc, staged, samples, count);
+			samples = staged;
+		}
+
+		if (cc->use_palette) {
+			palette_to_rgba(dst, samples, cc->palette, count);
+			continue;
+		}
+		switch (cc->space) {
+		case COLOR_SPACE_GRAY: gray_to_rgba(dst, samples, count, cc->invert[0]); break;
+		case COLOR_SPACE_RGB: rgb_to_rgba(dst, samples, count, cc->invert); break;
+		case COLOR_SPACE_CMYK: cmyk_to_rgba(dst, samples, count, cc->invert); break;
+
+		default: PANIC("unhandled ColorSpace: %s", color_space_to_str(cc->space));
+		}
+	}
+}
+
+void color_convert_row(const ColorConverter *cc, u8 *out, const u8 *in, u32 width) {
+	color_convert_span(cc, out, in, 0, width);
+}
+
+u64 color_row_stride(const ColorConverter *cc, u32 width) {
+	return ((u64)width * cc->n_components * cc->bits_per_component + 7) / 8;
+}
+
+local void convert_band(void *user_data, u32 band) {
+	const ConvertJob *job = user_data;
+	RawImage *image = job->image;
+	u32 first_row = band * COLOR_BAND_ROWS;
+	u32 end_row = MIN(first_row + COLOR_BAND_ROWS, image->height);
+
+	for (u32 y = first_row; y < end_row; y++) {
+		const u8 *row = job->samples + job->in_stride * (job->region.y + y);
+		color_convert_span(job->cc, image->data + (u64)y * image->width * 4, row, job->region.x, image->width);
+	}
+}
+
+RawImage color_convert_region(const ColorConverter *cc, const u8 *samples, u32 width, u32 height, ImageRegion region, ImageTarget target) {
+	ImageRegion r;
+	r.x = MIN(region.x, width);
+	r.y = MIN(region.y, height);
+	r.width = MIN(region.width, width - r.x);
+	r.height = MIN(region.height, height - r.y);
+	// nothing of the region is inside the image
+	if (r.width == 0 || r.height == 0) return (RawImage){ 0 };
+
+	RawImage image = {
+		.width = r.width,
+		.height = r.height,
+		.n_channels = 4,
+		.format = PIXEL_FORMAT_RGBA,
+	};
+	image.data = image_target_alloc(target, &image);
+
+	ConvertJob job = {
+		.cc = cc,
+		.samples = samples,
+		.in_stride = color_row_stride(cc, width),
+		.region = r,
+		.image = &image,
+	};
+	parallel_for((r.height + COLOR_BAND_ROWS - 1) / COLOR_BAND_ROWS, convert_band, &job);
+	return image;
+}
+
+RawImage color_convert_image(const ColorConverter *cc, const u8 *samples, u32 width, u32 height, ImageTarget target) {
+	ImageRegion all = { .width = width, .height = height };
+	return color_convert_region(cc, samples, width, height, all, target);
+}
+
+/// DICTIONARY ///
+
+local bool device_space_from_name(Name name, enum ColorSpace *space) {
+	if (cmp_name_str(name, "DeviceGray") || cmp_name_str(name, "G") || cmp_name_str(name, "CalGray")) *space = COLOR_SPACE_GRAY;
+	else if (cmp_name_str(name, "DeviceRGB") || cmp_name_str(name, "RGB") || cmp_name_str(name, "CalRGB")) *space = COLOR_SPACE_RGB;
+	else if (cmp_name_str(name, "DeviceCMYK") || cmp_name_str(name, "CMYK")) *space = COLOR_SPACE_CMYK;
+	else return false;
+	return true;
+}
+
+local inline i32 hex_digit(u8 c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// <...> with whitespace between the digits, a missing last digit is 0
+local u32 read_hex_string(PDFSlice slice, u8 *out, u32 capacity) {
+	u32 len = 0;
+	i32 high = -1;
+	for (u64 i = 0; i < slice.len && len < capacity; i++) {
+		i32 digit = hex_digit(slice.ptr[i]);
+		if (digit < 0) continue;
+		if (high < 0) {
+			high = digit;
+		}
+		else {
+			out[len++] = (u8)(high << 4 | digit);
+			high = -1;
+		}
+	}
+	if (high >= 0 && len < capacity) out[len++] = (u8)(high << 4);
+	return len;
+}
+
+// the slice of a literal string starts at its opening parenthesis and ends before the closing one
+local u32 read_literal_string(PDFSlice slice, u8 *out, u32 capacity) {
+	u32 len = 0;
+	u64 i = slice.len > 0 && slice.ptr[0] == '(' ? 1 : 0;
+	while (i < slice.len && len < capacity) {
+		u8 c = slice.ptr[i++];
+		if (c != '\\' || i == slice.len) {
+			out[len++] = c;
+			continue;
+		}
+
+		c = slice.ptr[i++];
+		switch (c) {
+		case 'n': out[len++] = '\n'; break;
+		case 'r': out[len++] = '\r'; break;
+		case 't': out[len++] = '\t'; break;
+		case 'b': out[len++] = '\b'; break;
+		case 'f': out[len++] = '\f'; break;
+		case '\r': if (i < slice.len && slice.ptr[i] == '\n') i++; break; // line continuation
+		case '\n': break;
+		default:
+			if (c >= '0' && c <= '7') {
+				u32 value = c - '0';
+				for (u32 n = 1; n < 3 && i < slice.len && slice.ptr[i] >= '0' && slice.ptr[i] <= '7'; n++) {
+					value = value * 8 + (slice.ptr[i++] - '0');
+				}
+				out[len++] = (u8)value;
+			}
+			else {
+				out[len++] = c; // \( \) \\ and unknown escapes
+			}
+		}
+	}
+	return len;
+}
+
+// [/Indexed base hival lookup], every entry can be a reference and the lookup a stream
+local bool parse_indexed(const PDF *pdf, const ObjectArray *array, ImageColor *color) {
+	if (array->count != 4) return false;
+	const PDFObject *base = resolve_object(pdf, &array->data[1]);
+	const PDFObject *hival = resolve_object(pdf, &array->data[2]);
+	const PDFObject *lookup = resolve_object(pdf, &array->data[3]);
+	if (!base || !hival || !lookup) return false;
+
+	if (base->kind == OBJ_ARRAY && base->data.array.count > 0) base = resolve_object(pdf, &base->data.array.data[0]);
+	if (!base || base->kind != OBJ_NAME || !device_space_from_name(base->data.name, &color->base)) return false;
+	if (hival->kind != OBJ_INTEGER || hival->data.integer.value < 0 || hival->data.integer.value >= COLOR_MAX_PALETTE) return false;
+
+	color->space = COLOR_SPACE_INDEXED;
+	color->hival = (u32)hival->data.integer.value;
+
+	u32 size = (color->hival + 1) * color_space_components(color->base);
+	u32 len;
+	if (lookup->kind == OBJ_HEX_STRING) len = read_hex_string(lookup->data.hex_string.slice, color->lookup, size);
+	else if (lookup->kind == OBJ_STRING) len = read_literal_string(lookup->data.string.slice, color->lookup, size);
+	else if (lookup->kind == OBJ_DECODED_STREAM && lookup->data.decoded_stream.kind == STREAM_DATA_BUFFER) {
+		const Buffer *buffer = &lookup->data.decoded_stream.data.buffer;
+		len = (u32)MIN(buffer->size, (u64)size);
+		memcpy(color->lookup, buffer->data, len);
+	}
+	else return false;
+
+	// a short table leaves the last colors black
+	memset(color->lookup + len, 0, size - len);
+	return true;
+}
+
+local bool parse_color_space(const PDF *pdf, PDFObject *obj, ImageColor *color) {
+	obj = resolve_object(pdf, obj);
+	if (!obj) return false;
+	if (obj->kind == OBJ_NAME) return device_space_from_name(obj->data.name, &color->space);
+	if (obj->kind != OBJ_ARRAY || obj->data.array.count == 0) return false;
+
+	const ObjectArray *array = &obj->data.array;
+	const PDFObject *first = resolve_object(pdf, &array->data[0]);
+	if (!first || first->kind != OBJ_NAME) return false;
+
+	Name family = first->data.name;
+	if (cmp_name_str(family, "Indexed") || cmp_name_str(family, "I")) return parse_indexed(pdf, array, color);
+	// the calibrated spaces are drawn like the device spaces
+	if (cmp_name_str(family, "CalGray") || cmp_name_str(family, "CalRGB")) return device_space_from_name(family, &color->space);
+	return false;
+}
+
+bool image_color_from_dict(const PDF *pdf, const Dictionary *dict, ImageColor *color) {
+	*color = (ImageColor){ .bits_per_component = (u32)find_dict_int(dict, "BitsPerComponent", 8) };
+
+	// a stencil mask has one bit per pixel and no color space, it paints with the fill color
+	if (find_dict_bool(dict, "ImageMask", false) || find_dict_bool(dict, "IM", false)) {
+		color->image_mask = true;
+		color->space = COLOR_SPACE_GRAY;
+		color->bits_per_component = 1;
+	}
+	else {
+		DictionaryEntry *space = find_dict_entry(dict, "ColorSpace");
+		if (!space) space = find_dict_entry(dict, "CS");
+		if (!space || !parse_color_space(pdf, &space->object, color)) return false;
+	}
+
+	u32 bits = color->bits_per_component;
+	if (bits != 1 && bits != 2 && bits != 4 && bits != 8 && bits != 16) return false;
+	if (bits == 16 && color->space == COLOR_SPACE_INDEXED) return false;
+
+	DictionaryEntry *decode = find_dict_entry(dict, "Decode");
+	if (!decode) decode = find_dict_entry(dict, "D");
+	const PDFObject *decode_array = decode ? resolve_object(pdf, &decode->object) : NULL;
+	if (decode_array && decode_array->kind == OBJ_ARRAY) {
+		const ObjectArray *array = &decode_array->data.array;
+		if (array->count != 2 * color_space_components(color->space)) return false;
+		for (u64 i = 0; i < array->count; i++) {
+			const PDFObject *value = resolve_object(pdf, &array->data[i]);
+			if (!value || !object_number(value, &color->decode[i])) return false;
+		}
+		color->has_decode = true;
+	}
+	return true;
+}
+
+const char *color_space_to_str(enum ColorSpace space) {
+	switch (space) {
+	case COLOR_SPACE_GRAY: return "DeviceGray";
+	case COLOR_SPACE_RGB: return "DeviceRGB";
+	case COLOR_SPACE_CMYK: return "DeviceCMYK";
+	case COLOR_SPACE_INDEXED: return "Indexed";
+
+	default: PANIC("unknown ColorSpace: %u", space);
+	}
+}
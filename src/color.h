@@ -0,0 +1,81 @@
+#pragma once
+
+#include "decompress.h"
+
+// conversion of image XObject samples to the RGBA layout of the renderer. /Decode arrays and Indexed
+// palettes are folded into lookup tables when the converter is made, so every row is converted in a
+// single pass over its samples. samples of 1, 2 and 4 bits stay packed until a row is converted
+
+enum ColorSpace {
+    COLOR_SPACE_GRAY,
+    COLOR_SPACE_RGB,
+    COLOR_SPACE_CMYK,
+    COLOR_SPACE_INDEXED,
+    COLOR_SPACE_COUNT,
+};
+
+#define COLOR_MAX_COMPONENTS 4
+#define COLOR_MAX_PALETTE 256
+
+// x / 255 rounded to nearest, exact for products of two 8 bit values
+local inline u8 div255(u32 x) {
+    x += 128;
+    return (u8)((x + (x >> 8)) >> 8);
+}
+
+// how the samples of an image map to colors
+typedef struct ImageColor {
+    enum ColorSpace space;
+    u32 bits_per_component; // 1, 2, 4, 8 or 16, Indexed images have at most 8
+    bool has_decode;
+    f32 decode[2 * COLOR_MAX_COMPONENTS]; // /Decode, a range per component
+    // Indexed only
+    enum ColorSpace base; // gray, RGB or CMYK
+    u32 hival;            // largest index
+    u8 lookup[COLOR_MAX_PALETTE * COLOR_MAX_COMPONENTS]; // hival + 1 colors in the base space
+    // /ImageMask only, 1 bit gray samples paint mask_color where they are 0 (1 with a /Decode [1 0])
+    bool image_mask;
+    u8 mask_color[3]; // RGB, black unless the fill color is set
+} ImageColor;
+
+typedef struct ColorConverter {
+    enum ColorSpace space;
+    u32 n_components;
+    u32 bits_per_component;
+    // a /Decode [1 0] flips all bits of its component, any other remapping goes through lut
+    u8 invert[COLOR_MAX_COMPONENTS];
+    bool use_lut;
+    u8 lut[COLOR_MAX_COMPONENTS][256];
+    // Indexed, image masks and gray of less than 8 bits: RGBA of every sample value, /Decode applied
+    bool use_palette;
+    u32 palette[COLOR_MAX_PALETTE];
+} ColorConverter;
+
+// components of a sample in the color space
+u32 color_space_components(enum ColorSpace space);
+// reads /ColorSpace, /BitsPerComponent, /Decode and /ImageMask of an image, references are resolved in pdf.
+// false if the color space is not a device space, CalGray, CalRGB or an Indexed space with one of them as
+// base and a string or stream lookup table
+bool image_color_from_dict(const PDF *pdf, const Dictionary *dict, ImageColor *color);
+
+void color_converter_init(ColorConverter *cc, const ImageColor *color);
+// converts a row of width samples into width RGBA pixels
+void color_convert_row(const ColorConverter *cc, u8 *out, const u8 *in, u32 width);
+// converts the width pixels of a row from pixel first on, row points to the start of the row
+void color_convert_span(const ColorConverter *cc, u8 *out, const u8 *row, u32 first, u32 width);
+// bytes of a row of width pixels, rows of packed samples start at a byte
+u64 color_row_stride(const ColorConverter *cc, u32 width);
+// converts packed rows of samples into an RGBA image in memory from target, on all threads
+RawImage color_convert_image(const ColorConverter *cc, const u8 *samples, u32 width, u32 height, ImageTarget target);
+// like color_convert_image for the pixels of region only, clamped to the image. this way a 1 bit image
+// can be kept packed (in the image cache) and expanded by tile. a region outside of the image gives an
+// empty image (data NULL, width and height 0)
+RawImage color_convert_region(const ColorConverter *cc, const u8 *samples, u32 width, u32 height, ImageRegion region, ImageTarget target);
+
+// count samples of bits (1, 2 or 4) each from sample first of row to one byte each. scale stretches
+// them to 0..255, otherwise they keep their values
+void unpack_samples(u8 *out, const u8 *row, u64 first, u32 count, u32 bits, bool scale);
+// count big endian 16 bit samples to 8 bits, rounded
+void narrow_samples16(u8 *out, const u8 *in, u32 count);
+
+const char *color_space_to_str(enum ColorSpace space);
@@ -0,0 +1,436 @@
+#include "content_paths.h"
+
+#include <string.h>
+#include <math.h>
+
+#define MAX_OPERANDS 8
+#define MAX_STATE_DEPTH 32
+
+/// MATRICES ///
+
+Matrix matrix_multiply(Matrix n, Matrix m) {
+	return (Matrix){
+		.a = n.a * m.a + n.b * m.c,
+		.b = n.a * m.b + n.b * m.d,
+		.c = n.c * m.a + n.d * m.c,
+		.d = n.c * m.b + n.d * m.d,
+		.e = n.e * m.a + n.f * m.c + m.e,
+		.f = n.e * m.b + n.f * m.d + m.f,
+	};
+}
+
+PathPoint matrix_apply(Matrix m, PathPoint p) {
+	return (PathPoint){
+		.x = m.a * p.x + m.c * p.y + m.e,
+		.y = m.b * p.x + m.d * p.y + m.f,
+	};
+}
+
+/// LEXER ///
+
+enum TokenKind {
+	TOKEN_END,
+	TOKEN_ERROR, // unterminated string
+	TOKEN_NUMBER,
+	TOKEN_OPERATOR,
+	TOKEN_ARRAY_BEGIN,
+	TOKEN_ARRAY_END,
+	TOKEN_OTHER, // names, strings and dictionary brackets, operands that are not numbers
+};
+
+typedef struct Token {
+	enum TokenKind kind;
+	f32 number;
+	const u8 *text; // of an operator
+	u32 length;
+} Token;
+
+typedef struct Lexer {
+	const u8 *data;
+	u64 size;
+	u64 pos;
+} Lexer;
+
+local inline bool is_space(u8 c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+}
+
+local inline bool is_delimiter(u8 c) {
+	return c == '(' || c == ')' || c == '<' || c == '>' || c == '[' || c == ']'
+		|| c == '{' || c == '}' || c == '/' || c == '%';
+}
+
+local inline bool is_regular(u8 c) {
+	return !is_space(c) && !is_delimiter(c);
+}
+
+local inline bool is_digit(u8 c) {
+	return c >= '0' && c <= '9';
+}
+
+local void skip_regular(Lexer *lx) {
+	while (lx->pos < lx->size && is_regular(lx->data[lx->pos])) lx->pos++;
+}
+
+// false if the string is not closed
+local bool skip_string(Lexer *lx) {
+	u32 depth = 0;
+	while (lx->pos < lx->size) {
+		u8 c = lx->data[lx->pos++];
+		if (c == '\\') lx->pos++;
+		else if (c == '(') depth++;
+		else if (c == ')' && --depth == 0) return true;
+	}
+	return false;
+}
+
+// numbers are read digit by digit, so the same stream always gives the same paths
+local Token lex_number(Lexer *lx) {
+	u64 start = lx->pos;
+	f64 sign = 1.0;
+	if (lx->data[lx->pos] == '-' || lx->data[lx->pos] == '+') {
+		if (lx->data[lx->pos] == '-') sign = -1.0;
+		lx->pos++;
+	}
+
+	f64 value = 0.0;
+	while (lx->pos < lx->size && is_digit(lx->data[lx->pos])) value = value * 10.0 + (lx->data[lx->pos++] - '0');
+	if (lx->pos < lx->size && lx->data[lx->pos] == '.') {
+		lx->pos++;
+		f64 scale = 0.1;
+		while (lx->pos < lx->size && is_digit(lx->data[lx->pos])) {
+			value += (lx->data[lx->pos++] - '0') * scale;
+			scale *= 0.1;
+		}
+	}
+
+	// something like "1.2.3" or "-x" is an operator the walker does not know
+	if (lx->pos < lx->size && is_regular(lx->data[lx->pos])) {
+		lx->pos = start;
+		skip_regular(lx);
+		return (Token){ .kind = TOKEN_OPERATOR, .text = lx->data + start, .length = (u32)(lx->pos - start) };
+	}
+	return (Token){ .kind = TOKEN_NUMBER, .number = (f32)(sign * value) };
+}
+
+local Token next_token(Lexer *lx) {
+	for (;;) {
+		while (lx->pos < lx->size && is_space(lx->data[lx->pos])) lx->pos++;
+		if (lx->pos >= lx->size) return (Token){ .kind = TOKEN_END };
+
+		u8 c = lx->data[lx->pos];
+		if (c != '%') break;
+		while (lx->pos < lx->size && lx->data[lx->pos] != '\n' && lx->data[lx->pos] != '\r') lx->pos++;
+	}
+
+	u8 c = lx->data[lx->pos];
+	switch (c) {
+	case '(':
+		return (Token){ .kind = skip_string(lx) ? TOKEN_OTHER : TOKEN_ERROR };
+	case '<':
+		lx->pos++;
+		if (lx->pos < lx->size && lx->data[lx->pos] == '<') {
+			lx->pos++;
+			return (Token){ .kind = TOKEN_OTHER };
+		}
+		while (lx->pos < lx->size && lx->data[lx->pos] != '>') lx->pos++;
+		if (lx->pos >= lx->size) return (Token){ .kind = TOKEN_ERROR };
+		lx->pos++;
+		return (Token){ .kind = TOKEN_OTHER };
+	case '>':
+		lx->pos++;
+		if (lx->pos < lx->size && lx->data[lx->pos] == '>') lx->pos++;
+		return (Token){ .kind = TOKEN_OTHER };
+	case '[':
+		lx->pos++;
+		return (Token){ .kind = TOKEN_ARRAY_BEGIN };
+	case ']':
+		lx->pos++;
+		return (Token){ .kind = TOKEN_ARRAY_END };
+	case '/':
+		lx->pos++;
+		skip_regular(lx);
+		return (Token){ .kind = TOKEN_OTHER };
+	case ')': case '{': case '}':
+		lx->pos++;
+		return (Token){ .kind = TOKEN_OTHER };
+	default:
+		break;
+	}
+
+	if (is_digit(c) || c == '-' || c == '+' || c == '.') return lex_number(lx);
+
+	u64 start = lx->pos;
+	skip_regular(lx);
+	return (Token){ .kind = TOKEN_OPERATOR, .text = lx->data + start, .length = (u32)(lx->pos - start) };
+}
+
+// moves past the data of an inline image, which starts after ID and one whitespace byte and ends
+// at an EI between whitespace. false if there is no EI
+local bool skip_inline_image(Lexer *lx) {
+	lx->pos++;
+	for (u64 i = lx->pos; i + 1 < lx->size; i++) {
+		if (lx->data[i] != 'E' || lx->data[i + 1] != 'I') continue;
+		bool space_before = i == 0 || is_space(lx->data[i - 1]);
+		bool space_after = i + 2 == lx->size || is_space(lx->data[i + 2]);
+		if (space_before && space_after) {
+			lx->pos = i + 2;
+			return true;
+		}
+	}
+	lx->pos = lx->size;
+	return false;
+}
+
+/// WALKER ///
+
+typedef struct GraphicsState {
+	Matrix ctm;
+	u8 fill[4];
+} GraphicsState;
+
+typedef struct Walker {
+	PagePaths *paths;
+	GraphicsState states[MAX_STATE_DEPTH];
+	u32 depth;
+	u32 lost_saves; // q past MAX_STATE_DEPTH, their Q do nothing
+
+	f32 operands[MAX_OPERANDS];
+	u32 n_operands;
+	bool other_operand; // a name, string or array was among the operands
+
+	// the path under construction starts at these indices of the arrays
+	u32 path_verb;
+	u32 path_point;
+	PathPoint current; // transformed
+	PathPoint subpath_start;
+	bool has_current;
+} Walker;
+
+local inline GraphicsState *gs(Walker *w) {
+	return &w->states[w->depth];
+}
+
+local inline bool op_is(const Token *t, const char *name) {
+	return t->length == strlen(name) && memcmp(t->text, name, t->length) == 0;
+}
+
+local inline u8 color_byte(f32 v) {
+	return (u8)lrintf(CLAMP(v, 1.0f, 0.0f) * 255.0f);
+}
+
+local void set_fill_rgb(Walker *w, f32 r, f32 g, f32 b) {
+	u8 *fill = gs(w)->fill;
+	fill[0] = color_byte(r);
+	fill[1] = color_byte(g);
+	fill[2] = color_byte(b);
+	fill[3] = 255;
+}
+
+// sc and scn, the color space is guessed from the operand count
+local void set_fill_components(Walker *w) {
+	const f32 *o = w->operands;
+	if (w->other_operand) return; // pattern
+	switch (w->n_operands) {
+	case 1: set_fill_rgb(w, o[0], o[0], o[0]); break;
+	case 3: set_fill_rgb(w, o[0], o[1], o[2]); break;
+	case 4:
+		set_fill_rgb(w, (1.0f - o[0]) * (1.0f - o[3]), (1.0f - o[1]) * (1.0f - o[3]), (1.0f - o[2]) * (1.0f - o[3]));
+		break;
+	default: break;
+	}
+}
+
+local void push_point(Walker *w, f32 x, f32 y) {
+	PathPoint p = matrix_apply(gs(w)->ctm, (PathPoint){ x, y });
+	arrput(w->paths->points, p);
+	w->current = p;
+}
+
+local void move_to(Walker *w, f32 x, f32 y) {
+	arrput(w->paths->verbs, PATH_MOVE);
+	push_point(w, x, y);
+	w->subpath_start = w->current;
+	w->has_current = true;
+}
+
+local void line_to(Walker *w, f32 x, f32 y) {
+	if (!w->has_current) {
+		move_to(w, x, y);
+		return;
+	}
+	arrput(w->paths->verbs, PATH_LINE);
+	push_point(w, x, y);
+}
+
+// control points in user space, except the first one of v, which is the current point
+local void cubic_to(Walker *w, const PathPoint *first, f32 x2, f32 y2, f32 x3, f32 y3) {
+	if (!w->has_current) return;
+	arrput(w->paths->verbs, PATH_CUBIC);
+	if (first) arrput(w->paths->points, *first);
+	else push_point(w, w->operands[0], w->operands[1]);
+	push_point(w, x2, y2);
+	push_point(w, x3, y3);
+}
+
+local void close_path(Walker *w) {
+	if (!w->has_current) return;
+	arrput(w->paths->verbs, PATH_CLOSE);
+	w->current = w->subpath_start;
+}
+
+local void end_path(Walker *w, bool fill, enum FillRule rule) {
+	PagePaths *paths = w->paths;
+	u32 n_verbs = (u32)arrlen(paths->verbs) - w->path_verb;
+
+	if (fill && n_verbs > 0) {
+		FilledPath path = {
+			.first_verb = w->path_verb,
+			.n_verbs = n_verbs,
+			.first_point = w->path_point,
+			.n_points = (u32)arrlen(paths->points) - w->path_point,
+			.rule = rule,
+		};
+		memcpy(path.color, gs(w)->fill, 4);
+		arrput(paths->paths, path);
+	} else {
+		arrsetlen(paths->verbs, w->path_verb);
+		arrsetlen(paths->points, w->path_point);
+	}
+
+	w->path_verb = (u32)arrlen(paths->verbs);
+	w->path_point = (u32)arrlen(paths->points);
+	w->has_current = false;
+}
+
+local void run_operator(Walker *w, const Token *t) {
+	const f32 *o = w->operands;
+	u32 n = w->other_operand ? 0 : w->n_operands;
+
+	if (op_is(t, "q")) {
+		if (w->depth + 1 < MAX_STATE_DEPTH) {
+			w->states[w->depth + 1] = w->states[w->depth];
+			w->depth += 1;
+		} else {
+			w->lost_saves += 1;
+		}
+	} else if (op_is(t, "Q")) {
+		if (w->lost_saves > 0) w->lost_saves -= 1;
+		else if (w->depth > 0) w->depth -= 1;
+	} else if (op_is(t, "cm")) {
+		if (n == 6) gs(w)->ctm = matrix_multiply((Matrix){ o[0], o[1], o[2], o[3], o[4], o[5] }, gs(w)->ctm);
+	}
+
+	/* path construction */
+	else if (op_is(t, "m")) {
+		if (n == 2) move_to(w, o[0], o[1]);
+	} else if (op_is(t, "l")) {
+		if (n == 2) line_to(w, o[0], o[1]);
+	} else if (op_is(t, "c")) {
+		if (n == 6) cubic_to(w, NULL, o[2], o[3], o[4], o[5]);
+	} else if (op_is(t, "v")) {
+		PathPoint current = w->current;
+		if (n == 4) cubic_to(w, &current, o[0], o[1], o[2], o[3]);
+	} else if (op_is(t, "y")) {
+		// the second control point is the end point
+		if (n == 4) cubic_to(w, NULL, o[2], o[3], o[2], o[3]);
+	} else if (op_is(t, "h")) {
+		close_path(w);
+	} else if (op_is(t, "re")) {
+		if (n == 4) {
+			move_to(w, o[0], o[1]);
+			line_to(w, o[0] + o[2], o[1]);
+			line_to(w, o[0] + o[2], o[1] + o[3]);
+			line_to(w, o[0], o[1] + o[3]);
+			close_path(w);
+		}
+	}
+
+	/* path painting */
+	else if (op_is(t, "f") || op_is(t, "F") || op_is(t, "B")) {
+		end_path(w, true, FILL_RULE_NONZERO);
+	} else if (op_is(t, "f*") || op_is(t, "B*")) {
+		end_path(w, true, FILL_RULE_EVEN_ODD);
+	} else if (op_is(t, "b")) {
+		close_path(w);
+		end_path(w, true, FILL_RULE_NONZERO);
+	} else if (op_is(t, "b*")) {
+		close_path(w);
+		end_path(w, true, FILL_RULE_EVEN_ODD);
+	} else if (op_is(t, "n") || op_is(t, "S") || op_is(t, "s")) {
+		end_path(w, false, FILL_RULE_NONZERO);
+	}
+
+	/* fill colors */
+	else if (op_is(t, "g")) {
+		if (n == 1) set_fill_rgb(w, o[0], o[0], o[0]);
+	} else if (op_is(t, "rg")) {
+		if (n == 3) set_fill_rgb(w, o[0], o[1], o[2]);
+	} else if (op_is(t, "k")) {
+		if (n == 4) set_fill_rgb(w, (1.0f - o[0]) * (1.0f - o[3]), (1.0f - o[1]) * (1.0f - o[3]), (1.0f - o[2]) * (1.0f - o[3]));
+	} else if (op_is(t, "cs")) {
+		set_fill_rgb(w, 0.0f, 0.0f, 0.0f);
+	} else if (op_is(t, "sc") || op_is(t, "scn")) {
+		set_fill_components(w);
+	}
+
+	w->n_operands = 0;
+	w->other_operand = false;
+}
+
+bool content_paths_parse(const u8 *data, u64 size, PagePaths *paths) {
+	Walker w = {
+		.paths = paths,
+		.states[0] = { .ctm = MATRIX_IDENTITY, .fill = { 0, 0, 0, 255 } },
+		.path_verb = (u32)arrlen(paths->verbs),
+		.path_point = (u32)arrlen(paths->points),
+	};
+	Lexer lx = { .data = data, .size = size };
+	u32 array_depth = 0;
+
+	for (;;) {
+		Token t = next_token(&lx);
+		switch (t.kind) {
+		case TOKEN_END:
+		case TOKEN_ERROR:
+			// a path that was never painted is dropped
+			end_path(&w, false, FILL_RULE_NONZERO);
+			return t.kind == TOKEN_END && array_depth == 0;
+		case TOKEN_NUMBER:
+			if (array_depth > 0) break;
+			if (w.n_operands < MAX_OPERANDS) w.operands[w.n_operands++] = t.number;
+			else w.other_operand = true;
+			break;
+		case TOKEN_ARRAY_BEGIN:
+			array_depth += 1;
+			break;
+		case TOKEN_ARRAY_END:
+			if (array_depth > 0) array_depth -= 1;
+			w.other_operand = true;
+			break;
+		case TOKEN_OTHER:
+			w.other_operand = true;
+			break;
+		case TOKEN_OPERATOR:
+			if (array_depth > 0) break;
+			if (op_is(&t, "ID")) {
+				if (!skip_inline_image(&lx)) {
+					end_path(&w, false, FILL_RULE_NONZERO);
+					return false;
+				}
+				w.n_operands = 0;
+				w.other_operand = false;
+				break;
+			}
+			run_operator(&w, &t);
+			break;
+		}
+	}
+}
+
+void page_paths_free(PagePaths *paths) {
+	arrfree(paths->verbs);
+	arrfree(paths->points);
+	arrfree(paths->paths);
+	*paths = (PagePaths){ 0 };
+}
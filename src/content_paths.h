@@ -0,0 +1,57 @@
+#pragma once
+
+#include "utils.h"
+
+// a minimal walker over page content streams that keeps the filled paths. it follows the graphics
+// state operators that move geometry (q, Q, cm) and the fill colors (g, rg, k, sc, scn), builds the
+// paths of m, l, c, v, y, re and h, and records every path that is filled. strokes, clipping, text and
+// images are skipped, so are operators it does not know
+
+enum FillRule {
+    FILL_RULE_NONZERO,  // f, F, B, b
+    FILL_RULE_EVEN_ODD, // f*, B*, b*
+};
+
+enum PathVerb {
+    PATH_MOVE,  // one point
+    PATH_LINE,  // one point
+    PATH_CUBIC, // two control points and the end point
+    PATH_CLOSE, // no points
+};
+
+// an affine transform in the order of the operands of cm: x' = a x + c y + e, y' = b x + d y + f
+typedef struct Matrix {
+    f32 a, b, c, d, e, f;
+} Matrix;
+
+typedef struct PathPoint {
+    f32 x;
+    f32 y;
+} PathPoint;
+
+typedef struct FilledPath {
+    u32 first_verb;
+    u32 n_verbs;
+    u32 first_point;
+    u32 n_points;
+    enum FillRule rule;
+    u8 color[4]; // premultiplied RGBA
+} FilledPath;
+
+// paths in default user space (points, y up), in painting order
+typedef struct PagePaths {
+    u8 *verbs;         // stb_ds array of enum PathVerb
+    PathPoint *points; // stb_ds array
+    FilledPath *paths; // stb_ds array
+} PagePaths;
+
+#define MATRIX_IDENTITY ((Matrix){ 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f })
+
+// m applied after n
+Matrix matrix_multiply(Matrix n, Matrix m);
+PathPoint matrix_apply(Matrix m, PathPoint p);
+
+// appends the filled paths of a decoded content stream. false if the stream ends inside a string,
+// an array or an inline image, the paths up to there are kept
+bool content_paths_parse(const u8 *data, u64 size, PagePaths *paths);
+void page_paths_free(PagePaths *paths);
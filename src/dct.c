@@ -0,0 +1,585 @@
+#include "dct.h"
+#include "buffer_pool.h"
+#include "threads.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <jpeglib.h>
+
+void dct_read_size(const u8 *data, u64 len, u32 *width, u32 *height) {
+	struct jpeg_decompress_struct info;
+	struct jpeg_error_mgr err;
+
+	info.err = jpeg_std_error(&err);
+	jpeg_create_decompress(&info);
+
+	jpeg_mem_src(&info, data, len);
+	(void)jpeg_read_header(&info, true);
+
+	*width = info.image_width;
+	*height = info.image_height;
+
+	jpeg_destroy_decompress(&info);
+}
+
+u32 dct_scaled_size(u32 size, enum DCTScale scale) {
+	ASSERT_MSG(scale < DCT_SCALE_COUNT, "invalid DCTScale: %u", scale);
+	u32 denom = 1u << scale;
+	return (u32)(((u64)size + denom - 1) / denom);
+}
+
+enum DCTScale dct_pick_scale(u32 width, u32 height, u32 target_width, u32 target_height) {
+	for (u32 scale = DCT_SCALE_EIGHTH; scale > DCT_SCALE_FULL; scale--) {
+		if (dct_scaled_size(width, scale) >= target_width && dct_scaled_size(height, scale) >= target_height) return scale;
+	}
+	return DCT_SCALE_FULL;
+}
+
+// rows handed to libjpeg per call, one call decodes at most one iMCU row (up to 16 rows at full scale)
+#define DCT_BATCH_ROWS 16
+
+// native layout of the jpeg, or RGBA / BGRA for gray and color jpegs
+local enum PixelFormat dct_output_format(const struct jpeg_decompress_struct *info, enum DCTOutput output) {
+	switch (info->jpeg_color_space) {
+	case JCS_CMYK:
+	case JCS_YCCK: return PIXEL_FORMAT_CMYK;
+	default: break;
+	}
+
+	switch (output) {
+	case DCT_OUTPUT_NATIVE: return info->num_components == 1 ? PIXEL_FORMAT_GRAY : PIXEL_FORMAT_RGB;
+	case DCT_OUTPUT_RGBA: return PIXEL_FORMAT_RGBA;
+	case DCT_OUTPUT_BGRA: return PIXEL_FORMAT_BGRA;
+
+	default: PANIC("unknown DCTOutput: %u", output);
+	}
+}
+
+// Adobe applications write CMYK jpegs with inverted samples and mark them with an APP14 segment
+local bool adobe_inverted(const struct jpeg_decompress_struct *info, enum PixelFormat format) {
+	return format == PIXEL_FORMAT_CMYK && info->saw_Adobe_marker;
+}
+
+local J_COLOR_SPACE pixel_format_color_space(enum PixelFormat format) {
+	switch (format) {
+	case PIXEL_FORMAT_GRAY: return JCS_GRAYSCALE;
+	case PIXEL_FORMAT_RGB: return JCS_RGB;
+	case PIXEL_FORMAT_CMYK: return JCS_CMYK;
+	case PIXEL_FORMAT_RGBA: return JCS_EXT_RGBA;
+	case PIXEL_FORMAT_BGRA: return JCS_EXT_BGRA;
+
+	default: PANIC("unknown PixelFormat: %u", format);
+	}
+}
+
+// decodes the whole image if region is NULL
+local RawImage decode_jpeg(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output,
+	const ImageRegion *region, ImageTarget target) {
+	ASSERT_MSG(scale < DCT_SCALE_COUNT, "invalid DCTScale: %u", scale);
+
+	struct jpeg_decompress_struct info;
+	struct jpeg_error_mgr err;
+
+	info.err = jpeg_std_error(&err);
+	jpeg_create_decompress(&info);
+
+	jpeg_mem_src(&info, data, len);
+	(void)jpeg_read_header(&info, true);
+
+	enum PixelFormat format = dct_output_format(&info, output);
+	info.out_color_space = pixel_format_color_space(format);
+	// the reduced IDCT computes the smaller image directly
+	info.scale_num = 1;
+	info.scale_denom = 1u << scale;
+	(void)jpeg_start_decompress(&info);
+
+	ImageRegion r = { .width = info.output_width, .height = info.output_height };
+	if (region) {
+		r.x = MIN(region->x, info.output_width);
+		r.y = MIN(region->y, info.output_height);
+		r.width = MIN(region->width, info.output_width - r.x);
+		r.height = MIN(region->height, info.output_height - r.y);
+	}
+	// nothing of the region is inside the image
+	if (r.width == 0 || r.height == 0) {
+		jpeg_abort_decompress(&info);
+		jpeg_destroy_decompress(&info);
+		return (RawImage){ 0 };
+	}
+
+	// decoded rows start at an iMCU column, so they can begin left of the region and be wider than it.
+	// fancy upsampling treats the crop edges like image edges, one more iMCU column on both sides keeps
+	// the region pixels identical to a full decode
+#if JPEG_LIB_VERSION >= 70
+	u32 imcu_width = (u32)(info.max_h_samp_factor * info.min_DCT_h_scaled_size);
+#else
+	u32 imcu_width = (u32)(info.max_h_samp_factor * info.min_DCT_scaled_size);
+#endif
+	JDIMENSION crop_x = r.x > imcu_width ? r.x - imcu_width : 0;
+	JDIMENSION crop_width = MIN(r.x + r.width + imcu_width, info.output_width) - crop_x;
+	if (crop_width != info.output_width) jpeg_crop_scanline(&info, &crop_x, &crop_width);
+	if (r.y > 0) (void)jpeg_skip_scanlines(&info, r.y);
+
+	u32 n_channels = (u32)info.output_components;
+	u64 crop_stride = (u64)crop_width * n_channels;
+	u64 row_stride = (u64)r.width * n_channels;
+	u64 row_offset = (u64)(r.x - crop_x) * n_channels;
+
+	RawImage image = {
+		.width = r.width,
+		.height = r.height,
+		.n_channels = (u8)n_channels,
+		.format = format,
+		.inverted = adobe_inverted(&info, format),
+	};
+	image.data = image_target_alloc(target, &image);
+
+	// cropped rows wider than the region are decoded into a batch and only their region columns are
+	// copied out, so the target only ever holds the packed region
+	bool cropped = crop_stride != row_stride;
+	u8 *batch = cropped ? buffer_pool_acquire(crop_stride * DCT_BATCH_ROWS) : NULL;
+
+	u8 *rows[DCT_BATCH_ROWS];
+	u32 end = r.y + r.height;
+	while (info.output_scanline < end) {
+		u32 first = info.output_scanline - r.y;
+		u32 n_rows = MIN(end - info.output_scanline, DCT_BATCH_ROWS);
+		for (u32 i = 0; i < n_rows; i++) {
+			rows[i] = cropped ? batch + crop_stride * i : image.data + row_stride * (first + i);
+		}
+		u32 n_read = jpeg_read_scanlines(&info, rows, n_rows);
+
+		if (cropped) {
+			for (u32 i = 0; i < n_read; i++) {
+				memcpy(image.data + row_stride * (first + i), rows[i] + row_offset, row_stride);
+			}
+		}
+	}
+	buffer_pool_release(batch);
+
+	// the rows below the region are never decoded, finishing would require reading them
+	if (info.output_scanline == info.output_height) jpeg_finish_decompress(&info);
+	jpeg_destroy_decompress(&info);
+
+	return image;
+}
+
+RawImage dct_decode_image(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output) {
+	return decode_jpeg(data, len, scale, output, NULL, (ImageTarget){ 0 });
+}
+
+RawImage dct_decode_region(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output, ImageRegion region) {
+	return decode_jpeg(data, len, scale, output, &region, (ImageTarget){ 0 });
+}
+
+RawImage dct_decode_region_into(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output,
+	ImageRegion region, ImageTarget target) {
+	return decode_jpeg(data, len, scale, output, &region, target);
+}
+
+/// PARALLEL DECODE ///
+
+// every entropy coded segment between two restart markers starts with reset DC predictions. when
+// restarts fall on MCU row boundaries, a run of segments is a complete jpeg of its own: the header
+// with a smaller height, the segments with renumbered markers and an EOI. such bands are decoded
+// on all threads into one image
+
+typedef struct Segment {
+	u64 start; // first byte of the entropy coded data
+	u64 end;   // restart marker or end of the scan
+} Segment;
+
+typedef struct RestartLayout {
+	u64 header_size;   // up to the end of the SOS segment
+	u64 height_offset; // of the SOF height
+	u32 image_height;
+	u32 mcus_per_row;
+	u32 mcu_rows;
+	u32 mcu_height;       // pixel rows of an MCU row
+	u32 rows_per_unit;    // MCU rows from one restart at a row boundary to the next
+	u32 restart_interval; // MCUs per segment
+	Segment *segments;    // stb_ds array
+} RestartLayout;
+
+typedef struct BandJob {
+	const u8 *data;
+	const RestartLayout *layout;
+	u32 n_bands;
+	u32 n_units;
+	enum DCTScale scale;
+	enum PixelFormat format;
+	u8 *out;
+	u64 row_stride;
+	u32 output_height;
+} BandJob;
+
+local inline u32 read_u16_be(const u8 *p) {
+	return (u32)p[0] << 8 | p[1];
+}
+
+local u32 gcd_u32(u32 a, u32 b) {
+	while (b) {
+		u32 t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// finds the segments of a single scan baseline jpeg, false if it can't be split
+local bool find_restart_layout(const u8 *data, u64 len, RestartLayout *layout) {
+	*layout = (RestartLayout){ 0 };
+	if (len < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+
+	u32 width = 0, n_components = 0, max_h = 1, max_v = 1;
+	u64 pos = 2;
+	for (;;) {
+		// markers can be preceded by any number of fill bytes
+		if (pos >= len || data[pos] != 0xFF) return false;
+		while (pos < len && data[pos] == 0xFF) pos++;
+		if (pos + 3 > len) return false;
+		u8 marker = data[pos++];
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) continue;
+
+		u32 segment_len = read_u16_be(data + pos);
+		if (segment_len < 2 || pos + segment_len > len) return false;
+		const u8 *segment = data + pos + 2;
+
+		switch (marker) {
+		case 0xC0: // baseline
+		case 0xC1: // extended sequential, huffman
+			if (segment_len < 8 || segment[0] != 8) return false;
+			layout->height_offset = pos + 3;
+			layout->image_height = read_u16_be(segment + 1);
+			width = read_u16_be(segment + 3);
+			n_components = segment[5];
+			// a height of 0 is defined by a DNL marker after the scan
+			if (layout->image_height == 0 || width == 0 || n_components == 0 || segment_len < 8 + 3 * n_components) return false;
+			for (u32 i = 0; i < n_components; i++) {
+				u8 sampling = segment[6 + 3 * i + 1];
+				max_h = MAX(max_h, (u32)(sampling >> 4));
+				max_v = MAX(max_v, (u32)(sampling & 15));
+			}
+			break;
+		case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+		case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+			return false; // progressive, lossless, hierarchical or arithmetic coded
+		case 0xDD:
+			if (segment_len < 4) return false;
+			layout->restart_interval = read_u16_be(segment);
+			break;
+		case 0xD9:
+			return false;
+		default:
+			break;
+		}
+
+		pos += segment_len;
+		if (marker == 0xDA) {
+			// the scan has to contain all components, otherwise more scans follow
+			if (n_components == 0 || segment_len < 3 || segment[0] != n_components) return false;
+			layout->header_size = pos;
+			break;
+		}
+	}
+	if (layout->restart_interval == 0) return false;
+
+	// a scan of a single component is not interleaved, its MCU is one block
+	if (n_components == 1) max_h = max_v = 1;
+	layout->mcu_height = 8 * max_v;
+	layout->mcus_per_row = (width + 8 * max_h - 1) / (8 * max_h);
+	layout->mcu_rows = (layout->image_height + layout->mcu_height - 1) / layout->mcu_height;
+	u32 row_gcd = gcd_u32(layout->mcus_per_row, layout->restart_interval);
+	layout->rows_per_unit = layout->restart_interval / row_gcd;
+
+	u64 n_mcus = (u64)layout->mcus_per_row * layout->mcu_rows;
+	u64 n_segments = (n_mcus + layout->restart_interval - 1) / layout->restart_interval;
+	arrsetcap(layout->segments, n_segments);
+
+	Segment segment = { .start = layout->header_size };
+	pos = layout->header_size;
+	for (;;) {
+		const u8 *ff = pos < len ? memchr(data + pos, 0xFF, len - pos) : NULL;
+		if (!ff) {
+			// data ends without EOI
+			segment.end = len;
+			arrput(layout->segments, segment);
+			break;
+		}
+		u64 marker_pos = (u64)(ff - data);
+		u64 next = marker_pos + 1;
+		while (next < len && data[next] == 0xFF) next++;
+		if (next == len) {
+			segment.end = marker_pos;
+			arrput(layout->segments, segment);
+			break;
+		}
+
+		u8 marker = data[next];
+		if (marker == 0x00) {
+			// stuffed 0xFF data byte
+			pos = next + 1;
+			continue;
+		}
+		segment.end = marker_pos;
+		arrput(layout->segments, segment);
+		if (marker < 0xD0 || marker > 0xD7) {
+			// DNL or another scan can't be split
+			if (marker != 0xD9) return false;
+			break;
+		}
+		if (marker != 0xD0 + ((arrlen(layout->segments) - 1) & 7) || (u64)arrlen(layout->segments) >= n_segments) return false;
+		segment.start = next + 1;
+		pos = next + 1;
+	}
+
+	return (u64)arrlen(layout->segments) == n_segments;
+}
+
+local void decode_band(void *user_data, u32 band) {
+	const BandJob *job = user_data;
+	const RestartLayout *layout = job->layout;
+	u32 denom = 1u << job->scale;
+
+	// MCU rows written by the band, whole units except for the last band
+	u32 first_row = (u32)((u64)job->n_units * band / job->n_bands) * layout->rows_per_unit;
+	u32 end_row = MIN((u32)((u64)job->n_units * (band + 1) / job->n_bands) * layout->rows_per_unit, layout->mcu_rows);
+	// one more unit on both sides gives the chroma upsampling the rows next to the band
+	u32 jpeg_first_row = first_row > 0 ? first_row - layout->rows_per_unit : 0;
+	u32 jpeg_end_row = MIN(end_row + layout->rows_per_unit, layout->mcu_rows);
+
+	u64 segments_per_unit = (u64)layout->rows_per_unit * layout->mcus_per_row / layout->restart_interval;
+	u64 first_segment = jpeg_first_row / layout->rows_per_unit * segments_per_unit;
+	u64 end_segment = jpeg_end_row == layout->mcu_rows ? (u64)arrlen(layout->segments)
+		: jpeg_end_row / layout->rows_per_unit * segments_per_unit;
+
+	u32 jpeg_top = jpeg_first_row * layout->mcu_height;
+	u32 jpeg_height = MIN(jpeg_end_row * layout->mcu_height, layout->image_height) - jpeg_top;
+
+	u64 size = layout->header_size + 2;
+	for (u64 i = first_segment; i < end_segment; i++) {
+		size += layout->segments[i].end - layout->segments[i].start + 2;
+	}
+	u8 *band_jpeg = buffer_pool_acquire(size);
+	memcpy(band_jpeg, job->data, layout->header_size);
+	band_jpeg[layout->height_offset] = (u8)(jpeg_height >> 8);
+	band_jpeg[layout->height_offset + 1] = (u8)jpeg_height;
+	u64 pos = layout->header_size;
+	for (u64 i = first_segment; i < end_segment; i++) {
+		const Segment *segment = &layout->segments[i];
+		if (i > first_segment) {
+			band_jpeg[pos++] = 0xFF;
+			band_jpeg[pos++] = (u8)(0xD0 + ((i - first_segment - 1) & 7));
+		}
+		memcpy(band_jpeg + pos, job->data + segment->start, segment->end - segment->start);
+		pos += segment->end - segment->start;
+	}
+	band_jpeg[pos++] = 0xFF;
+	band_jpeg[pos++] = 0xD9;
+
+	struct jpeg_decompress_struct info;
+	struct jpeg_error_mgr err;
+
+	info.err = jpeg_std_error(&err);
+	jpeg_create_decompress(&info);
+
+	jpeg_mem_src(&info, band_jpeg, pos);
+	(void)jpeg_read_header(&info, true);
+	info.out_color_space = pixel_format_color_space(job->format);
+	info.scale_num = 1;
+	info.scale_denom = denom;
+	(void)jpeg_start_decompress(&info);
+
+	// band tops are multiples of 8 rows, so they are exact at every scale
+	u32 skip = (first_row - jpeg_first_row) * layout->mcu_height / denom;
+	u32 out_first = first_row * layout->mcu_height / denom;
+	u32 out_end = end_row == layout->mcu_rows ? job->output_height : end_row * layout->mcu_height / denom;
+	if (skip > 0) (void)jpeg_skip_scanlines(&info, skip);
+
+	u8 *rows[DCT_BATCH_ROWS];
+	u32 end = skip + (out_end - out_first);
+	while (info.output_scanline < end) {
+		u32 n_rows = MIN(end - info.output_scanline, DCT_BATCH_ROWS);
+		for (u32 i = 0; i < n_rows; i++) {
+			rows[i] = job->out + job->row_stride * (out_first + info.output_scanline - skip + i);
+		}
+		(void)jpeg_read_scanlines(&info, rows, n_rows);
+	}
+
+	jpeg_destroy_decompress(&info);
+	buffer_pool_release(band_jpeg);
+}
+
+RawImage dct_decode_into(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output, ImageTarget target) {
+	ASSERT_MSG(scale < DCT_SCALE_COUNT, "invalid DCTScale: %u", scale);
+
+	u32 n_threads = thread_count();
+	RestartLayout layout = { 0 };
+	if (n_threads < 2 || !find_restart_layout(data, len, &layout)) {
+		arrfree(layout.segments);
+		return decode_jpeg(data, len, scale, output, NULL, target);
+	}
+
+	struct jpeg_decompress_struct info;
+	struct jpeg_error_mgr err;
+
+	info.err = jpeg_std_error(&err);
+	jpeg_create_decompress(&info);
+
+	jpeg_mem_src(&info, data, len);
+	(void)jpeg_read_header(&info, true);
+	info.scale_num = 1;
+	info.scale_denom = 1u << scale;
+	enum PixelFormat format = dct_output_format(&info, output);
+	info.out_color_space = pixel_format_color_space(format);
+	jpeg_calc_output_dimensions(&info);
+	u32 width = info.output_width;
+	u32 height = info.output_height;
+	u32 n_channels = (u32)info.output_components;
+	bool inverted = adobe_inverted(&info, format);
+	jpeg_destroy_decompress(&info);
+
+	u32 n_units = (layout.mcu_rows + layout.rows_per_unit - 1) / layout.rows_per_unit;
+	u32 n_bands = MIN(n_units, n_threads);
+	if ((u64)width * height < DCT_PARALLEL_MIN_PIXELS || n_bands < 2) {
+		arrfree(layout.segments);
+		return decode_jpeg(data, len, scale, output, NULL, target);
+	}
+
+	RawImage image = {
+		.width = width,
+		.height = height,
+		.n_channels = (u8)n_channels,
+		.format = format,
+		.inverted = inverted,
+	};
+	image.data = image_target_alloc(target, &image);
+
+	BandJob job = {
+		.data = data,
+		.layout = &layout,
+		.n_bands = n_bands,
+		.n_units = n_units,
+		.scale = scale,
+		.format = format,
+		.out = image.data,
+		.row_stride = (u64)width * n_channels,
+		.output_height = height,
+	};
+	parallel_for(n_bands, decode_band, &job);
+	arrfree(layout.segments);
+
+	return image;
+}
+
+RawImage dct_decode_parallel(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output) {
+	return dct_decode_into(data, len, scale, output, (ImageTarget){ 0 });
+}
+
+// one output pass of a buffered image, rows are packed
+local void read_output_pass(struct jpeg_decompress_struct *info, u8 *out, u64 row_stride) {
+	u8 *rows[DCT_BATCH_ROWS];
+	while (info->output_scanline < info->output_height) {
+		u32 n_rows = MIN(info->output_height - info->output_scanline, DCT_BATCH_ROWS);
+		for (u32 i = 0; i < n_rows; i++) {
+			rows[i] = out + row_stride * (info->output_scanline + i);
+		}
+		(void)jpeg_read_scanlines(info, rows, n_rows);
+	}
+}
+
+RawImage dct_decode_progressive(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output, DCTScanSink sink) {
+	ASSERT_MSG(scale < DCT_SCALE_COUNT, "invalid DCTScale: %u", scale);
+
+	struct jpeg_decompress_struct info;
+	struct jpeg_error_mgr err;
+
+	info.err = jpeg_std_error(&err);
+	jpeg_create_decompress(&info);
+
+	jpeg_mem_src(&info, data, len);
+	(void)jpeg_read_header(&info, true);
+
+	enum PixelFormat format = dct_output_format(&info, output);
+	info.out_color_space = pixel_format_color_space(format);
+	info.scale_num = 1;
+	info.scale_denom = 1u << scale;
+	// keeps the coefficients of all scans, so the image can be output any number of times
+	info.buffered_image = jpeg_has_multiple_scans(&info);
+	(void)jpeg_start_decompress(&info);
+
+	u32 n_channels = (u32)info.output_components;
+	u64 row_stride = (u64)info.output_width * n_channels;
+	u8 *out = buffer_pool_acquire(row_stride * info.output_height);
+	RawImage image = {
+		.data = out,
+		.width = info.output_width,
+		.height = info.output_height,
+		.n_channels = (u8)n_channels,
+		.format = format,
+		.inverted = adobe_inverted(&info, format),
+	};
+
+	if (!info.buffered_image) {
+		read_output_pass(&info, out, row_stride);
+		jpeg_finish_decompress(&info);
+		jpeg_destroy_decompress(&info);
+		return image;
+	}
+
+	// every scan is read completely before its pass, so the pass after the last scan is only made once,
+	// as the final pass. a missing end of the data reads as the end of the image
+	bool publish = sink.fn != NULL;
+	while (!jpeg_input_complete(&info)) {
+		int status = jpeg_consume_input(&info);
+		if (status == JPEG_SUSPENDED) break;
+		if (status != JPEG_REACHED_SOS || !publish) continue;
+
+		u32 scan = (u32)info.input_scan_number - 1;
+		info.dct_method = JDCT_IFAST;
+		(void)jpeg_start_output(&info, (int)scan);
+		read_output_pass(&info, out, row_stride);
+		(void)jpeg_finish_output(&info);
+		publish = sink.fn(sink.user_data, &image, scan);
+	}
+
+	info.dct_method = JDCT_ISLOW;
+	(void)jpeg_start_output(&info, info.input_scan_number);
+	read_output_pass(&info, out, row_stride);
+	(void)jpeg_finish_output(&info);
+
+	jpeg_finish_decompress(&info);
+	jpeg_destroy_decompress(&info);
+	return image;
+}
+
+DecodedStream dct_decode(Stream *stream) {
+	RawImage image = dct_decode_parallel(stream->slice.ptr, stream->slice.len, DCT_SCALE_FULL, DCT_OUTPUT_NATIVE);
+
+	return (DecodedStream) {
+		.data = (union StreamData){ .image = image },
+			.kind = STREAM_DATA_IMAGE,
+			.raw_stream = *stream,
+	};
+}
+
+const char *dct_scale_to_str(enum DCTScale scale) {
+	switch (scale) {
+	case DCT_SCALE_FULL: return "1/1";
+	case DCT_SCALE_HALF: return "1/2";
+	case DCT_SCALE_QUARTER: return "1/4";
+	case DCT_SCALE_EIGHTH: return "1/8";
+
+	default: PANIC("unknown DCTScale: %u", scale);
+	}
+}
+
+const char *dct_output_to_str(enum DCTOutput output) {
+	switch (output) {
+	case DCT_OUTPUT_NATIVE: return "Native";
+	case DCT_OUTPUT_RGBA: return "RGBA";
+	case DCT_OUTPUT_BGRA: return "BGRA";
+
+	default: PANIC("unknown DCTOutput: %u", output);
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "decompress.h"
+
+// DCTDecode through libjpeg-turbo. the IDCT can scale the image down by 2, 4 or 8 while decoding,
+// which skips most of the work for thumbnails and zoomed out pages
+
+enum DCTScale {
+    DCT_SCALE_FULL,
+    DCT_SCALE_HALF,
+    DCT_SCALE_QUARTER,
+    DCT_SCALE_EIGHTH,
+    DCT_SCALE_COUNT,
+};
+
+// pixel layout requested from the decoder. RGBA and BGRA come straight out of the color conversion,
+// so the image can be uploaded without an expansion pass. CMYK jpegs are always decoded as CMYK
+enum DCTOutput {
+    DCT_OUTPUT_NATIVE, // gray, RGB or CMYK like the jpeg
+    DCT_OUTPUT_RGBA,
+    DCT_OUTPUT_BGRA,
+};
+
+// receives the image after a scan of a progressive jpeg, at the quality of the scans read so far. the image
+// is only valid during the call and is overwritten by the next pass. returns false to skip the remaining
+// intermediate passes, the rest of the jpeg is then decoded in one go
+typedef bool (*DCTScanFn)(void *user_data, const RawImage *image, u32 scan);
+
+typedef struct DCTScanSink {
+    DCTScanFn fn;
+    void *user_data;
+} DCTScanSink;
+
+// smallest decoded image that is split into bands
+#define DCT_PARALLEL_MIN_PIXELS (1u << 20)
+
+// size of the image at full scale
+void dct_read_size(const u8 *data, u64 len, u32 *width, u32 *height);
+// size of the decoded image at a scale, rounded up like libjpeg does
+u32 dct_scaled_size(u32 size, enum DCTScale scale);
+// largest reduction whose output still covers target_width x target_height
+enum DCTScale dct_pick_scale(u32 width, u32 height, u32 target_width, u32 target_height);
+
+// decodes the jpeg into an image from the buffer pool
+RawImage dct_decode_image(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output);
+// like dct_decode_image, but a baseline jpeg with restart markers at MCU row boundaries is split into
+// bands that are decoded on all threads. other jpegs and images below DCT_PARALLEL_MIN_PIXELS are decoded serially
+RawImage dct_decode_parallel(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output);
+// decodes only the part of the jpeg inside region, given in pixels of the scaled image. rows above the
+// region only go through the entropy decoder, rows below it are never read and columns outside of it
+// skip the IDCT and color conversion. the region is clamped to the image, a region outside of it gives an
+// empty image (data NULL, width and height 0)
+RawImage dct_decode_region(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output, ImageRegion region);
+// like dct_decode_parallel, the pixels are written straight into memory from target
+RawImage dct_decode_into(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output, ImageTarget target);
+// like dct_decode_region, the pixels of the region are written straight into memory from target
+RawImage dct_decode_region_into(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output,
+    ImageRegion region, ImageTarget target);
+// decodes the jpeg like dct_decode_image, but a progressive jpeg is output after each of its scans
+// (with the fast IDCT) and passed to the sink, so it can be shown before the last scan is read.
+// the final image is returned and not passed to the sink. baseline jpegs have no intermediate images
+RawImage dct_decode_progressive(const u8 *data, u64 len, enum DCTScale scale, enum DCTOutput output, DCTScanSink sink);
+// decodes the stream data at full scale in its native format, in parallel if possible
+DecodedStream dct_decode(Stream *);
+
+const char *dct_scale_to_str(enum DCTScale scale);
+const char *dct_output_to_str(enum DCTOutput output);
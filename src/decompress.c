@@ -1,10 +1,17 @@
 #include "decompress.h"
+#include "memory.h"
+#include "buffer_pool.h"
+#include "fast_inflate.h"
+#include "predictor.h"
 
 
-#include <jpeglib.h>
 #include <zlib.h>
+#include <string.h>
 
-#define CHUNK 16384
+// smallest output buffer for inflate
+#define INFLATE_MIN_OUT 4096
+// inflated / compressed ratio assumed before anything was learned
+#define INFLATE_DEFAULT_RATIO 4.0
 
 
 const char *zret_to_str(i32 ret) {
@@ -37,56 +44,233 @@ local inline bool is_zerr(i32 ret) {
 	}
 }
 
-DecodedStream inflate_decode(Stream *stream) {
-	i32 ret = Z_ERRNO;
-	u8 *src = stream->slice.ptr;
-	u64 len = stream->slice.len;
+// zlib states are kept per thread and reset between streams instead of calling
+// inflateInit / inflateEnd for every stream. a filter chain can have more than one
+// Flate filter active at the same time, so there is one state per possible filter
+typedef struct InflateContext {
+	z_stream strm;
+	bool initialized;
+	bool in_use;
+} InflateContext;
+
+local thread_local InflateContext inflate_contexts[STREAM_MAX_FILTERS];
+// learned inflated / compressed size ratio
+local thread_local f64 inflate_ratio = INFLATE_DEFAULT_RATIO;
+
+local InflateContext *inflate_context_acquire(void) {
+	InflateContext *ctx = NULL;
+	for (u32 i = 0; i < STREAM_MAX_FILTERS; i++) {
+		if (!inflate_contexts[i].in_use) {
+			ctx = &inflate_contexts[i];
+			break;
+		}
+	}
+	ASSERT_MSG(ctx, "more than %u inflate states in use", STREAM_MAX_FILTERS);
 
-	z_stream strm = { 0 };
-	strm.zalloc = Z_NULL;
-	strm.zfree = Z_NULL;
-	strm.opaque = Z_NULL;
+	i32 ret = Z_OK;
 
-	ret = inflateInit(&strm);
-	if (is_zerr(ret)) goto zerr;
+	if (!ctx->initialized) {
+		ctx->strm = (z_stream){ 0 };
+		ctx->strm.zalloc = Z_NULL;
+		ctx->strm.zfree = Z_NULL;
+		ctx->strm.opaque = Z_NULL;
+		ret = inflateInit(&ctx->strm);
+		ctx->initialized = true;
+	}
+	else {
+		ret = inflateReset(&ctx->strm);
+	}
 
-	strm.next_in = src;
-	strm.total_in = strm.avail_in = len;
+	ASSERT_MSG(!is_zerr(ret), "could not initialize inflate: %s", zret_to_str(ret));
+	ctx->in_use = true;
+	return ctx;
+}
 
-	u64 avail_out = CHUNK;
-	u64 out_len = avail_out;
-	u8 *out = malloc(out_len * sizeof(u8));
-	u8 *next_out = out;
+local void inflate_context_release(InflateContext *ctx) {
+	ctx->in_use = false;
+}
 
-	for (;;) {
-		strm.next_out = next_out;
-		strm.avail_out = avail_out;
+local void inflate_context_learn(u64 in_len, u64 out_len) {
+	if (in_len == 0) return;
+	inflate_ratio = 0.75 * inflate_ratio + 0.25 * ((f64)out_len / (f64)in_len);
+}
 
-		ret = inflate(&strm, Z_NO_FLUSH);
-		if (is_zerr(ret)) goto zerr;
+void inflate_context_free(void) {
+	for (u32 i = 0; i < STREAM_MAX_FILTERS; i++) {
+		InflateContext *ctx = &inflate_contexts[i];
+		if (!ctx->initialized) continue;
 
-		if (strm.avail_out != 0) {
-			out_len += avail_out - strm.avail_out;
-			break;
+		ASSERT_MSG(!ctx->in_use, "inflate state is still in use");
+		inflateEnd(&ctx->strm);
+		*ctx = (InflateContext){ 0 };
+	}
+	inflate_ratio = INFLATE_DEFAULT_RATIO;
+}
+
+// deflate can not expand data by more than ~1032:1
+#define INFLATE_MAX_RATIO 1032
+
+// initial size of the output buffer, exact if the stream has a /DL entry. /DL comes from the file
+// and is clamped to what the compressed data can expand to, the output buffers grow past it if needed
+local u64 estimate_inflated_size(Stream *stream) {
+	DictionaryEntry *e = find_dict_entry(&stream->dict, "DL");
+	if (e && e->object.kind == OBJ_INTEGER && e->object.data.integer.value > 0) {
+		u64 max_len = stream->slice.len * INFLATE_MAX_RATIO + INFLATE_MIN_OUT;
+		return MIN((u64)e->object.data.integer.value, max_len);
+	}
+
+	u64 estimate = (u64)(stream->slice.len * inflate_ratio * 1.125);
+	return MAX(estimate, INFLATE_MIN_OUT);
+}
+
+local enum InflateEngine inflate_engine = INFLATE_ENGINE_FAST;
+
+void set_inflate_engine(enum InflateEngine engine) {
+	inflate_engine = engine;
+}
+
+enum InflateEngine get_inflate_engine(void) {
+	return inflate_engine;
+}
+
+// one-shot decode with the in-tree decoder, the output buffer is grown and the stream
+// decoded again if the estimate was too small. returns false if the stream has to be decoded
+// by zlib (invalid data, which zlib reports)
+local bool fast_inflate_decode(Stream *stream, Buffer *buffer) {
+	u64 len = stream->slice.len;
+	u64 max_out_len = len * INFLATE_MAX_RATIO + INFLATE_MIN_OUT;
+
+	if (len >= FAST_INFLATE_PARALLEL_MIN_SIZE) {
+		u8 *out = NULL;
+		u64 out_len = 0;
+		if (fast_zlib_inflate_parallel(stream->slice.ptr, len, &out, &out_len) == FAST_INFLATE_SUCCESS) {
+			inflate_context_learn(len, out_len);
+			*buffer = (Buffer){ .data = out, .size = out_len };
+			return true;
 		}
+	}
+
+	u8 *out = buffer_pool_acquire(estimate_inflated_size(stream));
+	for (;;) {
+		u64 out_len = 0;
+		enum FastInflateResult result = fast_zlib_inflate(stream->slice.ptr, len, out, mem_size(out), &out_len);
 
+		if (result == FAST_INFLATE_SUCCESS) {
+			inflate_context_learn(len, out_len);
+			*buffer = (Buffer){ .data = out, .size = out_len };
+			return true;
+		}
 
+		if (result == FAST_INFLATE_BAD_DATA || mem_size(out) >= max_out_len) break;
 
-		u64 prev_len = out_len;
-		u64 add_size = out_len;
+		u64 capacity = 4 * mem_size(out);
+		buffer_pool_release(out);
+		out = buffer_pool_acquire(capacity);
+	}
 
-		out_len += add_size;
-		out = realloc(out, out_len * sizeof(u8));
+	buffer_pool_release(out);
+	return false;
+}
 
-		next_out = out + prev_len;
-		avail_out = add_size;
+local bool buffer_sink_write(void *user_data, const u8 *data, u64 len) {
+	BufferSink *buffer = user_data;
+
+	if (!buffer->data || buffer->size + len > mem_size(buffer->data)) {
+		u64 capacity = MAX(2 * (buffer->size + len), INFLATE_MIN_OUT);
+		buffer->data = buffer_pool_grow(buffer->data, buffer->size, capacity);
 	}
 
-	ASSERT_MSG(ret == Z_STREAM_END, "deflate did not reach the end of the stream: %s", zret_to_str(ret));
+	memcpy(buffer->data + buffer->size, data, len);
+	buffer->size += len;
+	return true;
+}
+
+DecodeSink buffer_sink(BufferSink *buffer) {
+	return (DecodeSink){ .fn = buffer_sink_write, .user_data = buffer };
+}
+
+u8 *image_target_alloc(ImageTarget target, const RawImage *layout) {
+	u64 size = (u64)layout->width * layout->height * layout->n_channels;
+	if (!target.fn) return buffer_pool_acquire(size);
+
+	// a full target does not fail the decode, the image goes to the buffer pool instead
+	u8 *data = target.fn(target.user_data, layout, size);
+	return data ? data : buffer_pool_acquire(size);
+}
+
+// streams the inflated windows through the predictor, so every row is unfiltered
+// right after it was inflated instead of in a second pass over the whole buffer
+local DecodedStream inflate_predict_decode(Stream *stream, PredictorParams params) {
+	BufferSink out = { .data = buffer_pool_acquire(estimate_inflated_size(stream)) };
+
+	Predictor predictor;
+	predictor_init(&predictor, params, buffer_sink(&out));
+	(void)inflate_stream(stream, predictor_sink(&predictor), NULL);
+	(void)predictor_finish(&predictor);
+	predictor_free(&predictor);
+
+	Buffer buffer = {
+		.data = out.data,
+		.size = out.size,
+	};
+
+	return (DecodedStream) {
+		.data = (union StreamData){ .buffer = buffer },
+			.kind = STREAM_DATA_BUFFER,
+			.raw_stream = *stream,
+	};
+}
+
+DecodedStream inflate_decode(Stream *stream) {
+	// the /DecodeParms of the Flate filter, picked out of an array by parse_stream_filters
+	const Dictionary *parms = arrlen(stream->filters) > 0 ? stream->filters[0].parms : NULL;
+	PredictorParams params = predictor_params_from_dict(parms);
+	if (params.predictor != PREDICTOR_NONE) return inflate_predict_decode(stream, params);
+
+	Buffer fast_buffer = { 0 };
+	if (inflate_engine == INFLATE_ENGINE_FAST && fast_inflate_decode(stream, &fast_buffer)) {
+		return (DecodedStream) {
+			.data = (union StreamData){ .buffer = fast_buffer },
+				.kind = STREAM_DATA_BUFFER,
+				.raw_stream = *stream,
+		};
+	}
+
+	i32 ret = Z_ERRNO;
+	u8 *src = stream->slice.ptr;
+	u64 len = stream->slice.len;
+
+	u64 out_len = 0;
+	u8 *out = buffer_pool_acquire(estimate_inflated_size(stream));
+
+	InflateContext *ctx = inflate_context_acquire();
+	z_stream *strm = &ctx->strm;
+	strm->next_in = src;
+	strm->avail_in = (uInt)len;
+
+	for (;;) {
+		u64 avail_out = MIN(mem_size(out) - out_len, U32_MAX);
+		strm->next_out = out + out_len;
+		strm->avail_out = (uInt)avail_out;
+
+		ret = inflate(strm, Z_NO_FLUSH);
+		out_len += avail_out - strm->avail_out;
+
+		if (ret == Z_STREAM_END) break;
+		if (is_zerr(ret)) goto zerr;
 
-	ret = inflateEnd(&strm);
-	ASSERT(!is_zerr(ret));
+		if (strm->avail_out == 0) {
+			out = buffer_pool_grow(out, out_len, 2 * mem_size(out));
+		}
+		else if (strm->avail_in == 0) {
+			// truncated stream
+			break;
+		}
+	}
 
+	ASSERT_MSG(ret == Z_STREAM_END, "deflate did not reach the end of the stream: %s", zret_to_str(ret));
+	inflate_context_release(ctx);
+	inflate_context_learn(len, out_len);
 
 	Buffer buffer = {
 		.data = out,
@@ -103,51 +287,84 @@ zerr:
 	PANIC("ZERROR: %s", zret_to_str(ret));
 }
 
+void inflater_init(Inflater *inflater, DecodeSink next) {
+	ASSERT_NOT_NULL(next.fn);
+
+	*inflater = (Inflater){
+		.ctx = inflate_context_acquire(),
+		// the window is pooled, so streaming does not allocate after warm up
+		.window = buffer_pool_acquire(INFLATE_WINDOW),
+		.next = next,
+	};
+}
+
+void inflater_free(Inflater *inflater) {
+	inflate_context_release(inflater->ctx);
+	buffer_pool_release(inflater->window);
+	*inflater = (Inflater){ 0 };
+}
+
+local bool inflater_write(void *user_data, const u8 *data, u64 len) {
+	Inflater *inflater = user_data;
+	// anything after the end of the deflate stream is ignored
+	if (inflater->ended) return true;
+
+	z_stream *strm = &inflater->ctx->strm;
+	inflater->in_len += len;
 
-DecodedStream dct_decode(Stream *stream) {
-	u32 width = 0;
-	u32 height = 0;
-	u64 size = 0;
-	u32 n_channels = 0;
-	u8 *data = NULL;
+	while (len != 0) {
+		// avail_in is only 32 bit
+		uInt chunk_len = (uInt)MIN(len, U32_MAX);
+		strm->next_in = (u8 *)data;
+		strm->avail_in = chunk_len;
+		data += chunk_len;
+		len -= chunk_len;
 
-	struct jpeg_decompress_struct info;
-	struct jpeg_error_mgr err;
+		for (;;) {
+			strm->next_out = inflater->window;
+			strm->avail_out = INFLATE_WINDOW;
 
-	info.err = jpeg_std_error(&err);
-	jpeg_create_decompress(&info);
+			i32 ret = inflate(strm, Z_NO_FLUSH);
+			// no progress possible, the next chunk is needed
+			if (ret == Z_BUF_ERROR && strm->avail_in == 0) break;
+			if (is_zerr(ret)) PANIC("ZERROR: %s", zret_to_str(ret));
 
-	jpeg_mem_src(&info, stream->slice.ptr, stream->slice.len);
-	(void)jpeg_read_header(&info, true);
-	(void)jpeg_start_decompress(&info);
+			u64 out_len = INFLATE_WINDOW - strm->avail_out;
+			inflater->out_len += out_len;
 
-	width = info.output_width;
-	height = info.output_height;
-	n_channels = info.num_components;
+			if (out_len != 0 && !inflater->next.fn(inflater->next.user_data, inflater->window, out_len)) {
+				return false;
+			}
 
-	size = (u64)width * height * n_channels;
-	u32 row_stride = width * n_channels;
-	data = malloc(size * sizeof(u8));
+			if (ret == Z_STREAM_END) {
+				inflater->ended = true;
+				return true;
+			}
 
-	u8 *out_scanlines_ptr[1] = { 0 }; // for now only 1 scanline at the time
-	while (info.output_scanline < info.output_height) {
-		out_scanlines_ptr[0] = &data[row_stride * info.output_scanline];
-		(void)jpeg_read_scanlines(&info, out_scanlines_ptr, 1);
+			if (strm->avail_in == 0 && strm->avail_out != 0) break;
+		}
 	}
 
-	jpeg_finish_decompress(&info);
-	jpeg_destroy_decompress(&info);
+	return true;
+}
 
-	RawImage image = {
-		.data = data,
-		.width = width,
-		.height = height,
-		.n_channels = n_channels,
-	};
+DecodeSink inflater_sink(Inflater *inflater) {
+	return (DecodeSink){ .fn = inflater_write, .user_data = inflater };
+}
 
-	return (DecodedStream) {
-		.data = (union StreamData){ .image = image },
-			.kind = STREAM_DATA_IMAGE,
-			.raw_stream = *stream,
-	};
+void inflater_finish(Inflater *inflater) {
+	ASSERT_MSG(inflater->ended, "deflate did not reach the end of the stream");
+	inflate_context_learn(inflater->in_len, inflater->out_len);
+}
+
+bool inflate_stream(Stream *stream, DecodeSink sink, u64 *out_len) {
+	Inflater inflater;
+	inflater_init(&inflater, sink);
+
+	bool completed = inflater_write(&inflater, stream->slice.ptr, stream->slice.len);
+	if (completed) inflater_finish(&inflater);
+
+	if (out_len) *out_len = inflater.out_len;
+	inflater_free(&inflater);
+	return completed;
 }
@@ -2,6 +2,74 @@
 
 #include "pdf_objects.h"
 
+// size of the chunks handed to a DecodeSink by the streaming decoders
+#define INFLATE_WINDOW (64 * 1024)
 
+// consumer of streamed decoder output, returns false to stop decoding
+typedef bool (*DecodeSinkFn)(void *user_data, const u8 *data, u64 len);
+
+typedef struct DecodeSink {
+    DecodeSinkFn fn;
+    void *user_data;
+} DecodeSink;
+
+// sink that appends everything to a buffer from the buffer pool, data can be preallocated
+typedef struct BufferSink {
+    u8 *data;
+    u64 size;
+} BufferSink;
+
+DecodeSink buffer_sink(BufferSink *buffer);
+
+// memory an image decoder writes its pixels into. fn receives the layout of the image (data is NULL) and
+// returns size bytes for its packed rows, which then belong to the caller. every pixel is written once
+// and never read back, so write combined memory like a mapped staging buffer is fine.
+// fn returns NULL when it has no room for the image, which is then allocated from the buffer pool:
+// the caller tells the two apart by the pointer and releases pool memory with buffer_pool_release.
+// a target without fn allocates from the buffer pool
+typedef u8 *(*ImageTargetFn)(void *user_data, const RawImage *layout, u64 size);
+
+typedef struct ImageTarget {
+    ImageTargetFn fn;
+    void *user_data;
+} ImageTarget;
+
+// memory for the pixels of layout from the target, or from the buffer pool if the target is full
+u8 *image_target_alloc(ImageTarget target, const RawImage *layout);
+
+
+enum InflateEngine {
+    INFLATE_ENGINE_ZLIB,
+    INFLATE_ENGINE_FAST, // in-tree one-shot decoder (fast_inflate.h), falls back to zlib on errors
+};
+
+// selects the decoder used by inflate_decode, INFLATE_ENGINE_FAST by default
+void set_inflate_engine(enum InflateEngine engine);
+enum InflateEngine get_inflate_engine(void);
+
+// undoes the /DecodeParms predictor of the stream while inflating
 DecodedStream inflate_decode(Stream *);
-DecodedStream dct_decode(Stream *);
+// inflates the stream in windows of INFLATE_WINDOW bytes and passes each of them to sink,
+// memory use is bounded by the window size. returns false if the sink stopped decoding early.
+// out_len (optional) receives the number of inflated bytes
+bool inflate_stream(Stream *stream, DecodeSink sink, u64 *out_len);
+
+// push style inflate for filter chains, compressed data is written into the sink in chunks
+// of any size and every inflated window is passed on to next
+typedef struct Inflater {
+    struct InflateContext *ctx;
+    u8 *window;
+    DecodeSink next;
+    u64 in_len;
+    u64 out_len;
+    bool ended; // reached the end of the deflate stream
+} Inflater;
+
+void inflater_init(Inflater *inflater, DecodeSink next);
+DecodeSink inflater_sink(Inflater *inflater);
+// panics if the deflate stream is truncated
+void inflater_finish(Inflater *inflater);
+void inflater_free(Inflater *inflater);
+
+// releases the inflate states of the calling thread
+void inflate_context_free(void);
@@ -0,0 +1,1180 @@
+#include "fast_inflate.h"
+#include "buffer_pool.h"
+#include "memory.h"
+#include "threads.h"
+
+#include <string.h>
+#include <zlib.h>
+
+// Decode table entries (u32):
+//   bits  0..4   number of bits to consume
+//   bits  5..9   extra bits of a length/distance, bits of a subtable,
+//                or the length of the first code of a two literal entry
+//   bits 10..15  flags
+//   bits 16..31  literal (two literals: 16..23 and 24..31), length/distance base or subtable start
+
+#define ENTRY_LITERAL  (1u << 10)
+#define ENTRY_LITERAL2 (1u << 11) // two literals decoded with a single lookup
+#define ENTRY_SUBTABLE (1u << 12)
+#define ENTRY_EOB      (1u << 13)
+#define ENTRY_INVALID  (1u << 14)
+
+#define ENTRY(len, extra, flags, value) \
+	((u32)(len) | ((u32)(extra) << 5) | (u32)(flags) | ((u32)(value) << 16))
+
+#define ENTRY_LEN(e)   ((e) & 0x1f)
+#define ENTRY_EXTRA(e) (((e) >> 5) & 0x1f)
+#define ENTRY_VALUE(e) ((e) >> 16)
+
+#define MAX_CODE_LEN 15
+
+#define LITLEN_SYMS 288
+#define DIST_SYMS 32
+#define PRECODE_SYMS 19
+
+#define LITLEN_TABLEBITS 11
+#define DIST_TABLEBITS 8
+#define PRECODE_TABLEBITS 7
+
+// upper bound of main table + subtables (computed with zlib's enough tool)
+#define LITLEN_ENOUGH 2342
+#define DIST_ENOUGH 402
+#define PRECODE_ENOUGH (1 << PRECODE_TABLEBITS)
+
+local const u16 length_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+
+local const u8 length_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+
+local const u16 dist_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+
+local const u8 dist_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+local const u8 precode_order[PRECODE_SYMS] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+typedef struct DecodeTables {
+	u32 litlen[LITLEN_ENOUGH];
+	u32 dist[DIST_ENOUGH];
+} DecodeTables;
+
+typedef u32 (*SymbolEntryFn)(u32 symbol, u32 len);
+
+local u32 litlen_symbol_entry(u32 sym, u32 len) {
+	if (sym < 256) return ENTRY(len, 0, ENTRY_LITERAL, sym);
+	if (sym == 256) return ENTRY(len, 0, ENTRY_EOB, 0);
+	if (sym < 286) return ENTRY(len, length_extra[sym - 257], 0, length_base[sym - 257]);
+	return ENTRY(len, 0, ENTRY_INVALID, 0);
+}
+
+local u32 dist_symbol_entry(u32 sym, u32 len) {
+	if (sym < 30) return ENTRY(len, dist_extra[sym], 0, dist_base[sym]);
+	return ENTRY(len, 0, ENTRY_INVALID, 0);
+}
+
+local u32 precode_symbol_entry(u32 sym, u32 len) {
+	return ENTRY(len, 0, 0, sym);
+}
+
+local inline u32 reverse_bits(u32 code, u32 len) {
+	u32 res = 0;
+	for (u32 i = 0; i < len; i++) {
+		res = (res << 1) | (code & 1);
+		code >>= 1;
+	}
+	return res;
+}
+
+// builds a canonical huffman decode table with subtables for codes longer than table_bits.
+// returns false for over-subscribed or (except for a single code) incomplete codes
+local bool build_decode_table(u32 *table, u32 table_size, const u8 *lens, u32 n_syms,
+	u32 table_bits, SymbolEntryFn symbol_entry)
+{
+	u32 count[MAX_CODE_LEN + 1] = { 0 };
+	for (u32 i = 0; i < n_syms; i++) count[lens[i]] += 1;
+	count[0] = 0;
+
+	u32 max_len = 0;
+	i32 left = 1;
+	for (u32 len = 1; len <= MAX_CODE_LEN; len++) {
+		left = (left << 1) - (i32)count[len];
+		if (left < 0) return false; // over-subscribed
+		if (count[len]) max_len = len;
+	}
+	// incomplete codes are only allowed for a single code of length 1 (as in zlib)
+	if (left > 0 && max_len > 1) return false;
+
+	u32 main_size = 1u << table_bits;
+	u32 invalid = ENTRY(1, 0, ENTRY_INVALID, 0);
+	for (u32 i = 0; i < main_size; i++) table[i] = invalid;
+	if (max_len == 0) return true;
+
+	// first canonical code of every length
+	u32 next_code[MAX_CODE_LEN + 2] = { 0 };
+	u32 code = 0;
+	for (u32 len = 1; len <= MAX_CODE_LEN; len++) {
+		code = (code + count[len - 1]) << 1;
+		next_code[len] = code;
+	}
+
+	// codes in canonical order: sorted by length, then by symbol
+	u16 sorted[LITLEN_SYMS];
+	u32 offsets[MAX_CODE_LEN + 2] = { 0 };
+	for (u32 len = 1; len <= MAX_CODE_LEN; len++) offsets[len + 1] = offsets[len] + count[len];
+	for (u32 sym = 0; sym < n_syms; sym++) {
+		if (lens[sym]) sorted[offsets[lens[sym]]++] = (u16)sym;
+	}
+	u32 n_codes = offsets[MAX_CODE_LEN];
+
+	// longest code per main table slot, to size the subtables
+	u8 sub_len[1 << LITLEN_TABLEBITS];
+	if (max_len > table_bits) memset(sub_len, 0, main_size);
+
+	u32 canonical[LITLEN_SYMS];
+	for (u32 i = 0; i < n_codes; i++) {
+		u32 sym = sorted[i];
+		u32 len = lens[sym];
+		canonical[i] = reverse_bits(next_code[len]++, len);
+
+		if (len > table_bits) {
+			u32 slot = canonical[i] & (main_size - 1);
+			sub_len[slot] = (u8)MAX(sub_len[slot], len - table_bits);
+		}
+	}
+
+	u32 next_subtable = main_size;
+	for (u32 i = 0; i < n_codes; i++) {
+		u32 sym = sorted[i];
+		u32 len = lens[sym];
+		u32 rev = canonical[i];
+
+		if (len <= table_bits) {
+			u32 entry = symbol_entry(sym, len);
+			for (u32 j = rev; j < main_size; j += 1u << len) table[j] = entry;
+			continue;
+		}
+
+		u32 slot = rev & (main_size - 1);
+		u32 sub_bits = sub_len[slot];
+
+		if (!(table[slot] & ENTRY_SUBTABLE)) {
+			u32 sub_size = 1u << sub_bits;
+			if (next_subtable + sub_size > table_size) return false;
+			for (u32 j = 0; j < sub_size; j++) table[next_subtable + j] = invalid;
+			table[slot] = ENTRY(table_bits, sub_bits, ENTRY_SUBTABLE, next_subtable);
+			next_subtable += sub_size;
+		}
+
+		u32 start = ENTRY_VALUE(table[slot]);
+		u32 sub_code = rev >> table_bits;
+		u32 sub_code_len = len - table_bits;
+		u32 entry = symbol_entry(sym, sub_code_len);
+		for (u32 j = sub_code; j < (1u << sub_bits); j += 1u << sub_code_len) table[start + j] = entry;
+	}
+
+	return true;
+}
+
+// merges pairs of short literal codes into single entries, so two literals are decoded per lookup.
+// iterates backwards because entry i reads the (not yet merged) entry i >> len
+local void merge_literal_pairs(u32 *table) {
+	for (i32 i = (1 << LITLEN_TABLEBITS) - 1; i >= 0; i--) {
+		u32 first = table[i];
+		if ((first & (ENTRY_LITERAL | ENTRY_SUBTABLE)) != ENTRY_LITERAL) continue;
+
+		u32 len1 = ENTRY_LEN(first);
+		if (len1 >= LITLEN_TABLEBITS) continue;
+
+		u32 second = table[(u32)i >> len1];
+		if ((second & (ENTRY_LITERAL | ENTRY_LITERAL2 | ENTRY_SUBTABLE)) != ENTRY_LITERAL) continue;
+
+		u32 len2 = ENTRY_LEN(second);
+		if (len1 + len2 > LITLEN_TABLEBITS) continue;
+
+		u32 value = ENTRY_VALUE(first) | (ENTRY_VALUE(second) << 8);
+		table[i] = ENTRY(len1 + len2, len1, ENTRY_LITERAL | ENTRY_LITERAL2, value);
+	}
+}
+
+typedef struct FixedTables {
+	DecodeTables tables;
+	bool initialized;
+} FixedTables;
+
+local thread_local FixedTables fixed_tables;
+
+local const DecodeTables *get_fixed_tables(void) {
+	if (fixed_tables.initialized) return &fixed_tables.tables;
+
+	u8 lens[LITLEN_SYMS + DIST_SYMS];
+	u32 i = 0;
+	for (; i < 144; i++) lens[i] = 8;
+	for (; i < 256; i++) lens[i] = 9;
+	for (; i < 280; i++) lens[i] = 7;
+	for (; i < 288; i++) lens[i] = 8;
+	for (; i < LITLEN_SYMS + DIST_SYMS; i++) lens[i] = 5;
+
+	DecodeTables *t = &fixed_tables.tables;
+	ASSERT(build_decode_table(t->litlen, LITLEN_ENOUGH, lens, LITLEN_SYMS, LITLEN_TABLEBITS, litlen_symbol_entry));
+	ASSERT(build_decode_table(t->dist, DIST_ENOUGH, lens + LITLEN_SYMS, DIST_SYMS, DIST_TABLEBITS, dist_symbol_entry));
+	merge_literal_pairs(t->litlen);
+
+	fixed_tables.initialized = true;
+	return t;
+}
+
+
+/// BIT READER ///
+
+typedef struct BitReader {
+	const u8 *next;
+	const u8 *end;
+	u64 bitbuf;
+	u32 bitsleft;
+	u32 overread; // zero bytes fed in after the end of the input
+} BitReader;
+
+local inline u64 load_u64_le(const u8 *p) {
+	u64 v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+// fills the bit buffer to at least 56 bits. bits above bitsleft may already hold
+// the following input, the next refill ors in exactly the same bits
+local inline bool refill(BitReader *br) {
+	if (br->bitsleft > 56) return true;
+
+	if (br->end - br->next >= 8) {
+		br->bitbuf |= load_u64_le(br->next) << br->bitsleft;
+		u32 n_bytes = (63 - br->bitsleft) >> 3;
+		br->next += n_bytes;
+		br->bitsleft += n_bytes << 3;
+		return true;
+	}
+
+	while (br->bitsleft <= 56) {
+		if (br->next < br->end) {
+			br->bitbuf |= (u64)*br->next++ << br->bitsleft;
+		}
+		else {
+			// allows lookups on the last bits, consuming them is checked by bits_overread
+			if (br->overread >= sizeof(u64)) return false;
+			br->overread += 1;
+		}
+		br->bitsleft += 8;
+	}
+	return true;
+}
+
+local inline u64 peek_bits(BitReader *br, u32 n) {
+	return br->bitbuf & ((1ull << n) - 1);
+}
+
+local inline void consume_bits(BitReader *br, u32 n) {
+	br->bitbuf >>= n;
+	br->bitsleft -= n;
+}
+
+local inline u64 pop_bits(BitReader *br, u32 n) {
+	u64 bits = peek_bits(br, n);
+	consume_bits(br, n);
+	return bits;
+}
+
+// true if bits past the end of the input were consumed
+local inline bool bits_overread(BitReader *br) {
+	return br->overread * 8 > br->bitsleft;
+}
+
+// drops the bits of the current byte and rewinds next to the first unread input byte
+local inline bool align_to_byte(BitReader *br) {
+	consume_bits(br, br->bitsleft & 7);
+	u32 buffered = br->bitsleft >> 3;
+	if (buffered < br->overread) return false;
+
+	br->next -= buffered - br->overread;
+	br->bitbuf = 0;
+	br->bitsleft = 0;
+	br->overread = 0;
+	return true;
+}
+
+local inline u32 lookup(const u32 *table, u32 table_bits, BitReader *br) {
+	u32 entry = table[peek_bits(br, table_bits)];
+	if (entry & ENTRY_SUBTABLE) {
+		consume_bits(br, table_bits);
+		entry = table[ENTRY_VALUE(entry) + peek_bits(br, ENTRY_EXTRA(entry))];
+	}
+	return entry;
+}
+
+
+/// BLOCKS ///
+
+local bool read_dynamic_tables(BitReader *br, DecodeTables *t) {
+	if (!refill(br)) return false;
+
+	u32 n_litlen = (u32)pop_bits(br, 5) + 257;
+	u32 n_dist = (u32)pop_bits(br, 5) + 1;
+	u32 n_precode = (u32)pop_bits(br, 4) + 4;
+	if (n_litlen > 286 || n_dist > 30) return false;
+
+	u8 precode_lens[PRECODE_SYMS] = { 0 };
+	for (u32 i = 0; i < n_precode; i++) {
+		if (!refill(br)) return false;
+		precode_lens[precode_order[i]] = (u8)pop_bits(br, 3);
+	}
+
+	u32 precode[PRECODE_ENOUGH];
+	if (!build_decode_table(precode, PRECODE_ENOUGH, precode_lens, PRECODE_SYMS,
+		PRECODE_TABLEBITS, precode_symbol_entry)) return false;
+
+	u8 lens[LITLEN_SYMS + DIST_SYMS] = { 0 };
+	u32 n_lens = n_litlen + n_dist;
+	u32 i = 0;
+	while (i < n_lens) {
+		if (!refill(br)) return false;
+
+		u32 entry = precode[peek_bits(br, PRECODE_TABLEBITS)];
+		if (entry & ENTRY_INVALID) return false;
+		consume_bits(br, ENTRY_LEN(entry));
+
+		u32 sym = ENTRY_VALUE(entry);
+		if (sym < 16) {
+			lens[i++] = (u8)sym;
+			continue;
+		}
+
+		u8 value = 0;
+		u32 repeat = 0;
+		if (sym == 16) {
+			if (i == 0) return false;
+			value = lens[i - 1];
+			repeat = 3 + (u32)pop_bits(br, 2);
+		}
+		else if (sym == 17) {
+			repeat = 3 + (u32)pop_bits(br, 3);
+		}
+		else {
+			repeat = 11 + (u32)pop_bits(br, 7);
+		}
+
+		if (i + repeat > n_lens) return false;
+		memset(lens + i, value, repeat);
+		i += repeat;
+	}
+	if (bits_overread(br)) return false;
+
+	// the end of block code is required
+	if (lens[256] == 0) return false;
+
+	if (!build_decode_table(t->litlen, LITLEN_ENOUGH, lens, n_litlen, LITLEN_TABLEBITS, litlen_symbol_entry)) return false;
+	if (!build_decode_table(t->dist, DIST_ENOUGH, lens + n_litlen, n_dist, DIST_TABLEBITS, dist_symbol_entry)) return false;
+	merge_literal_pairs(t->litlen);
+
+	return true;
+}
+
+local enum FastInflateResult inflate_stored_block(BitReader *br, u8 **out_next, u8 *out_end) {
+	if (!align_to_byte(br)) return FAST_INFLATE_BAD_DATA;
+	if (br->end - br->next < 4) return FAST_INFLATE_BAD_DATA;
+
+	u32 len = br->next[0] | (br->next[1] << 8);
+	u32 nlen = br->next[2] | (br->next[3] << 8);
+	br->next += 4;
+
+	if (len != (~nlen & 0xffff)) return FAST_INFLATE_BAD_DATA;
+	if ((u64)(br->end - br->next) < len) return FAST_INFLATE_BAD_DATA;
+	if ((u64)(out_end - *out_next) < len) return FAST_INFLATE_SHORT_OUTPUT;
+
+	memcpy(*out_next, br->next, len);
+	*out_next += len;
+	br->next += len;
+
+	return FAST_INFLATE_SUCCESS;
+}
+
+// fast loop bounds: input for two unchecked refills, output for two literals and
+// the longest match including the word copy overshoot
+#define FASTLOOP_MIN_IN 16
+#define FASTLOOP_MIN_OUT (2 + 258 + 2 * 8)
+
+// unchecked refill, requires at least 8 bytes of input
+local inline void refill_fast(BitReader *br) {
+	br->bitbuf |= load_u64_le(br->next) << br->bitsleft;
+	u32 n_bytes = (63 - br->bitsleft) >> 3;
+	br->next += n_bytes;
+	br->bitsleft += n_bytes << 3;
+}
+
+// copies a match word at a time, requires 8 bytes of slack after the match
+local inline void copy_match_fast(u8 *out, u32 dist, u32 len) {
+	const u8 *src = out - dist;
+	u8 *end = out + len;
+	u64 word;
+
+	if (dist >= 8) {
+		do {
+			memcpy(&word, src, 8);
+			memcpy(out, &word, 8);
+			src += 8;
+			out += 8;
+		} while (out < end);
+	}
+	else if (dist == 1) {
+		word = 0x0101010101010101ull * *src;
+		do {
+			memcpy(out, &word, 8);
+			out += 8;
+		} while (out < end);
+	}
+	else {
+		// every store writes dist correct bytes, the rest is overwritten by the next store
+		do {
+			memcpy(&word, src, 8);
+			memcpy(out, &word, 8);
+			src += dist;
+			out += dist;
+		} while (out < end);
+	}
+}
+
+// copies a match of len bytes from dist bytes back
+local inline void copy_match(u8 *out, u8 *out_end, u32 dist, u32 len) {
+	const u8 *src = out - dist;
+
+	// word at a time, may write up to 7 bytes past the match
+	if (dist >= 8 && (u64)(out_end - out) >= (u64)len + 8) {
+		u8 *end = out + len;
+		do {
+			u64 word;
+			memcpy(&word, src, 8);
+			memcpy(out, &word, 8);
+			src += 8;
+			out += 8;
+		} while (out < end);
+		return;
+	}
+
+	if (dist == 1) {
+		memset(out, *src, len);
+		return;
+	}
+
+	for (u32 i = 0; i < len; i++) out[i] = src[i];
+}
+
+local enum FastInflateResult inflate_huffman_block(BitReader *br, const DecodeTables *t,
+	u8 *out_start, u8 **out_next, u8 *out_end)
+{
+	u8 *out = *out_next;
+	enum FastInflateResult result = FAST_INFLATE_BAD_DATA;
+
+	// fast loop without bounds checks while there is enough input and output left
+	while (br->end - br->next >= FASTLOOP_MIN_IN && out_end - out >= FASTLOOP_MIN_OUT) {
+		refill_fast(br);
+		u32 entry = lookup(t->litlen, LITLEN_TABLEBITS, br);
+
+		if (entry & ENTRY_LITERAL) {
+			consume_bits(br, ENTRY_LEN(entry));
+			out[0] = (u8)ENTRY_VALUE(entry);
+			out[1] = (u8)(ENTRY_VALUE(entry) >> 8);
+			out += (entry & ENTRY_LITERAL2) ? 2 : 1;
+
+			// at least 41 bits are left, enough for another literal
+			entry = lookup(t->litlen, LITLEN_TABLEBITS, br);
+			if (entry & ENTRY_LITERAL) {
+				consume_bits(br, ENTRY_LEN(entry));
+				out[0] = (u8)ENTRY_VALUE(entry);
+				out[1] = (u8)(ENTRY_VALUE(entry) >> 8);
+				out += (entry & ENTRY_LITERAL2) ? 2 : 1;
+				continue;
+			}
+			refill_fast(br);
+		}
+
+		if (entry & (ENTRY_INVALID | ENTRY_EOB)) {
+			if (entry & ENTRY_INVALID) goto done;
+			consume_bits(br, ENTRY_LEN(entry));
+			result = FAST_INFLATE_SUCCESS;
+			goto done;
+		}
+
+		consume_bits(br, ENTRY_LEN(entry));
+		u32 len = ENTRY_VALUE(entry) + (u32)pop_bits(br, ENTRY_EXTRA(entry));
+
+		u32 dist_entry = lookup(t->dist, DIST_TABLEBITS, br);
+		if (dist_entry & ENTRY_INVALID) goto done;
+		consume_bits(br, ENTRY_LEN(dist_entry));
+		u32 dist = ENTRY_VALUE(dist_entry) + (u32)pop_bits(br, ENTRY_EXTRA(dist_entry));
+
+		if (dist > (u64)(out - out_start)) goto done;
+		copy_match_fast(out, dist, len);
+		out += len;
+	}
+
+	// careful loop for the end of the input and output
+	for (;;) {
+		if (!refill(br)) goto done;
+
+		// at least 56 bits are available here, enough for a full length/distance pair
+		u32 entry = lookup(t->litlen, LITLEN_TABLEBITS, br);
+
+		if (entry & ENTRY_LITERAL) {
+			if (entry & ENTRY_LITERAL2) {
+				if (out_end - out >= 2) {
+					consume_bits(br, ENTRY_LEN(entry));
+					out[0] = (u8)ENTRY_VALUE(entry);
+					out[1] = (u8)(ENTRY_VALUE(entry) >> 8);
+					out += 2;
+					continue;
+				}
+				// no room for both, only take the first literal
+				consume_bits(br, ENTRY_EXTRA(entry));
+			}
+			else {
+				consume_bits(br, ENTRY_LEN(entry));
+			}
+
+			if (out == out_end) {
+				result = FAST_INFLATE_SHORT_OUTPUT;
+				goto done;
+			}
+			*out++ = (u8)ENTRY_VALUE(entry);
+			continue;
+		}
+
+		if (entry & ENTRY_INVALID) goto done;
+		consume_bits(br, ENTRY_LEN(entry));
+
+		if (entry & ENTRY_EOB) {
+			if (bits_overread(br)) goto done;
+			result = FAST_INFLATE_SUCCESS;
+			goto done;
+		}
+
+		u32 len = ENTRY_VALUE(entry) + (u32)pop_bits(br, ENTRY_EXTRA(entry));
+
+		u32 dist_entry = lookup(t->dist, DIST_TABLEBITS, br);
+		if (dist_entry & ENTRY_INVALID) goto done;
+		consume_bits(br, ENTRY_LEN(dist_entry));
+		u32 dist = ENTRY_VALUE(dist_entry) + (u32)pop_bits(br, ENTRY_EXTRA(dist_entry));
+
+		if (bits_overread(br)) goto done;
+		if (dist > (u64)(out - out_start)) goto done;
+		if (len > (u64)(out_end - out)) {
+			result = FAST_INFLATE_SHORT_OUTPUT;
+			goto done;
+		}
+
+		copy_match(out, out_end, dist, len);
+		out += len;
+	}
+
+done:
+	*out_next = out;
+	return result;
+}
+
+enum FastInflateResult fast_inflate(const u8 *in, u64 in_len, u8 *out, u64 out_cap, u64 *out_len, u64 *in_used) {
+	BitReader br = {
+		.next = in,
+		.end = in + in_len,
+	};
+
+	u8 *out_next = out;
+	u8 *out_end = out + out_cap;
+
+	DecodeTables dynamic_tables;
+	enum FastInflateResult result = FAST_INFLATE_SUCCESS;
+	bool final_block = false;
+
+	while (!final_block) {
+		if (!refill(&br)) return FAST_INFLATE_BAD_DATA;
+
+		final_block = pop_bits(&br, 1);
+		u32 block_type = (u32)pop_bits(&br, 2);
+		if (bits_overread(&br)) return FAST_INFLATE_BAD_DATA;
+
+		switch (block_type) {
+		case 0:
+			result = inflate_stored_block(&br, &out_next, out_end);
+			break;
+		case 1:
+			result = inflate_huffman_block(&br, get_fixed_tables(), out, &out_next, out_end);
+			break;
+		case 2:
+			if (!read_dynamic_tables(&br, &dynamic_tables)) return FAST_INFLATE_BAD_DATA;
+			result = inflate_huffman_block(&br, &dynamic_tables, out, &out_next, out_end);
+			break;
+		default:
+			return FAST_INFLATE_BAD_DATA;
+		}
+
+		if (result != FAST_INFLATE_SUCCESS) return result;
+	}
+
+	if (!align_to_byte(&br)) return FAST_INFLATE_BAD_DATA;
+
+	*out_len = (u64)(out_next - out);
+	if (in_used) *in_used = (u64)(br.next - in);
+	return FAST_INFLATE_SUCCESS;
+}
+
+enum FastInflateResult fast_zlib_inflate(const u8 *in, u64 in_len, u8 *out, u64 out_cap, u64 *out_len) {
+	if (in_len < 2 + 4) return FAST_INFLATE_BAD_DATA;
+
+	u8 cmf = in[0];
+	u8 flg = in[1];
+	if ((cmf & 0x0f) != 8 || (cmf >> 4) > 7) return FAST_INFLATE_BAD_DATA;
+	if (((u32)cmf * 256 + flg) % 31 != 0) return FAST_INFLATE_BAD_DATA;
+	if (flg & 0x20) return FAST_INFLATE_BAD_DATA; // preset dictionary
+
+	u64 in_used = 0;
+	enum FastInflateResult result = fast_inflate(in + 2, in_len - 2, out, out_cap, out_len, &in_used);
+	if (result != FAST_INFLATE_SUCCESS) return result;
+
+	const u8 *trailer = in + 2 + in_used;
+	if (in + in_len - trailer < 4) return FAST_INFLATE_BAD_DATA;
+
+	u32 expected = ((u32)trailer[0] << 24) | ((u32)trailer[1] << 16) | ((u32)trailer[2] << 8) | trailer[3];
+	u32 checksum = (u32)adler32_z(1, out, (z_size_t)*out_len);
+	if (checksum != expected) return FAST_INFLATE_BAD_DATA;
+
+	return FAST_INFLATE_SUCCESS;
+}
+
+/// PARALLEL ///
+
+// the compressed input is cut into chunks that are decoded at the same time. every chunk after
+// the first searches its part of the input for the start of a dynamic huffman block, verified by
+// decoding the whole block and the header of the block after it. a chunk then decodes from its
+// block start up to the start found by the next chunk. the 32 KiB of output before a chunk are
+// not known while it decodes, so its output starts as u16 symbols where values >= 256 refer to
+// that window. once the last 32 KiB of a chunk are free of window references, nothing later can
+// refer to the window and the chunk continues with the normal byte decoder. the references are
+// resolved chunk by chunk after all chunks are decoded
+
+#define DEFLATE_WINDOW_SIZE 32768
+// the marked output and its resolution make the total work about twice that of a serial decode,
+// fewer threads do not win anything
+#define PARALLEL_MIN_THREADS 4
+// smallest compressed part of the input given to one chunk
+#define PARALLEL_MIN_CHUNK (4ull << 20)
+// compressed bytes searched for a block start, encoders end blocks far more often. a chunk without
+// a start is decoded by the chunk before it
+#define SEARCH_MAX_BYTES (1ull << 20)
+// output of the verification decode in the block search, a longer block is taken as verified
+#define SEARCH_SCRATCH_SYMBOLS (1u << 20)
+
+typedef struct InflateChunk {
+	u64 start_bit;
+	u64 stop_bit; // start of the next chunk, U64_MAX for the last one
+	bool last;
+
+	u16 *marked;   // output up to the first clean window, symbols >= 256 refer to the window
+	u64 n_marked;
+	u8 *plain;     // output after that, preceded by history_len bytes of history
+	u64 history_len;
+	u64 n_plain;
+	bool plain_mode;
+
+	u64 in_used; // of the last chunk, up to the byte after the final block
+	u64 out_offset;
+	u32 adler;
+	enum FastInflateResult result;
+} InflateChunk;
+
+typedef struct ParallelInflate {
+	const u8 *in;
+	u64 in_len;
+	InflateChunk *chunks;
+	u32 n_chunks;
+	u8 *out;
+} ParallelInflate;
+
+local inline u64 bit_position(const BitReader *br, const u8 *in) {
+	return (u64)(br->next - in) * 8 + (u64)br->overread * 8 - br->bitsleft;
+}
+
+local BitReader reader_at(const u8 *in, u64 in_len, u64 bit) {
+	BitReader br = {
+		.next = in + bit / 8,
+		.end = in + in_len,
+	};
+	if (refill(&br)) consume_bits(&br, bit % 8);
+	return br;
+}
+
+// copies a match of u16 symbols 4 at a time, requires 4 symbols of slack after the match
+local inline void copy_marked_match_fast(u16 *out, u32 dist, u32 len) {
+	const u16 *src = out - dist;
+	u16 *end = out + len;
+	u32 step = MIN(dist, 4);
+	u64 word;
+
+	// for dist < 4 every store writes dist correct symbols, the rest is overwritten by the next store
+	do {
+		memcpy(&word, src, 8);
+		memcpy(out, &word, 8);
+		src += step;
+		out += step;
+	} while (out < end);
+}
+
+// match that reaches back into the window before the chunk
+local inline void copy_window_match(u16 *out_start, u64 pos, u32 dist, u32 len) {
+	for (u32 i = 0; i < len; i++) {
+		i64 src = (i64)(pos + i) - dist;
+		out_start[pos + i] = src >= 0 ? out_start[src] : (u16)(256 + DEFLATE_WINDOW_SIZE + src);
+	}
+}
+
+// decodes a huffman block into u16 symbols, references before out_start become window references.
+// same structure as inflate_huffman_block
+local enum FastInflateResult inflate_marked_block(BitReader *br, const DecodeTables *t,
+	u16 *out_start, u16 **out_next, u16 *out_end)
+{
+	u16 *out = *out_next;
+	enum FastInflateResult result = FAST_INFLATE_BAD_DATA;
+
+	while (br->end - br->next >= FASTLOOP_MIN_IN && out_end - out >= FASTLOOP_MIN_OUT) {
+		refill_fast(br);
+		u32 entry = lookup(t->litlen, LITLEN_TABLEBITS, br);
+
+		if (entry & ENTRY_LITERAL) {
+			consume_bits(br, ENTRY_LEN(entry));
+			out[0] = (u8)ENTRY_VALUE(entry);
+			out[1] = (u8)(ENTRY_VALUE(entry) >> 8);
+			out += (entry & ENTRY_LITERAL2) ? 2 : 1;
+
+			entry = lookup(t->litlen, LITLEN_TABLEBITS, br);
+			if (entry & ENTRY_LITERAL) {
+				consume_bits(br, ENTRY_LEN(entry));
+				out[0] = (u8)ENTRY_VALUE(entry);
+				out[1] = (u8)(ENTRY_VALUE(entry) >> 8);
+				out += (entry & ENTRY_LITERAL2) ? 2 : 1;
+				continue;
+			}
+			refill_fast(br);
+		}
+
+		if (entry & (ENTRY_INVALID | ENTRY_EOB)) {
+			if (entry & ENTRY_INVALID) goto done;
+			consume_bits(br, ENTRY_LEN(entry));
+			result = FAST_INFLATE_SUCCESS;
+			goto done;
+		}
+
+		consume_bits(br, ENTRY_LEN(entry));
+		u32 len = ENTRY_VALUE(entry) + (u32)pop_bits(br, ENTRY_EXTRA(entry));
+
+		u32 dist_entry = lookup(t->dist, DIST_TABLEBITS, br);
+		if (dist_entry & ENTRY_INVALID) goto done;
+		consume_bits(br, ENTRY_LEN(dist_entry));
+		u32 dist = ENTRY_VALUE(dist_entry) + (u32)pop_bits(br, ENTRY_EXTRA(dist_entry));
+
+		u64 pos = (u64)(out - out_start);
+		if (dist <= pos) copy_marked_match_fast(out, dist, len);
+		else if (dist <= pos + DEFLATE_WINDOW_SIZE) copy_window_match(out_start, pos, dist, len);
+		else goto done;
+		out += len;
+	}
+
+	for (;;) {
+		if (!refill(br)) goto done;
+		u32 entry = lookup(t->litlen, LITLEN_TABLEBITS, br);
+
+		if (entry & ENTRY_LITERAL) {
+			u32 n = (entry & ENTRY_LITERAL2) ? 2 : 1;
+			if ((u64)(out_end - out) < n) {
+				result = FAST_INFLATE_SHORT_OUTPUT;
+				goto done;
+			}
+			consume_bits(br, ENTRY_LEN(entry));
+			out[0] = (u8)ENTRY_VALUE(entry);
+			if (n == 2) out[1] = (u8)(ENTRY_VALUE(entry) >> 8);
+			out += n;
+			continue;
+		}
+
+		if (entry & ENTRY_INVALID) goto done;
+		consume_bits(br, ENTRY_LEN(entry));
+
+		if (entry & ENTRY_EOB) {
+			if (bits_overread(br)) goto done;
+			result = FAST_INFLATE_SUCCESS;
+			goto done;
+		}
+
+		u32 len = ENTRY_VALUE(entry) + (u32)pop_bits(br, ENTRY_EXTRA(entry));
+
+		u32 dist_entry = lookup(t->dist, DIST_TABLEBITS, br);
+		if (dist_entry & ENTRY_INVALID) goto done;
+		consume_bits(br, ENTRY_LEN(dist_entry));
+		u32 dist = ENTRY_VALUE(dist_entry) + (u32)pop_bits(br, ENTRY_EXTRA(dist_entry));
+
+		u64 pos = (u64)(out - out_start);
+		if (bits_overread(br)) goto done;
+		if (dist > pos + DEFLATE_WINDOW_SIZE) goto done;
+		if (len > (u64)(out_end - out)) {
+			result = FAST_INFLATE_SHORT_OUTPUT;
+			goto done;
+		}
+
+		copy_window_match(out_start, pos, dist, len);
+		out += len;
+	}
+
+done:
+	*out_next = out;
+	return result;
+}
+
+local enum FastInflateResult inflate_marked_stored_block(BitReader *br, u16 **out_next, u16 *out_end) {
+	if (!align_to_byte(br)) return FAST_INFLATE_BAD_DATA;
+	if (br->end - br->next < 4) return FAST_INFLATE_BAD_DATA;
+
+	u32 len = br->next[0] | (br->next[1] << 8);
+	u32 nlen = br->next[2] | (br->next[3] << 8);
+	br->next += 4;
+
+	if (len != (~nlen & 0xffff)) return FAST_INFLATE_BAD_DATA;
+	if ((u64)(br->end - br->next) < len) return FAST_INFLATE_BAD_DATA;
+	if ((u64)(out_end - *out_next) < len) return FAST_INFLATE_SHORT_OUTPUT;
+
+	for (u32 i = 0; i < len; i++) (*out_next)[i] = br->next[i];
+	*out_next += len;
+	br->next += len;
+
+	return FAST_INFLATE_SUCCESS;
+}
+
+// true if a block header that could start a valid block follows
+local bool valid_block_header(BitReader *br) {
+	if (!refill(br)) return false;
+	(void)pop_bits(br, 1);
+	u32 block_type = (u32)pop_bits(br, 2);
+
+	switch (block_type) {
+	case 0: {
+		if (!align_to_byte(br) || br->end - br->next < 4) return false;
+		u32 len = br->next[0] | (br->next[1] << 8);
+		u32 nlen = br->next[2] | (br->next[3] << 8);
+		return len == (~nlen & 0xffff);
+	}
+	case 1: return true;
+	case 2: {
+		DecodeTables tables;
+		return read_dynamic_tables(br, &tables);
+	}
+	default: return false;
+	}
+}
+
+// first bit in [from, to) that starts a non final dynamic block, U64_MAX if there is none
+local u64 find_block_start(const u8 *in, u64 in_len, u64 from, u64 to, u16 *scratch) {
+	DecodeTables tables;
+
+	for (u64 bit = from; bit < to && bit / 8 + 8 <= in_len; bit++) {
+		// BFINAL 0, BTYPE 2, HLIT and HDIST at most 29
+		u64 header = load_u64_le(in + bit / 8) >> (bit % 8);
+		if ((header & 7) != 4) continue;
+		if (((header >> 3) & 31) > 29 || ((header >> 8) & 31) > 29) continue;
+
+		BitReader br = reader_at(in, in_len, bit + 3);
+		if (!read_dynamic_tables(&br, &tables)) continue;
+
+		u16 *out = scratch;
+		enum FastInflateResult result = inflate_marked_block(&br, &tables, scratch, &out, scratch + SEARCH_SCRATCH_SYMBOLS);
+		if (result == FAST_INFLATE_SHORT_OUTPUT) return bit;
+		if (result == FAST_INFLATE_SUCCESS && valid_block_header(&br)) return bit;
+	}
+
+	return U64_MAX;
+}
+
+local void search_chunk(void *user_data, u32 index) {
+	ParallelInflate *p = user_data;
+	if (index == 0) return;
+
+	InflateChunk *chunk = &p->chunks[index];
+	u16 *scratch = (u16 *)buffer_pool_acquire(SEARCH_SCRATCH_SYMBOLS * sizeof(u16));
+	u64 search_end = MIN(chunk->stop_bit, chunk->start_bit + SEARCH_MAX_BYTES * 8);
+	chunk->start_bit = find_block_start(p->in, p->in_len, chunk->start_bit, search_end, scratch);
+	buffer_pool_release((u8 *)scratch);
+}
+
+// starts the byte decoder once the last window of the marked output has no window references
+local bool switch_to_plain(InflateChunk *chunk) {
+	if (chunk->n_marked < DEFLATE_WINDOW_SIZE) return false;
+
+	const u16 *window = chunk->marked + chunk->n_marked - DEFLATE_WINDOW_SIZE;
+	for (u32 i = 0; i < DEFLATE_WINDOW_SIZE; i++) {
+		if (window[i] >= 256) return false;
+	}
+
+	u64 capacity = MAX(4 * chunk->n_marked, 4 * DEFLATE_WINDOW_SIZE);
+	chunk->plain = buffer_pool_acquire(capacity);
+	for (u32 i = 0; i < DEFLATE_WINDOW_SIZE; i++) chunk->plain[i] = (u8)window[i];
+	chunk->history_len = DEFLATE_WINDOW_SIZE;
+	chunk->plain_mode = true;
+	return true;
+}
+
+local void decode_chunk(void *user_data, u32 index) {
+	ParallelInflate *p = user_data;
+	InflateChunk *chunk = &p->chunks[index];
+	chunk->result = FAST_INFLATE_BAD_DATA;
+
+	u64 in_bytes = (chunk->last ? p->in_len * 8 : chunk->stop_bit) / 8 - chunk->start_bit / 8;
+	if (index == 0) {
+		chunk->plain = buffer_pool_acquire(MAX(4 * in_bytes, 4 * DEFLATE_WINDOW_SIZE));
+		chunk->plain_mode = true;
+	}
+	else {
+		chunk->marked = (u16 *)buffer_pool_acquire(MAX(4 * in_bytes, 4 * DEFLATE_WINDOW_SIZE) * sizeof(u16));
+	}
+
+	BitReader br = reader_at(p->in, p->in_len, chunk->start_bit);
+	DecodeTables dynamic_tables;
+
+	for (;;) {
+		u64 pos = bit_position(&br, p->in);
+		if (!chunk->last && pos >= chunk->stop_bit) {
+			// the next chunk starts inside a block if the boundary is missed
+			if (pos == chunk->stop_bit) chunk->result = FAST_INFLATE_SUCCESS;
+			return;
+		}
+
+		// blocks are decoded again from here if the output has to grow
+		BitReader block_start = br;
+
+		if (!refill(&br)) return;
+		bool final_block = pop_bits(&br, 1);
+		u32 block_type = (u32)pop_bits(&br, 2);
+		if (bits_overread(&br)) return;
+
+		const DecodeTables *tables = NULL;
+		if (block_type == 1) tables = get_fixed_tables();
+		else if (block_type == 2) {
+			if (!read_dynamic_tables(&br, &dynamic_tables)) return;
+			tables = &dynamic_tables;
+		}
+		else if (block_type != 0) return;
+
+		enum FastInflateResult result;
+		if (chunk->plain_mode) {
+			u8 *start = chunk->plain;
+			u8 *next = start + chunk->history_len + chunk->n_plain;
+			u8 *end = start + mem_size(start);
+			result = tables ? inflate_huffman_block(&br, tables, start, &next, end) : inflate_stored_block(&br, &next, end);
+			if (result == FAST_INFLATE_SUCCESS) chunk->n_plain = (u64)(next - start) - chunk->history_len;
+		}
+		else {
+			u16 *start = chunk->marked;
+			u16 *next = start + chunk->n_marked;
+			u16 *end = start + mem_size((u8 *)start) / sizeof(u16);
+			result = tables ? inflate_marked_block(&br, tables, start, &next, end) : inflate_marked_stored_block(&br, &next, end);
+			if (result == FAST_INFLATE_SUCCESS) chunk->n_marked = (u64)(next - start);
+		}
+
+		if (result == FAST_INFLATE_SHORT_OUTPUT) {
+			if (chunk->plain_mode) {
+				u64 used = chunk->history_len + chunk->n_plain;
+				chunk->plain = buffer_pool_grow(chunk->plain, used, 2 * mem_size(chunk->plain));
+			}
+			else {
+				u64 used = chunk->n_marked * sizeof(u16);
+				chunk->marked = (u16 *)buffer_pool_grow((u8 *)chunk->marked, used, 2 * mem_size((u8 *)chunk->marked));
+			}
+			br = block_start;
+			continue;
+		}
+		if (result != FAST_INFLATE_SUCCESS) return;
+
+		if (final_block) {
+			if (!chunk->last || !align_to_byte(&br)) return;
+			chunk->in_used = (u64)(br.next - p->in);
+			chunk->result = FAST_INFLATE_SUCCESS;
+			return;
+		}
+
+		if (!chunk->plain_mode) (void)switch_to_plain(chunk);
+	}
+}
+
+// marked symbols in the last window of a chunk, the next chunk refers to them
+local inline u64 marked_tail_start(const InflateChunk *chunk) {
+	u64 total = chunk->n_marked + chunk->n_plain;
+	return total > DEFLATE_WINDOW_SIZE ? MIN(total - DEFLATE_WINDOW_SIZE, chunk->n_marked) : 0;
+}
+
+// a window reference is an index into the 32 KiB of output before the chunk, which have to be resolved
+// already. symbols are looked up in a table of the 256 byte values followed by the window
+local void resolve_marked(u8 *dst, const u16 *marked, u64 from, u64 to) {
+	if (from >= to) return;
+
+	u8 table[256 + DEFLATE_WINDOW_SIZE];
+	for (u32 i = 0; i < 256; i++) table[i] = (u8)i;
+	memcpy(table + 256, dst - DEFLATE_WINDOW_SIZE, DEFLATE_WINDOW_SIZE);
+
+	for (u64 j = from; j < to; j++) dst[j] = table[marked[j]];
+}
+
+local void copy_chunk(void *user_data, u32 index) {
+	ParallelInflate *p = user_data;
+	InflateChunk *chunk = &p->chunks[index];
+	if (chunk->n_plain) {
+		memcpy(p->out + chunk->out_offset + chunk->n_marked, chunk->plain + chunk->history_len, chunk->n_plain);
+	}
+}
+
+// resolves the marked symbols before the tail and computes the adler32 of the chunk
+local void finish_chunk(void *user_data, u32 index) {
+	ParallelInflate *p = user_data;
+	InflateChunk *chunk = &p->chunks[index];
+	resolve_marked(p->out + chunk->out_offset, chunk->marked, 0, marked_tail_start(chunk));
+	chunk->adler = (u32)adler32_z(1, p->out + chunk->out_offset, (z_size_t)(chunk->n_marked + chunk->n_plain));
+}
+
+// adler32 of two concatenated parts, like zlib's adler32_combine but with a 64 bit length everywhere
+local u32 adler32_combine_u64(u32 adler1, u32 adler2, u64 len2) {
+	const u32 base = 65521;
+	u32 rem = (u32)(len2 % base);
+	u32 sum1 = adler1 & 0xffff;
+	u32 sum2 = (rem * sum1) % base;
+	sum1 += (adler2 & 0xffff) + base - 1;
+	sum2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+	if (sum1 >= base) sum1 -= base;
+	if (sum1 >= base) sum1 -= base;
+	if (sum2 >= 2 * base) sum2 -= 2 * base;
+	if (sum2 >= base) sum2 -= base;
+	return sum1 | (sum2 << 16);
+}
+
+local void free_chunks(ParallelInflate *p) {
+	for (u32 i = 0; i < p->n_chunks; i++) {
+		buffer_pool_release((u8 *)p->chunks[i].marked);
+		buffer_pool_release(p->chunks[i].plain);
+	}
+	mem_free(p->chunks);
+}
+
+enum FastInflateResult fast_zlib_inflate_parallel(const u8 *in, u64 in_len, u8 **out, u64 *out_len) {
+	if (in_len < 2 + 4) return FAST_INFLATE_BAD_DATA;
+
+	u8 cmf = in[0];
+	u8 flg = in[1];
+	if ((cmf & 0x0f) != 8 || (cmf >> 4) > 7) return FAST_INFLATE_BAD_DATA;
+	if (((u32)cmf * 256 + flg) % 31 != 0) return FAST_INFLATE_BAD_DATA;
+	if (flg & 0x20) return FAST_INFLATE_BAD_DATA; // preset dictionary
+
+	const u8 *deflate = in + 2;
+	u64 deflate_len = in_len - 2;
+	u32 n_threads = thread_count();
+	u32 n_chunks = (u32)MIN(n_threads, MAX(deflate_len / PARALLEL_MIN_CHUNK, 1));
+	if (n_threads < PARALLEL_MIN_THREADS || n_chunks < 2) return FAST_INFLATE_BAD_DATA;
+
+	ParallelInflate p = {
+		.in = deflate,
+		.in_len = deflate_len,
+		.chunks = mem_alloc(MEM_TAG_DECODE, n_chunks * sizeof(InflateChunk)),
+		.n_chunks = n_chunks,
+	};
+	for (u32 i = 0; i < n_chunks; i++) {
+		p.chunks[i] = (InflateChunk){
+			.start_bit = deflate_len * 8 * i / n_chunks,
+			.stop_bit = deflate_len * 8 * (i + 1) / n_chunks,
+		};
+	}
+	parallel_for(n_chunks, search_chunk, &p);
+
+	// chunks without a block start are decoded by the chunk before them
+	u32 n_found = 0;
+	for (u32 i = 0; i < n_chunks; i++) {
+		if (p.chunks[i].start_bit != U64_MAX) p.chunks[n_found++] = p.chunks[i];
+	}
+	p.n_chunks = n_found;
+	for (u32 i = 0; i < n_found; i++) {
+		p.chunks[i].last = i + 1 == n_found;
+		p.chunks[i].stop_bit = p.chunks[i].last ? U64_MAX : p.chunks[i + 1].start_bit;
+	}
+	if (n_found < 2) {
+		free_chunks(&p);
+		return FAST_INFLATE_BAD_DATA;
+	}
+
+	parallel_for(p.n_chunks, decode_chunk, &p);
+
+	u64 total = 0;
+	for (u32 i = 0; i < p.n_chunks; i++) {
+		if (p.chunks[i].result != FAST_INFLATE_SUCCESS) {
+			free_chunks(&p);
+			return FAST_INFLATE_BAD_DATA;
+		}
+		p.chunks[i].out_offset = total;
+		total += p.chunks[i].n_marked + p.chunks[i].n_plain;
+	}
+
+	p.out = buffer_pool_acquire(MAX(total, 1));
+	parallel_for(p.n_chunks, copy_chunk, &p);
+
+	// a window reference needs the output before its chunk, the first window at the start of the output
+	if (p.chunks[1].out_offset < DEFLATE_WINDOW_SIZE) {
+		free_chunks(&p);
+		buffer_pool_release(p.out);
+		return FAST_INFLATE_BAD_DATA;
+	}
+	// the windows depend on each other and are resolved in order, everything before them in parallel
+	for (u32 i = 1; i < p.n_chunks; i++) {
+		const InflateChunk *chunk = &p.chunks[i];
+		resolve_marked(p.out + chunk->out_offset, chunk->marked, marked_tail_start(chunk), chunk->n_marked);
+	}
+	parallel_for(p.n_chunks, finish_chunk, &p);
+
+	u32 checksum = p.chunks[0].adler;
+	for (u32 i = 1; i < p.n_chunks; i++) {
+		const InflateChunk *chunk = &p.chunks[i];
+		checksum = adler32_combine_u64(checksum, chunk->adler, chunk->n_marked + chunk->n_plain);
+	}
+
+	const u8 *trailer = deflate + p.chunks[p.n_chunks - 1].in_used;
+	bool valid = in + in_len - trailer >= 4 &&
+		checksum == (((u32)trailer[0] << 24) | ((u32)trailer[1] << 16) | ((u32)trailer[2] << 8) | trailer[3]);
+	free_chunks(&p);
+	if (!valid) {
+		buffer_pool_release(p.out);
+		return FAST_INFLATE_BAD_DATA;
+	}
+
+	*out = p.out;
+	*out_len = total;
+	return FAST_INFLATE_SUCCESS;
+}
+
+const char *fast_inflate_result_to_str(enum FastInflateResult result) {
+	switch (result) {
+	case FAST_INFLATE_SUCCESS: return "SUCCESS";
+	case FAST_INFLATE_BAD_DATA: return "BAD_DATA";
+	case FAST_INFLATE_SHORT_OUTPUT: return "SHORT_OUTPUT";
+
+	default: PANIC("unknown FastInflateResult: %u", result);
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "utils.h"
+
+// one-shot DEFLATE (RFC 1951) decoder for buffers that are completely in memory.
+// faster than zlib's incremental state machine, but the output capacity must be known up front
+
+// compressed size from which inflate_decode tries fast_zlib_inflate_parallel
+#define FAST_INFLATE_PARALLEL_MIN_SIZE (16ull << 20)
+
+enum FastInflateResult {
+    FAST_INFLATE_SUCCESS,
+    FAST_INFLATE_BAD_DATA,     // invalid or truncated stream
+    FAST_INFLATE_SHORT_OUTPUT, // out_cap was too small, out is left undefined
+};
+
+// decodes a raw deflate stream, in_used (optional) receives the number of consumed input bytes
+enum FastInflateResult fast_inflate(const u8 *in, u64 in_len, u8 *out, u64 out_cap, u64 *out_len, u64 *in_used);
+// decodes a zlib (RFC 1950) wrapped deflate stream and verifies its adler32 checksum
+enum FastInflateResult fast_zlib_inflate(const u8 *in, u64 in_len, u8 *out, u64 out_cap, u64 *out_len);
+
+// fast_zlib_inflate on all threads for large streams, see fast_inflate.c. the output is allocated
+// from the buffer pool. FAST_INFLATE_BAD_DATA is also returned if the stream could not be split,
+// fast_zlib_inflate then decides if the data is valid
+enum FastInflateResult fast_zlib_inflate_parallel(const u8 *in, u64 in_len, u8 **out, u64 *out_len);
+
+const char *fast_inflate_result_to_str(enum FastInflateResult result);
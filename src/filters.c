@@ -0,0 +1,251 @@
+#include "filters.h"
+#include "buffer_pool.h"
+
+bool filter_is_streaming(enum FilterKind kind) {
+	switch (kind) {
+	case FILTER_KIND_FLATE:
+	case FILTER_KIND_ASCII_HEX:
+	case FILTER_KIND_ASCII85:
+	case FILTER_KIND_RUN_LENGTH:
+	case FILTER_KIND_LZW: return true;
+
+	case FILTER_KIND_NONE:
+	case FILTER_KIND_DCT:
+	case FILTER_KIND_CCITTFAX: return false;
+
+	default: PANIC("unknown FilterKind: %u", kind);
+	}
+}
+
+void filter_stage_init(FilterStage *stage, StreamFilter filter, DecodeSink next) {
+	ASSERT_MSG(filter_is_streaming(filter.kind), "%s can not be a pipeline stage", filter_kind_to_str(filter.kind));
+
+	*stage = (FilterStage){ .kind = filter.kind };
+
+	PredictorParams params = predictor_params_from_dict(filter.parms);
+	if (params.predictor != PREDICTOR_NONE) {
+		stage->has_predictor = true;
+		predictor_init(&stage->predictor, params, next);
+		next = predictor_sink(&stage->predictor);
+	}
+
+	switch (filter.kind) {
+	case FILTER_KIND_FLATE: inflater_init(&stage->inflater, next); break;
+	case FILTER_KIND_ASCII_HEX: ascii_hex_init(&stage->ascii_hex, next); break;
+	case FILTER_KIND_ASCII85: ascii85_init(&stage->ascii85, next); break;
+	case FILTER_KIND_RUN_LENGTH: run_length_init(&stage->run_length, next); break;
+	case FILTER_KIND_LZW: lzw_init(&stage->lzw, (u32)find_dict_int(filter.parms, "EarlyChange", 1), next); break;
+
+	default: PANIC("unhandled FilterKind: %u", filter.kind);
+	}
+}
+
+DecodeSink filter_stage_sink(FilterStage *stage) {
+	switch (stage->kind) {
+	case FILTER_KIND_FLATE: return inflater_sink(&stage->inflater);
+	case FILTER_KIND_ASCII_HEX: return ascii_hex_sink(&stage->ascii_hex);
+	case FILTER_KIND_ASCII85: return ascii85_sink(&stage->ascii85);
+	case FILTER_KIND_RUN_LENGTH: return run_length_sink(&stage->run_length);
+	case FILTER_KIND_LZW: return lzw_sink(&stage->lzw);
+
+	default: PANIC("unhandled FilterKind: %u", stage->kind);
+	}
+}
+
+void filter_stage_finish(FilterStage *stage) {
+	switch (stage->kind) {
+	case FILTER_KIND_FLATE: inflater_finish(&stage->inflater); break;
+	case FILTER_KIND_ASCII_HEX: (void)ascii_hex_finish(&stage->ascii_hex); break;
+	case FILTER_KIND_ASCII85: (void)ascii85_finish(&stage->ascii85); break;
+	case FILTER_KIND_RUN_LENGTH: (void)run_length_finish(&stage->run_length); break;
+	case FILTER_KIND_LZW: (void)lzw_finish(&stage->lzw); break;
+
+	default: PANIC("unhandled FilterKind: %u", stage->kind);
+	}
+
+	if (stage->has_predictor) (void)predictor_finish(&stage->predictor);
+}
+
+void filter_stage_free(FilterStage *stage) {
+	switch (stage->kind) {
+	case FILTER_KIND_FLATE: inflater_free(&stage->inflater); break;
+	case FILTER_KIND_ASCII_HEX: ascii_hex_free(&stage->ascii_hex); break;
+	case FILTER_KIND_ASCII85: ascii85_free(&stage->ascii85); break;
+	case FILTER_KIND_RUN_LENGTH: run_length_free(&stage->run_length); break;
+	case FILTER_KIND_LZW: lzw_free(&stage->lzw); break;
+
+	default: PANIC("unhandled FilterKind: %u", stage->kind);
+	}
+
+	if (stage->has_predictor) predictor_free(&stage->predictor);
+	*stage = (FilterStage){ 0 };
+}
+
+local DecodedStream undecoded_stream(Stream *stream) {
+	return (DecodedStream) {
+		.data = (union StreamData){ .buffer = { 0 } },
+			.kind = STREAM_DATA_NONE,
+			.raw_stream = *stream,
+	};
+}
+
+// packed 1 bit rows, /Rows defaults to the /Height of the image
+local DecodedStream ccitt_decode_stream(Stream *stream, StreamFilter filter) {
+	CCITTParams params = ccitt_params_from_dict(filter.parms);
+	if (params.rows == 0) params.rows = (u32)CLAMP(find_dict_int(&stream->dict, "Height", 0), U32_MAX, 0);
+
+	return (DecodedStream) {
+		.data = (union StreamData){ .buffer = ccitt_decode(stream->slice.ptr, stream->slice.len, params) },
+			.kind = STREAM_DATA_BUFFER,
+			.raw_stream = *stream,
+	};
+}
+
+// runs the streaming filters of the chain, returns the output of the last one
+local Buffer run_pipeline(Stream *stream, u32 n_stages) {
+	FilterStage stages[STREAM_MAX_FILTERS];
+	// most chains contain Flate or LZW, which expand by about 4
+	BufferSink out = { .data = buffer_pool_acquire(4 * stream->slice.len) };
+
+	// stages are set up back to front, each one writes into the one after it
+	DecodeSink next = buffer_sink(&out);
+	for (u32 i = n_stages; i-- > 0;) {
+		filter_stage_init(&stages[i], stream->filters[i], next);
+		next = filter_stage_sink(&stages[i]);
+	}
+
+	(void)next.fn(next.user_data, stream->slice.ptr, stream->slice.len);
+
+	// front to back, so the data flushed by a stage is seen by the finish of the next one
+	for (u32 i = 0; i < n_stages; i++) {
+		filter_stage_finish(&stages[i]);
+	}
+	for (u32 i = 0; i < n_stages; i++) {
+		filter_stage_free(&stages[i]);
+	}
+
+	return (Buffer){ .data = out.data, .size = out.size };
+}
+
+DecodedStream decode_stream(Stream *stream) {
+	u32 n_filters = (u32)arrlen(stream->filters);
+	if (n_filters == 0) return undecoded_stream(stream);
+	ASSERT_MSG(n_filters <= STREAM_MAX_FILTERS, "too many filters: %u", n_filters);
+
+	for (u32 i = 0; i < n_filters; i++) {
+		enum FilterKind kind = stream->filters[i].kind;
+		ASSERT_MSG(filter_is_streaming(kind) || i == n_filters - 1,
+			"%s has to be the last filter", filter_kind_to_str(kind));
+	}
+
+	// single filters are decoded in one go
+	if (n_filters == 1) {
+		switch (stream->filters[0].kind) {
+		case FILTER_KIND_FLATE: return inflate_decode(stream);
+		case FILTER_KIND_DCT: return dct_decode(stream);
+		case FILTER_KIND_CCITTFAX: return ccitt_decode_stream(stream, stream->filters[0]);
+		default: break;
+		}
+	}
+
+	enum FilterKind last = stream->filters[n_filters - 1].kind;
+	u32 n_stages = filter_is_streaming(last) ? n_filters : n_filters - 1;
+	Buffer buffer = run_pipeline(stream, n_stages);
+
+	if (n_stages == n_filters) {
+		return (DecodedStream) {
+			.data = (union StreamData){ .buffer = buffer },
+				.kind = STREAM_DATA_BUFFER,
+				.raw_stream = *stream,
+		};
+	}
+
+	// the image filter decodes the output of the pipeline
+	Stream image_stream = *stream;
+	image_stream.slice = (PDFSlice){ .ptr = buffer.data, .len = buffer.size };
+
+	DecodedStream ds = { 0 };
+	switch (last) {
+	case FILTER_KIND_DCT: ds = dct_decode(&image_stream); break;
+	case FILTER_KIND_CCITTFAX: ds = ccitt_decode_stream(&image_stream, stream->filters[n_filters - 1]); break;
+	default: PANIC("unhandled FilterKind: %u", last);
+	}
+
+	buffer_pool_release(buffer.data);
+	ds.raw_stream = *stream;
+	return ds;
+}
+
+void dct_image_init(DCTImage *image, Stream *stream, enum DCTOutput output) {
+	u32 n_filters = (u32)arrlen(stream->filters);
+	ASSERT_MSG(n_filters >= 1 && n_filters <= STREAM_MAX_FILTERS, "invalid filter count: %u", n_filters);
+	ASSERT_MSG(stream->filters[n_filters - 1].kind == FILTER_KIND_DCT, "%s is not an image filter",
+		filter_kind_to_str(stream->filters[n_filters - 1].kind));
+
+	*image = (DCTImage){ .output = output };
+	if (n_filters == 1) {
+		image->jpeg = (Buffer){ .data = stream->slice.ptr, .size = stream->slice.len };
+	}
+	else {
+		image->jpeg = run_pipeline(stream, n_filters - 1);
+		image->owns_jpeg = true;
+	}
+
+	dct_read_size(image->jpeg.data, image->jpeg.size, &image->width, &image->height);
+}
+
+const RawImage *dct_image_get(DCTImage *image, u32 target_width, u32 target_height) {
+	enum DCTScale scale = dct_pick_scale(image->width, image->height, target_width, target_height);
+
+	RawImage *scaled = &image->scales[scale];
+	if (!scaled->data) *scaled = dct_decode_parallel(image->jpeg.data, image->jpeg.size, scale, image->output);
+	return scaled;
+}
+
+const RawImage *dct_image_get_progressive(DCTImage *image, u32 target_width, u32 target_height, DCTScanSink sink) {
+	enum DCTScale scale = dct_pick_scale(image->width, image->height, target_width, target_height);
+
+	RawImage *scaled = &image->scales[scale];
+	if (!scaled->data) *scaled = dct_decode_progressive(image->jpeg.data, image->jpeg.size, scale, image->output, sink);
+	return scaled;
+}
+
+RawImage dct_image_decode_region(DCTImage *image, u32 target_width, u32 target_height, ImageRegion region) {
+	enum DCTScale scale = dct_pick_scale(image->width, image->height, target_width, target_height);
+
+	// scaled pixels that touch the region
+	u32 denom = 1u << scale;
+	u64 x_end = (u64)region.x + region.width;
+	u64 y_end = (u64)region.y + region.height;
+	ImageRegion scaled = {
+		.x = region.x / denom,
+		.y = region.y / denom,
+		.width = (u32)((x_end + denom - 1) / denom - region.x / denom),
+		.height = (u32)((y_end + denom - 1) / denom - region.y / denom),
+	};
+
+	return dct_decode_region(image->jpeg.data, image->jpeg.size, scale, image->output, scaled);
+}
+
+void dct_image_free(DCTImage *image) {
+	for (u32 i = 0; i < DCT_SCALE_COUNT; i++) {
+		buffer_pool_release(image->scales[i].data);
+	}
+	if (image->owns_jpeg) buffer_pool_release(image->jpeg.data);
+	*image = (DCTImage){ 0 };
+}
+
+const char *filter_kind_to_str(enum FilterKind kind) {
+	switch (kind) {
+	case FILTER_KIND_NONE: return "None";
+	case FILTER_KIND_FLATE: return "FlateDecode";
+	case FILTER_KIND_DCT: return "DCTDecode";
+	case FILTER_KIND_CCITTFAX: return "CCITTFaxDecode";
+	case FILTER_KIND_ASCII_HEX: return "ASCIIHexDecode";
+	case FILTER_KIND_ASCII85: return "ASCII85Decode";
+	case FILTER_KIND_RUN_LENGTH: return "RunLengthDecode";
+	case FILTER_KIND_LZW: return "LZWDecode";
+
+	default: PANIC("unknown FilterKind: %u", kind);
+	}
+}
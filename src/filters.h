@@ -0,0 +1,64 @@
+#pragma once
+
+#include "decompress.h"
+#include "predictor.h"
+#include "basic_filters.h"
+#include "lzw.h"
+#include "ccitt.h"
+#include "dct.h"
+
+// a /Filter chain is decoded as a pipeline of stages. encoded data is written into the first
+// stage in chunks of any size and every stage passes its output on to the next one as soon as
+// it is decoded, so no stage materializes its full output. only the last stage writes into a buffer.
+// image filters (DCT, CCITTFax) need all of their input at once and can only be the last filter of a chain
+
+typedef struct FilterStage {
+    enum FilterKind kind;
+    union {
+        Inflater inflater;
+        AsciiHexDecoder ascii_hex;
+        Ascii85Decoder ascii85;
+        RunLengthDecoder run_length;
+        LZWDecoder lzw;
+    };
+    bool has_predictor;
+    Predictor predictor; // /Predictor of the stage, applied to its output
+} FilterStage;
+
+// true if the filter can be a pipeline stage
+bool filter_is_streaming(enum FilterKind kind);
+
+// the stage writes its decoded output into next
+void filter_stage_init(FilterStage *stage, StreamFilter filter, DecodeSink next);
+// sink that receives the encoded input of the stage
+DecodeSink filter_stage_sink(FilterStage *stage);
+// called after all input was written, passes on any buffered data
+void filter_stage_finish(FilterStage *stage);
+void filter_stage_free(FilterStage *stage);
+
+// decodes the stream through all of its filters
+DecodedStream decode_stream(Stream *stream);
+
+// DCTDecode image stream whose scales are decoded on first use, so a page shown small only pays for
+// the reduced decode. every scale is kept until dct_image_free
+typedef struct DCTImage {
+    Buffer jpeg;    // input of the DCT filter
+    bool owns_jpeg; // decoded by the filters in front of DCTDecode
+    u32 width;      // full size
+    u32 height;
+    enum DCTOutput output; // layout of every scale
+    RawImage scales[DCT_SCALE_COUNT]; // data is NULL for scales that were not decoded yet
+} DCTImage;
+
+// the last filter of the stream has to be DCTDecode, the stream data has to outlive the image
+void dct_image_init(DCTImage *image, Stream *stream, enum DCTOutput output);
+// the image at the largest reduction that still covers target_width x target_height
+const RawImage *dct_image_get(DCTImage *image, u32 target_width, u32 target_height);
+// like dct_image_get, a scale that is not decoded yet passes the intermediate images of a progressive jpeg to sink
+const RawImage *dct_image_get_progressive(DCTImage *image, u32 target_width, u32 target_height, DCTScanSink sink);
+// decodes the visible part of the image, region is in full scale pixels. the scale is picked for the whole image
+// shown at target_width x target_height. regions are not cached, the image belongs to the caller
+RawImage dct_image_decode_region(DCTImage *image, u32 target_width, u32 target_height, ImageRegion region);
+void dct_image_free(DCTImage *image);
+
+const char *filter_kind_to_str(enum FilterKind kind);
@@ -0,0 +1,100 @@
+#include "frame_stats.h"
+
+#include <string.h>
+
+const char *frame_timer_to_str(enum FrameTimer timer) {
+	switch (timer) {
+	case FRAME_TIMER_FRAME: return "frame";
+	case FRAME_TIMER_FENCE_WAIT: return "fence_wait";
+	case FRAME_TIMER_ACQUIRE: return "acquire";
+	case FRAME_TIMER_RECORD: return "record";
+	case FRAME_TIMER_SUBMIT: return "submit";
+	case FRAME_TIMER_PRESENT: return "present";
+	case FRAME_TIMER_GPU: return "gpu";
+
+	default: PANIC("unknown FrameTimer: %u", timer);
+	}
+}
+
+local void log_frame_timings(FILE *log, u64 frame, const FrameTimings *timings) {
+	fprintf(log, "%llu", (unsigned long long)frame);
+	for (u32 i = 0; i < FRAME_TIMER_COUNT; i++) {
+		if (timings->ms[i] == FRAME_TIMING_NONE) fprintf(log, ",");
+		else fprintf(log, ",%.4f", timings->ms[i]);
+	}
+	fprintf(log, "\n");
+}
+
+void frame_stats_push(FrameStats *stats, const FrameTimings *timings) {
+	stats->history[stats->frame_count % FRAME_STATS_HISTORY] = *timings;
+
+	if (stats->log) {
+		log_frame_timings(stats->log, stats->frame_count, timings);
+	}
+
+	stats->frame_count += 1;
+}
+
+local int cmp_f64(const void *a, const void *b) {
+	f64 x = *(const f64 *)a;
+	f64 y = *(const f64 *)b;
+	return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of a sorted array
+local inline f64 percentile(const f64 *sorted, u32 count, u32 p) {
+	u32 rank = (u32)(((u64)p * count + 99) / 100);
+	return sorted[MAX(rank, 1) - 1];
+}
+
+FramePercentiles frame_stats_percentiles(const FrameStats *stats, enum FrameTimer timer) {
+	ASSERT(timer < FRAME_TIMER_COUNT);
+
+	u32 frames = (u32)MIN(stats->frame_count, FRAME_STATS_HISTORY);
+	f64 values[FRAME_STATS_HISTORY];
+	u32 count = 0;
+	for (u32 i = 0; i < frames; i++) {
+		f64 ms = stats->history[i].ms[timer];
+		if (ms != FRAME_TIMING_NONE) values[count++] = ms;
+	}
+	if (count == 0) return (FramePercentiles) { 0 };
+
+	qsort(values, count, sizeof(f64), cmp_f64);
+
+	return (FramePercentiles) {
+		.p50 = percentile(values, count, 50),
+		.p95 = percentile(values, count, 95),
+		.p99 = percentile(values, count, 99),
+	};
+}
+
+bool frame_stats_open_log(FrameStats *stats, const char *path) {
+	ASSERT_MSG(!stats->log, "frame log already open");
+
+	FILE *fp = fopen(path, "w");
+	if (!fp) return false;
+
+	fprintf(fp, "frame");
+	for (u32 i = 0; i < FRAME_TIMER_COUNT; i++) {
+		fprintf(fp, ",%s_ms", frame_timer_to_str(i));
+	}
+	fprintf(fp, "\n");
+
+	stats->log = fp;
+	return true;
+}
+
+void frame_stats_close_log(FrameStats *stats) {
+	if (!stats->log) return;
+
+	fclose(stats->log);
+	stats->log = NULL;
+}
+
+void print_frame_stats(const FrameStats *stats) {
+	for (u32 i = 0; i < FRAME_TIMER_COUNT; i++) {
+		FramePercentiles p = frame_stats_percentiles(stats, i);
+		println("%-10s p50: %7.3f ms  p95: %7.3f ms  p99: %7.3f ms",
+			frame_timer_to_str(i), p.p50, p.p95, p.p99);
+	}
+}
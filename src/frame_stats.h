@@ -0,0 +1,51 @@
+#pragma once
+
+#include "utils.h"
+
+// number of frames kept for the percentile calculation
+#define FRAME_STATS_HISTORY 1024
+
+enum FrameTimer {
+    FRAME_TIMER_FRAME,      // cpu time between two consecutive frames
+    FRAME_TIMER_FENCE_WAIT, // waiting for the frame in flight to finish
+    FRAME_TIMER_ACQUIRE,    // vkAcquireNextImageKHR
+    FRAME_TIMER_RECORD,     // command buffer recording
+    FRAME_TIMER_SUBMIT,     // vkQueueSubmit
+    FRAME_TIMER_PRESENT,    // vkQueuePresentKHR
+    FRAME_TIMER_GPU,        // renderpass on the gpu (timestamp queries)
+
+    FRAME_TIMER_COUNT,
+};
+
+// a timer that has no value for a frame, e.g. the gpu time before the first timestamps were written
+#define FRAME_TIMING_NONE (-1.0)
+
+// all values in milliseconds, or FRAME_TIMING_NONE
+typedef struct FrameTimings {
+    f64 ms[FRAME_TIMER_COUNT];
+} FrameTimings;
+
+typedef struct FramePercentiles {
+    f64 p50;
+    f64 p95;
+    f64 p99;
+} FramePercentiles;
+
+// ring buffer of the last FRAME_STATS_HISTORY frame timings
+typedef struct FrameStats {
+    FrameTimings history[FRAME_STATS_HISTORY];
+    u64 frame_count;
+
+    FILE *log; // optional csv log, one line per frame
+} FrameStats;
+
+void frame_stats_push(FrameStats *stats, const FrameTimings *timings);
+// percentiles over the recorded history, frames without a value for timer are skipped. zero if no
+// frame has one
+FramePercentiles frame_stats_percentiles(const FrameStats *stats, enum FrameTimer timer);
+
+bool frame_stats_open_log(FrameStats *stats, const char *path);
+void frame_stats_close_log(FrameStats *stats);
+
+const char *frame_timer_to_str(enum FrameTimer timer);
+void print_frame_stats(const FrameStats *stats);
@@ -0,0 +1,363 @@
+#include "image_assembly.h"
+#include "memory.h"
+#include "simd.h"
+#include "threads.h"
+
+#include <string.h>
+#include <math.h>
+
+// pixels assembled per step of a row, the colors are staged on the stack
+#define ASSEMBLY_CHUNK_PIXELS 256
+// output rows assembled by one parallel_for index
+#define ASSEMBLY_BAND_ROWS 64
+
+// mask samples to alpha, the /Decode of the mask and samples of other sizes than 8 bits go through lut
+typedef struct AlphaConverter {
+	u32 bits_per_component;
+	bool use_lut;
+	u8 lut[256];
+} AlphaConverter;
+
+typedef struct AssemblyJob {
+	const ImageSamples *image;
+	const ColorConverter *cc;
+	u64 in_stride;
+	// mask only
+	const ImageSamples *mask;
+	AlphaConverter alpha;
+	u64 mask_stride;
+	const u32 *mask_columns; // mask column of every image column, NULL if both have the same width
+	bool has_matte;
+	u8 matte[3]; // RGB
+	RawImage *out;
+} AssemblyJob;
+
+// index of the source pixel whose center is nearest to the center of pixel i
+local inline u32 nearest_index(u32 i, u32 size, u32 src_size) {
+	return (u32)(((2 * (u64)i + 1) * src_size) / (2 * (u64)size));
+}
+
+/// PREMULTIPLY ///
+
+local void premultiply_scalar(u8 *out, const u8 *rgba, const u8 *alpha, u32 count, u32 start) {
+	for (u32 x = start; x < count; x++) {
+		u32 a = alpha[x];
+		out[4 * x + 0] = div255(rgba[4 * x + 0] * a);
+		out[4 * x + 1] = div255(rgba[4 * x + 1] * a);
+		out[4 * x + 2] = div255(rgba[4 * x + 2] * a);
+		out[4 * x + 3] = (u8)a;
+	}
+}
+
+// like premultiply_scalar, every function returns the pixel at which the scalar version has to continue.
+// the products are divided by 255 with the rounding of div255
+
+#if PTRAIL_SSE2
+
+local inline __m128i mul_div255_epi16(__m128i a, __m128i b) {
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+local u32 premultiply_simd(u8 *out, const u8 *rgba, const u8 *alpha, u32 count) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i alpha_bytes = _mm_set1_epi32((i32)0xff000000);
+	u32 x = 0;
+	for (; x + 4 <= count; x += 4) {
+		u32 a4;
+		memcpy(&a4, alpha + x, 4);
+		// the alpha of a pixel in all of its bytes
+		__m128i a = _mm_cvtsi32_si128((i32)a4);
+		a = _mm_unpacklo_epi8(a, a);
+		a = _mm_unpacklo_epi16(a, a);
+
+		__m128i px = _mm_loadu_si128((const __m128i *)(rgba + 4 * x));
+		__m128i lo = mul_div255_epi16(_mm_unpacklo_epi8(px, zero), _mm_unpacklo_epi8(a, zero));
+		__m128i hi = mul_div255_epi16(_mm_unpackhi_epi8(px, zero), _mm_unpackhi_epi8(a, zero));
+		__m128i r = _mm_packus_epi16(lo, hi);
+		r = _mm_or_si128(_mm_andnot_si128(alpha_bytes, r), _mm_and_si128(alpha_bytes, a));
+		_mm_storeu_si128((__m128i *)(out + 4 * x), r);
+	}
+	return x;
+}
+
+#elif PTRAIL_NEON
+
+// (x + ((x + 128) >> 8) + 128) >> 8, like div255
+local inline uint8x8_t div255_u16(uint16x8_t x) {
+	return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+local u32 premultiply_simd(u8 *out, const u8 *rgba, const u8 *alpha, u32 count) {
+	u32 x = 0;
+	for (; x + 16 <= count; x += 16) {
+		uint8x16x4_t px = vld4q_u8(rgba + 4 * x);
+		uint8x16_t a = vld1q_u8(alpha + x);
+		for (u32 c = 0; c < 3; c++) {
+			uint8x8_t lo = div255_u16(vmull_u8(vget_low_u8(px.val[c]), vget_low_u8(a)));
+			uint8x8_t hi = div255_u16(vmull_u8(vget_high_u8(px.val[c]), vget_high_u8(a)));
+			px.val[c] = vcombine_u8(lo, hi);
+		}
+		px.val[3] = a;
+		vst4q_u8(out + 4 * x, px);
+	}
+	return x;
+}
+
+#endif
+
+void premultiply_alpha(u8 *out, const u8 *rgba, const u8 *alpha, u32 count) {
+	u32 x = 0;
+#if PTRAIL_SIMD
+	x = premultiply_simd(out, rgba, alpha, count);
+#endif
+	premultiply_scalar(out, rgba, alpha, count, x);
+}
+
+// colors that were blended with the matte are unblended: c' = m + a * (c - m), so the premultiplied
+// color a * c is c' - m * (1 - a). masks with a matte are rare, there is no SIMD version
+local void unmatte_alpha(u8 *out, const u8 *rgba, const u8 *alpha, u32 count, const u8 *matte) {
+	for (u32 x = 0; x < count; x++) {
+		u32 a = alpha[x];
+		for (u32 c = 0; c < 3; c++) {
+			i32 value = (i32)rgba[4 * x + c] - div255(matte[c] * (255 - a));
+			out[4 * x + c] = (u8)CLAMP(value, (i32)a, 0);
+		}
+		out[4 * x + 3] = (u8)a;
+	}
+}
+
+/// MASK ///
+
+local void alpha_converter_init(AlphaConverter *ac, const ImageColor *color) {
+	u32 bits = color->bits_per_component;
+	*ac = (AlphaConverter){
+		.bits_per_component = bits,
+		.use_lut = color->has_decode || bits < 8,
+	};
+	if (!ac->use_lut) return;
+
+	// 16 bit samples are narrowed before the lookup
+	u32 max_sample = (1u << MIN(bits, 8)) - 1;
+	f32 d_min = color->has_decode ? color->decode[0] : 0.0f;
+	f32 d_max = color->has_decode ? color->decode[1] : 1.0f;
+	for (u32 sample = 0; sample <= max_sample; sample++) {
+		f32 value = 255.0f * (d_min + (f32)sample * (d_max - d_min) / (f32)max_sample);
+		ac->lut[sample] = (u8)CLAMP(lrintf(value), 255, 0);
+	}
+}
+
+// alpha of a whole mask row, in out unless the samples can be used as they are
+local const u8 *mask_row_alpha(const AlphaConverter *ac, u8 *out, const u8 *row, u32 width) {
+	u32 bits = ac->bits_per_component;
+	if (bits == 8 && !ac->use_lut) return row;
+
+	const u8 *samples = row;
+	if (bits < 8) {
+		unpack_samples(out, row, 0, width, bits, false);
+		samples = out;
+	}
+	else if (bits == 16) {
+		narrow_samples16(out, row, width);
+		samples = out;
+	}
+	if (ac->use_lut) {
+		for (u32 x = 0; x < width; x++) out[x] = ac->lut[samples[x]];
+	}
+	return out;
+}
+
+// the matte color through a converter for the color space of the image
+local void matte_rgb(const ImageColor *color, const f32 *matte, u8 *rgb) {
+	ImageColor matte_color = { .space = color->space, .bits_per_component = 8 };
+	ColorConverter cc;
+	color_converter_init(&cc, &matte_color);
+
+	u8 samples[COLOR_MAX_COMPONENTS];
+	for (u32 c = 0; c < cc.n_components; c++) samples[c] = (u8)CLAMP(lrintf(255.0f * matte[c]), 255, 0);
+
+	u8 rgba[4];
+	color_convert_row(&cc, rgba, samples, 1);
+	memcpy(rgb, rgba, 3);
+}
+
+/// ASSEMBLY ///
+
+local void assemble_band(void *user_data, u32 band) {
+	const AssemblyJob *job = user_data;
+	const ImageSamples *image = job->image;
+	const ImageSamples *mask = job->mask;
+	RawImage *out = job->out;
+	u32 first_row = band * ASSEMBLY_BAND_ROWS;
+	u32 end_row = MIN(first_row + ASSEMBLY_BAND_ROWS, out->height);
+
+	if (!mask) {
+		for (u32 y = first_row; y < end_row; y++) {
+			color_convert_row(job->cc, out->data + (u64)y * out->width * 4, image->data + job->in_stride * y, out->width);
+		}
+		return;
+	}
+
+	u8 rgba[ASSEMBLY_CHUNK_PIXELS * 4];
+	u8 gathered[ASSEMBLY_CHUNK_PIXELS];
+	u8 *mask_alpha = mem_alloc(MEM_TAG_DECODE, mask->width);
+	const u8 *alpha = NULL;
+	u32 mask_y = U32_MAX;
+
+	for (u32 y = first_row; y < end_row; y++) {
+		const u8 *row = image->data + job->in_stride * y;
+		u8 *dst = out->data + (u64)y * out->width * 4;
+
+		// neighbouring rows of an upscaled mask share its rows
+		u32 my = mask->height == image->height ? y : nearest_index(y, image->height, mask->height);
+		if (my != mask_y) {
+			alpha = mask_row_alpha(&job->alpha, mask_alpha, mask->data + job->mask_stride * my, mask->width);
+			mask_y = my;
+		}
+
+		for (u32 x = 0; x < out->width; x += ASSEMBLY_CHUNK_PIXELS) {
+			u32 count = MIN(out->width - x, ASSEMBLY_CHUNK_PIXELS);
+			color_convert_span(job->cc, rgba, row, x, count);
+
+			const u8 *a = alpha + x;
+			if (job->mask_columns) {
+				for (u32 i = 0; i < count; i++) gathered[i] = alpha[job->mask_columns[x + i]];
+				a = gathered;
+			}
+
+			if (job->has_matte) unmatte_alpha(dst + (u64)x * 4, rgba, a, count, job->matte);
+			else premultiply_alpha(dst + (u64)x * 4, rgba, a, count);
+		}
+	}
+
+	mem_free(mask_alpha);
+}
+
+RawImage image_assemble(const ImageSamples *image, const SoftMask *mask, ImageTarget target) {
+	ColorConverter cc;
+	color_converter_init(&cc, &image->color);
+
+	RawImage out = {
+		.width = image->width,
+		.height = image->height,
+		.n_channels = 4,
+		.format = PIXEL_FORMAT_RGBA,
+	};
+	out.data = image_target_alloc(target, &out);
+
+	AssemblyJob job = {
+		.image = image,
+		.cc = &cc,
+		.in_stride = color_row_stride(&cc, image->width),
+		.out = &out,
+	};
+
+	u32 *mask_columns = NULL;
+	if (mask) {
+		const ImageSamples *m = &mask->samples;
+		ASSERT_MSG(m->color.space == COLOR_SPACE_GRAY && !m->color.image_mask, "/SMask is not a DeviceGray image");
+		job.mask = m;
+		job.mask_stride = ((u64)m->width * m->color.bits_per_component + 7) / 8;
+		alpha_converter_init(&job.alpha, &m->color);
+
+		if (m->width != image->width) {
+			mask_columns = mem_alloc(MEM_TAG_DECODE, (u64)image->width * sizeof(*mask_columns));
+			for (u32 x = 0; x < image->width; x++) mask_columns[x] = nearest_index(x, image->width, m->width);
+			job.mask_columns = mask_columns;
+		}
+
+		// a matte needs a color per component, there is none for palette colors
+		if (mask->n_matte > 0 && mask->n_matte == color_space_components(image->color.space)
+			&& image->color.space != COLOR_SPACE_INDEXED && !image->color.image_mask) {
+			job.has_matte = true;
+			matte_rgb(&image->color, mask->matte, job.matte);
+		}
+	}
+
+	parallel_for((out.height + ASSEMBLY_BAND_ROWS - 1) / ASSEMBLY_BAND_ROWS, assemble_band, &job);
+
+	mem_free(mask_columns);
+	return out;
+}
+
+/// STREAMS ///
+
+bool image_samples_from_stream(const PDF *pdf, const DecodedStream *stream, ImageSamples *samples) {
+	const Dictionary *dict = &stream->raw_stream.dict;
+	*samples = (ImageSamples){ 0 };
+	ImageColor *color = &samples->color;
+
+	// DCTDecode, the jpeg was decoded to 8 bit samples in its own color space
+	if (stream->kind == STREAM_DATA_IMAGE) {
+		const RawImage *image = &stream->data.image;
+		enum ColorSpace space;
+		switch (image->format) {
+		case PIXEL_FORMAT_GRAY: space = COLOR_SPACE_GRAY; break;
+		case PIXEL_FORMAT_RGB: space = COLOR_SPACE_RGB; break;
+		case PIXEL_FORMAT_CMYK: space = COLOR_SPACE_CMYK; break;
+		default: return false;
+		}
+
+		// a missing or contradicting /ColorSpace is replaced by the one of the jpeg, /Decode is kept otherwise
+		if (!image_color_from_dict(pdf, dict, color) || color->image_mask || color->space != space) {
+			*color = (ImageColor){ .space = space };
+		}
+		color->bits_per_component = 8;
+
+		// the inverted samples of an Adobe jpeg flip every /Decode range, [1 0] without one
+		if (image->inverted) {
+			for (u32 i = 0; i < COLOR_MAX_COMPONENTS; i++) {
+				f32 min = color->has_decode ? color->decode[2 * i] : 0.0f;
+				f32 max = color->has_decode ? color->decode[2 * i + 1] : 1.0f;
+				color->decode[2 * i] = max;
+				color->decode[2 * i + 1] = min;
+			}
+			color->has_decode = true;
+		}
+
+		samples->data = image->data;
+		samples->width = image->width;
+		samples->height = image->height;
+		return true;
+	}
+
+	if (stream->kind != STREAM_DATA_BUFFER || !image_color_from_dict(pdf, dict, color)) return false;
+
+	i64 width = find_dict_int(dict, "Width", find_dict_int(dict, "W", 0));
+	i64 height = find_dict_int(dict, "Height", find_dict_int(dict, "H", 0));
+	if (width <= 0 || height <= 0 || width > U32_MAX || height > U32_MAX) return false;
+
+	u32 n_components = color->image_mask ? 1 : color_space_components(color->space);
+	u64 stride = ((u64)width * n_components * color->bits_per_component + 7) / 8;
+	const Buffer *buffer = &stream->data.buffer;
+	if (stride * (u64)height > buffer->size) return false;
+
+	samples->data = buffer->data;
+	samples->width = (u32)width;
+	samples->height = (u32)height;
+	return true;
+}
+
+bool soft_mask_from_dict(const PDF *pdf, const Dictionary *dict, SoftMask *mask) {
+	// /SMask can also be a name, /None
+	DictionaryEntry *entry = find_dict_entry(dict, "SMask");
+	if (!entry || entry->object.kind != OBJ_REFERENCE) return false;
+
+	PDFObject *obj = resolve_object(pdf, &entry->object);
+	if (!obj || obj->kind != OBJ_DECODED_STREAM) return false;
+
+	*mask = (SoftMask){ .ref = entry->object.data.reference };
+	const DecodedStream *stream = &obj->data.decoded_stream;
+	if (!image_samples_from_stream(pdf, stream, &mask->samples)) return false;
+	if (mask->samples.color.space != COLOR_SPACE_GRAY || mask->samples.color.image_mask) return false;
+
+	DictionaryEntry *matte = find_dict_entry(&stream->raw_stream.dict, "Matte");
+	if (matte && matte->object.kind == OBJ_ARRAY && matte->object.data.array.count <= COLOR_MAX_COMPONENTS) {
+		const ObjectArray *array = &matte->object.data.array;
+		mask->n_matte = (u32)array->count;
+		for (u64 i = 0; i < array->count; i++) {
+			if (!object_number(&array->data[i], &mask->matte[i])) mask->n_matte = 0;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "color.h"
+
+// assembly of image XObjects into the RGBA the renderer uploads. an image with a /SMask gets the
+// mask as its alpha channel, the mask rows are converted next to the image rows and every chunk of
+// pixels is premultiplied and written in one pass, so the output memory is written once
+
+// samples of an image XObject as they come out of its filters
+typedef struct ImageSamples {
+    const u8 *data; // packed rows, a row starts at a byte
+    u32 width;
+    u32 height;
+    ImageColor color;
+} ImageSamples;
+
+typedef struct SoftMask {
+    Reference ref;
+    ImageSamples samples; // DeviceGray
+    u32 n_matte; // components of /Matte, 0 without one
+    f32 matte[COLOR_MAX_COMPONENTS]; // color the image was blended with, in its color space
+} SoftMask;
+
+// reads the size and the colors of a decoded image stream of pdf. false if the stream is not an image that
+// can be converted or has less data than its size needs
+bool image_samples_from_stream(const PDF *pdf, const DecodedStream *stream, ImageSamples *samples);
+// resolves the /SMask of an image dictionary. false if there is none or it is not a DeviceGray image
+bool soft_mask_from_dict(const PDF *pdf, const Dictionary *dict, SoftMask *mask);
+
+// converts the image to RGBA in memory from target, on all threads. with a mask the color channels are
+// premultiplied by its alpha, a mask of another size is sampled at the nearest pixel. mask can be NULL
+RawImage image_assemble(const ImageSamples *image, const SoftMask *mask, ImageTarget target);
+
+// writes count RGBA pixels with the alpha values and their colors multiplied by them
+void premultiply_alpha(u8 *out, const u8 *rgba, const u8 *alpha, u32 count);
@@ -0,0 +1,264 @@
+#include "image_cache.h"
+#include "buffer_pool.h"
+#include "image_assembly.h"
+#include "memory.h"
+
+#define MIN_BUCKETS 64
+
+/// KEYS ///
+
+local inline u64 mix_hash(u64 h, u64 value) {
+	h ^= value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+	return h;
+}
+
+local u64 hash_key(const ImageKey *key) {
+	u64 h = key->ref.object_num;
+	h = mix_hash(h, key->ref.generation);
+	h = mix_hash(h, ((u64)key->pipeline << 32) | key->output);
+	h = mix_hash(h, key->scale);
+	h = mix_hash(h, ((u64)key->region.x << 32) | key->region.y);
+	h = mix_hash(h, ((u64)key->region.width << 32) | key->region.height);
+	h = mix_hash(h, key->mask.object_num);
+	h = mix_hash(h, key->mask.generation);
+
+	// finalizer, the bucket index uses the low bits
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+local inline bool key_equal(const ImageKey *a, const ImageKey *b) {
+	return a->ref.object_num == b->ref.object_num
+		&& a->ref.generation == b->ref.generation
+		&& a->pipeline == b->pipeline
+		&& a->output == b->output
+		&& a->scale == b->scale
+		&& a->region.x == b->region.x
+		&& a->region.y == b->region.y
+		&& a->region.width == b->region.width
+		&& a->region.height == b->region.height
+		&& a->mask.object_num == b->mask.object_num
+		&& a->mask.generation == b->mask.generation;
+}
+
+/// TABLE ///
+
+local ImageCacheEntry *find_entry(ImageCache *cache, const ImageKey *key, u64 hash) {
+	ImageCacheEntry *e = cache->buckets[hash & (cache->n_buckets - 1)];
+	while (e && !(e->hash == hash && key_equal(&e->key, key))) e = e->next;
+	return e;
+}
+
+local void grow_buckets(ImageCache *cache) {
+	u32 n_buckets = cache->n_buckets * 2;
+	ImageCacheEntry **buckets = mem_calloc(MEM_TAG_OBJECTS, n_buckets * sizeof(*buckets));
+
+	for (u32 i = 0; i < cache->n_buckets; i++) {
+		ImageCacheEntry *e = cache->buckets[i];
+		while (e) {
+			ImageCacheEntry *next = e->next;
+			ImageCacheEntry **bucket = &buckets[e->hash & (n_buckets - 1)];
+			e->next = *bucket;
+			*bucket = e;
+			e = next;
+		}
+	}
+
+	mem_free(cache->buckets);
+	cache->buckets = buckets;
+	cache->n_buckets = n_buckets;
+}
+
+local void insert_entry(ImageCache *cache, ImageCacheEntry *e) {
+	if (cache->n_entries >= cache->n_buckets) grow_buckets(cache);
+
+	ImageCacheEntry **bucket = &cache->buckets[e->hash & (cache->n_buckets - 1)];
+	e->next = *bucket;
+	*bucket = e;
+	cache->n_entries += 1;
+	cache->bytes += e->bytes;
+}
+
+local void remove_entry(ImageCache *cache, ImageCacheEntry *e) {
+	ImageCacheEntry **link = &cache->buckets[e->hash & (cache->n_buckets - 1)];
+	while (*link != e) link = &(*link)->next;
+	*link = e->next;
+	cache->n_entries -= 1;
+	cache->bytes -= e->bytes;
+}
+
+/// LRU ///
+
+local void lru_push(ImageCache *cache, ImageCacheEntry *e) {
+	e->lru_prev = cache->lru_last;
+	e->lru_next = NULL;
+	if (cache->lru_last) cache->lru_last->lru_next = e;
+	else cache->lru_first = e;
+	cache->lru_last = e;
+}
+
+local void lru_unlink(ImageCache *cache, ImageCacheEntry *e) {
+	if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+	else cache->lru_first = e->lru_next;
+	if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+	else cache->lru_last = e->lru_prev;
+	e->lru_prev = NULL;
+	e->lru_next = NULL;
+}
+
+local void free_entry(ImageCache *cache, ImageCacheEntry *e) {
+	remove_entry(cache, e);
+	buffer_pool_release(e->image.data);
+	mem_free(e);
+}
+
+// frees unreferenced entries, least recently released first, until the cache holds at most budget bytes
+local void evict(ImageCache *cache, u64 budget) {
+	while (cache->bytes > budget && cache->lru_first) {
+		ImageCacheEntry *e = cache->lru_first;
+		lru_unlink(cache, e);
+		free_entry(cache, e);
+		cache->stats.evictions += 1;
+	}
+}
+
+/// CACHE ///
+
+void image_cache_init(ImageCache *cache, u64 budget) {
+	*cache = (ImageCache){
+		.buckets = mem_calloc(MEM_TAG_OBJECTS, MIN_BUCKETS * sizeof(*cache->buckets)),
+		.n_buckets = MIN_BUCKETS,
+		.budget = budget,
+	};
+}
+
+const RawImage *image_cache_acquire(ImageCache *cache, ImageKey key, ImageDecoder decoder) {
+	u64 hash = hash_key(&key);
+
+	ImageCacheEntry *e = find_entry(cache, &key, hash);
+	if (e) {
+		if (e->refcount == 0) lru_unlink(cache, e);
+		e->refcount += 1;
+		cache->stats.hits += 1;
+		return &e->image;
+	}
+	if (!decoder.fn) return NULL;
+
+	cache->stats.misses += 1;
+	RawImage image = decoder.fn(decoder.user_data, &key);
+	// nothing is cached for an image that could not be decoded, the next acquire tries again
+	if (!image.data) return NULL;
+
+	e = mem_alloc(MEM_TAG_OBJECTS, sizeof(*e));
+	*e = (ImageCacheEntry){
+		.image = image,
+		.key = key,
+		.hash = hash,
+		.bytes = (u64)image.width * image.height * image.n_channels,
+		.refcount = 1,
+	};
+	insert_entry(cache, e);
+
+	// make room for the new image in what is not referenced
+	evict(cache, cache->budget);
+	return &e->image;
+}
+
+local RawImage decode_dct(void *user_data, const ImageKey *key) {
+	DCTImage *image = user_data;
+	if (key->region.width == 0) {
+		return dct_decode_parallel(image->jpeg.data, image->jpeg.size, key->scale, image->output);
+	}
+	return dct_decode_region(image->jpeg.data, image->jpeg.size, key->scale, image->output, key->region);
+}
+
+const RawImage *image_cache_acquire_dct(ImageCache *cache, Reference ref, DCTImage *image, u32 target_width, u32 target_height) {
+	ImageKey key = {
+		.ref = ref,
+		.pipeline = IMAGE_PIPELINE_DCT,
+		.output = image->output,
+		.scale = dct_pick_scale(image->width, image->height, target_width, target_height),
+	};
+	ImageDecoder decoder = { .fn = decode_dct, .user_data = image };
+	return image_cache_acquire(cache, key, decoder);
+}
+
+typedef struct XObjectImage {
+	ImageSamples samples;
+	SoftMask mask;
+	bool has_mask;
+} XObjectImage;
+
+local RawImage decode_xobject(void *user_data, const ImageKey *key) {
+	(void)key;
+	const XObjectImage *image = user_data;
+	return image_assemble(&image->samples, image->has_mask ? &image->mask : NULL, (ImageTarget){ 0 });
+}
+
+const RawImage *image_cache_acquire_xobject(ImageCache *cache, const PDF *pdf, Reference ref) {
+	PDFObject ref_obj = obj_from_reference(ref);
+	PDFObject *obj = resolve_object(pdf, &ref_obj);
+	if (!obj || obj->kind != OBJ_DECODED_STREAM) return NULL;
+
+	// only the dictionaries are read here, the pixels are converted on a miss
+	XObjectImage image = { 0 };
+	const DecodedStream *stream = &obj->data.decoded_stream;
+	if (!image_samples_from_stream(pdf, stream, &image.samples)) return NULL;
+	image.has_mask = soft_mask_from_dict(pdf, &stream->raw_stream.dict, &image.mask);
+
+	ImageKey key = {
+		.ref = ref,
+		.pipeline = IMAGE_PIPELINE_XOBJECT,
+		.output = DCT_OUTPUT_RGBA,
+		.scale = DCT_SCALE_FULL,
+	};
+	if (image.has_mask) key.mask = image.mask.ref;
+	ImageDecoder decoder = { .fn = decode_xobject, .user_data = &image };
+	return image_cache_acquire(cache, key, decoder);
+}
+
+void image_cache_release(ImageCache *cache, const RawImage *image) {
+	if (!image) return;
+
+	ImageCacheEntry *e = (ImageCacheEntry *)image;
+	ASSERT_MSG(e->refcount > 0, "image %llu %llu released more often than acquired",
+		(unsigned long long)e->key.ref.object_num, (unsigned long long)e->key.ref.generation);
+
+	e->refcount -= 1;
+	if (e->refcount == 0) {
+		lru_push(cache, e);
+		evict(cache, cache->budget);
+	}
+}
+
+void image_cache_set_budget(ImageCache *cache, u64 budget) {
+	cache->budget = budget;
+	evict(cache, budget);
+}
+
+void image_cache_trim(ImageCache *cache) {
+	evict(cache, 0);
+}
+
+void image_cache_free(ImageCache *cache) {
+	image_cache_trim(cache);
+	ASSERT_MSG(cache->n_entries == 0, "%u images are still referenced", cache->n_entries);
+
+	mem_free(cache->buckets);
+	*cache = (ImageCache){ 0 };
+}
+
+void print_image_cache(const ImageCache *cache) {
+	u32 n_referenced = 0;
+	for (u32 i = 0; i < cache->n_buckets; i++) {
+		for (ImageCacheEntry *e = cache->buckets[i]; e; e = e->next) n_referenced += e->refcount > 0;
+	}
+
+	printf("image cache  entries: %u (%u referenced)  size: %10.2f KiB  budget: %10.2f KiB\n",
+		cache->n_entries, n_referenced, cache->bytes / 1024.0, cache->budget / 1024.0);
+	printf("             hits: %llu  misses: %llu  evictions: %llu\n",
+		(unsigned long long)cache->stats.hits, (unsigned long long)cache->stats.misses,
+		(unsigned long long)cache->stats.evictions);
+}
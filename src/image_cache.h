@@ -0,0 +1,84 @@
+#pragma once
+
+#include "filters.h"
+
+// decoded images shared by all pages that draw the same image object. an entry is keyed by the object
+// reference, the pipeline that decoded it and its pixel layout, the decode scale, the decoded region and
+// the soft mask merged into it, and is refcounted
+// by the pages that show it.
+// released entries stay cached until the cache is over its byte budget, then the least recently
+// released ones are freed. referenced entries are never freed, so the cache can go over its budget.
+// the cache is not thread safe, decoders may still use parallel_for
+
+// how the pixels of an entry were made, the same object gives different images through each
+enum ImagePipeline {
+    IMAGE_PIPELINE_DCT,     // the jpeg decoded in the layout of output
+    IMAGE_PIPELINE_XOBJECT, // the image XObject assembled to premultiplied RGBA
+};
+
+typedef struct ImageKey {
+    Reference ref;
+    enum ImagePipeline pipeline;
+    enum DCTOutput output; // DCT_OUTPUT_RGBA for IMAGE_PIPELINE_XOBJECT
+    enum DCTScale scale;
+    ImageRegion region; // in pixels of the scaled image, all zero for the whole image
+    Reference mask;     // /SMask merged into the alpha of the image, all zero without one
+} ImageKey;
+
+// decodes the image of key into a buffer from the buffer pool, an image without data if it can't be decoded
+typedef RawImage (*ImageDecodeFn)(void *user_data, const ImageKey *key);
+
+typedef struct ImageDecoder {
+    ImageDecodeFn fn;
+    void *user_data;
+} ImageDecoder;
+
+typedef struct ImageCacheEntry {
+    RawImage image; // first member, a pointer to the image is a pointer to its entry
+    ImageKey key;
+    u64 hash;
+    u64 bytes;
+    u32 refcount;
+    struct ImageCacheEntry *next; // in the bucket
+    // unreferenced entries in the order they were released
+    struct ImageCacheEntry *lru_prev;
+    struct ImageCacheEntry *lru_next;
+} ImageCacheEntry;
+
+typedef struct ImageCacheStats {
+    u64 hits;
+    u64 misses;
+    u64 evictions;
+} ImageCacheStats;
+
+typedef struct ImageCache {
+    ImageCacheEntry **buckets; // power of two count
+    u32 n_buckets;
+    u32 n_entries;
+    ImageCacheEntry *lru_first; // evicted first
+    ImageCacheEntry *lru_last;
+    u64 bytes;  // pixel data of all entries
+    u64 budget; // bytes
+    ImageCacheStats stats;
+} ImageCache;
+
+void image_cache_init(ImageCache *cache, u64 budget);
+// the image of key, decoded with decoder if it is not cached yet. the image stays valid until it is
+// released. with a NULL decoder only a cached image is returned, NULL if there is none. NULL as well if
+// the decoder gave no image
+const RawImage *image_cache_acquire(ImageCache *cache, ImageKey key, ImageDecoder decoder);
+// like image_cache_acquire, the image is decoded from the jpeg of a DCTImage at the scale dct_image_get picks
+const RawImage *image_cache_acquire_dct(ImageCache *cache, Reference ref, DCTImage *image, u32 target_width, u32 target_height);
+// like image_cache_acquire, the image XObject at ref is assembled to RGBA, premultiplied by its /SMask if
+// it has one. the masked image is cached next to the image under the same ref. NULL if ref is not an image
+const RawImage *image_cache_acquire_xobject(ImageCache *cache, const PDF *pdf, Reference ref);
+// drops a reference taken by image_cache_acquire
+void image_cache_release(ImageCache *cache, const RawImage *image);
+// evicts unreferenced entries until the cache fits the new budget
+void image_cache_set_budget(ImageCache *cache, u64 budget);
+// frees every unreferenced entry
+void image_cache_trim(ImageCache *cache);
+// all images have to be released
+void image_cache_free(ImageCache *cache);
+
+void print_image_cache(const ImageCache *cache);
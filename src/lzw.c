@@ -0,0 +1,151 @@
+#include "lzw.h"
+#include "memory.h"
+#include "buffer_pool.h"
+
+#include <string.h>
+
+#define LZW_CLEAR 256
+#define LZW_EOD 257
+#define LZW_FIRST_CODE 258
+#define LZW_MIN_CODE_LEN 9
+#define LZW_MAX_CODE_LEN 12
+
+// room for the longest possible string and for copying short strings in one 16 byte block
+#define LZW_SLACK (LZW_MAX_CODES + 16)
+
+local void lzw_reset(LZWDecoder *d) {
+	d->code_len = LZW_MIN_CODE_LEN;
+	d->next_code = LZW_FIRST_CODE;
+	d->has_prev = false;
+	d->output_len = 0;
+	d->sent_len = 0;
+	d->frozen_len = 0;
+}
+
+void lzw_init(LZWDecoder *d, u32 early_change, DecodeSink next) {
+	ASSERT_NOT_NULL(next.fn);
+
+	*d = (LZWDecoder){
+		.next = next,
+		.early_change = early_change ? 1 : 0,
+		.output = buffer_pool_acquire(INFLATE_WINDOW + LZW_SLACK),
+		.table = (LZWEntry *)buffer_pool_acquire(LZW_MAX_CODES * sizeof(LZWEntry)),
+	};
+	lzw_reset(d);
+}
+
+void lzw_free(LZWDecoder *d) {
+	buffer_pool_release(d->output);
+	buffer_pool_release((u8 *)d->table);
+	*d = (LZWDecoder){ 0 };
+}
+
+// passes on everything decoded since the last call
+local bool lzw_send(LZWDecoder *d) {
+	if (d->output_len > d->sent_len && !d->stopped) {
+		d->stopped = !d->next.fn(d->next.user_data, d->output + d->sent_len, d->output_len - d->sent_len);
+	}
+	d->sent_len = d->output_len;
+
+	// once the table is full no entry refers to newer output, so it does not have to be kept
+	if (d->frozen_len != 0) {
+		d->output_len = d->frozen_len;
+		d->sent_len = d->frozen_len;
+	}
+
+	return !d->stopped;
+}
+
+// strings are copied from earlier output to its end, so they never overlap. short strings are
+// copied as one block, the bytes after them are overwritten by the next string
+local inline void copy_string(u8 *dst, const u8 *src, u32 len) {
+	if (len <= 16) {
+		u8 block[16];
+		memcpy(block, src, 16);
+		memcpy(dst, block, 16);
+	}
+	else {
+		memcpy(dst, src, len);
+	}
+}
+
+local bool lzw_write(void *user_data, const u8 *data, u64 len) {
+	LZWDecoder *d = user_data;
+	if (d->stopped) return false;
+
+	u64 i = 0;
+	while (!d->ended) {
+		while (d->n_bits < d->code_len && i < len) {
+			d->bits = d->bits << 8 | data[i++];
+			d->n_bits += 8;
+		}
+		if (d->n_bits < d->code_len) break;
+
+		d->n_bits -= d->code_len;
+		u32 code = (u32)(d->bits >> d->n_bits) & ((1u << d->code_len) - 1);
+
+		if (code == LZW_CLEAR) {
+			if (!lzw_send(d)) return false;
+			lzw_reset(d);
+			continue;
+		}
+		if (code == LZW_EOD) {
+			d->ended = true;
+			break;
+		}
+
+		if (d->output_len + LZW_SLACK > mem_size(d->output)) {
+			ASSERT_MSG(d->output_len < U32_MAX / 2, "LZW output without clear code is too large");
+			d->output = buffer_pool_grow(d->output, d->output_len, 2 * mem_size(d->output));
+		}
+
+		u8 *output = d->output;
+		u8 *dst = output + d->output_len;
+		LZWEntry curr = { .offset = (u32)d->output_len };
+
+		if (code < 256) {
+			*dst = (u8)code;
+			curr.len = 1;
+		}
+		else if (code < d->next_code) {
+			LZWEntry e = d->table[code];
+			copy_string(dst, output + e.offset, e.len);
+			curr.len = e.len;
+		}
+		else if (code == d->next_code && d->has_prev) {
+			// the entry that is being defined: previous string + its first byte
+			copy_string(dst, output + d->prev.offset, d->prev.len);
+			dst[d->prev.len] = output[d->prev.offset];
+			curr.len = d->prev.len + 1;
+		}
+		else {
+			PANIC("invalid LZW code: %u", code);
+		}
+		d->output_len += curr.len;
+
+		if (d->has_prev && d->next_code < LZW_MAX_CODES) {
+			d->table[d->next_code] = (LZWEntry){ .offset = d->prev.offset, .len = d->prev.len + 1 };
+			d->next_code += 1;
+
+			if (d->next_code + d->early_change >= (1u << d->code_len) && d->code_len < LZW_MAX_CODE_LEN) {
+				d->code_len += 1;
+			}
+			if (d->next_code == LZW_MAX_CODES) d->frozen_len = d->output_len;
+		}
+
+		d->prev = curr;
+		d->has_prev = true;
+
+		if (d->output_len - d->sent_len >= INFLATE_WINDOW && !lzw_send(d)) return false;
+	}
+
+	return lzw_send(d);
+}
+
+DecodeSink lzw_sink(LZWDecoder *d) {
+	return (DecodeSink){ .fn = lzw_write, .user_data = d };
+}
+
+bool lzw_finish(LZWDecoder *d) {
+	return lzw_send(d);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "decompress.h"
+
+// streaming LZWDecode. the decoded output is kept in one buffer since the last clear code and
+// every table entry is an (offset, length) slice of it: the string of a new entry is the previous
+// string followed by the first byte of the current one, which is exactly where it occurs in the output.
+// decoding a code is a single copy, without per code allocations or walking prefix chains
+
+#define LZW_MAX_CODES 4096
+
+typedef struct LZWEntry {
+    u32 offset;
+    u32 len;
+} LZWEntry;
+
+typedef struct LZWDecoder {
+    DecodeSink next;
+    u32 early_change; // /EarlyChange, 1 if codes get longer one code early (default)
+
+    u32 code_len;
+    u32 next_code;
+    u64 bits;
+    u32 n_bits;
+
+    LZWEntry prev; // string of the previous code
+    bool has_prev;
+
+    u8 *output;    // pooled, everything decoded since the last clear code
+    u64 output_len;
+    u64 sent_len;  // bytes of output already passed on
+    u64 frozen_len; // output referenced by a full table, 0 if the table is not full
+
+    bool ended;    // reached the end of data code
+    bool stopped;  // the next sink stopped decoding
+    LZWEntry *table; // pooled, LZW_MAX_CODES entries
+} LZWDecoder;
+
+void lzw_init(LZWDecoder *d, u32 early_change, DecodeSink next);
+DecodeSink lzw_sink(LZWDecoder *d);
+// passes on the remaining output, returns false if the next sink stopped
+bool lzw_finish(LZWDecoder *d);
+void lzw_free(LZWDecoder *d);
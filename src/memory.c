@@ -0,0 +1,138 @@
+#include "memory.h"
+
+#include <string.h>
+#include <stdatomic.h>
+
+// every allocation is prefixed with a header, the size keeps the user pointer 16 byte aligned
+typedef struct MemHeader {
+	u64 size;
+	u32 tag;
+	u32 magic;
+} MemHeader;
+
+static_assert(sizeof(MemHeader) == 16, "allocation alignment");
+
+#define MEM_MAGIC 0x6d656d21u
+
+typedef struct MemCounter {
+	_Atomic u64 current;
+	_Atomic u64 peak;
+	_Atomic u64 budget;
+} MemCounter;
+
+local MemCounter counters[MEM_TAG_COUNT];
+
+local inline MemHeader *get_header(const void *ptr) {
+	MemHeader *header = (MemHeader *)ptr - 1;
+	ASSERT_MSG(header->magic == MEM_MAGIC, "pointer was not allocated with mem_alloc");
+	return header;
+}
+
+void mem_track_alloc(enum MemTag tag, u64 size) {
+	ASSERT(tag < MEM_TAG_COUNT);
+	MemCounter *counter = &counters[tag];
+
+	u64 current = atomic_fetch_add(&counter->current, size) + size;
+	u64 peak = atomic_load(&counter->peak);
+	while (current > peak && !atomic_compare_exchange_weak(&counter->peak, &peak, current));
+}
+
+void mem_track_free(enum MemTag tag, u64 size) {
+	ASSERT(tag < MEM_TAG_COUNT);
+	atomic_fetch_sub(&counters[tag].current, size);
+}
+
+void mem_set_budget(enum MemTag tag, u64 budget) {
+	ASSERT(tag < MEM_TAG_COUNT);
+	atomic_store(&counters[tag].budget, budget);
+}
+
+void *mem_alloc(enum MemTag tag, u64 size) {
+	MemHeader *header = malloc(sizeof(MemHeader) + size);
+	ASSERT_MSG(header, "out of memory, could not allocate %llu bytes", (unsigned long long)size);
+
+	*header = (MemHeader){ .size = size, .tag = tag, .magic = MEM_MAGIC };
+	mem_track_alloc(tag, size);
+
+	return header + 1;
+}
+
+void *mem_calloc(enum MemTag tag, u64 size) {
+	void *ptr = mem_alloc(tag, size);
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+void *mem_realloc(enum MemTag tag, void *ptr, u64 size) {
+	if (!ptr) return mem_alloc(tag, size);
+
+	MemHeader *header = get_header(ptr);
+	enum MemTag ptr_tag = header->tag;
+	u64 prev_size = header->size;
+
+	header = realloc(header, sizeof(MemHeader) + size);
+	ASSERT_MSG(header, "out of memory, could not allocate %llu bytes", (unsigned long long)size);
+	header->size = size;
+
+	if (size > prev_size) mem_track_alloc(ptr_tag, size - prev_size);
+	else mem_track_free(ptr_tag, prev_size - size);
+
+	return header + 1;
+}
+
+void mem_free(void *ptr) {
+	if (!ptr) return;
+
+	MemHeader *header = get_header(ptr);
+	mem_track_free(header->tag, header->size);
+	header->magic = 0;
+	free(header);
+}
+
+u64 mem_size(const void *ptr) {
+	return get_header(ptr)->size;
+}
+
+// stb_ds hooks (see utils.h), all dynamic arrays belong to parsed object trees
+void *mem_stbds_realloc(void *ptr, size_t size) {
+	return mem_realloc(MEM_TAG_OBJECTS, ptr, size);
+}
+
+void mem_stbds_free(void *ptr) {
+	mem_free(ptr);
+}
+
+MemReport mem_report(void) {
+	MemReport report = { 0 };
+
+	for (u32 i = 0; i < MEM_TAG_COUNT; i++) {
+		report.categories[i] = (MemCategoryReport){
+			.current = atomic_load(&counters[i].current),
+			.peak = atomic_load(&counters[i].peak),
+			.budget = atomic_load(&counters[i].budget),
+		};
+	}
+
+	return report;
+}
+
+const char *mem_tag_to_str(enum MemTag tag) {
+	switch (tag) {
+	case MEM_TAG_PDF_CONTENT: return "pdf_content";
+	case MEM_TAG_OBJECTS: return "objects";
+	case MEM_TAG_DECODE: return "decode";
+	case MEM_TAG_VMA: return "vma";
+
+	default: PANIC("unknown MemTag: %u", tag);
+	}
+}
+
+void print_mem_report(MemReport report) {
+	for (u32 i = 0; i < MEM_TAG_COUNT; i++) {
+		MemCategoryReport c = report.categories[i];
+		printf("%-12s current: %10.2f KiB  peak: %10.2f KiB",
+			mem_tag_to_str(i), c.current / 1024.0, c.peak / 1024.0);
+		if (c.budget != 0) printf("  budget: %10.2f KiB", c.budget / 1024.0);
+		printf("\n");
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "utils.h"
+
+// every allocation is accounted to one of these categories
+enum MemTag {
+    MEM_TAG_PDF_CONTENT, // raw content of the pdf file
+    MEM_TAG_OBJECTS,     // parsed object trees (stb_ds arrays, xref table, object buffer)
+    MEM_TAG_DECODE,      // decoded stream buffers and images
+    MEM_TAG_VMA,         // device memory blocks allocated by vma
+
+    MEM_TAG_COUNT,
+};
+
+typedef struct MemCategoryReport {
+    u64 current; // bytes
+    u64 peak;    // bytes
+    u64 budget;  // bytes, 0 if the category has no known budget
+} MemCategoryReport;
+
+typedef struct MemReport {
+    MemCategoryReport categories[MEM_TAG_COUNT];
+} MemReport;
+
+// counting allocators, memory returned by these must be freed with mem_free
+void *mem_alloc(enum MemTag tag, u64 size);
+void *mem_calloc(enum MemTag tag, u64 size);
+// keeps the tag of ptr, or uses tag if ptr is NULL
+void *mem_realloc(enum MemTag tag, void *ptr, u64 size);
+void mem_free(void *ptr);
+// requested size of an allocation returned by mem_alloc
+u64 mem_size(const void *ptr);
+
+// accounting for memory not allocated through mem_alloc (e.g. vma)
+void mem_track_alloc(enum MemTag tag, u64 size);
+void mem_track_free(enum MemTag tag, u64 size);
+void mem_set_budget(enum MemTag tag, u64 budget);
+
+MemReport mem_report(void);
+
+const char *mem_tag_to_str(enum MemTag tag);
+void print_mem_report(MemReport report);
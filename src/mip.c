@@ -0,0 +1,233 @@
+#include "mip.h"
+#include "buffer_pool.h"
+#include "simd.h"
+#include "threads.h"
+
+#include <string.h>
+
+// output rows of a level reduced by one parallel_for index
+#define MIP_BAND_ROWS 32
+// smaller levels are reduced on the calling thread
+#define MIP_PARALLEL_MIN_PIXELS (1u << 16)
+
+typedef struct ReduceJob {
+	const RawImage *src;
+	RawImage *dst;
+} ReduceJob;
+
+/// SCALAR ///
+
+// averages the 2x2 blocks of two rows into the output pixels [start, out_width). the second column
+// is clamped, so an image one pixel wide averages its rows only
+local void reduce_scalar(u8 *out, const u8 *r0, const u8 *r1, u32 in_width, u32 out_width, u32 n_channels, u32 start) {
+	for (u32 x = start; x < out_width; x++) {
+		u64 x0 = (u64)2 * x * n_channels;
+		u64 x1 = (u64)MIN(2 * x + 1, in_width - 1) * n_channels;
+		for (u32 c = 0; c < n_channels; c++) {
+			u32 sum = (u32)r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c];
+			out[(u64)x * n_channels + c] = (u8)((sum + 2) >> 2);
+		}
+	}
+}
+
+/// SIMD ///
+
+// like reduce_scalar without the clamping, every function returns the pixel at which the scalar
+// version has to continue. the sums of four samples fit 16 bit lanes and are rounded like the scalar ones
+
+#if PTRAIL_SSE2
+
+local inline __m128i round_quarter_epi16(__m128i sum) {
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+// sums of the byte pairs of both rows in 16 bit lanes
+local inline __m128i byte_pair_sum(__m128i a, __m128i b) {
+	__m128i mask = _mm_set1_epi16(0x00ff);
+	__m128i even = _mm_add_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+	__m128i odd = _mm_add_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+	return _mm_add_epi16(even, odd);
+}
+
+// sums of the 4 byte pixel pairs (0, 1) and (2, 3) of both rows in 16 bit lanes
+local inline __m128i pixel_pair_sum(__m128i a, __m128i b) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+	__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+	return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+}
+
+local u32 reduce1_simd(u8 *out, const u8 *r0, const u8 *r1, u32 out_width) {
+	u32 x = 0;
+	for (; x + 16 <= out_width; x += 16) {
+		const u8 *a = r0 + 2 * x;
+		const u8 *b = r1 + 2 * x;
+		__m128i lo = byte_pair_sum(_mm_loadu_si128((const __m128i *)a), _mm_loadu_si128((const __m128i *)b));
+		__m128i hi = byte_pair_sum(_mm_loadu_si128((const __m128i *)(a + 16)), _mm_loadu_si128((const __m128i *)(b + 16)));
+		_mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(round_quarter_epi16(lo), round_quarter_epi16(hi)));
+	}
+	return x;
+}
+
+// 3 channel pixels have no SSE2 version: without a byte shuffle, gathering the channels of the pixel
+// pairs costs more than the scalar loop
+
+local u32 reduce4_simd(u8 *out, const u8 *r0, const u8 *r1, u32 out_width) {
+	u32 x = 0;
+	for (; x + 4 <= out_width; x += 4) {
+		const u8 *a = r0 + 8 * x;
+		const u8 *b = r1 + 8 * x;
+		__m128i lo = pixel_pair_sum(_mm_loadu_si128((const __m128i *)a), _mm_loadu_si128((const __m128i *)b));
+		__m128i hi = pixel_pair_sum(_mm_loadu_si128((const __m128i *)(a + 16)), _mm_loadu_si128((const __m128i *)(b + 16)));
+		_mm_storeu_si128((__m128i *)(out + 4 * x), _mm_packus_epi16(round_quarter_epi16(lo), round_quarter_epi16(hi)));
+	}
+	return x;
+}
+
+#elif PTRAIL_NEON
+
+// pairwise widening adds of both rows, the rounding narrow computes (sum + 2) >> 2
+local inline uint8x8_t reduce_plane(uint8x16_t a, uint8x16_t b) {
+	return vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(a), b), 2);
+}
+
+local u32 reduce1_simd(u8 *out, const u8 *r0, const u8 *r1, u32 out_width) {
+	u32 x = 0;
+	for (; x + 8 <= out_width; x += 8) {
+		vst1_u8(out + x, reduce_plane(vld1q_u8(r0 + 2 * x), vld1q_u8(r1 + 2 * x)));
+	}
+	return x;
+}
+
+// the structured loads split the pixels into one plane per channel
+local u32 reduce3_simd(u8 *out, const u8 *r0, const u8 *r1, u32 out_width) {
+	u32 x = 0;
+	for (; x + 8 <= out_width; x += 8) {
+		uint8x16x3_t a = vld3q_u8(r0 + 6 * x);
+		uint8x16x3_t b = vld3q_u8(r1 + 6 * x);
+		uint8x8x3_t d;
+		for (u32 c = 0; c < 3; c++) d.val[c] = reduce_plane(a.val[c], b.val[c]);
+		vst3_u8(out + 3 * x, d);
+	}
+	return x;
+}
+
+local u32 reduce4_simd(u8 *out, const u8 *r0, const u8 *r1, u32 out_width) {
+	u32 x = 0;
+	for (; x + 8 <= out_width; x += 8) {
+		uint8x16x4_t a = vld4q_u8(r0 + 8 * x);
+		uint8x16x4_t b = vld4q_u8(r1 + 8 * x);
+		uint8x8x4_t d;
+		for (u32 c = 0; c < 4; c++) d.val[c] = reduce_plane(a.val[c], b.val[c]);
+		vst4_u8(out + 4 * x, d);
+	}
+	return x;
+}
+
+#endif
+
+/// REDUCE ///
+
+local void reduce_rows(const RawImage *src, RawImage *dst, u32 first_row, u32 end_row) {
+	u32 n_channels = src->n_channels;
+	u64 src_stride = (u64)src->width * n_channels;
+	u64 dst_stride = (u64)dst->width * n_channels;
+
+	for (u32 y = first_row; y < end_row; y++) {
+		const u8 *r0 = src->data + src_stride * (2 * y);
+		const u8 *r1 = src->data + src_stride * MIN(2 * y + 1, src->height - 1);
+		u8 *out = dst->data + dst_stride * y;
+
+		u32 x = 0;
+#if PTRAIL_SIMD
+		if (n_channels == 1) x = reduce1_simd(out, r0, r1, dst->width);
+		else if (n_channels == 4) x = reduce4_simd(out, r0, r1, dst->width);
+#endif
+#if PTRAIL_NEON
+		if (n_channels == 3) x = reduce3_simd(out, r0, r1, dst->width);
+#endif
+		reduce_scalar(out, r0, r1, src->width, dst->width, n_channels, x);
+	}
+}
+
+local void reduce_band(void *user_data, u32 band) {
+	const ReduceJob *job = user_data;
+	u32 first_row = band * MIP_BAND_ROWS;
+	reduce_rows(job->src, job->dst, first_row, MIN(first_row + MIP_BAND_ROWS, job->dst->height));
+}
+
+void mip_reduce(const RawImage *src, RawImage *dst) {
+	ASSERT_MSG(dst->width == mip_level_size(src->width, 1) && dst->height == mip_level_size(src->height, 1),
+		"%ux%u is not the next level of %ux%u", dst->width, dst->height, src->width, src->height);
+	ASSERT_MSG(dst->n_channels == src->n_channels, "channel count changes from %u to %u", src->n_channels, dst->n_channels);
+
+	if ((u64)dst->width * dst->height < MIP_PARALLEL_MIN_PIXELS) {
+		reduce_rows(src, dst, 0, dst->height);
+		return;
+	}
+
+	ReduceJob job = { .src = src, .dst = dst };
+	parallel_for((dst->height + MIP_BAND_ROWS - 1) / MIP_BAND_ROWS, reduce_band, &job);
+}
+
+/// CHAIN ///
+
+u32 mip_level_count(u32 width, u32 height) {
+	u32 count = 1;
+	while (width > 1 || height > 1) {
+		width = mip_level_size(width, 1);
+		height = mip_level_size(height, 1);
+		count += 1;
+	}
+	return count;
+}
+
+u32 mip_level_size(u32 size, u32 level) {
+	if (level >= 32) return 1;
+	return MAX(size >> level, 1);
+}
+
+// every level is reduced from the one before it. the first reduction reads the whole image, all
+// levels after it only add a third to its work, so the coarse levels follow right after it
+MipChain mip_chain_build(const RawImage *image, u32 n_levels, ImageTarget target, MipSink sink) {
+	ASSERT_MSG(image->n_channels == 1 || image->n_channels == 3 || image->n_channels == 4,
+		"unsupported channel count: %u", image->n_channels);
+
+	MipChain chain = {
+		.n_levels = MIN(MAX(n_levels, 1), mip_level_count(image->width, image->height)),
+	};
+	chain.levels[0] = *image;
+
+	for (u32 i = 1; i < chain.n_levels; i++) {
+		const RawImage *src = &chain.levels[i - 1];
+		RawImage *dst = &chain.levels[i];
+		*dst = (RawImage){
+			.width = mip_level_size(src->width, 1),
+			.height = mip_level_size(src->height, 1),
+			.n_channels = src->n_channels,
+			.format = src->format,
+		};
+		// a level the target has no room for comes from the buffer pool, like in image_target_alloc
+		u64 size = (u64)dst->width * dst->height * dst->n_channels;
+		dst->data = target.fn ? target.fn(target.user_data, dst, size) : NULL;
+		if (!dst->data) {
+			dst->data = buffer_pool_acquire(size);
+			chain.pooled |= 1u << i;
+		}
+		mip_reduce(src, dst);
+	}
+
+	if (sink.fn) {
+		for (u32 i = chain.n_levels; i-- > 0;) {
+			if (!sink.fn(sink.user_data, &chain.levels[i], i)) break;
+		}
+	}
+	return chain;
+}
+
+void mip_chain_free(MipChain *chain) {
+	for (u32 i = 1; i < chain->n_levels; i++) {
+		if (chain->pooled & (1u << i)) buffer_pool_release(chain->levels[i].data);
+	}
+	*chain = (MipChain){ 0 };
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "decompress.h"
+
+// mip chain of an image. every level halves the size of the one before it (rounded down, at least 1)
+// by averaging 2x2 blocks, an odd last row or column is dropped. level 0 is the image itself
+
+// a u32 size is down to 1 after at most 31 halvings
+#define MIP_MAX_LEVELS 32
+
+// receives a finished level, coarsest first. returns false to stop receiving levels
+typedef bool (*MipLevelFn)(void *user_data, const RawImage *level, u32 index);
+
+typedef struct MipSink {
+    MipLevelFn fn;
+    void *user_data;
+} MipSink;
+
+typedef struct MipChain {
+    RawImage levels[MIP_MAX_LEVELS]; // levels[0] is the source image, it is not owned by the chain
+    u32 n_levels;
+    u32 pooled; // bit per level that was allocated from the buffer pool
+} MipChain;
+
+// levels down to 1x1, including level 0
+u32 mip_level_count(u32 width, u32 height);
+// size of a level
+u32 mip_level_size(u32 size, u32 level);
+// builds levels 1 to n_levels - 1 of image on all threads, into memory from target. image needs 1, 3 or 4
+// channels. afterwards the levels are passed to sink from the coarsest one, so a preview can be shown
+// (and uploaded) before the large levels are. n_levels is clamped to mip_level_count
+MipChain mip_chain_build(const RawImage *image, u32 n_levels, ImageTarget target, MipSink sink);
+// halves src into dst, dst has the size of the next level
+void mip_reduce(const RawImage *src, RawImage *dst);
+// frees the levels that came from the buffer pool
+void mip_chain_free(MipChain *chain);
@@ -0,0 +1,96 @@
+#include "page_layout.h"
+#include "memory.h"
+
+#include <math.h>
+
+#define PI_F32 3.14159265358979f
+
+// versions are never reused, so a renderer can't mistake a new layout for the one it uploaded last
+local u64 next_layout_version = 1;
+
+// /Rotate can be negative, -90 is a quarter turn counterclockwise like 270
+local inline u32 quarter_turns(i32 rotate) {
+	ASSERT_MSG(rotate % 90 == 0, "/Rotate is not a multiple of 90: %d", rotate);
+	return (u32)(((rotate % 360) + 360) % 360) / 90;
+}
+
+// the boxes keep their sizes, only the positions change
+local void arrange(PageLayout *layout) {
+	f32 widest = 0.0f;
+	for (u32 i = 0; i < layout->n_pages; i++) widest = MAX(widest, layout->instances[i].width);
+
+	f32 y = layout->gap;
+	for (u32 i = 0; i < layout->n_pages; i++) {
+		PageInstance *page = &layout->instances[i];
+		page->x = layout->gap + (widest - page->width) / 2.0f;
+		page->y = y;
+		y += page->height + layout->gap;
+	}
+
+	layout->width = widest + 2.0f * layout->gap;
+	layout->height = y;
+	layout->version = next_layout_version++;
+}
+
+void page_layout_init(PageLayout *layout, const PageSize *sizes, u32 n_pages, f32 gap) {
+	*layout = (PageLayout){
+		.instances = mem_alloc(MEM_TAG_OBJECTS, MAX(n_pages, 1) * sizeof(PageInstance)),
+		.n_pages = n_pages,
+		.gap = gap,
+	};
+
+	for (u32 i = 0; i < n_pages; i++) {
+		u32 turns = quarter_turns(sizes[i].rotate);
+		bool sideways = turns % 2 == 1;
+		layout->instances[i] = (PageInstance){
+			.width = sideways ? sizes[i].height : sizes[i].width,
+			.height = sideways ? sizes[i].width : sizes[i].height,
+			.texture_index = PAGE_NO_TEXTURE,
+			.rotation = (f32)turns * PI_F32 / 2.0f,
+		};
+	}
+	arrange(layout);
+}
+
+void page_layout_set_rotation(PageLayout *layout, u32 page, i32 rotate) {
+	ASSERT_MSG(page < layout->n_pages, "page %u of %u", page, layout->n_pages);
+	PageInstance *instance = &layout->instances[page];
+
+	u32 turns = quarter_turns(rotate);
+	u32 old_turns = (u32)lrintf(instance->rotation / (PI_F32 / 2.0f)) % 4;
+	if ((turns + old_turns) % 2 == 1) {
+		f32 width = instance->width;
+		instance->width = instance->height;
+		instance->height = width;
+	}
+	instance->rotation = (f32)turns * PI_F32 / 2.0f;
+	arrange(layout);
+}
+
+PageRange page_layout_visible(const PageLayout *layout, f32 top, f32 bottom) {
+	const PageInstance *pages = layout->instances;
+
+	// first page whose bottom is below top
+	u32 lo = 0, hi = layout->n_pages;
+	while (lo < hi) {
+		u32 mid = lo + (hi - lo) / 2;
+		if (pages[mid].y + pages[mid].height <= top) lo = mid + 1;
+		else hi = mid;
+	}
+	u32 first = lo;
+
+	// first page that starts at or below bottom
+	hi = layout->n_pages;
+	while (lo < hi) {
+		u32 mid = lo + (hi - lo) / 2;
+		if (pages[mid].y < bottom) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return (PageRange){ .first = first, .count = lo - first };
+}
+
+void page_layout_free(PageLayout *layout) {
+	mem_free(layout->instances);
+	*layout = (PageLayout){ 0 };
+}
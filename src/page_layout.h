@@ -0,0 +1,50 @@
+#pragma once
+
+#include "utils.h"
+
+// pages of a document stacked from top to bottom and centered horizontally, in layout units
+// (points at a zoom of 1). every page is one instance of a unit quad, the renderer keeps the
+// instances in a buffer and rewrites it only when the version of the layout changes
+
+// texture_index of a quad that is drawn as blank paper
+#define PAGE_NO_TEXTURE U32_MAX
+
+// per instance vertex data of a page, or of a tile of one
+typedef struct PageInstance {
+    f32 x; // top left corner of the page box
+    f32 y;
+    f32 width; // box on the layout, turned with the page
+    f32 height;
+    u32 texture_index; // slot of the tile atlas
+    f32 rotation; // clockwise, radians
+    f32 texture_width; // part of the slot the quad shows, in atlas texture coordinates
+    f32 texture_height;
+} PageInstance;
+
+typedef struct PageSize {
+    f32 width; // media box
+    f32 height;
+    i32 rotate; // /Rotate, a multiple of 90 degrees, negative turns counterclockwise
+} PageSize;
+
+typedef struct PageLayout {
+    PageInstance *instances; // one per page, from the top
+    u32 n_pages;
+    f32 gap;    // around and between the pages
+    f32 width;  // widest page and the gaps next to it
+    f32 height; // all pages and the gaps between them
+    u64 version;
+} PageLayout;
+
+// pages [first, first + count)
+typedef struct PageRange {
+    u32 first;
+    u32 count;
+} PageRange;
+
+void page_layout_init(PageLayout *layout, const PageSize *sizes, u32 n_pages, f32 gap);
+// turns a page to rotate degrees (clockwise) and moves the pages below it
+void page_layout_set_rotation(PageLayout *layout, u32 page, i32 rotate);
+// pages that overlap the layout rows [top, bottom), found by binary search
+PageRange page_layout_visible(const PageLayout *layout, f32 top, f32 bottom);
+void page_layout_free(PageLayout *layout);
@@ -1,4 +1,6 @@
 #include "pdf_objects.h"
+#include "memory.h"
+#include "buffer_pool.h"
 
 #include <ctype.h>
 
@@ -29,12 +31,46 @@ DictionaryEntry *find_dict_entry(const Dictionary *dict, const char *str) {
 	return ret;
 }
 
+i64 find_dict_int(const Dictionary *dict, const char *str, i64 default_value) {
+	if (!dict) return default_value;
+
+	DictionaryEntry *entry = find_dict_entry(dict, str);
+	if (!entry || entry->object.kind != OBJ_INTEGER) return default_value;
+
+	return entry->object.data.integer.value;
+}
+
+bool find_dict_bool(const Dictionary *dict, const char *str, bool default_value) {
+	if (!dict) return default_value;
+
+	DictionaryEntry *entry = find_dict_entry(dict, str);
+	if (!entry || entry->object.kind != OBJ_BOOLEAN) return default_value;
+
+	return entry->object.data.boolean.value;
+}
+
+bool object_number(const PDFObject *obj, f32 *value) {
+	if (obj->kind == OBJ_INTEGER) *value = (f32)obj->data.integer.value;
+	else if (obj->kind == OBJ_REAL_NUMBER) *value = (f32)obj->data.real_number.value;
+	else return false;
+	return true;
+}
+
 DictionaryEntry *get_dict_entry(const Dictionary *dict, const char *str) {
 	DictionaryEntry *ret = find_dict_entry(dict, str);
 	ASSERT_MSG(ret, "could not find dict entry: %s", str);
 	return ret;
 }
 
+// objects are parsed in xref order, object n is at n - 1
+PDFObject *resolve_object(const PDF *pdf, PDFObject *obj) {
+	if (!obj || obj->kind != OBJ_REFERENCE) return obj;
+
+	u64 object_num = obj->data.reference.object_num;
+	if (object_num == 0 || object_num > pdf->xref_table.obj_count) return NULL;
+	return &pdf->object_buffer[object_num - 1];
+}
+
 
 #define X(TYP, VAR, IDNT)               \
 PDFObject obj_from_##IDNT(TYP IDNT) {   \
@@ -141,7 +177,7 @@ void print_decoded_stream(DecodedStream s) {
 
 	switch (s.kind) {
 	case STREAM_DATA_BUFFER: printf("Buffer: %lu", s.data.buffer.size); break;
-	case STREAM_DATA_IMAGE: printf("image: %u x %u", s.data.image.width, s.data.image.height); break;
+	case STREAM_DATA_IMAGE: printf("image: %u x %u %s", s.data.image.width, s.data.image.height, pixel_format_to_str(s.data.image.format)); break;
 	case STREAM_DATA_NONE: printf("raw buffer"); break;
 	default: PANIC("unhandled StreamDataKind: found: %i", s.kind); break;
 	}
@@ -162,6 +198,18 @@ const char *obj_kind_to_str(enum PDFObjectKind kind) {
 	}
 }
 
+const char *pixel_format_to_str(enum PixelFormat format) {
+	switch (format) {
+	case PIXEL_FORMAT_GRAY: return "Gray";
+	case PIXEL_FORMAT_RGB: return "RGB";
+	case PIXEL_FORMAT_CMYK: return "CMYK";
+	case PIXEL_FORMAT_RGBA: return "RGBA";
+	case PIXEL_FORMAT_BGRA: return "BGRA";
+
+	default: PANIC("unknown PixelFormat: %u", format);
+	}
+}
+
 void print_object_kind(enum PDFObjectKind kind) {
 	printf("%s", obj_kind_to_str(kind));
 }
@@ -210,11 +258,11 @@ void print_pdf(PDF pdf) {
 }
 
 local inline void free_buffer(Buffer b) {
-	free(b.data);
+	buffer_pool_release(b.data);
 }
 
 local inline void free_image(RawImage img) {
-	free(img.data);
+	buffer_pool_release(img.data);
 }
 
 void free_object(PDFObject *obj);
@@ -228,6 +276,7 @@ local inline void free_dictionary(Dictionary dict) {
 
 local inline void free_stream(Stream s) {
 	free_dictionary(s.dict);
+	arrfree(s.filters);
 }
 
 local inline void free_decoded_stream(DecodedStream ds) {
@@ -273,20 +322,24 @@ void free_object(PDFObject *obj) {
 local inline void free_xref_table(XRefTable *t) {
 	ASSERT(t->entries);
 
-	free(t->entries);
+	mem_free(t->entries);
 
 	*t = (XRefTable){ 0 };
 }
 
 local inline void free_pdf_content(PDFContent *c) {
 	ASSERT(c->data);
-	free(c->data);
+	mem_free(c->data);
 	*c = (PDFContent){ 0 };
 }
 
 void free_pdf(PDF *pdf) {
+	for (u64 i = 0; i < pdf->xref_table.obj_count; i++) {
+		free_object(&pdf->object_buffer[i]);
+	}
+
 	free_dictionary(pdf->trailer.dict);
 	free_xref_table(&pdf->xref_table);
-	free(pdf->object_buffer);
+	mem_free(pdf->object_buffer);
 	free_pdf_content(&pdf->content);
 }
@@ -60,18 +60,41 @@ typedef struct Dictionary {
     u64 count;
 } Dictionary;
 
+// layout of the pixels of a RawImage, 8 bits per channel
+enum PixelFormat {
+    PIXEL_FORMAT_GRAY,
+    PIXEL_FORMAT_RGB,
+    PIXEL_FORMAT_CMYK,
+    PIXEL_FORMAT_RGBA, // alpha is 255 unless the image has a mask
+    PIXEL_FORMAT_BGRA,
+};
+
 typedef struct RawImage {
     u8 *data;
     u32 width;
     u32 height;
     u8 n_channels;
+    enum PixelFormat format;
+    bool inverted; // CMYK of a jpeg with an Adobe marker, 255 is no ink
 } RawImage;
 
+// rectangle of an image in pixels
+typedef struct ImageRegion {
+    u32 x;
+    u32 y;
+    u32 width;
+    u32 height;
+} ImageRegion;
+
 enum FilterKind {
     FILTER_KIND_NONE,
     FILTER_KIND_FLATE,
     FILTER_KIND_DCT,
     FILTER_KIND_CCITTFAX,
+    FILTER_KIND_ASCII_HEX,
+    FILTER_KIND_ASCII85,
+    FILTER_KIND_RUN_LENGTH,
+    FILTER_KIND_LZW,
 };
 
 enum StreamDataKind {
@@ -85,11 +108,20 @@ union StreamData {
     RawImage image;
 };
 
+// maximum number of filters applied to a single stream
+#define STREAM_MAX_FILTERS 8
+
+typedef struct StreamFilter {
+    enum FilterKind kind;
+    const Dictionary *parms; // /DecodeParms of the filter, NULL if it has none
+} StreamFilter;
+
 // points to the encoded pdf stream
 typedef struct Stream {
     Dictionary dict;
     PDFSlice slice;
-    enum FilterKind filter_kind;
+    // /Filter in the order the filters are applied (stb_ds array)
+    StreamFilter *filters;
 } Stream;
 
 typedef struct DecodedStream {
@@ -179,6 +211,8 @@ X_PDF_OBJECTS
 #undef X
 
 PDFObject *derefrence_object(PDFObject *obj, XRefTable table);
+// the object a reference points to, other objects are returned as they are. NULL if the reference is not in the xref table
+PDFObject *resolve_object(const PDF *pdf, PDFObject *obj);
 
 bool cmp_name_str(Name n, const char *);
 
@@ -186,12 +220,19 @@ bool cmp_name_str(Name n, const char *);
 DictionaryEntry *get_dict_entry(const Dictionary *d, const char *);
 // returns null if not found
 DictionaryEntry *find_dict_entry(const Dictionary *d, const char *);
+// returns default_value if d is null or the entry is missing or not an integer
+i64 find_dict_int(const Dictionary *d, const char *, i64 default_value);
+// returns default_value if d is null or the entry is missing or not a boolean
+bool find_dict_bool(const Dictionary *d, const char *, bool default_value);
+// integers and reals as f32, false for other objects
+bool object_number(const PDFObject *obj, f32 *value);
 
 
 void free_pdf(PDF *);
 
 
 const char *obj_kind_to_str(enum PDFObjectKind kind);
+const char *pixel_format_to_str(enum PixelFormat format);
 
 void print_object_kind(enum PDFObjectKind);
 void print_pdf_slice(PDFSlice);
@@ -1,6 +1,8 @@
 #include "pdf_parse.h"
 
 #include "decompress.h"
+#include "filters.h"
+#include "memory.h"
 #include "utils.h"
 
 #include <string.h>
@@ -567,48 +569,70 @@ Dictionary parse_dictionary(Parser *p) {
 	return dict;
 }
 
-local DecodedStream parse_stream_data(Stream *s) {
-	enum FilterKind filter = FILTER_KIND_NONE;
-
-	for (u64 i = 0; i < s->dict.count; i++) {
-		DictionaryEntry *e = &s->dict.entries[i];
-		Name n = e->name;
-
-		if (cmp_name_str(n, "Filter")) {
-			// TODO: filter array
-			if (e->object.kind != OBJ_NAME) PANIC("Filter value is not a name!");
-			Name filter_name = e->object.data.name;
-
-			if (cmp_name_str(filter_name, "FlateDecode")) filter = FILTER_KIND_FLATE;
-			else if (cmp_name_str(filter_name, "DCTDecode")) filter = FILTER_KIND_DCT;
-			else if (cmp_name_str(filter_name, "CCITTFaxDecode")) filter = FILTER_KIND_CCITTFAX;
-			else {
-				printf("unknown filter: ");
-				print_name(filter_name);
-				printf("\n");
-				PANIC("unknown filter\n");
-			}
+local enum FilterKind parse_filter_name(Name filter_name) {
+	if (cmp_name_str(filter_name, "FlateDecode")) return FILTER_KIND_FLATE;
+	else if (cmp_name_str(filter_name, "DCTDecode")) return FILTER_KIND_DCT;
+	else if (cmp_name_str(filter_name, "CCITTFaxDecode")) return FILTER_KIND_CCITTFAX;
+	else if (cmp_name_str(filter_name, "ASCIIHexDecode")) return FILTER_KIND_ASCII_HEX;
+	else if (cmp_name_str(filter_name, "ASCII85Decode")) return FILTER_KIND_ASCII85;
+	else if (cmp_name_str(filter_name, "RunLengthDecode")) return FILTER_KIND_RUN_LENGTH;
+	else if (cmp_name_str(filter_name, "LZWDecode")) return FILTER_KIND_LZW;
+	else {
+		printf("unknown filter: ");
+		print_name(filter_name);
+		printf("\n");
+		PANIC("unknown filter\n");
+	}
+}
 
-		}
-		else if (cmp_name_str(n, "Length")) {
-			//TODO
-		}
+local inline const Dictionary *filter_parms(const PDFObject *parms) {
+	if (parms && parms->kind == OBJ_DICTIONARY) return &parms->data.dictionary;
+	return NULL;
+}
+
+// /Filter is a name or an array of names, /DecodeParms a dictionary or an array
+// with one dictionary (or null) per filter
+local void parse_stream_filters(Stream *s) {
+	DictionaryEntry *filter = find_dict_entry(&s->dict, "Filter");
+	if (!filter) return;
+
+	DictionaryEntry *parms_entry = find_dict_entry(&s->dict, "DecodeParms");
+	const PDFObject *parms = parms_entry ? &parms_entry->object : NULL;
+
+	if (filter->object.kind == OBJ_NAME) {
+		if (parms && parms->kind == OBJ_ARRAY) parms = parms->data.array.count > 0 ? &parms->data.array.data[0] : NULL;
+
+		StreamFilter f = {
+			.kind = parse_filter_name(filter->object.data.name),
+			.parms = filter_parms(parms),
+		};
+		arrput(s->filters, f);
 	}
+	else if (filter->object.kind == OBJ_ARRAY) {
+		ObjectArray names = filter->object.data.array;
 
-	s->filter_kind = filter;
+		for (u64 i = 0; i < names.count; i++) {
+			if (names.data[i].kind != OBJ_NAME) PANIC("Filter array element is not a name!");
 
-	switch (filter) {
-	case FILTER_KIND_FLATE:  return inflate_decode(s);
-	case FILTER_KIND_DCT:    return dct_decode(s);
-	case FILTER_KIND_CCITTFAX:
-	case FILTER_KIND_NONE:   return (DecodedStream) {
-		.data = { 0 },
-			.kind = STREAM_DATA_NONE,
-			.raw_stream = *s,
-	};
+			const PDFObject *p = NULL;
+			if (parms && parms->kind == OBJ_ARRAY && i < parms->data.array.count) p = &parms->data.array.data[i];
+			else if (i == 0) p = parms;
 
-	default: PANIC("unhandled FilterKind: %u", filter);
+			StreamFilter f = {
+				.kind = parse_filter_name(names.data[i].data.name),
+				.parms = filter_parms(p),
+			};
+			arrput(s->filters, f);
+		}
 	}
+	else {
+		PANIC("Filter value is not a name or an array!");
+	}
+}
+
+local DecodedStream parse_stream_data(Stream *s) {
+	parse_stream_filters(s);
+	return decode_stream(s);
 }
 
 PDFObject parse_primitive(Parser *p) {
@@ -754,8 +778,7 @@ XRefTable parse_xref_table(Parser *p) {
 	skip_space(p);
 	parse_xref_entry(p);
 
-	XRefEntry *entries = malloc(obj_count * sizeof(XRefEntry));
-	PDFObject *object_buffer = malloc(obj_count * sizeof(PDFObject));
+	XRefEntry *entries = mem_alloc(MEM_TAG_OBJECTS, obj_count * sizeof(XRefEntry));
 
 	for (u64 i = 0; i < obj_count; i++) {
 		XRefEntry e = parse_xref_entry(p);
@@ -829,7 +852,7 @@ PDF parse_pdf(PDFContent *content) {
 
 	pdf.xref_table = table;
 	pdf.trailer = trailer;
-	pdf.object_buffer = malloc(pdf.xref_table.obj_count * sizeof(PDFObject));
+	pdf.object_buffer = mem_alloc(MEM_TAG_OBJECTS, pdf.xref_table.obj_count * sizeof(PDFObject));
 
 	for (u32 i = 0; i < pdf.xref_table.obj_count; i++) {
 		XRefEntry xref = table.entries[i];
@@ -858,7 +881,7 @@ PDFContent load_file(const char *path) {
 		ASSERT_MSG(bufsize != -1, "could not tell buffer size");
 
 		/* Allocate our buffer to that size. */
-		source = malloc(sizeof(char) * (bufsize + 1));
+		source = mem_alloc(MEM_TAG_PDF_CONTENT, sizeof(char) * (bufsize + 1));
 		ASSERT(source);
 		memset(source, 0, bufsize + 1);
 
@@ -0,0 +1,466 @@
+#include "predictor.h"
+#include "buffer_pool.h"
+#include "simd.h"
+
+#include <string.h>
+
+local u32 parms_u32(const Dictionary *parms, const char *key, u32 default_value) {
+	i64 value = find_dict_int(parms, key, default_value);
+	ASSERT_MSG(value >= 0 && value <= U32_MAX, "/%s out of range: %lli", key, (long long)value);
+	return (u32)value;
+}
+
+PredictorParams predictor_params_from_dict(const Dictionary *parms) {
+	PredictorParams params = {
+		.predictor = parms_u32(parms, "Predictor", PREDICTOR_NONE),
+		.colors = parms_u32(parms, "Colors", 1),
+		.bits_per_component = parms_u32(parms, "BitsPerComponent", 8),
+		.columns = parms_u32(parms, "Columns", 1),
+	};
+
+	if (params.predictor == 0) params.predictor = PREDICTOR_NONE;
+	ASSERT_MSG(params.predictor <= PREDICTOR_TIFF || (params.predictor >= PREDICTOR_PNG && params.predictor <= 15),
+		"invalid /Predictor: %u", params.predictor);
+
+	switch (params.bits_per_component) {
+	case 1: case 2: case 4: case 8: case 16: break;
+	default: PANIC("invalid /BitsPerComponent: %u", params.bits_per_component);
+	}
+
+	ASSERT_MSG(params.colors >= 1 && params.colors <= 32, "invalid /Colors: %u", params.colors);
+	ASSERT_MSG(params.columns >= 1, "invalid /Columns: %u", params.columns);
+
+	return params;
+}
+
+
+/// SCALAR UNFILTERING ///
+
+// rows are decoded from in to out, in is never written so loads do not depend on the previous
+// stores. the scalar functions continue at start, everything before it is already decoded,
+// they also finish the bytes the vectorized versions leave over
+
+local void sub_scalar(u8 *out, const u8 *in, u32 len, u32 bpp, u32 start) {
+	u32 i = start;
+	for (; i < MIN(bpp, len); i++) {
+		out[i] = in[i];
+	}
+	for (; i < len; i++) {
+		out[i] = in[i] + out[i - bpp];
+	}
+}
+
+local void up_scalar(u8 *out, const u8 *in, const u8 *prev, u32 len, u32 start) {
+	for (u32 i = start; i < len; i++) {
+		out[i] = in[i] + prev[i];
+	}
+}
+
+local void avg_scalar(u8 *out, const u8 *in, const u8 *prev, u32 len, u32 bpp, u32 start) {
+	u32 i = start;
+	for (; i < MIN(bpp, len); i++) {
+		out[i] = in[i] + (prev[i] >> 1);
+	}
+	for (; i < len; i++) {
+		out[i] = in[i] + (u8)(((u32)out[i - bpp] + prev[i]) >> 1);
+	}
+}
+
+local inline u8 paeth_predictor(u8 a, u8 b, u8 c) {
+	i32 p = (i32)a + b - c;
+	i32 pa = abs(p - a);
+	i32 pb = abs(p - b);
+	i32 pc = abs(p - c);
+
+	if (pa <= pb && pa <= pc) return a;
+	if (pb <= pc) return b;
+	return c;
+}
+
+local void paeth_scalar(u8 *out, const u8 *in, const u8 *prev, u32 len, u32 bpp, u32 start) {
+	u32 i = start;
+	// a = c = 0 for the first pixel, the predictor is always b
+	for (; i < MIN(bpp, len); i++) {
+		out[i] = in[i] + prev[i];
+	}
+	for (; i < len; i++) {
+		out[i] = in[i] + paeth_predictor(out[i - bpp], prev[i], prev[i - bpp]);
+	}
+}
+
+
+/// VECTORIZED UNFILTERING ///
+
+// Up is independent for every byte and processed 16 bytes at a time. Sub with 1 byte per pixel
+// is a prefix sum over 16 bytes. Sub, Avg and Paeth for 2 - 8 bytes per pixel decode one pixel
+// per iteration with all its channels in one register, the previous pixel never leaves the register.
+// they store 8 bytes per pixel, the bytes after the pixel are overwritten by the next one, so
+// they stop 8 bytes before the end of the row.
+// every function returns the index at which the scalar version has to continue
+
+#if PTRAIL_SSE2
+
+local u32 up_simd(u8 *out, const u8 *in, const u8 *prev, u32 len) {
+	u32 i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(prev + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_add_epi8(x, b));
+	}
+	return i;
+}
+
+local u32 sub1_simd(u8 *out, const u8 *in, u32 len) {
+	__m128i carry = _mm_setzero_si128();
+	u32 i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi8(x, carry);
+		_mm_storeu_si128((__m128i *)(out + i), x);
+
+		// broadcast byte 15
+		carry = _mm_unpackhi_epi8(x, x);
+		carry = _mm_shufflehi_epi16(carry, 0xff);
+		carry = _mm_unpackhi_epi64(carry, carry);
+	}
+	return i;
+}
+
+#define LOAD_PIXEL(p) _mm_loadl_epi64((const __m128i *)(p))
+#define STORE_PIXEL(p, d) _mm_storel_epi64((__m128i *)(p), (d))
+
+local u32 sub_simd(u8 *out, const u8 *in, u32 len, u32 bpp) {
+	__m128i d = _mm_setzero_si128();
+	u32 i = 0;
+	for (; i + 8 <= len; i += bpp) {
+		d = _mm_add_epi8(LOAD_PIXEL(in + i), d);
+		STORE_PIXEL(out + i, d);
+	}
+	return i;
+}
+
+local u32 avg_simd(u8 *out, const u8 *in, const u8 *prev, u32 len, u32 bpp) {
+	__m128i one = _mm_set1_epi8(1);
+	__m128i d = _mm_setzero_si128();
+	u32 i = 0;
+	for (; i + 8 <= len; i += bpp) {
+		__m128i a = d;
+		__m128i b = LOAD_PIXEL(prev + i);
+		// PNG averages with truncation, _mm_avg_epu8 rounds up
+		__m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		d = _mm_add_epi8(LOAD_PIXEL(in + i), avg);
+		STORE_PIXEL(out + i, d);
+	}
+	return i;
+}
+
+local inline __m128i abs_epi16(__m128i x) {
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+local inline __m128i select_epi16(__m128i cond, __m128i t, __m128i f) {
+	return _mm_or_si128(_mm_and_si128(cond, t), _mm_andnot_si128(cond, f));
+}
+
+local u32 paeth_simd(u8 *out, const u8 *in, const u8 *prev, u32 len, u32 bpp) {
+	__m128i zero = _mm_setzero_si128();
+	// channels are widened to 16 bit, so a + b - c does not overflow
+	__m128i b = zero;
+	__m128i d = zero;
+	u32 i = 0;
+	for (; i + 8 <= len; i += bpp) {
+		__m128i c = b;
+		__m128i a = d;
+		b = _mm_unpacklo_epi8(LOAD_PIXEL(prev + i), zero);
+
+		__m128i pa = _mm_sub_epi16(b, c); // p - a = b - c
+		__m128i pb = _mm_sub_epi16(a, c); // p - b = a - c
+		__m128i pc = _mm_add_epi16(pa, pb); // p - c = (b - c) + (a - c)
+		pa = abs_epi16(pa);
+		pb = abs_epi16(pb);
+		pc = abs_epi16(pc);
+
+		__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		// ties are broken in the order a, b, c
+		__m128i nearest = select_epi16(_mm_cmpeq_epi16(smallest, pa), a,
+			select_epi16(_mm_cmpeq_epi16(smallest, pb), b, c));
+
+		// 8 bit add, so the result wraps around at 256 and stays in the low byte
+		d = _mm_add_epi8(_mm_unpacklo_epi8(LOAD_PIXEL(in + i), zero), nearest);
+		STORE_PIXEL(out + i, _mm_packus_epi16(d, d));
+	}
+	return i;
+}
+
+#undef LOAD_PIXEL
+#undef STORE_PIXEL
+
+#elif PTRAIL_NEON
+
+local u32 up_simd(u8 *out, const u8 *in, const u8 *prev, u32 len) {
+	u32 i = 0;
+	for (; i + 16 <= len; i += 16) {
+		vst1q_u8(out + i, vaddq_u8(vld1q_u8(in + i), vld1q_u8(prev + i)));
+	}
+	return i;
+}
+
+local u32 sub1_simd(u8 *out, const u8 *in, u32 len) {
+	uint8x16_t zero = vdupq_n_u8(0);
+	uint8x16_t carry = zero;
+	u32 i = 0;
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t x = vld1q_u8(in + i);
+		x = vaddq_u8(x, vextq_u8(zero, x, 15));
+		x = vaddq_u8(x, vextq_u8(zero, x, 14));
+		x = vaddq_u8(x, vextq_u8(zero, x, 12));
+		x = vaddq_u8(x, vextq_u8(zero, x, 8));
+		x = vaddq_u8(x, carry);
+		vst1q_u8(out + i, x);
+		carry = vdupq_n_u8(vgetq_lane_u8(x, 15));
+	}
+	return i;
+}
+
+local u32 sub_simd(u8 *out, const u8 *in, u32 len, u32 bpp) {
+	uint8x8_t d = vdup_n_u8(0);
+	u32 i = 0;
+	for (; i + 8 <= len; i += bpp) {
+		d = vadd_u8(vld1_u8(in + i), d);
+		vst1_u8(out + i, d);
+	}
+	return i;
+}
+
+local u32 avg_simd(u8 *out, const u8 *in, const u8 *prev, u32 len, u32 bpp) {
+	uint8x8_t d = vdup_n_u8(0);
+	u32 i = 0;
+	for (; i + 8 <= len; i += bpp) {
+		// halving add truncates like the PNG average
+		d = vadd_u8(vld1_u8(in + i), vhadd_u8(d, vld1_u8(prev + i)));
+		vst1_u8(out + i, d);
+	}
+	return i;
+}
+
+local inline uint8x8_t paeth_neon(uint8x8_t a, uint8x8_t b, uint8x8_t c) {
+	uint16x8_t pa = vabdl_u8(b, c); // |p - a| = |b - c|
+	uint16x8_t pb = vabdl_u8(a, c); // |p - b| = |a - c|
+	uint16x8_t pc = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c)); // |p - c| = |a + b - 2c|
+
+	uint16x8_t use_a = vandq_u16(vcleq_u16(pa, pb), vcleq_u16(pa, pc));
+	uint16x8_t use_b = vcleq_u16(pb, pc);
+
+	// ties are broken in the order a, b, c
+	uint8x8_t nearest = vbsl_u8(vmovn_u16(use_b), b, c);
+	return vbsl_u8(vmovn_u16(use_a), a, nearest);
+}
+
+local u32 paeth_simd(u8 *out, const u8 *in, const u8 *prev, u32 len, u32 bpp) {
+	uint8x8_t b = vdup_n_u8(0);
+	uint8x8_t d = vdup_n_u8(0);
+	u32 i = 0;
+	for (; i + 8 <= len; i += bpp) {
+		uint8x8_t c = b;
+		b = vld1_u8(prev + i);
+		d = vadd_u8(vld1_u8(in + i), paeth_neon(d, b, c));
+		vst1_u8(out + i, d);
+	}
+	return i;
+}
+
+#endif
+
+
+/// ROW DECODING ///
+
+local void unfilter_sub(u8 *out, const u8 *in, u32 len, u32 bpp) {
+	u32 i = 0;
+#if PTRAIL_SIMD
+	if (bpp == 1) i = sub1_simd(out, in, len);
+	else if (bpp <= 8) i = sub_simd(out, in, len, bpp);
+#endif
+	sub_scalar(out, in, len, bpp, i);
+}
+
+local void unfilter_up(u8 *out, const u8 *in, const u8 *prev, u32 len) {
+	u32 i = 0;
+#if PTRAIL_SIMD
+	i = up_simd(out, in, prev, len);
+#endif
+	up_scalar(out, in, prev, len, i);
+}
+
+// with 1 byte per pixel every byte depends on the one before it and there is nothing to vectorize
+local void unfilter_avg(u8 *out, const u8 *in, const u8 *prev, u32 len, u32 bpp) {
+	u32 i = 0;
+#if PTRAIL_SIMD
+	if (bpp >= 2 && bpp <= 8) i = avg_simd(out, in, prev, len, bpp);
+#endif
+	avg_scalar(out, in, prev, len, bpp, i);
+}
+
+local void unfilter_paeth(u8 *out, const u8 *in, const u8 *prev, u32 len, u32 bpp) {
+	u32 i = 0;
+#if PTRAIL_SIMD
+	if (bpp >= 2 && bpp <= 8) i = paeth_simd(out, in, prev, len, bpp);
+#endif
+	paeth_scalar(out, in, prev, len, bpp, i);
+}
+
+void png_unfilter_row(enum PNGFilter filter, u8 *out, const u8 *in, const u8 *prev, u32 len, u32 bpp) {
+	switch (filter) {
+	case PNG_FILTER_NONE: memcpy(out, in, len); return;
+	case PNG_FILTER_SUB: unfilter_sub(out, in, len, bpp); return;
+	case PNG_FILTER_UP: unfilter_up(out, in, prev, len); return;
+	case PNG_FILTER_AVG: unfilter_avg(out, in, prev, len, bpp); return;
+	case PNG_FILTER_PAETH: unfilter_paeth(out, in, prev, len, bpp); return;
+
+	default: PANIC("invalid PNG filter type: %u", filter);
+	}
+}
+
+local inline u32 get_sample(const u8 *row, u64 index, u32 bpc) {
+	u64 bit = index * bpc;
+	u32 shift = 8 - bpc - (u32)(bit & 7);
+	return (row[bit >> 3] >> shift) & ((1u << bpc) - 1);
+}
+
+local inline void set_sample(u8 *row, u64 index, u32 bpc, u32 value) {
+	u64 bit = index * bpc;
+	u32 shift = 8 - bpc - (u32)(bit & 7);
+	u32 mask = ((1u << bpc) - 1) << shift;
+	row[bit >> 3] = (u8)((row[bit >> 3] & ~mask) | ((value << shift) & mask));
+}
+
+void tiff_unpredict_row(u8 *out, const u8 *in, u32 len, u32 colors, u32 bits_per_component) {
+	switch (bits_per_component) {
+	// same as PNG Sub with one pixel being colors bytes
+	case 8: unfilter_sub(out, in, len, colors); return;
+
+	case 16: {
+		u32 stride = 2 * colors;
+		u32 i = 0;
+		for (; i < MIN(stride, len); i++) {
+			out[i] = in[i];
+		}
+		for (; i + 1 < len; i += 2) {
+			u32 value = ((u32)in[i] << 8 | in[i + 1]) + ((u32)out[i - stride] << 8 | out[i - stride + 1]);
+			out[i] = (u8)(value >> 8);
+			out[i + 1] = (u8)value;
+		}
+		if (i < len) out[i] = in[i];
+		return;
+	}
+
+	default: {
+		u32 bpc = bits_per_component;
+		u64 n_samples = (u64)len * 8 / bpc;
+		memcpy(out, in, len);
+		for (u64 s = colors; s < n_samples; s++) {
+			set_sample(out, s, bpc, get_sample(out, s, bpc) + get_sample(out, s - colors, bpc));
+		}
+		return;
+	}
+	}
+}
+
+
+/// STREAMING ///
+
+void predictor_init(Predictor *p, PredictorParams params, DecodeSink next) {
+	ASSERT_NOT_NULL(next.fn);
+
+	u64 bits_per_pixel = (u64)params.colors * params.bits_per_component;
+	u64 row_len = ((u64)params.columns * bits_per_pixel + 7) / 8;
+	ASSERT_MSG(row_len < U32_MAX, "predictor row too long: %llu bytes", (unsigned long long)row_len);
+
+	*p = (Predictor){
+		.params = params,
+		.row_len = (u32)row_len,
+		.bpp = (u32)((bits_per_pixel + 7) / 8),
+		.tag_len = params.predictor >= PREDICTOR_PNG ? 1 : 0,
+		.next = next,
+	};
+
+	p->pending = buffer_pool_acquire(row_len + p->tag_len);
+	p->curr = buffer_pool_acquire(row_len);
+	p->prev = buffer_pool_acquire(row_len);
+	memset(p->prev, 0, row_len);
+}
+
+void predictor_free(Predictor *p) {
+	buffer_pool_release(p->pending);
+	buffer_pool_release(p->curr);
+	buffer_pool_release(p->prev);
+	*p = (Predictor){ 0 };
+}
+
+// decodes the first len bytes of an encoded row and passes them on
+local bool predictor_emit_row(Predictor *p, const u8 *encoded, u32 len) {
+	const u8 *in = encoded + p->tag_len;
+
+	switch (p->params.predictor) {
+	case PREDICTOR_NONE: memcpy(p->curr, in, len); break;
+	case PREDICTOR_TIFF: tiff_unpredict_row(p->curr, in, len, p->params.colors, p->params.bits_per_component); break;
+	default: png_unfilter_row(encoded[0], p->curr, in, p->prev, len, p->bpp); break;
+	}
+
+	u8 *row = p->curr;
+	p->curr = p->prev;
+	p->prev = row;
+	p->filled = 0;
+
+	return p->next.fn(p->next.user_data, row, len);
+}
+
+local bool predictor_write(void *user_data, const u8 *data, u64 len) {
+	Predictor *p = user_data;
+	u32 encoded_row_len = p->row_len + p->tag_len;
+
+	while (len != 0) {
+		// rows that are complete in data are decoded from there, only rows that
+		// cross the boundary between two chunks are collected in pending
+		if (p->filled == 0 && len >= encoded_row_len) {
+			if (!predictor_emit_row(p, data, p->row_len)) return false;
+			data += encoded_row_len;
+			len -= encoded_row_len;
+			continue;
+		}
+
+		u32 n = (u32)MIN(len, (u64)(encoded_row_len - p->filled));
+		memcpy(p->pending + p->filled, data, n);
+		p->filled += n;
+		data += n;
+		len -= n;
+
+		if (p->filled == encoded_row_len && !predictor_emit_row(p, p->pending, p->row_len)) return false;
+	}
+
+	return true;
+}
+
+DecodeSink predictor_sink(Predictor *p) {
+	return (DecodeSink){ .fn = predictor_write, .user_data = p };
+}
+
+bool predictor_finish(Predictor *p) {
+	if (p->filled <= p->tag_len) return true;
+	return predictor_emit_row(p, p->pending, p->filled - p->tag_len);
+}
+
+const char *png_filter_to_str(enum PNGFilter filter) {
+	switch (filter) {
+	case PNG_FILTER_NONE: return "None";
+	case PNG_FILTER_SUB: return "Sub";
+	case PNG_FILTER_UP: return "Up";
+	case PNG_FILTER_AVG: return "Average";
+	case PNG_FILTER_PAETH: return "Paeth";
+
+	default: PANIC("unknown PNGFilter: %u", filter);
+	}
+}
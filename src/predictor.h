@@ -0,0 +1,60 @@
+#pragma once
+
+#include "decompress.h"
+
+// /DecodeParms predictors of the Flate (and LZW) filters
+
+enum PredictorKind {
+    PREDICTOR_NONE = 1,
+    PREDICTOR_TIFF = 2,
+    // 10 - 15 all select PNG prediction, the filter type is stored at the start of every row
+    PREDICTOR_PNG = 10,
+};
+
+enum PNGFilter {
+    PNG_FILTER_NONE,
+    PNG_FILTER_SUB,
+    PNG_FILTER_UP,
+    PNG_FILTER_AVG,
+    PNG_FILTER_PAETH,
+};
+
+typedef struct PredictorParams {
+    u32 predictor;
+    u32 colors;
+    u32 bits_per_component;
+    u32 columns;
+} PredictorParams;
+
+// reads /Predictor, /Colors, /BitsPerComponent and /Columns, missing entries get their default value.
+// parms can be NULL
+PredictorParams predictor_params_from_dict(const Dictionary *parms);
+
+// streaming predictor reversal, encoded data is collected row by row and every
+// decoded row is passed to the next sink while it is still in cache
+typedef struct Predictor {
+    PredictorParams params;
+    u32 row_len;    // decoded bytes per row
+    u32 bpp;        // bytes per pixel, at least 1
+    u32 tag_len;    // 1 for PNG (filter type byte), 0 for TIFF
+    u32 filled;     // bytes of pending received so far
+    u8 *pending;    // encoded row that is split across two chunks, [tag][row]
+    u8 *curr;       // row that is decoded next
+    u8 *prev;       // previous decoded row, zeroed for the first row
+    DecodeSink next;
+} Predictor;
+
+void predictor_init(Predictor *p, PredictorParams params, DecodeSink next);
+// sink that feeds encoded data into the predictor
+DecodeSink predictor_sink(Predictor *p);
+// decodes and passes on an incomplete last row, returns false if the next sink stopped
+bool predictor_finish(Predictor *p);
+void predictor_free(Predictor *p);
+
+// reverses the PNG filter of a single row from in to out, which must not overlap.
+// prev is the previous decoded row (all zero for the first row)
+void png_unfilter_row(enum PNGFilter filter, u8 *out, const u8 *in, const u8 *prev, u32 len, u32 bpp);
+// reverses TIFF predictor 2 (horizontal differencing) of a single row from in to out, which must not overlap
+void tiff_unpredict_row(u8 *out, const u8 *in, u32 len, u32 colors, u32 bits_per_component);
+
+const char *png_filter_to_str(enum PNGFilter filter);
@@ -0,0 +1,519 @@
+#include "raster.h"
+#include "color.h"
+#include "memory.h"
+#include "simd.h"
+
+#include <string.h>
+#include <math.h>
+
+#define SUBPIXEL_BITS 8
+#define SUBPIXELS (1 << SUBPIXEL_BITS)
+// coverage of a pixel inside a path, the cells hold twice the covered area in subpixels squared
+#define FULL_COVERAGE (2 * SUBPIXELS * SUBPIXELS)
+// subpixels, keeps the products of the edge math in 64 bits and the cells in 32
+#define COORD_LIMIT (f32)(1 << 28)
+// pixels a flattened curve may be off its curve
+#define FLATTEN_TOLERANCE 0.1f
+#define MAX_CURVE_SEGMENTS 128
+
+// the rasterizer and the pixels tiles are composited in, kept per thread. compositing reads the pixels
+// back, which is slow on the write combined memory the tiles end up in
+typedef struct TileScratch {
+	Rasterizer rasterizer;
+	u8 *pixels;
+} TileScratch;
+
+local thread_local TileScratch tile_scratch;
+
+/// EDGES ///
+
+local inline i32 to_subpixels(f32 v) {
+	return (i32)lrintf(CLAMP(v * SUBPIXELS, COORD_LIMIT, -COORD_LIMIT));
+}
+
+local inline i32 abs_i32(i32 v) {
+	return v < 0 ? -v : v;
+}
+
+// position on the line through (a0, b0) and (a1, b1) at a, rounded towards b0
+local inline i32 interpolate(i32 a0, i32 b0, i32 a1, i32 b1, i32 a) {
+	return b0 + (i32)((i64)(b1 - b0) * (a - a0) / (a1 - a0));
+}
+
+local inline void touch_cells(Rasterizer *r, u32 row, i32 first, i32 last) {
+	r->row_min[row] = MIN(r->row_min[row], first);
+	r->row_max[row] = MAX(r->row_max[row], last);
+}
+
+// an edge piece inside one pixel, fx0 and fx1 in [0, SUBPIXELS] from its left side. the pixel gets the
+// part of the winding right of the piece, the pixels right of it all of it
+local inline void add_cell(Rasterizer *r, u32 row, i32 column, i32 fx0, i32 fx1, i32 dy) {
+	i32 *cells = r->cells + (u64)row * r->stride;
+	i32 area = dy * (fx0 + fx1);
+	cells[column] += dy * 2 * SUBPIXELS - area;
+	cells[column + 1] += area;
+	touch_cells(r, row, column, column + 1);
+}
+
+local inline void add_left(Rasterizer *r, u32 row, i32 dy) {
+	r->cells[(u64)row * r->stride] += dy * 2 * SUBPIXELS;
+	touch_cells(r, row, 0, 0);
+}
+
+// the part of an edge inside one row, ya and yb in the row. sign is the direction of the edge
+local void add_row(Rasterizer *r, u32 row, i32 xa, i32 ya, i32 xb, i32 yb, i32 sign) {
+	i32 right_edge = (i32)r->width * SUBPIXELS;
+
+	// from left to right, the winding only depends on the height of every piece
+	if (xa > xb) {
+		i32 t = xa; xa = xb; xb = t;
+		t = ya; ya = yb; yb = t;
+	}
+	if (xb <= 0) {
+		add_left(r, row, sign * abs_i32(yb - ya));
+		return;
+	}
+	if (xa >= right_edge) return;
+
+	i32 x0 = xa, y0 = ya, x1 = xb, y1 = yb;
+	if (xa < 0) {
+		y0 = interpolate(xa, ya, xb, yb, 0);
+		x0 = 0;
+		add_left(r, row, sign * abs_i32(y0 - ya));
+	}
+	if (xb > right_edge) {
+		y1 = interpolate(xa, ya, xb, yb, right_edge);
+		x1 = right_edge;
+	}
+
+	for (;;) {
+		i32 column = x0 >> SUBPIXEL_BITS;
+		i32 left = column << SUBPIXEL_BITS;
+		i32 boundary = left + SUBPIXELS;
+		if (x1 <= boundary) {
+			add_cell(r, row, column, x0 - left, x1 - left, sign * abs_i32(y1 - y0));
+			return;
+		}
+		i32 y = interpolate(xa, ya, xb, yb, boundary);
+		add_cell(r, row, column, x0 - left, SUBPIXELS, sign * abs_i32(y - y0));
+		x0 = boundary;
+		y0 = y;
+	}
+}
+
+void rasterizer_line(Rasterizer *r, f32 fx0, f32 fy0, f32 fx1, f32 fy1) {
+	i32 x0 = to_subpixels(fx0), y0 = to_subpixels(fy0);
+	i32 x1 = to_subpixels(fx1), y1 = to_subpixels(fy1);
+	if (y0 == y1) return;
+
+	// rows are walked downwards
+	i32 sign = 1;
+	if (y0 > y1) {
+		i32 t = x0; x0 = x1; x1 = t;
+		t = y0; y0 = y1; y1 = t;
+		sign = -1;
+	}
+
+	i32 bottom = (i32)r->height * SUBPIXELS;
+	if (y1 <= 0 || y0 >= bottom) return;
+
+	i32 top_x = y0 < 0 ? interpolate(y0, x0, y1, x1, 0) : x0;
+	i32 bottom_x = y1 > bottom ? interpolate(y0, x0, y1, x1, bottom) : x1;
+	i32 top_y = MAX(y0, 0), bottom_y = MIN(y1, bottom);
+
+	for (i32 row = top_y >> SUBPIXEL_BITS; (row << SUBPIXEL_BITS) < bottom_y; row++) {
+		i32 ya = MAX(top_y, row << SUBPIXEL_BITS);
+		i32 yb = MIN(bottom_y, (row + 1) << SUBPIXEL_BITS);
+		i32 xa = ya == top_y ? top_x : interpolate(y0, x0, y1, x1, ya);
+		i32 xb = yb == bottom_y ? bottom_x : interpolate(y0, x0, y1, x1, yb);
+		add_row(r, (u32)row, xa, ya, xb, yb, sign);
+	}
+}
+
+/// PATHS ///
+
+// a cubic is cut into as many lines as Wang's formula asks for to stay within FLATTEN_TOLERANCE
+local void add_cubic(Rasterizer *r, PathPoint p0, PathPoint p1, PathPoint p2, PathPoint p3) {
+	f32 ddx = MAX(fabsf(p0.x - 2.0f * p1.x + p2.x), fabsf(p1.x - 2.0f * p2.x + p3.x));
+	f32 ddy = MAX(fabsf(p0.y - 2.0f * p1.y + p2.y), fabsf(p1.y - 2.0f * p2.y + p3.y));
+	f32 dd = sqrtf(ddx * ddx + ddy * ddy);
+	u32 n = (u32)ceilf(sqrtf(0.75f * dd / FLATTEN_TOLERANCE));
+	n = CLAMP(n, MAX_CURVE_SEGMENTS, 1);
+
+	PathPoint prev = p0;
+	for (u32 i = 1; i <= n; i++) {
+		f32 t = (f32)i / (f32)n;
+		f32 s = 1.0f - t;
+		f32 b0 = s * s * s, b1 = 3.0f * s * s * t, b2 = 3.0f * s * t * t, b3 = t * t * t;
+		PathPoint p = i == n ? p3 : (PathPoint){
+			.x = b0 * p0.x + b1 * p1.x + b2 * p2.x + b3 * p3.x,
+			.y = b0 * p0.y + b1 * p1.y + b2 * p2.y + b3 * p3.y,
+		};
+		rasterizer_line(r, prev.x, prev.y, p.x, p.y);
+		prev = p;
+	}
+}
+
+void rasterizer_path(Rasterizer *r, const PagePaths *paths, const FilledPath *path, Matrix m) {
+	const u8 *verbs = paths->verbs + path->first_verb;
+	const PathPoint *points = paths->points + path->first_point;
+	PathPoint start = { 0 }, current = { 0 };
+
+	u32 p = 0;
+	for (u32 i = 0; i < path->n_verbs; i++) {
+		switch (verbs[i]) {
+		case PATH_MOVE:
+			// fills close their subpaths
+			rasterizer_line(r, current.x, current.y, start.x, start.y);
+			start = current = matrix_apply(m, points[p++]);
+			break;
+		case PATH_LINE: {
+			PathPoint next = matrix_apply(m, points[p++]);
+			rasterizer_line(r, current.x, current.y, next.x, next.y);
+			current = next;
+			break;
+		}
+		case PATH_CUBIC: {
+			PathPoint c1 = matrix_apply(m, points[p]);
+			PathPoint c2 = matrix_apply(m, points[p + 1]);
+			PathPoint end = matrix_apply(m, points[p + 2]);
+			p += 3;
+			add_cubic(r, current, c1, c2, end);
+			current = end;
+			break;
+		}
+		case PATH_CLOSE:
+			rasterizer_line(r, current.x, current.y, start.x, start.y);
+			current = start;
+			break;
+		default:
+			PANIC("unknown path verb %u", verbs[i]);
+		}
+	}
+	rasterizer_line(r, current.x, current.y, start.x, start.y);
+}
+
+/// COVERAGE ///
+
+local inline u8 coverage_alpha(i32 winding, enum FillRule rule) {
+	i32 c = abs_i32(winding);
+	if (rule == FILL_RULE_EVEN_ODD) {
+		c &= 2 * FULL_COVERAGE - 1;
+		c = MIN(c, 2 * FULL_COVERAGE - c);
+	} else {
+		c = MIN(c, FULL_COVERAGE);
+	}
+	return (u8)((c * 255 + FULL_COVERAGE / 2) / FULL_COVERAGE);
+}
+
+// prefix sum of the cells [start, end) into the alpha of the pixels, clears the cells. returns the winding after end
+local i32 accumulate_scalar(u8 *alpha, i32 *cells, u32 end, enum FillRule rule, u32 start, i32 winding) {
+	for (u32 x = start; x < end; x++) {
+		winding += cells[x];
+		cells[x] = 0;
+		alpha[x] = coverage_alpha(winding, rule);
+	}
+	return winding;
+}
+
+// the color scaled by alpha over the pixel: s = color * a, d = s + dst * (1 - s.a)
+local void composite_scalar(u8 *dst, const u8 *alpha, u32 count, const u8 color[4], u32 start) {
+	for (u32 x = start; x < count; x++) {
+		u32 a = alpha[x];
+		u32 sa = div255(color[3] * a);
+		u8 *px = dst + 4 * x;
+		for (u32 c = 0; c < 4; c++) px[c] = (u8)(div255(color[c] * a) + div255(px[c] * (255 - sa)));
+	}
+}
+
+local void store_scalar(u8 *dst, u32 count, const u8 color[4], u32 start) {
+	for (u32 x = start; x < count; x++) memcpy(dst + 4 * x, color, 4);
+}
+
+// like the scalar versions, every function returns the pixel at which the scalar version has to
+// continue. the integer math is the same, so the results are too
+
+#if PTRAIL_SSE2
+
+local inline __m128i mul_div255_epi16(__m128i a, __m128i b) {
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// a where mask is set, b elsewhere
+local inline __m128i select_si128(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+local u32 accumulate_simd(u8 *alpha, i32 *cells, u32 end, enum FillRule rule, u32 start, i32 *winding) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i full = _mm_set1_epi32(FULL_COVERAGE);
+	__m128i twice_full = _mm_set1_epi32(2 * FULL_COVERAGE);
+	__m128i run = _mm_set1_epi32(*winding);
+
+	u32 x = start;
+	for (; x + 4 <= end; x += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(cells + x));
+		_mm_storeu_si128((__m128i *)(cells + x), zero);
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi32(v, run);
+		run = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+
+		__m128i sign = _mm_srai_epi32(v, 31);
+		__m128i c = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+		if (rule == FILL_RULE_EVEN_ODD) {
+			c = _mm_and_si128(c, _mm_sub_epi32(twice_full, _mm_set1_epi32(1)));
+			c = select_si128(_mm_cmpgt_epi32(c, full), _mm_sub_epi32(twice_full, c), c);
+		} else {
+			c = select_si128(_mm_cmpgt_epi32(c, full), full, c);
+		}
+		// c * 255 rounded to FULL_COVERAGE
+		__m128i a = _mm_sub_epi32(_mm_slli_epi32(c, 8), c);
+		a = _mm_srli_epi32(_mm_add_epi32(a, _mm_set1_epi32(FULL_COVERAGE / 2)), 17);
+		a = _mm_packs_epi32(a, a);
+		a = _mm_packus_epi16(a, a);
+		u32 a4 = (u32)_mm_cvtsi128_si32(a);
+		memcpy(alpha + x, &a4, 4);
+	}
+	*winding = _mm_cvtsi128_si32(run);
+	return x;
+}
+
+local u32 composite_simd(u8 *dst, const u8 *alpha, u32 count, const u8 color[4]) {
+	__m128i zero = _mm_setzero_si128();
+	u32 color4;
+	memcpy(&color4, color, 4);
+	__m128i src = _mm_unpacklo_epi8(_mm_set1_epi32((i32)color4), zero);
+	__m128i max = _mm_set1_epi16(255);
+
+	u32 x = 0;
+	for (; x + 4 <= count; x += 4) {
+		u32 a4;
+		memcpy(&a4, alpha + x, 4);
+		// the alpha of a pixel in all of its bytes
+		__m128i a = _mm_cvtsi32_si128((i32)a4);
+		a = _mm_unpacklo_epi8(a, a);
+		a = _mm_unpacklo_epi16(a, a);
+
+		__m128i px = _mm_loadu_si128((const __m128i *)(dst + 4 * x));
+		__m128i halves[2] = { _mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero) };
+		__m128i coverage[2] = { _mm_unpacklo_epi8(a, zero), _mm_unpackhi_epi8(a, zero) };
+		for (u32 h = 0; h < 2; h++) {
+			__m128i s = mul_div255_epi16(src, coverage[h]);
+			__m128i sa = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			halves[h] = _mm_add_epi16(s, mul_div255_epi16(halves[h], _mm_sub_epi16(max, sa)));
+		}
+		_mm_storeu_si128((__m128i *)(dst + 4 * x), _mm_packus_epi16(halves[0], halves[1]));
+	}
+	return x;
+}
+
+local u32 store_simd(u8 *dst, u32 count, const u8 color[4]) {
+	u32 color4;
+	memcpy(&color4, color, 4);
+	__m128i v = _mm_set1_epi32((i32)color4);
+	u32 x = 0;
+	for (; x + 4 <= count; x += 4) _mm_storeu_si128((__m128i *)(dst + 4 * x), v);
+	return x;
+}
+
+#elif PTRAIL_NEON
+
+// (x + ((x + 128) >> 8) + 128) >> 8, like div255
+local inline uint8x8_t div255_u16(uint16x8_t x) {
+	return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+local u32 accumulate_simd(u8 *alpha, i32 *cells, u32 end, enum FillRule rule, u32 start, i32 *winding) {
+	int32x4_t zero = vdupq_n_s32(0);
+	int32x4_t full = vdupq_n_s32(FULL_COVERAGE);
+	int32x4_t twice_full = vdupq_n_s32(2 * FULL_COVERAGE);
+	int32x4_t run = vdupq_n_s32(*winding);
+
+	u32 x = start;
+	for (; x + 4 <= end; x += 4) {
+		int32x4_t v = vld1q_s32(cells + x);
+		vst1q_s32(cells + x, zero);
+		v = vaddq_s32(v, vextq_s32(zero, v, 3));
+		v = vaddq_s32(v, vextq_s32(zero, v, 2));
+		v = vaddq_s32(v, run);
+		run = vdupq_n_s32(vgetq_lane_s32(v, 3));
+
+		int32x4_t c = vabsq_s32(v);
+		if (rule == FILL_RULE_EVEN_ODD) {
+			c = vandq_s32(c, vsubq_s32(twice_full, vdupq_n_s32(1)));
+			c = vminq_s32(c, vsubq_s32(twice_full, c));
+		} else {
+			c = vminq_s32(c, full);
+		}
+		uint32x4_t cu = vreinterpretq_u32_s32(c);
+		uint32x4_t a = vsubq_u32(vshlq_n_u32(cu, 8), cu);
+		a = vshrq_n_u32(vaddq_u32(a, vdupq_n_u32(FULL_COVERAGE / 2)), 17);
+		uint16x4_t a16 = vmovn_u32(a);
+		uint8x8_t a8 = vmovn_u16(vcombine_u16(a16, a16));
+		u32 a4 = vget_lane_u32(vreinterpret_u32_u8(a8), 0);
+		memcpy(alpha + x, &a4, 4);
+	}
+	*winding = vgetq_lane_s32(run, 0);
+	return x;
+}
+
+local u32 composite_simd(u8 *dst, const u8 *alpha, u32 count, const u8 color[4]) {
+	uint8x8_t src[4] = { vdup_n_u8(color[0]), vdup_n_u8(color[1]), vdup_n_u8(color[2]), vdup_n_u8(color[3]) };
+	u32 x = 0;
+	for (; x + 8 <= count; x += 8) {
+		uint8x8x4_t px = vld4_u8(dst + 4 * x);
+		uint8x8_t a = vld1_u8(alpha + x);
+		uint8x8_t sa = div255_u16(vmull_u8(src[3], a));
+		uint8x8_t inv = vsub_u8(vdup_n_u8(255), sa);
+		for (u32 c = 0; c < 4; c++) {
+			uint8x8_t s = div255_u16(vmull_u8(src[c], a));
+			px.val[c] = vadd_u8(s, div255_u16(vmull_u8(px.val[c], inv)));
+		}
+		vst4_u8(dst + 4 * x, px);
+	}
+	return x;
+}
+
+local u32 store_simd(u8 *dst, u32 count, const u8 color[4]) {
+	u32 color4;
+	memcpy(&color4, color, 4);
+	uint32x4_t v = vdupq_n_u32(color4);
+	u32 x = 0;
+	for (; x + 4 <= count; x += 4) vst1q_u8(dst + 4 * x, vreinterpretq_u8_u32(v));
+	return x;
+}
+
+#endif
+
+local i32 accumulate(u8 *alpha, i32 *cells, u32 start, u32 end, enum FillRule rule) {
+	i32 winding = 0;
+	u32 x = start;
+#if PTRAIL_SIMD
+	x = accumulate_simd(alpha, cells, end, rule, start, &winding);
+#endif
+	return accumulate_scalar(alpha, cells, end, rule, x, winding);
+}
+
+local void composite(u8 *dst, const u8 *alpha, u32 count, const u8 color[4]) {
+	u32 x = 0;
+#if PTRAIL_SIMD
+	x = composite_simd(dst, alpha, count, color);
+#endif
+	composite_scalar(dst, alpha, count, color, x);
+}
+
+local void store(u8 *dst, u32 count, const u8 color[4]) {
+	u32 x = 0;
+#if PTRAIL_SIMD
+	x = store_simd(dst, count, color);
+#endif
+	store_scalar(dst, count, color, x);
+}
+
+/// RASTERIZER ///
+
+void rasterizer_init(Rasterizer *r, u32 width, u32 height) {
+	// a cell right of the last pixel takes the area of edges in the last column
+	u32 stride = width + 1;
+	*r = (Rasterizer){
+		.width = width,
+		.height = height,
+		.stride = stride,
+		.cells = mem_calloc(MEM_TAG_DECODE, (u64)stride * MAX(height, 1) * sizeof(i32)),
+		.row_min = mem_alloc(MEM_TAG_DECODE, MAX(height, 1) * sizeof(i32)),
+		.row_max = mem_alloc(MEM_TAG_DECODE, MAX(height, 1) * sizeof(i32)),
+		.alpha = mem_alloc(MEM_TAG_DECODE, stride),
+	};
+	for (u32 y = 0; y < height; y++) {
+		r->row_min[y] = (i32)stride;
+		r->row_max[y] = -1;
+	}
+}
+
+void rasterizer_free(Rasterizer *r) {
+	mem_free(r->cells);
+	mem_free(r->row_min);
+	mem_free(r->row_max);
+	mem_free(r->alpha);
+	*r = (Rasterizer){ 0 };
+}
+
+void rasterizer_fill(Rasterizer *r, enum FillRule rule, const u8 color[4], u8 *rgba, u32 stride) {
+	for (u32 y = 0; y < r->height; y++) {
+		i32 first = r->row_min[y], last = r->row_max[y];
+		if (first > last) continue;
+		r->row_min[y] = (i32)r->stride;
+		r->row_max[y] = -1;
+
+		i32 *cells = r->cells + (u64)y * r->stride;
+		u8 *row = rgba + (u64)y * stride;
+
+		// the pixels from the last touched cell on all have the winding after it
+		u32 end = MIN((u32)last + 1, r->width);
+		i32 winding = accumulate(r->alpha, cells, (u32)first, end, rule);
+		if ((u32)last == r->width) cells[last] = 0;
+		composite(row + 4 * (u64)first, r->alpha + first, end - (u32)first, color);
+
+		u32 rest = r->width - end;
+		u8 a = coverage_alpha(winding, rule);
+		if (rest == 0 || a == 0) continue;
+
+		if (a == 255 && color[3] == 255) {
+			store(row + 4 * (u64)end, rest, color);
+		} else {
+			memset(r->alpha + end, a, rest);
+			composite(row + 4 * (u64)end, r->alpha + end, rest, color);
+		}
+	}
+}
+
+// sizes r to width x height, keeping its memory if that fits. the cells are all zero between fills
+// whatever the stride, only the touched rows are reset
+local void rasterizer_fit(Rasterizer *r, u32 width, u32 height) {
+	u64 n_cells = (u64)(width + 1) * MAX(height, 1);
+	bool fits = r->cells && n_cells * sizeof(i32) <= mem_size(r->cells)
+		&& MAX(height, 1) * sizeof(i32) <= mem_size(r->row_min) && width + 1 <= mem_size(r->alpha);
+	if (!fits) {
+		rasterizer_free(r);
+		rasterizer_init(r, width, height);
+		return;
+	}
+
+	r->width = width;
+	r->height = height;
+	r->stride = width + 1;
+	for (u32 y = 0; y < height; y++) {
+		r->row_min[y] = (i32)r->stride;
+		r->row_max[y] = -1;
+	}
+}
+
+void raster_page_tile(const PagePaths *paths, f32 page_height, f32 scale, u32 x, u32 y, u32 width, u32 height, u8 *rgba) {
+	TileScratch *scratch = &tile_scratch;
+	u64 size = (u64)width * height * 4;
+	if (!scratch->pixels || mem_size(scratch->pixels) < size) {
+		mem_free(scratch->pixels);
+		scratch->pixels = mem_alloc(MEM_TAG_DECODE, MAX(size, 1));
+	}
+	u8 *pixels = scratch->pixels;
+	memset(pixels, 255, size);
+
+	// points with y up to the pixels of the tile with y down
+	Matrix m = {
+		.a = scale, .b = 0.0f,
+		.c = 0.0f, .d = -scale,
+		.e = -(f32)x, .f = page_height * scale - (f32)y,
+	};
+
+	Rasterizer *r = &scratch->rasterizer;
+	rasterizer_fit(r, width, height);
+	for (u32 i = 0; i < (u32)arrlen(paths->paths); i++) {
+		const FilledPath *path = &paths->paths[i];
+		rasterizer_path(r, paths, path, m);
+		rasterizer_fill(r, path->rule, path->color, pixels, width * 4);
+	}
+
+	memcpy(rgba, pixels, size);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "content_paths.h"
+
+// anti-aliased scanline rasterizer for filled paths, the CPU rendering backend. edges are snapped to
+// 1/256 of a pixel and accumulated into a cell per pixel as integer winding deltas, a prefix sum over
+// a row gives the signed coverage of every pixel. only the rows and the columns an edge touched are
+// visited, the pixels right of the last touched cell of a row share one coverage and are filled as a
+// span. the coverage math is integer, so the SIMD and the scalar paths give the same pixels and a
+// render can serve as the reference for the GPU
+
+typedef struct Rasterizer {
+    u32 width;
+    u32 height;
+    u32 stride;   // cells per row, more than width
+    i32 *cells;   // winding deltas, all zero between fills
+    i32 *row_min; // first and last touched cell of every row, min > max for rows without edges
+    i32 *row_max;
+    u8 *alpha;    // coverage of the row being filled
+} Rasterizer;
+
+void rasterizer_init(Rasterizer *r, u32 width, u32 height);
+void rasterizer_free(Rasterizer *r);
+
+// adds an edge, in pixels with y down. the parts above, below and right of the rasterizer are dropped,
+// the parts left of it cover the whole row
+void rasterizer_line(Rasterizer *r, f32 x0, f32 y0, f32 x1, f32 y1);
+// adds the edges of a filled path mapped to pixels by m, every subpath is closed
+void rasterizer_path(Rasterizer *r, const PagePaths *paths, const FilledPath *path, Matrix m);
+// composites the premultiplied color over the RGBA pixels (stride bytes per row) where the edges cover
+// under rule, then drops the edges
+void rasterizer_fill(Rasterizer *r, enum FillRule rule, const u8 color[4], u8 *rgba, u32 stride);
+
+// renders the page pixels [x, x + width) x [y, y + height) of a page that is page_height points high
+// at scale pixels per point: white paper and the filled paths on it. rgba is packed, width * 4 bytes per row.
+// the tile is composited in scratch memory of the thread and copied into rgba once, so rgba can be write
+// combined memory like the upload ring
+void raster_page_tile(const PagePaths *paths, f32 page_height, f32 scale, u32 x, u32 y, u32 width, u32 height, u8 *rgba);
@@ -0,0 +1,27 @@
+#pragma once
+
+// compile time SIMD detection. code paths are selected with #if PTRAIL_SSE2 / PTRAIL_AVX2 / PTRAIL_NEON,
+// every vectorized function has a scalar fallback. define PTRAIL_NO_SIMD to force the scalar paths
+
+#if !defined(PTRAIL_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define PTRAIL_SSE2 1
+#include <emmintrin.h>
+#else
+#define PTRAIL_SSE2 0
+#endif
+
+#if !defined(PTRAIL_NO_SIMD) && defined(__AVX2__)
+#define PTRAIL_AVX2 1
+#include <immintrin.h>
+#else
+#define PTRAIL_AVX2 0
+#endif
+
+#if !defined(PTRAIL_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64))
+#define PTRAIL_NEON 1
+#include <arm_neon.h>
+#else
+#define PTRAIL_NEON 0
+#endif
+
+#define PTRAIL_SIMD (PTRAIL_SSE2 || PTRAIL_NEON)
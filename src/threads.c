@@ -0,0 +1,213 @@
+#include "threads.h"
+
+#include <stdatomic.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+
+typedef SRWLOCK Mutex;
+typedef CONDITION_VARIABLE Cond;
+typedef HANDLE Thread;
+
+local void mutex_init(Mutex *m) { InitializeSRWLock(m); }
+local void mutex_lock(Mutex *m) { AcquireSRWLockExclusive(m); }
+local void mutex_unlock(Mutex *m) { ReleaseSRWLockExclusive(m); }
+local void cond_init(Cond *c) { InitializeConditionVariable(c); }
+local void cond_wait(Cond *c, Mutex *m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+local void cond_broadcast(Cond *c) { WakeAllConditionVariable(c); }
+
+local u32 core_count(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (u32)info.dwNumberOfProcessors;
+}
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Cond;
+typedef pthread_t Thread;
+
+local void mutex_init(Mutex *m) { pthread_mutex_init(m, NULL); }
+local void mutex_lock(Mutex *m) { pthread_mutex_lock(m); }
+local void mutex_unlock(Mutex *m) { pthread_mutex_unlock(m); }
+local void cond_init(Cond *c) { pthread_cond_init(c, NULL); }
+local void cond_wait(Cond *c, Mutex *m) { pthread_cond_wait(c, m); }
+local void cond_broadcast(Cond *c) { pthread_cond_broadcast(c); }
+
+local u32 core_count(void) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (u32)n : 1;
+}
+#endif
+
+typedef struct ThreadPool {
+	Mutex mutex;
+	Cond work_cond; // a loop was started or the pool stops
+	Cond done_cond; // the last worker left the loop
+	Thread workers[THREADS_MAX_WORKERS];
+	u32 n_workers;
+	bool initialized; // mutex and conditions, they are kept after a shutdown
+	bool started;
+	bool stop;
+
+	// current loop
+	u64 generation;
+	u64 start_generation; // generation when the workers were started
+	ParallelFn fn;
+	void *user_data;
+	u32 count;
+	atomic_uint next_index;
+	u32 n_active; // workers that did not leave the loop yet
+} ThreadPool;
+
+local ThreadPool pool;
+// threads_set_count, 0 for one thread per core
+local u32 requested_count;
+// held by the thread that runs a loop on the pool
+local atomic_flag pool_busy = ATOMIC_FLAG_INIT;
+// set on workers and while the calling thread works on a loop
+local thread_local bool in_loop;
+
+local void run_indices(void) {
+	for (;;) {
+		u32 index = atomic_fetch_add_explicit(&pool.next_index, 1, memory_order_relaxed);
+		if (index >= pool.count) break;
+		pool.fn(pool.user_data, index);
+	}
+}
+
+local void worker_loop(void) {
+	in_loop = true;
+	u64 seen = pool.start_generation;
+
+	mutex_lock(&pool.mutex);
+	for (;;) {
+		while (!pool.stop && pool.generation == seen) cond_wait(&pool.work_cond, &pool.mutex);
+		if (pool.stop) break;
+		seen = pool.generation;
+		mutex_unlock(&pool.mutex);
+
+		run_indices();
+
+		mutex_lock(&pool.mutex);
+		pool.n_active -= 1;
+		if (pool.n_active == 0) cond_broadcast(&pool.done_cond);
+	}
+	mutex_unlock(&pool.mutex);
+}
+
+#if defined(_WIN32)
+local DWORD WINAPI worker_main(LPVOID arg) {
+	(void)arg;
+	worker_loop();
+	return 0;
+}
+
+local void start_worker(Thread *thread) {
+	*thread = CreateThread(NULL, 0, worker_main, NULL, 0, NULL);
+	ASSERT_MSG(*thread != NULL, "failed to start worker thread");
+}
+
+local void join_worker(Thread thread) {
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+#else
+local void *worker_main(void *arg) {
+	(void)arg;
+	worker_loop();
+	return NULL;
+}
+
+local void start_worker(Thread *thread) {
+	int result = pthread_create(thread, NULL, worker_main, NULL);
+	ASSERT_MSG(result == 0, "failed to start worker thread: %d", result);
+}
+
+local void join_worker(Thread thread) {
+	pthread_join(thread, NULL);
+}
+#endif
+
+// called with pool_busy held
+local void start_pool(void) {
+	if (!pool.initialized) {
+		mutex_init(&pool.mutex);
+		cond_init(&pool.work_cond);
+		cond_init(&pool.done_cond);
+		pool.initialized = true;
+	}
+	pool.stop = false;
+	pool.start_generation = pool.generation;
+	pool.n_workers = thread_count() - 1;
+	for (u32 i = 0; i < pool.n_workers; i++) {
+		start_worker(&pool.workers[i]);
+	}
+	pool.started = true;
+}
+
+u32 thread_count(void) {
+	u32 count = requested_count ? requested_count : core_count();
+	return MIN(count, THREADS_MAX_WORKERS + 1);
+}
+
+void threads_set_count(u32 count) {
+	requested_count = count;
+}
+
+void parallel_for(u32 count, ParallelFn fn, void *user_data) {
+	bool serial = count <= 1 || in_loop || atomic_flag_test_and_set_explicit(&pool_busy, memory_order_acquire);
+	if (serial) {
+		for (u32 i = 0; i < count; i++) fn(user_data, i);
+		return;
+	}
+
+	if (!pool.started) start_pool();
+	if (pool.n_workers == 0) {
+		for (u32 i = 0; i < count; i++) fn(user_data, i);
+		atomic_flag_clear_explicit(&pool_busy, memory_order_release);
+		return;
+	}
+
+	mutex_lock(&pool.mutex);
+	pool.fn = fn;
+	pool.user_data = user_data;
+	pool.count = count;
+	atomic_store_explicit(&pool.next_index, 0, memory_order_relaxed);
+	pool.n_active = pool.n_workers;
+	pool.generation += 1;
+	cond_broadcast(&pool.work_cond);
+	mutex_unlock(&pool.mutex);
+
+	in_loop = true;
+	run_indices();
+	in_loop = false;
+
+	// workers that wake up late still have to see the loop before the next one can start
+	mutex_lock(&pool.mutex);
+	while (pool.n_active > 0) cond_wait(&pool.done_cond, &pool.mutex);
+	mutex_unlock(&pool.mutex);
+
+	atomic_flag_clear_explicit(&pool_busy, memory_order_release);
+}
+
+void threads_shutdown(void) {
+	while (atomic_flag_test_and_set_explicit(&pool_busy, memory_order_acquire));
+
+	if (pool.started) {
+		mutex_lock(&pool.mutex);
+		pool.stop = true;
+		cond_broadcast(&pool.work_cond);
+		mutex_unlock(&pool.mutex);
+
+		for (u32 i = 0; i < pool.n_workers; i++) {
+			join_worker(pool.workers[i]);
+		}
+		pool.n_workers = 0;
+		pool.started = false;
+	}
+
+	atomic_flag_clear_explicit(&pool_busy, memory_order_release);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "utils.h"
+
+// worker threads for data parallel loops, started by the first parallel_for. the calling thread
+// works on the loop too, so on a single core no worker is started and loops run serially
+
+#define THREADS_MAX_WORKERS 31
+
+typedef void (*ParallelFn)(void *user_data, u32 index);
+
+// threads a loop is spread over, including the calling thread
+u32 thread_count(void);
+// spreads loops over count threads instead of one per core, 0 goes back to one per core. the workers
+// are started with the count that is set then, so call it before the first loop or after threads_shutdown
+void threads_set_count(u32 count);
+// calls fn(user_data, i) for every i in [0, count) and returns once all calls are done. a loop started
+// inside fn, or while another thread runs a loop, runs serially on the calling thread
+void parallel_for(u32 count, ParallelFn fn, void *user_data);
+// joins the workers, the next parallel_for starts them again
+void threads_shutdown(void);
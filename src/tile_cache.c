@@ -0,0 +1,255 @@
+#include "tile_cache.h"
+
+#include <math.h>
+
+#define PI_F32 3.14159265358979f
+
+/// GEOMETRY ///
+
+f32 tile_zoom_scale(i32 zoom_level) {
+	return ldexpf(1.0f, zoom_level);
+}
+
+i32 tile_zoom_level(f32 zoom) {
+	// a zoom that is a power of two up to rounding gets its own level
+	i32 level = (i32)ceilf(log2f(zoom) - 1e-4f);
+	return CLAMP(level, TILE_ZOOM_LEVEL_MAX, TILE_ZOOM_LEVEL_MIN);
+}
+
+local inline u32 quarter_turns(f32 rotation) {
+	return (u32)lrintf(rotation / (PI_F32 / 2.0f)) % 4;
+}
+
+// (a, b) on the turned page box to (u, v) on the unturned page, both in [0, 1]. the inverse of
+// the turn the vertex shader gives the texture coordinates
+local inline void unturn_point(u32 turns, f32 a, f32 b, f32 *u, f32 *v) {
+	switch (turns) {
+	case 0: *u = a; *v = b; break;
+	case 1: *u = b; *v = 1.0f - a; break;
+	case 2: *u = 1.0f - a; *v = 1.0f - b; break;
+	default: *u = 1.0f - b; *v = a; break;
+	}
+}
+
+local inline void turn_point(u32 turns, f32 u, f32 v, f32 *a, f32 *b) {
+	switch (turns) {
+	case 0: *a = u; *b = v; break;
+	case 1: *a = 1.0f - v; *b = u; break;
+	case 2: *a = 1.0f - u; *b = 1.0f - v; break;
+	default: *a = v; *b = 1.0f - u; break;
+	}
+}
+
+// rect is x0, y0, x1, y1
+local void map_rect(u32 turns, bool unturn, const f32 in[4], f32 out[4]) {
+	f32 x0, y0, x1, y1;
+	if (unturn) {
+		unturn_point(turns, in[0], in[1], &x0, &y0);
+		unturn_point(turns, in[2], in[3], &x1, &y1);
+	} else {
+		turn_point(turns, in[0], in[1], &x0, &y0);
+		turn_point(turns, in[2], in[3], &x1, &y1);
+	}
+	out[0] = MIN(x0, x1);
+	out[1] = MIN(y0, y1);
+	out[2] = MAX(x0, x1);
+	out[3] = MAX(y0, y1);
+}
+
+void tile_layout_visible(const PageLayout *layout, PageRange range, i32 zoom_level,
+                         f32 left, f32 top, f32 right, f32 bottom, VisibleTile **tiles) {
+	f32 scale = tile_zoom_scale(zoom_level);
+
+	for (u32 page = range.first; page < range.first + range.count; page++) {
+		const PageInstance *box = &layout->instances[page];
+		f32 x0 = MAX(left, box->x), x1 = MIN(right, box->x + box->width);
+		f32 y0 = MAX(top, box->y), y1 = MIN(bottom, box->y + box->height);
+		if (x0 >= x1 || y0 >= y1) continue;
+
+		u32 turns = quarter_turns(box->rotation);
+		bool sideways = turns % 2 == 1;
+		u32 page_width = (u32)ceilf((sideways ? box->height : box->width) * scale);
+		u32 page_height = (u32)ceilf((sideways ? box->width : box->height) * scale);
+		if (page_width == 0 || page_height == 0) continue;
+		u32 columns = (page_width + TILE_SIZE - 1) / TILE_SIZE;
+		u32 rows = (page_height + TILE_SIZE - 1) / TILE_SIZE;
+
+		// the overlap in pixels of the unturned page
+		f32 seen[4] = {
+			(x0 - box->x) / box->width, (y0 - box->y) / box->height,
+			(x1 - box->x) / box->width, (y1 - box->y) / box->height,
+		};
+		f32 unturned[4];
+		map_rect(turns, true, seen, unturned);
+
+		u32 first_column = MIN((u32)(unturned[0] * (f32)page_width) / TILE_SIZE, columns - 1);
+		u32 first_row = MIN((u32)(unturned[1] * (f32)page_height) / TILE_SIZE, rows - 1);
+		u32 end_column = MIN((u32)ceilf(unturned[2] * (f32)page_width / TILE_SIZE), columns);
+		u32 end_row = MIN((u32)ceilf(unturned[3] * (f32)page_height / TILE_SIZE), rows);
+
+		for (u32 ty = first_row; ty < end_row; ty++) {
+			for (u32 tx = first_column; tx < end_column; tx++) {
+				u32 px = tx * TILE_SIZE, py = ty * TILE_SIZE;
+				u32 width = MIN(TILE_SIZE, page_width - px);
+				u32 height = MIN(TILE_SIZE, page_height - py);
+
+				// neighbours compute their shared edge from the same pixel, so no seams open up
+				f32 rect[4] = {
+					(f32)px / (f32)page_width, (f32)py / (f32)page_height,
+					(f32)(px + width) / (f32)page_width, (f32)(py + height) / (f32)page_height,
+				};
+				f32 turned[4];
+				map_rect(turns, false, rect, turned);
+
+				VisibleTile tile = {
+					.key = { .page = page, .zoom_level = zoom_level, .x = tx, .y = ty },
+					.width = width,
+					.height = height,
+					.instance = {
+						.x = box->x + turned[0] * box->width,
+						.y = box->y + turned[1] * box->height,
+						.width = (turned[2] - turned[0]) * box->width,
+						.height = (turned[3] - turned[1]) * box->height,
+						.texture_index = PAGE_NO_TEXTURE,
+						.rotation = box->rotation,
+					},
+				};
+				arrput(*tiles, tile);
+			}
+		}
+	}
+}
+
+/// KEYS ///
+
+local inline u64 mix_hash(u64 h, u64 value) {
+	h ^= value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+	return h;
+}
+
+local u64 hash_key(const TileKey *key) {
+	u64 h = key->page;
+	h = mix_hash(h, (u32)key->zoom_level);
+	h = mix_hash(h, ((u64)key->x << 32) | key->y);
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+local inline bool key_equal(const TileKey *a, const TileKey *b) {
+	return a->page == b->page && a->zoom_level == b->zoom_level && a->x == b->x && a->y == b->y;
+}
+
+/// TABLE ///
+
+local inline TileSlot **bucket_of(TileCache *cache, u64 hash) {
+	return &cache->buckets[hash & (TILE_ATLAS_SLOTS - 1)];
+}
+
+local TileSlot *find_slot(TileCache *cache, const TileKey *key, u64 hash) {
+	TileSlot *s = *bucket_of(cache, hash);
+	while (s && !(s->hash == hash && key_equal(&s->key, key))) s = s->next;
+	return s;
+}
+
+local void remove_slot(TileCache *cache, TileSlot *s) {
+	TileSlot **link = bucket_of(cache, s->hash);
+	while (*link != s) link = &(*link)->next;
+	*link = s->next;
+	s->next = NULL;
+	s->occupied = false;
+}
+
+/// LRU ///
+
+local void lru_unlink(TileCache *cache, TileSlot *s) {
+	if (s->lru_prev) s->lru_prev->lru_next = s->lru_next;
+	else cache->lru_first = s->lru_next;
+	if (s->lru_next) s->lru_next->lru_prev = s->lru_prev;
+	else cache->lru_last = s->lru_prev;
+	s->lru_prev = NULL;
+	s->lru_next = NULL;
+}
+
+local void lru_push_back(TileCache *cache, TileSlot *s) {
+	s->lru_prev = cache->lru_last;
+	s->lru_next = NULL;
+	if (cache->lru_last) cache->lru_last->lru_next = s;
+	else cache->lru_first = s;
+	cache->lru_last = s;
+}
+
+local void lru_push_front(TileCache *cache, TileSlot *s) {
+	s->lru_prev = NULL;
+	s->lru_next = cache->lru_first;
+	if (cache->lru_first) cache->lru_first->lru_prev = s;
+	else cache->lru_last = s;
+	cache->lru_first = s;
+}
+
+local void touch(TileCache *cache, TileSlot *s) {
+	s->last_used = cache->frame;
+	lru_unlink(cache, s);
+	lru_push_back(cache, s);
+}
+
+/// CACHE ///
+
+void tile_cache_init(TileCache *cache) {
+	*cache = (TileCache){ .frame = 1 };
+	for (u32 i = 0; i < TILE_ATLAS_SLOTS; i++) lru_push_back(cache, &cache->slots[i]);
+}
+
+void tile_cache_next_frame(TileCache *cache) {
+	cache->frame += 1;
+}
+
+u32 tile_cache_acquire(TileCache *cache, TileKey key, bool *miss) {
+	u64 hash = hash_key(&key);
+	*miss = false;
+
+	TileSlot *s = find_slot(cache, &key, hash);
+	if (s) {
+		touch(cache, s);
+		cache->stats.hits += 1;
+		return (u32)(s - cache->slots);
+	}
+
+	// slots used in this frame are at the back of the list, the ones still uploading are skipped
+	TileSlot *victim = cache->lru_first;
+	while (victim) {
+		if (victim->occupied && victim->last_used == cache->frame) return U32_MAX;
+		if (victim->state != TEXTURE_STATE_QUEUED && victim->state != TEXTURE_STATE_UPLOADING) break;
+		victim = victim->lru_next;
+	}
+	if (!victim) return U32_MAX;
+
+	if (victim->occupied) {
+		remove_slot(cache, victim);
+		cache->stats.evictions += 1;
+	}
+	victim->key = key;
+	victim->hash = hash;
+	victim->occupied = true;
+	victim->state = TEXTURE_STATE_EMPTY;
+
+	TileSlot **bucket = bucket_of(cache, hash);
+	victim->next = *bucket;
+	*bucket = victim;
+
+	touch(cache, victim);
+	cache->stats.misses += 1;
+	*miss = true;
+	return (u32)(victim - cache->slots);
+}
+
+void tile_cache_discard(TileCache *cache, u32 slot) {
+	ASSERT_MSG(slot < TILE_ATLAS_SLOTS, "tile slot %u", slot);
+	TileSlot *s = &cache->slots[slot];
+	ASSERT_MSG(s->state == TEXTURE_STATE_EMPTY, "discarded a tile that was queued for upload");
+	if (s->occupied) remove_slot(cache, s);
+	lru_unlink(cache, s);
+	lru_push_front(cache, s);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "page_layout.h"
+
+// pages are rendered in square tiles of TILE_SIZE pixels. a tile belongs to a zoom level, level l has
+// 2^l pixels per layout unit, and the renderer draws the level whose pixels are at least as small as the
+// ones of the window. tiles live in the slots of one atlas texture. the cache maps (page, level, tile) to
+// a slot and reuses the least recently drawn slot for a tile that is not cached, so only tiles that were
+// visible are ever rendered and tiles that scrolled out of view are the first to go
+
+#define TILE_SIZE 256
+#define TILE_ATLAS_SIZE 4096 // pixels, the atlas is square
+#define TILE_ATLAS_COLUMNS (TILE_ATLAS_SIZE / TILE_SIZE)
+#define TILE_ATLAS_SLOTS (TILE_ATLAS_COLUMNS * TILE_ATLAS_COLUMNS)
+
+#define TILE_ZOOM_LEVEL_MIN (-4)
+#define TILE_ZOOM_LEVEL_MAX 4
+
+enum TextureState {
+    TEXTURE_STATE_EMPTY,
+    TEXTURE_STATE_QUEUED,    // waiting in the upload manager for the next batch
+    TEXTURE_STATE_UPLOADING, // copy submitted, its fence has not signaled yet
+    TEXTURE_STATE_READY,     // in SHADER_READ_ONLY_OPTIMAL, can be sampled
+};
+
+typedef struct TileKey {
+    u32 page;
+    i32 zoom_level;
+    u32 x; // column of the tile in the unturned page
+    u32 y;
+} TileKey;
+
+// a tile that overlaps the window
+typedef struct VisibleTile {
+    TileKey key;
+    u32 width; // pixels, less than TILE_SIZE at the right and bottom edges of a page
+    u32 height;
+    PageInstance instance; // where the tile is drawn, the texture fields are left to the renderer
+} VisibleTile;
+
+typedef struct TileSlot {
+    TileKey key;
+    u64 hash;
+    bool occupied; // holds key, otherwise the slot is free
+    enum TextureState state;
+    u64 last_used; // frame
+    struct TileSlot *next; // in the bucket
+    // every slot, the least recently used first
+    struct TileSlot *lru_prev;
+    struct TileSlot *lru_next;
+} TileSlot;
+
+typedef struct TileCacheStats {
+    u64 hits;
+    u64 misses;
+    u64 evictions;
+} TileCacheStats;
+
+typedef struct TileCache {
+    TileSlot slots[TILE_ATLAS_SLOTS];
+    TileSlot *buckets[TILE_ATLAS_SLOTS];
+    TileSlot *lru_first; // reused first
+    TileSlot *lru_last;
+    u64 frame;
+    TileCacheStats stats;
+} TileCache;
+
+// pixels per layout unit
+f32 tile_zoom_scale(i32 zoom_level);
+// the coarsest level that is at least as sharp as zoom pixels per layout unit
+i32 tile_zoom_level(f32 zoom);
+// appends the tiles of the pages in range that overlap the layout rectangle [left, right) x [top, bottom)
+// to the stb_ds array tiles, page by page and row by row
+void tile_layout_visible(const PageLayout *layout, PageRange range, i32 zoom_level,
+                         f32 left, f32 top, f32 right, f32 bottom, VisibleTile **tiles);
+
+void tile_cache_init(TileCache *cache);
+// slots used from here on belong to the next frame, they are not reused while it is drawn
+void tile_cache_next_frame(TileCache *cache);
+// the slot of key, used in this frame. *miss is set when the slot was taken for key now and the tile
+// has to be rendered into it. U32_MAX if every slot is used in this frame or waits for its upload
+u32 tile_cache_acquire(TileCache *cache, TileKey key, bool *miss);
+// frees a slot whose tile could not be rendered, it is the next one reused
+void tile_cache_discard(TileCache *cache, u32 slot);
@@ -8,6 +8,12 @@
 #include <stdbool.h>
 #include <assert.h>
 
+// stb_ds allocations are counted by the memory accounting (see memory.h)
+void *mem_stbds_realloc(void *ptr, size_t size);
+void mem_stbds_free(void *ptr);
+#define STBDS_REALLOC(context, ptr, size) mem_stbds_realloc(ptr, size)
+#define STBDS_FREE(context, ptr) mem_stbds_free(ptr)
+
 #include <ext/stb_ds.h>
 
 // taken from [https://github.com/gingerBill/gb]
@@ -83,6 +89,14 @@ static_assert(sizeof(usize) == sizeof(isize), "type check");
 #define println(...) do { printf(__VA_ARGS__); printf("\n"); } while (0)
 #define local static
 
+#ifndef thread_local
+#if defined(_MSC_VER)
+#define thread_local __declspec(thread)
+#else
+#define thread_local _Thread_local
+#endif
+#endif
+
 #ifndef COUNT_OF
 #define COUNT_OF(x) ((sizeof(x)/sizeof(x[0])) / ((size_t)(!(sizeof(x) % sizeof(x[0])))))
 #endif
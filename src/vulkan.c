@@ -1,7 +1,18 @@
 #include "vulkan.h"
 #include "window.h"
+#include "frame_stats.h"
+#include "memory.h"
+#include "decompress.h"
+#include "dct.h"
+#include "buffer_pool.h"
+#include "pdf_parse.h"
+#include "page_layout.h"
+#include "tile_cache.h"
+#include "threads.h"
+#include "raster.h"
 
 #include <time.h>
+#include <string.h>
 #include <ext/stb_ds.h>
 #include <vulkan/vulkan.h>
 #include <ext/vk_mem_alloc.h>
@@ -21,6 +32,8 @@ typedef struct SPIRVBinary {
 
 #define VK_FORMAT_FVEC2 VK_FORMAT_R32G32_SFLOAT
 #define VK_FORMAT_FVEC3 VK_FORMAT_R32G32B32_SFLOAT
+#define VK_FORMAT_F32 VK_FORMAT_R32_SFLOAT
+#define VK_FORMAT_U32 VK_FORMAT_R32_UINT
 
 typedef struct fvec2 {
     f32 x;
@@ -33,12 +46,19 @@ typedef struct fvec3 {
     f32 z;
 } fvec3;
 
+// corner of the unit quad every page is drawn with
 typedef struct Vertex {
     fvec2 pos;
-    fvec3 color;
 } Vertex;
 
-static_assert(sizeof(Vertex) == 5 * sizeof(f32), "packed vertex");
+static_assert(sizeof(Vertex) == 2 * sizeof(f32), "packed vertex");
+static_assert(sizeof(PageInstance) == 6 * sizeof(f32), "packed page instance");
+
+// push constant, maps layout units to clip space: pos * scale + offset
+typedef struct PageView {
+    fvec2 scale;
+    fvec2 offset;
+} PageView;
 
 typedef struct BufferAllocationCreateInfo {
     VkBufferUsageFlags buffer_usage;
@@ -50,8 +70,21 @@ typedef struct BufferAllocationCreateInfo {
 typedef struct BufferAllocation {
     VkBuffer buffer;
     VmaAllocation allocation;
+    void *mapped; // NULL unless created with VMA_ALLOCATION_CREATE_MAPPED_BIT
 } BufferAllocation;
 
+// pages of the document shown by run
+#define DEMO_PAGE_COUNT 1000
+// layout units around and between the pages
+#define PAGE_GAP 12.0f
+
+// host visible buffer that stays mapped while it exists. decoders write images straight into it through
+// upload_image_target, from where they are copied into device local images
+typedef struct StagingBuffer {
+    BufferAllocation buffer;
+    VkDeviceSize size;
+} StagingBuffer;
+
 typedef struct SwapchainSupportDetails {
 	VkSurfaceCapabilitiesKHR surface_capabilities;
 	VkSurfaceFormatKHR surface_format;
@@ -85,11 +118,75 @@ typedef struct VkContext {
 	VkQueue present_queue;
 	u32 present_queue_index;
 	u32 graphics_queue_index;
+	f32 timestamp_period; // nanoseconds per timestamp tick
+	u32 timestamp_valid_bits; // 0 if the graphics queue does not support timestamps
 } VkContext;
 
+// device local RGBA image of a page, or the tile atlas
+typedef struct PageTexture {
+    VkImage image;
+    VmaAllocation allocation;
+    VkImageView view;
+    VkExtent2D extent;
+    VkImageLayout layout; // after the last recorded upload
+    enum TextureState state;
+} PageTexture;
+
+#define UPLOAD_RING_SIZE (64ull << 20)
+// offset alignment of images in the ring, covers optimalBufferCopyOffsetAlignment of common devices
+#define UPLOAD_ALIGNMENT 256
+// submitted batches whose fences have not been seen yet
+#define UPLOAD_MAX_BATCHES 4
+// copies waiting for a batch, and copies per batch
+#define UPLOAD_MAX_COPIES 128
+// bytes submitted by one upload_manager_update, larger backlogs are spread over the next frames
+#define UPLOAD_FRAME_BUDGET (16ull << 20)
+
+typedef struct UploadCopy {
+    PageTexture *texture;
+    VkOffset2D origin; // of the copied rectangle in the texture
+    VkExtent2D extent;
+    enum TextureState *state; // of the texture or of the part of it that is copied
+    VkDeviceSize offset;   // in the staging buffer
+    VkDeviceSize ring_end; // ring position after the pixels of the copy
+} UploadCopy;
+
+typedef struct UploadBatch {
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+    VkDeviceSize ring_end; // ring memory before it is free once the fence signals
+    enum TextureState *states[UPLOAD_MAX_COPIES];
+    u32 n_copies;
+} UploadBatch;
+
+// streams images into device local textures. decoders write the pixels straight into a persistently
+// mapped staging ring (upload_image_target), queued images are copied in batches of vkCmdCopyBufferToImage
+// on the graphics queue and every batch signals a fence of its own. the fences are polled, so neither
+// the uploads nor ptrail_renderpass_begin wait for each other. not thread safe, every image is queued,
+// in the order its memory was allocated, so a finished batch frees the ring up to its last copy
+typedef struct UploadManager {
+    const VkContext *context;
+    StagingBuffer staging;
+    // ring positions count every byte ever allocated and released, the offset is the position modulo the size
+    VkDeviceSize head;
+    VkDeviceSize tail;
+    VkDeviceSize queue_head; // after the last queued image, images between it and head are not queued yet
+
+    VkCommandPool command_pool;
+    UploadBatch batches[UPLOAD_MAX_BATCHES];
+    u32 oldest_batch;
+    u32 n_pending; // submitted batches from oldest_batch on
+
+    UploadCopy queued[UPLOAD_MAX_COPIES];
+    u32 n_queued;
+} UploadManager;
+
 #define MAX_FRAMES_IN_FLIGHT 2
 typedef struct PapertrailRenderpass {
 	VkPipeline pipeline;
+	VkPipelineLayout pipeline_layout; // for the push constants
+	VkDescriptorSetLayout descriptor_set_layout; // the tile atlas
+	VkSampler sampler;
 	SwapchainCreateInfo swapchain_create_info; // for rebuilding the swapchain
 	Swapchain swapchain;
 	VkRenderPass renderpass;
@@ -100,13 +197,61 @@ typedef struct PapertrailRenderpass {
 	VkSemaphore semaphore_render_finished[MAX_FRAMES_IN_FLIGHT];
 	VkFence fence_in_flight[MAX_FRAMES_IN_FLIGHT];
 
+	// two timestamps (begin, end) per frame in flight
+	VkQueryPool timestamp_query_pool;
+	bool timestamps_written[MAX_FRAMES_IN_FLIGHT];
+
     u32 current_frame_index;
     u32 current_swapchain_image_index;
+
+	FrameTimings current_timings;
+	f64 frame_begin_time;
+	f64 record_begin_time;
+	FrameStats *frame_stats; // optional, frames are not recorded if NULL
 } PapertrailRenderpass;
 
+// renders a tile of a page into width * height packed RGBA pixels, called on worker threads
+typedef void (*TileRenderFn)(void *user_data, const VisibleTile *tile, u8 *rgba);
+
+typedef struct TileRenderer {
+    TileRenderFn fn;
+    void *user_data;
+} TileRenderer;
+
+// tiles rendered in one frame, the visible tiles that are left are rendered in the next frames
+#define TILES_PER_FRAME 32
+
+// the tiles of the visible pages live in the slots of one atlas texture, the tile cache decides which
+// slot a tile gets. tiles are rendered into the upload ring and copied into their slot, until the copy
+// is done the page shows blank paper there
+typedef struct TileAtlas {
+    PageTexture texture; // TILE_ATLAS_SIZE square
+    TileCache cache;
+    TileRenderer renderer;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet descriptor_set;
+
+    VisibleTile *visible; // stb_ds array, the tiles of the current frame
+    // instances of the tiles drawn by every frame in flight, written once its fence has signaled
+    BufferAllocation instance_buffers[MAX_FRAMES_IN_FLIGHT];
+    u32 instance_capacity[MAX_FRAMES_IN_FLIGHT];
+} TileAtlas;
+
 typedef struct PapertrailRenderData {
     BufferAllocation vertex_buffer;
     BufferAllocation index_buffer;
+    UploadManager uploads;
+    TileAtlas tiles;
+    PageTexture jpeg; // PTRAIL_JPEG, not drawn yet
+
+    // a PageInstance per page of the layout, rewritten when the layout version changes
+    const PageLayout *layout;
+    BufferAllocation instance_buffer;
+    u32 instance_capacity;
+    u64 instance_version;
+
+    f32 scroll; // layout units above the top of the window
+    f32 zoom;   // pixels per layout unit
 } PapertrailRenderData;
 
 // callback functions and data for window events (e.g. resizing)
@@ -117,10 +262,10 @@ typedef struct PapertrailWindowCallbackFn {
 } PapertrailWindowCallbackFn;
 
 const Vertex VERTICES[] = {
-        {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-        {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
-        {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
-        {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}}
+        {{0.0f, 0.0f}},
+        {{1.0f, 0.0f}},
+        {{1.0f, 1.0f}},
+        {{0.0f, 1.0f}}
 };
 
 const u16 INDICES[] = {
@@ -128,10 +273,18 @@ const u16 INDICES[] = {
 };
 
 
-const VkVertexInputBindingDescription vertex_binding_description = {
-        .binding = 0,
-        .stride = sizeof(Vertex),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+// the quad corners advance per vertex, the pages per instance
+const VkVertexInputBindingDescription vertex_binding_descriptions[] = {
+        {
+            .binding = 0,
+            .stride = sizeof(Vertex),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+        },
+        {
+            .binding = 1,
+            .stride = sizeof(PageInstance),
+            .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+        }
 };
 
 const VkVertexInputAttributeDescription vertex_attribute_descriptions[] = {
@@ -142,10 +295,34 @@ const VkVertexInputAttributeDescription vertex_attribute_descriptions[] = {
             .offset = offsetof(Vertex, pos),
         },
         {
-            .binding = 0,
+            .binding = 1,
             .location = 1,
-            .format = VK_FORMAT_FVEC3,
-            .offset = offsetof(Vertex, color)
+            .format = VK_FORMAT_FVEC2,
+            .offset = offsetof(PageInstance, x),
+        },
+        {
+            .binding = 1,
+            .location = 2,
+            .format = VK_FORMAT_FVEC2,
+            .offset = offsetof(PageInstance, width),
+        },
+        {
+            .binding = 1,
+            .location = 3,
+            .format = VK_FORMAT_U32,
+            .offset = offsetof(PageInstance, texture_index),
+        },
+        {
+            .binding = 1,
+            .location = 4,
+            .format = VK_FORMAT_F32,
+            .offset = offsetof(PageInstance, rotation),
+        },
+        {
+            .binding = 1,
+            .location = 5,
+            .format = VK_FORMAT_FVEC2,
+            .offset = offsetof(PageInstance, texture_width),
         }
 };
 
@@ -247,18 +424,20 @@ local inline VkResult buffer_allocation_create(VmaAllocator allocator,
 
     VkBuffer buffer;
     VmaAllocation allocation;
+    VmaAllocationInfo allocation_info;
     VK_RET_ERR(vmaCreateBuffer(
             allocator,
             &buffer_create_info,
             &allocation_create_info,
             &buffer,
             &allocation,
-            NULL)
+            &allocation_info)
     );
 
     *buffer_allocation = (BufferAllocation) {
         .buffer = buffer,
         .allocation = allocation,
+        .mapped = allocation_info.pMappedData,
     };
 
     return VK_SUCCESS;
@@ -268,9 +447,617 @@ local inline void buffer_allocation_destroy(BufferAllocation *buff, VmaAllocator
     vmaDestroyBuffer(allocator, buff->buffer, buff->allocation);
 }
 
+VkResult staging_buffer_create(VmaAllocator allocator, VkDeviceSize size, StagingBuffer *staging) {
+    BufferAllocationCreateInfo create_info = {
+            .size = size,
+            .buffer_usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .memory_usage = VMA_MEMORY_USAGE_AUTO,
+            .allocation_flag = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    };
+
+    *staging = (StagingBuffer) { .size = size };
+    VK_RET_ERR(buffer_allocation_create(allocator, &create_info, &staging->buffer));
+    ASSERT_MSG(staging->buffer.mapped, "staging buffer is not mapped");
+    return VK_SUCCESS;
+}
+
+void staging_buffer_destroy(StagingBuffer *staging, VmaAllocator allocator) {
+    buffer_allocation_destroy(&staging->buffer, allocator);
+    *staging = (StagingBuffer) { 0 };
+}
+
+// offset of memory returned by the image target, for VkBufferImageCopy.bufferOffset
+local VkDeviceSize staging_buffer_offset(const StagingBuffer *staging, const u8 *data) {
+    return (VkDeviceSize)(data - (const u8 *)staging->buffer.mapped);
+}
+
+// whether data was allocated from the buffer, and not from the buffer pool by a full image target
+local bool staging_buffer_owns(const StagingBuffer *staging, const u8 *data) {
+    const u8 *mapped = staging->buffer.mapped;
+    return data >= mapped && data < mapped + staging->size;
+}
+
+
+/// TEXTURES ///
+
+VkResult page_texture_create(const VkContext *c, u32 width, u32 height, PageTexture *texture) {
+    VkImageCreateInfo image_create_info = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = VK_FORMAT_R8G8B8A8_SRGB,
+            .extent = { .width = width, .height = height, .depth = 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    VmaAllocationCreateInfo allocation_create_info = {
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+    };
+
+    *texture = (PageTexture) {
+            .extent = { .width = width, .height = height },
+            .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    VK_RET_ERR(vmaCreateImage(c->allocator, &image_create_info, &allocation_create_info,
+                              &texture->image, &texture->allocation, NULL));
+
+    VkImageViewCreateInfo image_view_create_info = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = texture->image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = VK_FORMAT_R8G8B8A8_SRGB,
+            .subresourceRange = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .levelCount = 1,
+                    .layerCount = 1,
+            },
+    };
+    VK_RET_ERR(vkCreateImageView(c->device, &image_view_create_info, NULL, &texture->view));
+    return VK_SUCCESS;
+}
+
+// the texture can't be part of a batch that is still executing
+void page_texture_destroy(const VkContext *c, PageTexture *texture) {
+    ASSERT_MSG(texture->state != TEXTURE_STATE_QUEUED && texture->state != TEXTURE_STATE_UPLOADING,
+               "texture destroyed during its upload");
+    vkDestroyImageView(c->device, texture->view, NULL);
+    vmaDestroyImage(c->allocator, texture->image, texture->allocation);
+    *texture = (PageTexture) { 0 };
+}
+
+
+/// UPLOADS ///
+
+VkResult upload_manager_init(UploadManager *um, const VkContext *c, VkDeviceSize ring_size) {
+    *um = (UploadManager) { .context = c };
+    VK_RET_ERR(staging_buffer_create(c->allocator, ring_size, &um->staging));
+
+    VkCommandPoolCreateInfo command_pool_create_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = c->graphics_queue_index,
+    };
+    VK_RET_ERR(vkCreateCommandPool(c->device, &command_pool_create_info, NULL, &um->command_pool));
+
+    VkCommandBuffer command_buffers[UPLOAD_MAX_BATCHES];
+    VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = um->command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = UPLOAD_MAX_BATCHES,
+    };
+    VK_RET_ERR(vkAllocateCommandBuffers(c->device, &command_buffer_allocate_info, command_buffers));
+
+    VkFenceCreateInfo fence_create_info = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+    };
+    for (u32 i = 0; i < UPLOAD_MAX_BATCHES; i++) {
+        um->batches[i].command_buffer = command_buffers[i];
+        VK_RET_ERR(vkCreateFence(c->device, &fence_create_info, NULL, &um->batches[i].fence));
+    }
+    return VK_SUCCESS;
+}
+
+// the textures of a finished batch can be sampled and its ring memory is reused
+local void retire_batch(UploadManager *um, UploadBatch *batch) {
+    for (u32 i = 0; i < batch->n_copies; i++) {
+        *batch->states[i] = TEXTURE_STATE_READY;
+    }
+    batch->n_copies = 0;
+    um->tail = batch->ring_end;
+    VK_CHECK(vkResetFences(um->context->device, 1, &batch->fence));
+
+    um->oldest_batch = (um->oldest_batch + 1) % UPLOAD_MAX_BATCHES;
+    um->n_pending -= 1;
+}
+
+// retires the finished batches without waiting, they finish in the order they were submitted
+void upload_manager_poll(UploadManager *um) {
+    while (um->n_pending > 0) {
+        UploadBatch *batch = &um->batches[um->oldest_batch];
+        VkResult result = vkGetFenceStatus(um->context->device, batch->fence);
+        if (result == VK_NOT_READY) break;
+        VK_CHECK(result);
+        retire_batch(um, batch);
+    }
+}
+
+local void wait_oldest_batch(UploadManager *um) {
+    UploadBatch *batch = &um->batches[um->oldest_batch];
+    VK_CHECK(vkWaitForFences(um->context->device, 1, &batch->fence, VK_TRUE, U64_MAX));
+    retire_batch(um, batch);
+}
+
+// records the queued copies into one command buffer, up to budget bytes (at least one copy). every
+// image goes to TRANSFER_DST and back to SHADER_READ_ONLY once per batch, however many of its parts are
+// copied, the barriers of the batch are issued together. an image that was uploaded before keeps its
+// pixels, the frames submitted earlier finish sampling it before the copies start
+local void submit_batch(UploadManager *um, VkDeviceSize budget) {
+    const VkContext *c = um->context;
+    if (um->n_queued == 0) return;
+    if (um->n_pending == UPLOAD_MAX_BATCHES) wait_oldest_batch(um);
+
+    UploadBatch *batch = &um->batches[(um->oldest_batch + um->n_pending) % UPLOAD_MAX_BATCHES];
+    VkImageMemoryBarrier to_transfer[UPLOAD_MAX_COPIES];
+    VkImageMemoryBarrier to_shader[UPLOAD_MAX_COPIES];
+    PageTexture *textures[UPLOAD_MAX_COPIES];
+    u32 n_textures = 0;
+
+    u32 n_copies = 0;
+    VkDeviceSize bytes = 0;
+    while (n_copies < um->n_queued) {
+        const UploadCopy *copy = &um->queued[n_copies];
+        VkDeviceSize size = (VkDeviceSize)copy->extent.width * copy->extent.height * 4;
+        if (n_copies > 0 && bytes + size > budget) break;
+        bytes += size;
+        n_copies += 1;
+
+        u32 t = 0;
+        while (t < n_textures && textures[t] != copy->texture) t++;
+        if (t < n_textures) continue;
+
+        PageTexture *texture = copy->texture;
+        textures[n_textures] = texture;
+        VkImageMemoryBarrier barrier = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = 0,
+                .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .oldLayout = texture->layout,
+                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = texture->image,
+                .subresourceRange = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .levelCount = 1,
+                        .layerCount = 1,
+                },
+        };
+        to_transfer[n_textures] = barrier;
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        to_shader[n_textures] = barrier;
+
+        texture->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        n_textures += 1;
+    }
+
+    VkCommandBuffer command_buffer = batch->command_buffer;
+    VK_CHECK(vkResetCommandBuffer(command_buffer, 0));
+    VkCommandBufferBeginInfo command_buffer_begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VK_CHECK(vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info));
+
+    // the copies may overwrite tiles that frames in flight still sample
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, NULL, 0, NULL, n_textures, to_transfer);
+
+    for (u32 i = 0; i < n_copies; i++) {
+        const UploadCopy *copy = &um->queued[i];
+        VkBufferImageCopy region = {
+                .bufferOffset = copy->offset,
+                .bufferRowLength = 0, // tightly packed
+                .bufferImageHeight = 0,
+                .imageSubresource = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .mipLevel = 0,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                },
+                .imageOffset = { copy->origin.x, copy->origin.y, 0 },
+                .imageExtent = { copy->extent.width, copy->extent.height, 1 },
+        };
+        vkCmdCopyBufferToImage(command_buffer, um->staging.buffer.buffer, copy->texture->image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        *copy->state = TEXTURE_STATE_UPLOADING;
+        batch->states[i] = copy->state;
+    }
+
+    // later submissions on the queue sample the textures only after the copies
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         0, 0, NULL, 0, NULL, n_textures, to_shader);
+    VK_CHECK(vkEndCommandBuffer(command_buffer));
+
+    VK_CHECK(vmaFlushAllocation(c->allocator, um->staging.buffer.allocation, 0, VK_WHOLE_SIZE));
+
+    VkSubmitInfo submit_info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &command_buffer,
+    };
+    VK_CHECK(vkQueueSubmit(c->graphics_queue, 1, &submit_info, batch->fence));
+
+    batch->n_copies = n_copies;
+    batch->ring_end = um->queued[n_copies - 1].ring_end;
+    um->n_pending += 1;
+
+    um->n_queued -= n_copies;
+    memmove(um->queued, um->queued + n_copies, um->n_queued * sizeof(UploadCopy));
+}
+
+// once a frame: retires finished batches and submits up to UPLOAD_FRAME_BUDGET bytes of queued images.
+// never waits, with every batch in flight the images stay queued until the next frame
+void upload_manager_update(UploadManager *um) {
+    upload_manager_poll(um);
+    if (um->n_pending < UPLOAD_MAX_BATCHES) submit_batch(um, UPLOAD_FRAME_BUDGET);
+}
+
+// frees the oldest ring memory that is in use by the gpu. false if there is none,
+// then the rest of the ring belongs to images that were not queued yet
+local bool make_room(UploadManager *um) {
+    if (um->n_pending == 0) {
+        if (um->n_queued == 0) return false;
+        submit_batch(um, U64_MAX);
+    }
+    wait_oldest_batch(um);
+    return true;
+}
+
+// ring position where an image of size bytes allocated at position starts, images are never split
+// at the end of the ring
+local VkDeviceSize ring_image_start(VkDeviceSize position, VkDeviceSize size, VkDeviceSize ring_size) {
+    VkDeviceSize start = (position + UPLOAD_ALIGNMENT - 1) / UPLOAD_ALIGNMENT * UPLOAD_ALIGNMENT;
+    VkDeviceSize offset = start % ring_size;
+    if (offset + size > ring_size) start += ring_size - offset;
+    return start;
+}
+
+// waits for uploads only when the decoders get a whole ring ahead of the gpu. NULL if the image is
+// not RGBA, does not fit the ring, or if the rest of the ring holds images that were allocated but not
+// queued. image_target_alloc then decodes into the buffer pool
+local u8 *upload_ring_alloc(void *user_data, const RawImage *layout, u64 size) {
+    UploadManager *um = user_data;
+    if (layout->format != PIXEL_FORMAT_RGBA) return NULL;
+    VkDeviceSize ring_size = um->staging.size;
+    if (size > ring_size) return NULL;
+
+    for (;;) {
+        VkDeviceSize start = ring_image_start(um->head, size, ring_size);
+        // an empty ring is free up to the start, the padding at its end included
+        if (um->tail == um->head) um->tail = start;
+
+        if (start + size - um->tail <= ring_size) {
+            um->head = start + size;
+            return (u8 *)um->staging.buffer.mapped + start % ring_size;
+        }
+        if (!make_room(um)) return NULL;
+    }
+}
+
+// whether an RGBA image of width x height can be decoded into upload_image_target. images the ring
+// can't hold would be decoded into the buffer pool, checking first saves the decode
+local bool upload_manager_fits(const UploadManager *um, u32 width, u32 height) {
+    return (u64)width * height * 4 <= um->staging.size;
+}
+
+// decode target whose images are uploaded with upload_manager_queue. a decoder writes into it only
+// once the images decoded into it before are queued
+ImageTarget upload_image_target(UploadManager *um) {
+    return (ImageTarget) { .fn = upload_ring_alloc, .user_data = um };
+}
+
+// queues the copy of an image from upload_image_target into the texture at origin. state follows
+// the copy and is TEXTURE_STATE_READY a few frames later
+void upload_manager_queue_region(UploadManager *um, const RawImage *image, PageTexture *texture,
+                                 VkOffset2D origin, enum TextureState *state) {
+    ASSERT_MSG(origin.x >= 0 && origin.y >= 0 && (u32)origin.x + image->width <= texture->extent.width
+               && (u32)origin.y + image->height <= texture->extent.height,
+               "%ux%u image uploaded at %d, %d into a %ux%u texture", image->width, image->height,
+               origin.x, origin.y, texture->extent.width, texture->extent.height);
+    ASSERT_MSG(image->format == PIXEL_FORMAT_RGBA, "textures are RGBA, not %s", pixel_format_to_str(image->format));
+
+    if (um->n_queued == UPLOAD_MAX_COPIES) submit_batch(um, U64_MAX);
+
+    // retiring a batch frees the ring up to its last copy, which would also free the images allocated
+    // before it that are not queued yet. the image has to be the next one after the last queued image
+    VkDeviceSize size = (VkDeviceSize)image->width * image->height * 4;
+    VkDeviceSize start = ring_image_start(um->queue_head, size, um->staging.size);
+    VkDeviceSize offset = staging_buffer_offset(&um->staging, image->data);
+    ASSERT_MSG(offset == start % um->staging.size && start + size <= um->head,
+               "image at %llu queued out of allocation order, the next one is at %llu",
+               (unsigned long long)offset, (unsigned long long)(start % um->staging.size));
+    um->queue_head = start + size;
+
+    um->queued[um->n_queued++] = (UploadCopy) {
+            .texture = texture,
+            .origin = origin,
+            .extent = { .width = image->width, .height = image->height },
+            .state = state,
+            .offset = offset,
+            .ring_end = um->queue_head,
+    };
+    *state = TEXTURE_STATE_QUEUED;
+}
+
+// queues the copy of an image from upload_image_target into a texture of its size
+void upload_manager_queue(UploadManager *um, const RawImage *image, PageTexture *texture) {
+    ASSERT_MSG(image->width == texture->extent.width && image->height == texture->extent.height,
+               "%ux%u image uploaded into a %ux%u texture", image->width, image->height,
+               texture->extent.width, texture->extent.height);
+    upload_manager_queue_region(um, image, texture, (VkOffset2D) { 0, 0 }, &texture->state);
+}
+
+// decodes a jpeg straight into the upload ring and queues it into a new texture of its size. false if
+// the jpeg does not decode to RGBA (CMYK) or is larger than the ring, nothing is created then
+bool upload_manager_queue_jpeg(UploadManager *um, const u8 *data, u64 len, enum DCTScale scale, PageTexture *texture) {
+    u32 width = 0, height = 0;
+    dct_read_size(data, len, &width, &height);
+    if (!upload_manager_fits(um, dct_scaled_size(width, scale), dct_scaled_size(height, scale))) return false;
+
+    // the ring only takes RGBA, other images come back from the buffer pool
+    RawImage image = dct_decode_into(data, len, scale, DCT_OUTPUT_RGBA, upload_image_target(um));
+    if (!staging_buffer_owns(&um->staging, image.data)) {
+        buffer_pool_release(image.data);
+        return false;
+    }
+
+    VK_CHECK(page_texture_create(um->context, image.width, image.height, texture));
+    upload_manager_queue(um, &image, texture);
+    return true;
+}
+
+void upload_manager_destroy(UploadManager *um) {
+    const VkContext *c = um->context;
+    while (um->n_pending > 0) wait_oldest_batch(um);
+
+    // images that never made it into a batch go back to empty
+    for (u32 i = 0; i < um->n_queued; i++) {
+        *um->queued[i].state = TEXTURE_STATE_EMPTY;
+    }
+
+    for (u32 i = 0; i < UPLOAD_MAX_BATCHES; i++) {
+        vkDestroyFence(c->device, um->batches[i].fence, NULL);
+    }
+    vkDestroyCommandPool(c->device, um->command_pool, NULL);
+    staging_buffer_destroy(&um->staging, c->allocator);
+    *um = (UploadManager) { 0 };
+}
+
+
+/// TILES ///
+
+VkResult tile_atlas_init(TileAtlas *atlas, const VkContext *c, const PapertrailRenderpass *rp, TileRenderer renderer) {
+    *atlas = (TileAtlas) { .renderer = renderer };
+    tile_cache_init(&atlas->cache);
+    VK_RET_ERR(page_texture_create(c, TILE_ATLAS_SIZE, TILE_ATLAS_SIZE, &atlas->texture));
+
+    VkDescriptorPoolSize pool_size = {
+            .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = 1,
+    };
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .maxSets = 1,
+            .poolSizeCount = 1,
+            .pPoolSizes = &pool_size,
+    };
+    VK_RET_ERR(vkCreateDescriptorPool(c->device, &descriptor_pool_create_info, NULL, &atlas->descriptor_pool));
+
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = atlas->descriptor_pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &rp->descriptor_set_layout,
+    };
+    VK_RET_ERR(vkAllocateDescriptorSets(c->device, &descriptor_set_allocate_info, &atlas->descriptor_set));
+
+    // the sampler is immutable in the set layout. the atlas is only sampled where a tile is ready,
+    // by then its first upload has moved it to the layout given here
+    VkDescriptorImageInfo image_info = {
+            .imageView = atlas->texture.view,
+            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+    VkWriteDescriptorSet write = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = atlas->descriptor_set,
+            .dstBinding = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &image_info,
+    };
+    vkUpdateDescriptorSets(c->device, 1, &write, 0, NULL);
+    return VK_SUCCESS;
+}
+
+// the uploads into the atlas have to be finished or dropped
+void tile_atlas_destroy(TileAtlas *atlas, const VkContext *c) {
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (atlas->instance_capacity[i] > 0) buffer_allocation_destroy(&atlas->instance_buffers[i], c->allocator);
+    }
+    vkDestroyDescriptorPool(c->device, atlas->descriptor_pool, NULL);
+    page_texture_destroy(c, &atlas->texture);
+    arrfree(atlas->visible);
+    *atlas = (TileAtlas) { 0 };
+}
+
+typedef struct TileJobs {
+    TileRenderer renderer;
+    const VisibleTile *tiles[TILES_PER_FRAME];
+    u8 *pixels[TILES_PER_FRAME];
+} TileJobs;
+
+local void render_tile_job(void *user_data, u32 index) {
+    TileJobs *jobs = user_data;
+    jobs->renderer.fn(jobs->renderer.user_data, jobs->tiles[index], jobs->pixels[index]);
+}
+
+// finds the tiles of level that overlap the layout rectangle [left, right) x [top, bottom) and renders
+// up to TILES_PER_FRAME of the ones that are not in the atlas, on all threads, straight into the upload
+// ring. the rendered tiles are queued for upload into their slots
+void tile_atlas_update(TileAtlas *atlas, UploadManager *uploads, const PageLayout *layout, PageRange pages,
+                       i32 level, f32 left, f32 top, f32 right, f32 bottom) {
+    tile_cache_next_frame(&atlas->cache);
+    arrsetlen(atlas->visible, 0);
+    tile_layout_visible(layout, pages, level, left, top, right, bottom, &atlas->visible);
+
+    TileJobs jobs = { .renderer = atlas->renderer };
+    u32 slots[TILES_PER_FRAME];
+    u32 n_jobs = 0;
+
+    for (u32 i = 0; i < (u32)arrlen(atlas->visible); i++) {
+        VisibleTile *tile = &atlas->visible[i];
+        bool miss;
+        u32 slot = tile_cache_acquire(&atlas->cache, tile->key, &miss);
+        tile->instance.texture_index = slot;
+        tile->instance.texture_width = (f32)tile->width / TILE_ATLAS_SIZE;
+        tile->instance.texture_height = (f32)tile->height / TILE_ATLAS_SIZE;
+        if (slot == U32_MAX || !miss) continue;
+
+        RawImage image_layout = { .width = tile->width, .height = tile->height, .n_channels = 4, .format = PIXEL_FORMAT_RGBA };
+        u8 *pixels = n_jobs < TILES_PER_FRAME
+                ? upload_ring_alloc(uploads, &image_layout, (u64)tile->width * tile->height * 4)
+                : NULL;
+        if (!pixels) {
+            // over the budget of the frame, the tile gets a slot again when it is still visible
+            tile_cache_discard(&atlas->cache, slot);
+            tile->instance.texture_index = U32_MAX;
+            continue;
+        }
+
+        jobs.tiles[n_jobs] = tile;
+        jobs.pixels[n_jobs] = pixels;
+        slots[n_jobs] = slot;
+        n_jobs += 1;
+    }
+
+    parallel_for(n_jobs, render_tile_job, &jobs);
+
+    // in the order of the ring allocations
+    for (u32 i = 0; i < n_jobs; i++) {
+        const VisibleTile *tile = jobs.tiles[i];
+        RawImage image = {
+                .data = jobs.pixels[i],
+                .width = tile->width,
+                .height = tile->height,
+                .n_channels = 4,
+                .format = PIXEL_FORMAT_RGBA,
+        };
+        VkOffset2D origin = {
+                .x = (i32)(slots[i] % TILE_ATLAS_COLUMNS * TILE_SIZE),
+                .y = (i32)(slots[i] / TILE_ATLAS_COLUMNS * TILE_SIZE),
+        };
+        upload_manager_queue_region(uploads, &image, &atlas->texture, origin, &atlas->cache.slots[slots[i]].state);
+    }
+}
+
+// writes the instances of the visible tiles that are in the atlas into the buffer of the frame in flight,
+// whose fence has signaled. returns how many there are
+u32 tile_atlas_write_instances(TileAtlas *atlas, const VkContext *c, u32 frame_index) {
+    u32 n_visible = (u32)arrlen(atlas->visible);
+    BufferAllocation *buffer = &atlas->instance_buffers[frame_index];
+
+    if (n_visible > atlas->instance_capacity[frame_index]) {
+        if (atlas->instance_capacity[frame_index] > 0) buffer_allocation_destroy(buffer, c->allocator);
+
+        u32 capacity = MAX(n_visible, 2 * atlas->instance_capacity[frame_index]);
+        BufferAllocationCreateInfo create_info = {
+                .size = (VkDeviceSize)capacity * sizeof(PageInstance),
+                .buffer_usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                .memory_usage = VMA_MEMORY_USAGE_AUTO,
+                .allocation_flag = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        };
+        VK_CHECK(buffer_allocation_create(c->allocator, &create_info, buffer));
+        ASSERT_MSG(buffer->mapped, "tile instance buffer is not mapped");
+        atlas->instance_capacity[frame_index] = capacity;
+    }
+
+    PageInstance *instances = buffer->mapped;
+    u32 n_ready = 0;
+    for (u32 i = 0; i < n_visible; i++) {
+        const VisibleTile *tile = &atlas->visible[i];
+        u32 slot = tile->instance.texture_index;
+        if (slot == U32_MAX || atlas->cache.slots[slot].state != TEXTURE_STATE_READY) continue;
+        instances[n_ready++] = tile->instance;
+    }
+
+    if (n_ready > 0) {
+        VK_CHECK(vmaFlushAllocation(c->allocator, buffer->allocation, 0, (VkDeviceSize)n_ready * sizeof(PageInstance)));
+    }
+    return n_ready;
+}
+
 local inline void ptrail_render_data_destroy(PapertrailRenderData *data, const VkContext *c) {
     buffer_allocation_destroy(&data->vertex_buffer, c->allocator);
     buffer_allocation_destroy(&data->index_buffer, c->allocator);
+    // waits for the uploads, the tiles in the atlas are not in use afterwards
+    upload_manager_destroy(&data->uploads);
+    tile_atlas_destroy(&data->tiles, c);
+    if (data->jpeg.image) page_texture_destroy(c, &data->jpeg);
+    if (data->instance_capacity > 0) buffer_allocation_destroy(&data->instance_buffer, c->allocator);
+}
+
+// rewrites the instance buffer if the layout changed since the last upload, scrolling and zooming
+// leave it alone. layout changes are rare (opening a document, turning a page), so the frames in
+// flight that read the old instances are waited for instead of keeping a buffer per frame
+local void page_instances_update(PapertrailRenderData *data, const VkContext *c) {
+    const PageLayout *layout = data->layout;
+    if (!layout || layout->version == data->instance_version) return;
+
+    VK_CHECK(vkQueueWaitIdle(c->graphics_queue));
+
+    if (layout->n_pages > data->instance_capacity) {
+        if (data->instance_capacity > 0) buffer_allocation_destroy(&data->instance_buffer, c->allocator);
+
+        u32 capacity = MAX(layout->n_pages, 2 * data->instance_capacity);
+        BufferAllocationCreateInfo create_info = {
+                .size = (VkDeviceSize)capacity * sizeof(PageInstance),
+                .buffer_usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                .memory_usage = VMA_MEMORY_USAGE_AUTO,
+                .allocation_flag = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        };
+        VK_CHECK(buffer_allocation_create(c->allocator, &create_info, &data->instance_buffer));
+        ASSERT_MSG(data->instance_buffer.mapped, "instance buffer is not mapped");
+        data->instance_capacity = capacity;
+    }
+
+    VkDeviceSize size = (VkDeviceSize)layout->n_pages * sizeof(PageInstance);
+    memcpy(data->instance_buffer.mapped, layout->instances, size);
+    if (size > 0) VK_CHECK(vmaFlushAllocation(c->allocator, data->instance_buffer.allocation, 0, size));
+    data->instance_version = layout->version;
+}
+
+// the layout is centered horizontally and scrolled vertically
+local PageView page_view(const PapertrailRenderData *data, VkExtent2D extent) {
+    fvec2 scale = {
+            .x = 2.0f * data->zoom / (f32)extent.width,
+            .y = 2.0f * data->zoom / (f32)extent.height,
+    };
+    f32 left = (data->layout->width - (f32)extent.width / data->zoom) / 2.0f;
+
+    return (PageView) {
+            .scale = scale,
+            .offset = { .x = -left * scale.x - 1.0f, .y = -data->scroll * scale.y - 1.0f },
+    };
 }
 
 
@@ -526,6 +1313,36 @@ VkPhysicalDevice vk_pick_physical_device(
 
 /// VK_CONTEXT ///
 
+local void VKAPI_PTR vma_allocate_callback(VmaAllocator allocator, u32 memory_type,
+                                           VkDeviceMemory memory, VkDeviceSize size, void *user_data) {
+    mem_track_alloc(MEM_TAG_VMA, size);
+}
+
+local void VKAPI_PTR vma_free_callback(VmaAllocator allocator, u32 memory_type,
+                                       VkDeviceMemory memory, VkDeviceSize size, void *user_data) {
+    mem_track_free(MEM_TAG_VMA, size);
+}
+
+local const VmaDeviceMemoryCallbacks vma_memory_callbacks = {
+        .pfnAllocate = vma_allocate_callback,
+        .pfnFree = vma_free_callback,
+};
+
+// queries the heap budgets from vma and stores their sum in the memory report
+local void vk_update_memory_budget(const VkContext *c) {
+    const VkPhysicalDeviceMemoryProperties *memory_properties;
+    vmaGetMemoryProperties(c->allocator, &memory_properties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(c->allocator, budgets);
+
+    u64 budget = 0;
+    for (u32 i = 0; i < memory_properties->memoryHeapCount; i++) {
+        budget += budgets[i].budget;
+    }
+    mem_set_budget(MEM_TAG_VMA, budget);
+}
+
 VkContext vk_context_init(PapertrailWindow *window) {
 
 	VkApplicationInfo application_info = {
@@ -607,6 +1424,7 @@ VkContext vk_context_init(PapertrailWindow *window) {
 			break;
 		}
 	}
+	u32 timestamp_valid_bits = queue_families[graphics_queue_index].timestampValidBits;
 
 	/* present queue */
 	VkBool32 found_present_support = false;
@@ -667,6 +1485,7 @@ VkContext vk_context_init(PapertrailWindow *window) {
             .physicalDevice = physical_device,
             .device = device,
             .instance = instance,
+            .pDeviceMemoryCallbacks = &vma_memory_callbacks,
     };
     VmaAllocator allocator;
     vmaCreateAllocator(&allocator_create_info, &allocator);
@@ -681,6 +1500,8 @@ VkContext vk_context_init(PapertrailWindow *window) {
         .graphics_queue_index = graphics_queue_index,
         .present_queue = present_queue,
         .present_queue_index = present_queue_index,
+        .timestamp_period = physical_device_properties.limits.timestampPeriod,
+        .timestamp_valid_bits = timestamp_valid_bits,
 	};
 }
 
@@ -703,8 +1524,14 @@ void ptrail_renderpass_destroy(VkDevice device, PapertrailRenderpass *rp) {
 		vkDestroyFence(device, rp->fence_in_flight[i], NULL);
 	}
 
+	if (rp->timestamp_query_pool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(device, rp->timestamp_query_pool, NULL);
+	}
 	vkDestroyCommandPool(device, rp->command_pool, NULL);
 	vkDestroyPipeline(device, rp->pipeline, NULL);
+	vkDestroyPipelineLayout(device, rp->pipeline_layout, NULL);
+	vkDestroyDescriptorSetLayout(device, rp->descriptor_set_layout, NULL);
+	vkDestroySampler(device, rp->sampler, NULL);
 	vkDestroyRenderPass(device, rp->renderpass, NULL);
 	swapchain_destroy(device, &rp->swapchain);
 }
@@ -726,8 +1553,8 @@ PapertrailRenderpass ptrail_renderpass_init(const VkContext *c, PapertrailWindow
 
 	VkPipelineVertexInputStateCreateInfo pipeline_vertex_input_create_info = {
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-			.vertexBindingDescriptionCount = 1,
-			.pVertexBindingDescriptions = &vertex_binding_description,
+			.vertexBindingDescriptionCount = COUNT_OF(vertex_binding_descriptions),
+			.pVertexBindingDescriptions = vertex_binding_descriptions,
 			.vertexAttributeDescriptionCount = COUNT_OF(vertex_attribute_descriptions),
 			.pVertexAttributeDescriptions = vertex_attribute_descriptions,
 	};
@@ -796,10 +1623,47 @@ PapertrailRenderpass ptrail_renderpass_init(const VkContext *c, PapertrailWindow
 
 	};
 
+	VkPushConstantRange push_constant_range = {
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+			.offset = 0,
+			.size = sizeof(PageView),
+	};
+
+	// the tiles are magnified up to twice and minified up to half, a single level filters well enough
+	VkSamplerCreateInfo sampler_create_info = {
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.maxLod = 0.0f,
+	};
+	VkSampler sampler;
+	VK_CHECK(vkCreateSampler(c->device, &sampler_create_info, NULL, &sampler));
+
+	VkDescriptorSetLayoutBinding atlas_binding = {
+			.binding = 0,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			.pImmutableSamplers = &sampler,
+	};
+	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = 1,
+			.pBindings = &atlas_binding,
+	};
+	VkDescriptorSetLayout descriptor_set_layout;
+	VK_CHECK(vkCreateDescriptorSetLayout(c->device, &descriptor_set_layout_create_info, NULL, &descriptor_set_layout));
+
 	VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-			.setLayoutCount = 0,
-			.pushConstantRangeCount = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &descriptor_set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range,
 	};
     VkPipelineLayout pipeline_layout;
 	VK_CHECK(vkCreatePipelineLayout(c->device, &pipeline_layout_create_info, NULL, &pipeline_layout));
@@ -897,7 +1761,6 @@ PapertrailRenderpass ptrail_renderpass_init(const VkContext *c, PapertrailWindow
 		&graphics_pipeline_create_info, NULL, &pipeline));
 
     /* cleanup */
-    vkDestroyPipelineLayout(c->device, pipeline_layout, NULL);
     vkDestroyShaderModule(c->device, vertex_module, NULL);
     vkDestroyShaderModule(c->device, fragment_module, NULL);
 
@@ -956,12 +1819,29 @@ PapertrailRenderpass ptrail_renderpass_init(const VkContext *c, PapertrailWindow
 		VK_CHECK(vkCreateFence(c->device, &fence_create_info, NULL, &in_flight_fences[i]));
 	}
 
+
+	/// TIMESTAMP QUERIES ///
+
+	VkQueryPool timestamp_query_pool = VK_NULL_HANDLE;
+	if (c->timestamp_valid_bits != 0) {
+		VkQueryPoolCreateInfo query_pool_create_info = {
+				.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				.queryType = VK_QUERY_TYPE_TIMESTAMP,
+				.queryCount = 2 * MAX_FRAMES_IN_FLIGHT,
+		};
+		VK_CHECK(vkCreateQueryPool(c->device, &query_pool_create_info, NULL, &timestamp_query_pool));
+	}
+
 	PapertrailRenderpass ptrail_renderpass = {
 		.pipeline = pipeline,
+		.pipeline_layout = pipeline_layout,
+		.descriptor_set_layout = descriptor_set_layout,
+		.sampler = sampler,
 		.renderpass = renderpass,
 		.swapchain = swapchain,
 		.swapchain_create_info = swapchain_create_info,
 		.command_pool = command_pool,
+		.timestamp_query_pool = timestamp_query_pool,
 		.current_frame_index = 0,
 	};
 
@@ -977,17 +1857,49 @@ PapertrailRenderpass ptrail_renderpass_init(const VkContext *c, PapertrailWindow
 	return ptrail_renderpass;
 }
 
+// reads the gpu time of the last frame that used this frame index.
+// must be called after its fence was signaled, the result lags MAX_FRAMES_IN_FLIGHT frames behind,
+// FRAME_TIMING_NONE until timestamps were written for this frame index
+local f64 read_gpu_frame_time(PapertrailRenderpass *rp, const VkContext *c) {
+    u32 frame = rp->current_frame_index;
+    if (rp->timestamp_query_pool == VK_NULL_HANDLE || !rp->timestamps_written[frame]) return FRAME_TIMING_NONE;
+
+    u64 timestamps[2] = { 0 };
+    VkResult result = vkGetQueryPoolResults(c->device,
+                                            rp->timestamp_query_pool,
+                                            2 * frame, 2,
+                                            sizeof(timestamps), timestamps, sizeof(u64),
+                                            VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) return FRAME_TIMING_NONE;
+
+    u64 mask = c->timestamp_valid_bits >= 64 ? U64_MAX : (1ull << c->timestamp_valid_bits) - 1;
+    u64 ticks = (timestamps[1] - timestamps[0]) & mask;
+    return (f64)ticks * c->timestamp_period / 1e6;
+}
+
 void ptrail_renderpass_begin(PapertrailRenderpass *rp, const VkContext *c, PapertrailWindow *window) {
     VkCommandBuffer command_buffer = rp->command_buffers[rp->current_frame_index];
     VkSemaphore image_available_semaphore = rp->semaphore_image_available[rp->current_frame_index];
     VkSemaphore render_finished_semaphore = rp->semaphore_render_finished[rp->current_frame_index];
     VkFence in_flight_fence = rp->fence_in_flight[rp->current_frame_index];
+    FrameTimings *timings = &rp->current_timings;
 
 
     /// ACQUIRE IMAGE ///
 
+    // the first frame has no previous one to measure against
+    f64 begin_time = ptrail_get_time();
+    timings->ms[FRAME_TIMER_FRAME] = rp->frame_begin_time != 0.0
+            ? (begin_time - rp->frame_begin_time) * 1e3
+            : FRAME_TIMING_NONE;
+    rp->frame_begin_time = begin_time;
+
     vkWaitForFences(c->device, 1, &in_flight_fence, VK_TRUE, U64_MAX);
 
+    f64 fence_time = ptrail_get_time();
+    timings->ms[FRAME_TIMER_FENCE_WAIT] = (fence_time - begin_time) * 1e3;
+    timings->ms[FRAME_TIMER_GPU] = read_gpu_frame_time(rp, c);
+
     VkResult result = vkAcquireNextImageKHR(c->device,
                                             rp->swapchain.vk_swapchain,
                                             U64_MAX,
@@ -1004,6 +1916,8 @@ void ptrail_renderpass_begin(PapertrailRenderpass *rp, const VkContext *c, Paper
     ASSERT_MSG(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR, "failed to acquire swapchain image");
     vkResetFences(c->device, 1, &in_flight_fence);
 
+    rp->record_begin_time = ptrail_get_time();
+    timings->ms[FRAME_TIMER_ACQUIRE] = (rp->record_begin_time - fence_time) * 1e3;
 
 
     vkResetCommandBuffer(command_buffer, 0);
@@ -1012,6 +1926,13 @@ void ptrail_renderpass_begin(PapertrailRenderpass *rp, const VkContext *c, Paper
     };
     VK_CHECK(vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info));
 
+    if (rp->timestamp_query_pool != VK_NULL_HANDLE) {
+        u32 first_query = 2 * rp->current_frame_index;
+        vkCmdResetQueryPool(command_buffer, rp->timestamp_query_pool, first_query, 2);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            rp->timestamp_query_pool, first_query);
+    }
+
 
     /// BEGIN RENDERPASS ///
 
@@ -1057,10 +1978,21 @@ void ptrail_renderpass_end(PapertrailRenderpass *rp, const VkContext *c, Papertr
     VkFence in_flight_fence = rp->fence_in_flight[rp->current_frame_index];
 
     vkCmdEndRenderPass(command_buffer);
+
+    if (rp->timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            rp->timestamp_query_pool, 2 * rp->current_frame_index + 1);
+        rp->timestamps_written[rp->current_frame_index] = true;
+    }
+
     VK_CHECK(vkEndCommandBuffer(command_buffer));
 
     /// END RENDERPASS ///
 
+    FrameTimings *timings = &rp->current_timings;
+    f64 submit_time = ptrail_get_time();
+    timings->ms[FRAME_TIMER_RECORD] = (submit_time - rp->record_begin_time) * 1e3;
+
     VkSemaphore wait_semaphore = image_available_semaphore;
     VkSemaphore signal_semaphore = render_finished_semaphore;
     VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -1076,6 +2008,9 @@ void ptrail_renderpass_end(PapertrailRenderpass *rp, const VkContext *c, Papertr
     };
     VK_CHECK(vkQueueSubmit(c->graphics_queue, 1, &submit_info, in_flight_fence));
 
+    f64 present_time = ptrail_get_time();
+    timings->ms[FRAME_TIMER_SUBMIT] = (present_time - submit_time) * 1e3;
+
 
     VkPresentInfoKHR present_info = {
             .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
@@ -1087,6 +2022,7 @@ void ptrail_renderpass_end(PapertrailRenderpass *rp, const VkContext *c, Papertr
     };
 
     VkResult result = vkQueuePresentKHR(c->present_queue, &present_info);
+    timings->ms[FRAME_TIMER_PRESENT] = (ptrail_get_time() - present_time) * 1e3;
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
         rp->swapchain_create_info.image_extent = get_vk_window_size(window);
@@ -1097,6 +2033,10 @@ void ptrail_renderpass_end(PapertrailRenderpass *rp, const VkContext *c, Papertr
         ASSERT_MSG(result == VK_SUCCESS, "failed to present swapchain image. err_code: %i", result);
     }
 
+    if (rp->frame_stats) {
+        frame_stats_push(rp->frame_stats, timings);
+    }
+
     rp->current_frame_index = (rp->current_frame_index + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
@@ -1106,18 +2046,93 @@ void ptrail_render_frame(
         const VkContext *c,
         PapertrailWindow *window)
 {
-    ptrail_renderpass_begin(rp, c, window);
+    page_instances_update(render_data, c);
+    const PageLayout *layout = render_data->layout;
+    VkExtent2D extent = rp->swapchain.extent;
+
+    // the visible pages are consecutive instances, they are drawn together
+    PageRange visible = { 0 };
+    if (layout) {
+        f32 width = (f32)extent.width / render_data->zoom;
+        f32 left = (layout->width - width) / 2.0f;
+        f32 bottom = render_data->scroll + (f32)extent.height / render_data->zoom;
+        visible = page_layout_visible(layout, render_data->scroll, bottom);
+
+        tile_atlas_update(&render_data->tiles, &render_data->uploads, layout, visible,
+                          tile_zoom_level(render_data->zoom), left, render_data->scroll, left + width, bottom);
+    }
 
+    upload_manager_update(&render_data->uploads);
+    ptrail_renderpass_begin(rp, c, window);
     VkCommandBuffer command_buffer = rp->command_buffers[rp->current_frame_index];
-    VkDeviceSize offset = {0};
 
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, &render_data->vertex_buffer.buffer, &offset);
-    vkCmdBindIndexBuffer(command_buffer, render_data->index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-	vkCmdDrawIndexed(command_buffer, 6, 1, 0, 0, 0);
+    if (visible.count > 0) {
+        PageView view = page_view(render_data, extent);
+        vkCmdPushConstants(command_buffer, rp->pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(view), &view);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, rp->pipeline_layout,
+                                0, 1, &render_data->tiles.descriptor_set, 0, NULL);
+
+        // blank pages first, the tiles that are in the atlas on top of them
+        VkBuffer vertex_buffers[2] = { render_data->vertex_buffer.buffer, render_data->instance_buffer.buffer };
+        VkDeviceSize offsets[2] = { 0, 0 };
+        vkCmdBindVertexBuffers(command_buffer, 0, 2, vertex_buffers, offsets);
+        vkCmdBindIndexBuffer(command_buffer, render_data->index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+        vkCmdDrawIndexed(command_buffer, COUNT_OF(INDICES), visible.count, 0, 0, visible.first);
+
+        u32 n_tiles = tile_atlas_write_instances(&render_data->tiles, c, rp->current_frame_index);
+        if (n_tiles > 0) {
+            VkBuffer tile_buffer = render_data->tiles.instance_buffers[rp->current_frame_index].buffer;
+            vkCmdBindVertexBuffers(command_buffer, 1, 1, &tile_buffer, offsets);
+            vkCmdDrawIndexed(command_buffer, COUNT_OF(INDICES), n_tiles, 0, 0, 0);
+        }
+    }
 
     ptrail_renderpass_end(rp, c, window);
 }
 
+// a step of the mouse wheel moves the pages by SCROLL_STEP pixels
+#define SCROLL_STEP 60.0f
+
+local void scroll_callback(PapertrailWindow *window, f64 x_offset, f64 y_offset) {
+    (void)x_offset;
+    PapertrailWindowCallbackFn *ptrs = ptrail_window_get_client_state(window);
+    PapertrailRenderData *data = ptrs->p_render_data;
+    if (!data->layout) return;
+
+    u32 width, height;
+    ptrail_window_get_size(window, &width, &height);
+    f32 max_scroll = MAX(data->layout->height - (f32)height / data->zoom, 0.0f);
+    data->scroll = CLAMP(data->scroll - (f32)y_offset * SCROLL_STEP / data->zoom, max_scroll, 0.0f);
+}
+
+// letter and A4 pages with some of them turned, until documents are opened here
+local PageSize demo_page_size(u32 page) {
+    PageSize size = page % 2 == 0
+            ? (PageSize) { .width = 612.0f, .height = 792.0f }
+            : (PageSize) { .width = 595.0f, .height = 842.0f };
+    if (page % 7 == 3) size.rotate = 90;
+    return size;
+}
+
+// a heading, lines of text as bars, a framed ring and a fold triangle, drawn on every demo page
+local const char DEMO_PAGE_CONTENT[] =
+    "0.2 0.3 0.6 rg 72 700 300 28 re f\n"
+    "0.55 g 72 660 468 8 re 72 644 440 8 re 72 628 452 8 re 72 612 300 8 re f\n"
+    "q 1 0 0 1 306 400 cm\n"
+    "0.8 0.2 0.2 rg 0 -100 m 55 -100 100 -55 100 0 c 100 55 55 100 0 100 c\n"
+    "-55 100 -100 55 -100 0 c -100 -55 -55 -100 0 -100 c h\n"
+    "-60 -60 120 120 re f*\n"
+    "Q 0 0 0 0.4 k 72 72 m 144 72 l 72 144 l f\n";
+
+// the demo content rasterized on the CPU, into the unturned page
+local void demo_render_tile(void *user_data, const VisibleTile *tile, u8 *rgba) {
+    const PagePaths *paths = user_data;
+    f32 scale = tile_zoom_scale(tile->key.zoom_level);
+    PageSize size = demo_page_size(tile->key.page);
+    raster_page_tile(paths, size.height, scale, tile->key.x * TILE_SIZE, tile->key.y * TILE_SIZE,
+                     tile->width, tile->height, rgba);
+}
+
 void window_refresh_callback(PapertrailWindow *window) {
 	PapertrailWindowCallbackFn *ptrs = ptrail_window_get_client_state(window);
 	ptrail_render_frame(ptrs->p_renderpass, ptrs->p_render_data, ptrs->p_context, window);
@@ -1136,7 +2151,7 @@ void run() {
 
     VkContext c = vk_context_init(window);
 	PapertrailRenderpass rp = ptrail_renderpass_init(&c, window);
-    PapertrailRenderData render_data;
+    PapertrailRenderData render_data = { 0 };
 
 
 	PapertrailWindowCallbackFn callback_ptrs = {
@@ -1147,6 +2162,7 @@ void run() {
 
 	ptrail_window_set_resize_callback(window, framebuffer_resized_callback);
 	ptrail_window_set_refresh_callback(window, window_refresh_callback);
+	ptrail_window_set_scroll_callback(window, scroll_callback);
 	ptrail_window_set_client_state(window, &callback_ptrs);
 
     /// VERTEX & INDEX BUFFER INIT ///
@@ -1159,7 +2175,7 @@ void run() {
     };
 
     BufferAllocationCreateInfo index_buffer_create_info = {
-            .size = sizeof(VERTICES),
+            .size = sizeof(INDICES),
             .buffer_usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
             .memory_usage = VMA_MEMORY_USAGE_AUTO,
             .allocation_flag = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
@@ -1167,6 +2183,21 @@ void run() {
 
     VK_CHECK(buffer_allocation_create(c.allocator, &vertex_buffer_create_info, &render_data.vertex_buffer));
     VK_CHECK(buffer_allocation_create(c.allocator, &index_buffer_create_info, &render_data.index_buffer));
+    VK_CHECK(upload_manager_init(&render_data.uploads, &c, UPLOAD_RING_SIZE));
+    PagePaths demo_paths = { 0 };
+    ASSERT(content_paths_parse((const u8 *)DEMO_PAGE_CONTENT, sizeof(DEMO_PAGE_CONTENT) - 1, &demo_paths));
+    TileRenderer tile_renderer = { .fn = demo_render_tile, .user_data = &demo_paths };
+    VK_CHECK(tile_atlas_init(&render_data.tiles, &c, &rp, tile_renderer));
+
+    // optional jpeg that is decoded into the upload ring without a copy
+    const char *jpeg_path = getenv("PTRAIL_JPEG");
+    if (jpeg_path) {
+        PDFContent jpeg = load_file(jpeg_path);
+        if (!upload_manager_queue_jpeg(&render_data.uploads, jpeg.data, jpeg.size, DCT_SCALE_FULL, &render_data.jpeg)) {
+            println("could not upload jpeg: %s", jpeg_path);
+        }
+        mem_free(jpeg.data);
+    }
 
     void *buffer_data;
     vmaMapMemory(c.allocator, render_data.vertex_buffer.allocation, &buffer_data);
@@ -1177,6 +2208,29 @@ void run() {
     memcpy(buffer_data, INDICES, sizeof(INDICES));
     vmaUnmapMemory(c.allocator, render_data.index_buffer.allocation);
 
+    /// PAGE LAYOUT ///
+
+    PageSize *page_sizes = mem_alloc(MEM_TAG_OBJECTS, DEMO_PAGE_COUNT * sizeof(PageSize));
+    for (u32 i = 0; i < DEMO_PAGE_COUNT; i++) page_sizes[i] = demo_page_size(i);
+
+    PageLayout layout;
+    page_layout_init(&layout, page_sizes, DEMO_PAGE_COUNT, PAGE_GAP);
+    mem_free(page_sizes);
+
+    render_data.layout = &layout;
+    render_data.zoom = (f32)get_vk_window_size(window).width / layout.width;
+
+    // kept on the heap, the history is too large for the stack
+    FrameStats *frame_stats = calloc(1, sizeof(FrameStats));
+    ASSERT(frame_stats);
+    rp.frame_stats = frame_stats;
+
+    // optional per frame csv log
+    const char *frame_log_path = getenv("PTRAIL_FRAME_LOG");
+    if (frame_log_path && !frame_stats_open_log(frame_stats, frame_log_path)) {
+        println("could not open frame log: %s", frame_log_path);
+    }
+
     f64 prev_time = ptrail_get_time();
     u64 frame_count = 0;
 
@@ -1187,7 +2241,10 @@ void run() {
         f64 curr_time = ptrail_get_time();
         frame_count += 1;
         if (curr_time - prev_time >= 1) {
-            println("fps: %llu", frame_count);
+            FramePercentiles frame_time = frame_stats_percentiles(frame_stats, FRAME_TIMER_FRAME);
+            println("fps: %llu, frame time p50: %.2f ms, p95: %.2f ms, p99: %.2f ms",
+                    frame_count, frame_time.p50, frame_time.p95, frame_time.p99);
+            vk_update_memory_budget(&c);
             frame_count = 0;
             prev_time = curr_time;
         }
@@ -1201,8 +2258,14 @@ void run() {
 	/// CLEANUP ///
 	vkDeviceWaitIdle(c.device);
 
-    buffer_allocation_destroy(&render_data.vertex_buffer, c.allocator);
-    buffer_allocation_destroy(&render_data.index_buffer, c.allocator);
+    print_frame_stats(frame_stats);
+    print_mem_report(mem_report());
+    frame_stats_close_log(frame_stats);
+    free(frame_stats);
+
+    ptrail_render_data_destroy(&render_data, &c);
+    page_paths_free(&demo_paths);
+    page_layout_free(&layout);
 
 	ptrail_renderpass_destroy(c.device, &rp);
 	vk_context_destroy(&c);
@@ -27,6 +27,10 @@ void ptrail_window_set_refresh_callback(PapertrailWindow *window, PapertrailRefr
     glfwSetWindowRefreshCallback(window, fn_ptr);
 }
 
+void ptrail_window_set_scroll_callback(PapertrailWindow *window, PapertrailScrollCallbackFn fn_ptr) {
+    glfwSetScrollCallback(window, fn_ptr);
+}
+
 void ptrail_window_set_client_state(PapertrailWindow *window, void *state) {
     glfwSetWindowUserPointer(window, state);
 }
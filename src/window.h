@@ -8,6 +8,7 @@ struct GLFWwindow;
 typedef struct GLFWwindow PapertrailWindow;
 typedef void (*PapertrailResizeCallbackFn)(PapertrailWindow *, i32, i32);
 typedef void (*PapertrailRefreshCallbackFn)(PapertrailWindow *);
+typedef void (*PapertrailScrollCallbackFn)(PapertrailWindow *, f64, f64);
 
 typedef u32 PTRAIL_RESULT; // currently = VK_RESULT
 
@@ -21,6 +22,8 @@ void ptrail_window_free(PapertrailWindow *window);
 
 void ptrail_window_set_resize_callback(PapertrailWindow *window, PapertrailResizeCallbackFn fn_ptr);
 void ptrail_window_set_refresh_callback(PapertrailWindow *window, PapertrailRefreshCallbackFn fn_ptr);
+// receives the x and y offsets of the mouse wheel or touchpad
+void ptrail_window_set_scroll_callback(PapertrailWindow *window, PapertrailScrollCallbackFn fn_ptr);
 // a client can store a pointer to any data in the window, for later use (e.g inside callbacks)
 void ptrail_window_set_client_state(PapertrailWindow *window, void *state);
 
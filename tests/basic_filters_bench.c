@@ -0,0 +1,427 @@
+#include "src/basic_filters.h"
+#include "src/lzw.h"
+#include "src/memory.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// the ASCIIHex, ASCII85, RunLength and LZW stages against plain scalar reference decoders. every stage
+// has to give the same bytes as its reference, the throughput of both is printed. the encoded data is
+// fed to the stages in chunks, like a filter chain does
+
+#define DECODED_LEN (8u << 20)
+#define CHUNK_LEN (16u << 10)
+#define RUNS 5
+
+local u32 failures;
+
+/// INPUT ///
+
+local u64 rng_state = 0x2545f4914f6cdd1dull;
+
+local u32 rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (u32)(rng_state >> 32);
+}
+
+// an encoded stream, grows as it is written
+typedef struct Bytes {
+	u8 *data;
+	u64 len;
+} Bytes;
+
+local void bytes_put(Bytes *b, u8 c) {
+	if (!b->data || b->len == mem_size(b->data)) {
+		b->data = mem_realloc(MEM_TAG_DECODE, b->data, MAX(2 * b->len, 4096));
+	}
+	b->data[b->len++] = c;
+}
+
+local Bytes encode_hex(const u8 *data, u64 len) {
+	static const char digits[] = "0123456789abcdef";
+	Bytes b = { 0 };
+	for (u64 i = 0; i < len; i++) {
+		bytes_put(&b, (u8)digits[data[i] >> 4]);
+		bytes_put(&b, (u8)digits[data[i] & 15]);
+		if (i % 32 == 31) bytes_put(&b, '\n');
+	}
+	bytes_put(&b, '>');
+	return b;
+}
+
+local Bytes encode_ascii85(const u8 *data, u64 len) {
+	Bytes b = { 0 };
+	u32 column = 0;
+	for (u64 i = 0; i < len; i += 4) {
+		u32 n = (u32)MIN(4, len - i);
+		u32 value = 0;
+		for (u32 k = 0; k < 4; k++) value = value << 8 | (k < n ? data[i + k] : 0);
+
+		if (value == 0 && n == 4) {
+			bytes_put(&b, 'z');
+			column += 1;
+		}
+		else {
+			u8 group[5];
+			for (u32 k = 5; k-- > 0;) {
+				group[k] = (u8)('!' + value % 85);
+				value /= 85;
+			}
+			for (u32 k = 0; k < n + 1; k++) bytes_put(&b, group[k]);
+			column += n + 1;
+		}
+		if (column >= 75) {
+			bytes_put(&b, '\n');
+			column = 0;
+		}
+	}
+	bytes_put(&b, '~');
+	bytes_put(&b, '>');
+	return b;
+}
+
+local Bytes encode_run_length(const u8 *data, u64 len) {
+	Bytes b = { 0 };
+	u64 i = 0;
+	while (i < len) {
+		u64 run = 1;
+		while (i + run < len && run < 128 && data[i + run] == data[i]) run++;
+		if (run >= 2) {
+			bytes_put(&b, (u8)(257 - run));
+			bytes_put(&b, data[i]);
+			i += run;
+			continue;
+		}
+
+		u64 literal = 1;
+		while (i + literal < len && literal < 128 &&
+			!(i + literal + 1 < len && data[i + literal] == data[i + literal + 1])) literal++;
+		bytes_put(&b, (u8)(literal - 1));
+		for (u64 k = 0; k < literal; k++) bytes_put(&b, data[i + k]);
+		i += literal;
+	}
+	bytes_put(&b, 128);
+	return b;
+}
+
+typedef struct BitWriter {
+	Bytes out;
+	u64 bits;
+	u32 n_bits;
+} BitWriter;
+
+local void put_code(BitWriter *w, u32 code, u32 code_len) {
+	w->bits = w->bits << code_len | code;
+	w->n_bits += code_len;
+	while (w->n_bits >= 8) {
+		w->n_bits -= 8;
+		bytes_put(&w->out, (u8)(w->bits >> w->n_bits));
+	}
+}
+
+// LZWDecode with /EarlyChange 1, a clear code whenever the table is full
+local Bytes encode_lzw(const u8 *data, u64 len) {
+	// child code of every (code, byte) pair, 0 if there is none
+	u16 *children = mem_calloc(MEM_TAG_DECODE, LZW_MAX_CODES * 256 * sizeof(u16));
+	BitWriter w = { 0 };
+	u32 code_len = 9, next_code = 258, n_codes = 0;
+	put_code(&w, 256, code_len);
+
+	u32 prefix = data[0];
+	for (u64 i = 1; i <= len; i++) {
+		if (i < len && children[prefix * 256 + data[i]]) {
+			prefix = children[prefix * 256 + data[i]];
+			continue;
+		}
+
+		put_code(&w, prefix, code_len);
+		n_codes += 1;
+		if (i == len) break;
+
+		children[prefix * 256 + data[i]] = (u16)next_code;
+		next_code += 1;
+		// the decoder defines its entries one code later, with early change one code before the width is used up
+		if (next_code + 1 > (1u << code_len) && code_len < 12) code_len += 1;
+		if (next_code == LZW_MAX_CODES - 3) {
+			put_code(&w, 256, code_len);
+			memset(children, 0, LZW_MAX_CODES * 256 * sizeof(u16));
+			code_len = 9;
+			next_code = 258;
+			n_codes = 0;
+		}
+		prefix = data[i];
+	}
+
+	// the decoder defines one more entry after the last code
+	if (n_codes >= 2 && next_code + 1 >= (1u << code_len) && code_len < 12) code_len += 1;
+	put_code(&w, 257, code_len);
+	if (w.n_bits > 0) put_code(&w, 0, 8 - w.n_bits);
+
+	mem_free(children);
+	return w.out;
+}
+
+// random bytes, runs of one byte and words from a small vocabulary mixed, the data each filter is used for
+local void fill_input(u8 *data, u64 len, u32 kind) {
+	static const char *words[] = { "BT", "ET", "Tf", "Td", "Tj", "re", "f", "q", "Q", "cm", "0", "12", "612", "792" };
+	u64 i = 0;
+	while (i < len) {
+		if (kind == 0) {
+			data[i++] = (u8)rng_next();
+		}
+		else if (kind == 1) {
+			u64 run = rng_next() % 2 == 0 ? 1 + rng_next() % 200 : 1;
+			u8 value = (u8)rng_next();
+			for (u64 k = 0; k < run && i < len; k++) data[i++] = run == 1 ? (u8)rng_next() : value;
+		}
+		else {
+			const char *word = words[rng_next() % COUNT_OF(words)];
+			for (u64 k = 0; word[k] && i < len; k++) data[i++] = (u8)word[k];
+			if (i < len) data[i++] = rng_next() % 6 == 0 ? '\n' : ' ';
+		}
+	}
+}
+
+/// REFERENCE DECODERS ///
+
+local i32 hex_value(u8 c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+local u64 reference_hex(const u8 *in, u64 len, u8 *out) {
+	u64 n = 0;
+	i32 high = -1;
+	for (u64 i = 0; i < len && in[i] != '>'; i++) {
+		i32 v = hex_value(in[i]);
+		if (v < 0) continue;
+		if (high < 0) high = v;
+		else {
+			out[n++] = (u8)(high << 4 | v);
+			high = -1;
+		}
+	}
+	if (high >= 0) out[n++] = (u8)(high << 4);
+	return n;
+}
+
+local u64 reference_ascii85(const u8 *in, u64 len, u8 *out) {
+	u64 n = 0;
+	u32 value = 0, n_digits = 0;
+	for (u64 i = 0; i < len && in[i] != '~'; i++) {
+		u8 c = in[i];
+		if (c == 'z' && n_digits == 0) {
+			memset(out + n, 0, 4);
+			n += 4;
+			continue;
+		}
+		if (c < '!' || c > 'u') continue;
+
+		value = value * 85 + (c - '!');
+		if (++n_digits == 5) {
+			for (u32 k = 0; k < 4; k++) out[n++] = (u8)(value >> (24 - 8 * k));
+			value = 0;
+			n_digits = 0;
+		}
+	}
+	if (n_digits >= 2) {
+		for (u32 k = n_digits; k < 5; k++) value = value * 85 + ('u' - '!');
+		for (u32 k = 0; k < n_digits - 1; k++) out[n++] = (u8)(value >> (24 - 8 * k));
+	}
+	return n;
+}
+
+local u64 reference_run_length(const u8 *in, u64 len, u8 *out) {
+	u64 n = 0, i = 0;
+	while (i < len && in[i] != 128) {
+		u8 length = in[i++];
+		if (length < 128) {
+			memcpy(out + n, in + i, length + 1u);
+			n += length + 1u;
+			i += length + 1u;
+		}
+		else {
+			memset(out + n, in[i++], 257u - length);
+			n += 257u - length;
+		}
+	}
+	return n;
+}
+
+// the textbook decoder: every entry is a prefix code and a byte, strings are written backwards
+// by walking the prefix chain
+local u64 reference_lzw(const u8 *in, u64 len, u8 *out) {
+	static u16 prefix[LZW_MAX_CODES];
+	static u8 suffix[LZW_MAX_CODES];
+	static u8 first[LZW_MAX_CODES];
+	static u16 lengths[LZW_MAX_CODES];
+	for (u32 c = 0; c < 256; c++) {
+		suffix[c] = first[c] = (u8)c;
+		lengths[c] = 1;
+	}
+
+	u64 n = 0, bits = 0, i = 0;
+	u32 n_bits = 0, code_len = 9, next_code = 258;
+	i32 prev = -1;
+	for (;;) {
+		while (n_bits < code_len && i < len) {
+			bits = bits << 8 | in[i++];
+			n_bits += 8;
+		}
+		if (n_bits < code_len) break;
+		n_bits -= code_len;
+		u32 code = (u32)(bits >> n_bits) & ((1u << code_len) - 1);
+
+		if (code == 256) {
+			code_len = 9;
+			next_code = 258;
+			prev = -1;
+			continue;
+		}
+		if (code == 257) break;
+
+		u64 string_len;
+		if (code < next_code) {
+			string_len = lengths[code];
+			for (u32 c = code, k = (u32)string_len; k-- > 0; c = prefix[c]) out[n + k] = suffix[c];
+		}
+		else {
+			// the entry that is being defined: previous string + its first byte
+			string_len = lengths[prev] + 1u;
+			for (u32 c = (u32)prev, k = lengths[prev]; k-- > 0; c = prefix[c]) out[n + k] = suffix[c];
+			out[n + string_len - 1] = first[prev];
+		}
+
+		if (prev >= 0 && next_code < LZW_MAX_CODES) {
+			prefix[next_code] = (u16)prev;
+			suffix[next_code] = out[n];
+			first[next_code] = first[prev];
+			lengths[next_code] = (u16)(lengths[prev] + 1);
+			next_code += 1;
+			if (next_code + 1 >= (1u << code_len) && code_len < 12) code_len += 1;
+		}
+		n += string_len;
+		prev = (i32)code;
+	}
+	return n;
+}
+
+/// STAGES ///
+
+typedef struct Output {
+	u8 *data;
+	u64 len;
+} Output;
+
+local bool output_write(void *user_data, const u8 *data, u64 len) {
+	Output *out = user_data;
+	memcpy(out->data + out->len, data, len);
+	out->len += len;
+	return true;
+}
+
+local void feed(DecodeSink sink, const Bytes *in) {
+	for (u64 i = 0; i < in->len; i += CHUNK_LEN) {
+		sink.fn(sink.user_data, in->data + i, MIN(CHUNK_LEN, in->len - i));
+	}
+}
+
+local u64 stage_hex(const Bytes *in, Output *out) {
+	AsciiHexDecoder d;
+	ascii_hex_init(&d, (DecodeSink){ .fn = output_write, .user_data = out });
+	feed(ascii_hex_sink(&d), in);
+	ascii_hex_finish(&d);
+	ascii_hex_free(&d);
+	return out->len;
+}
+
+local u64 stage_ascii85(const Bytes *in, Output *out) {
+	Ascii85Decoder d;
+	ascii85_init(&d, (DecodeSink){ .fn = output_write, .user_data = out });
+	feed(ascii85_sink(&d), in);
+	ascii85_finish(&d);
+	ascii85_free(&d);
+	return out->len;
+}
+
+local u64 stage_run_length(const Bytes *in, Output *out) {
+	RunLengthDecoder d;
+	run_length_init(&d, (DecodeSink){ .fn = output_write, .user_data = out });
+	feed(run_length_sink(&d), in);
+	run_length_finish(&d);
+	run_length_free(&d);
+	return out->len;
+}
+
+local u64 stage_lzw(const Bytes *in, Output *out) {
+	LZWDecoder d;
+	lzw_init(&d, 1, (DecodeSink){ .fn = output_write, .user_data = out });
+	feed(lzw_sink(&d), in);
+	lzw_finish(&d);
+	lzw_free(&d);
+	return out->len;
+}
+
+/// BENCHMARK ///
+
+typedef u64 (*StageFn)(const Bytes *in, Output *out);
+typedef u64 (*ReferenceFn)(const u8 *in, u64 len, u8 *out);
+
+local f64 now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+}
+
+local void bench(const char *name, u32 kind, Bytes (*encode)(const u8 *, u64), StageFn stage, ReferenceFn reference) {
+	u8 *data = mem_alloc(MEM_TAG_DECODE, DECODED_LEN);
+	fill_input(data, DECODED_LEN, kind);
+	Bytes in = encode(data, DECODED_LEN);
+
+	u8 *expected = mem_alloc(MEM_TAG_DECODE, DECODED_LEN);
+	Output out = { .data = mem_alloc(MEM_TAG_DECODE, DECODED_LEN) };
+
+	f64 best_stage = 1e9, best_reference = 1e9;
+	u64 expected_len = 0;
+	for (u32 run = 0; run < RUNS; run++) {
+		f64 t0 = now();
+		expected_len = reference(in.data, in.len, expected);
+		f64 t1 = now();
+		out.len = 0;
+		stage(&in, &out);
+		f64 t2 = now();
+		best_reference = MIN(best_reference, t1 - t0);
+		best_stage = MIN(best_stage, t2 - t1);
+	}
+
+	bool same = expected_len == DECODED_LEN && memcmp(expected, data, DECODED_LEN) == 0 &&
+		out.len == DECODED_LEN && memcmp(out.data, data, DECODED_LEN) == 0;
+	if (!same) failures += 1;
+
+	f64 mb = (f64)DECODED_LEN / (1 << 20);
+	printf("%-11s reference %8.1f MB/s  stage %8.1f MB/s  %5.2fx  %s\n", name,
+		mb / best_reference, mb / best_stage, best_reference / best_stage, same ? "ok" : "MISMATCH");
+
+	mem_free(out.data);
+	mem_free(expected);
+	mem_free(in.data);
+	mem_free(data);
+}
+
+int main(void) {
+	bench("ASCIIHex", 0, encode_hex, stage_hex, reference_hex);
+	bench("ASCII85", 0, encode_ascii85, stage_ascii85, reference_ascii85);
+	bench("RunLength", 1, encode_run_length, stage_run_length, reference_run_length);
+	bench("LZW", 2, encode_lzw, stage_lzw, reference_lzw);
+
+	if (failures) {
+		fprintf(stderr, "%u stages differ from their reference\n", failures);
+		return 1;
+	}
+	return 0;
+}
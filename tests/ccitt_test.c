@@ -0,0 +1,482 @@
+#include "src/ccitt.h"
+#include "src/memory.h"
+#include "src/buffer_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// ccitt_decode on hand coded T.4 / T.6 vectors, and on bitmaps run through a plain encoder in every
+// coding the PDF filter allows: Group 3 1D, mixed 1D/2D, Group 4, with and without EOLs and byte alignment
+
+local u32 failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1; \
+    } \
+} while (0)
+
+/// INPUT ///
+
+local u64 rng_state = 0x9e3779b97f4a7c15ull;
+
+local u32 rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (u32)(rng_state >> 32);
+}
+
+typedef struct BitWriter {
+	u8 *data;
+	u64 cap;
+	u64 n_bits;
+} BitWriter;
+
+local void put_bits(BitWriter *w, u32 code, u32 len) {
+	for (u32 i = len; i-- > 0;) {
+		ASSERT(w->n_bits < w->cap * 8);
+		if ((code >> i) & 1) w->data[w->n_bits >> 3] |= (u8)(0x80 >> (w->n_bits & 7));
+		w->n_bits += 1;
+	}
+}
+
+// a string of '0' and '1', spaces are skipped
+local void put_string(BitWriter *w, const char *bits) {
+	for (; *bits; bits++) {
+		if (*bits != ' ') put_bits(w, *bits == '1', 1);
+	}
+}
+
+local void pad_to_byte(BitWriter *w) {
+	w->n_bits = (w->n_bits + 7) & ~7ull;
+}
+
+// a bitmap of '#' (black) and '.' (white) rows, packed like ccitt_decode writes it with 0 as black
+local u8 *pack_rows(const char **rows, u32 n_rows, u32 columns) {
+	u32 stride = (columns + 7) / 8;
+	u8 *out = mem_alloc(MEM_TAG_DECODE, (u64)stride * n_rows);
+	memset(out, 0xff, (u64)stride * n_rows);
+	for (u32 y = 0; y < n_rows; y++) {
+		for (u32 x = 0; x < columns; x++) {
+			if (rows[y][x] == '#') out[(u64)y * stride + x / 8] &= (u8)~(0x80 >> (x % 8));
+		}
+	}
+	return out;
+}
+
+/// ENCODER ///
+
+typedef struct Code {
+	u16 code;
+	u8 len;
+} Code;
+
+// T.4 tables 2 and 3, terminating codes 0 - 63 and make up codes 64 - 1728
+local const Code white_terminating[64] = {
+	{ 0x35, 8 }, { 0x07, 6 }, { 0x07, 4 }, { 0x08, 4 }, { 0x0b, 4 }, { 0x0c, 4 }, { 0x0e, 4 }, { 0x0f, 4 },
+	{ 0x13, 5 }, { 0x14, 5 }, { 0x07, 5 }, { 0x08, 5 }, { 0x08, 6 }, { 0x03, 6 }, { 0x34, 6 }, { 0x35, 6 },
+	{ 0x2a, 6 }, { 0x2b, 6 }, { 0x27, 7 }, { 0x0c, 7 }, { 0x08, 7 }, { 0x17, 7 }, { 0x03, 7 }, { 0x04, 7 },
+	{ 0x28, 7 }, { 0x2b, 7 }, { 0x13, 7 }, { 0x24, 7 }, { 0x18, 7 }, { 0x02, 8 }, { 0x03, 8 }, { 0x1a, 8 },
+	{ 0x1b, 8 }, { 0x12, 8 }, { 0x13, 8 }, { 0x14, 8 }, { 0x15, 8 }, { 0x16, 8 }, { 0x17, 8 }, { 0x28, 8 },
+	{ 0x29, 8 }, { 0x2a, 8 }, { 0x2b, 8 }, { 0x2c, 8 }, { 0x2d, 8 }, { 0x04, 8 }, { 0x05, 8 }, { 0x0a, 8 },
+	{ 0x0b, 8 }, { 0x52, 8 }, { 0x53, 8 }, { 0x54, 8 }, { 0x55, 8 }, { 0x24, 8 }, { 0x25, 8 }, { 0x58, 8 },
+	{ 0x59, 8 }, { 0x5a, 8 }, { 0x5b, 8 }, { 0x4a, 8 }, { 0x4b, 8 }, { 0x32, 8 }, { 0x33, 8 }, { 0x34, 8 },
+};
+
+local const Code white_make_up[27] = {
+	{ 0x1b, 5 }, { 0x12, 5 }, { 0x17, 6 }, { 0x37, 7 }, { 0x36, 8 }, { 0x37, 8 }, { 0x64, 8 }, { 0x65, 8 },
+	{ 0x68, 8 }, { 0x67, 8 }, { 0xcc, 9 }, { 0xcd, 9 }, { 0xd2, 9 }, { 0xd3, 9 }, { 0xd4, 9 }, { 0xd5, 9 },
+	{ 0xd6, 9 }, { 0xd7, 9 }, { 0xd8, 9 }, { 0xd9, 9 }, { 0xda, 9 }, { 0xdb, 9 }, { 0x98, 9 }, { 0x99, 9 },
+	{ 0x9a, 9 }, { 0x18, 6 }, { 0x9b, 9 },
+};
+
+local const Code black_terminating[64] = {
+	{ 0x37, 10 }, { 0x02, 3 }, { 0x03, 2 }, { 0x02, 2 }, { 0x03, 3 }, { 0x03, 4 }, { 0x02, 4 }, { 0x03, 5 },
+	{ 0x05, 6 }, { 0x04, 6 }, { 0x04, 7 }, { 0x05, 7 }, { 0x07, 7 }, { 0x04, 8 }, { 0x07, 8 }, { 0x18, 9 },
+	{ 0x17, 10 }, { 0x18, 10 }, { 0x08, 10 }, { 0x67, 11 }, { 0x68, 11 }, { 0x6c, 11 }, { 0x37, 11 }, { 0x28, 11 },
+	{ 0x17, 11 }, { 0x18, 11 }, { 0xca, 12 }, { 0xcb, 12 }, { 0xcc, 12 }, { 0xcd, 12 }, { 0x68, 12 }, { 0x69, 12 },
+	{ 0x6a, 12 }, { 0x6b, 12 }, { 0xd2, 12 }, { 0xd3, 12 }, { 0xd4, 12 }, { 0xd5, 12 }, { 0xd6, 12 }, { 0xd7, 12 },
+	{ 0x6c, 12 }, { 0x6d, 12 }, { 0xda, 12 }, { 0xdb, 12 }, { 0x54, 12 }, { 0x55, 12 }, { 0x56, 12 }, { 0x57, 12 },
+	{ 0x64, 12 }, { 0x65, 12 }, { 0x52, 12 }, { 0x53, 12 }, { 0x24, 12 }, { 0x37, 12 }, { 0x38, 12 }, { 0x27, 12 },
+	{ 0x28, 12 }, { 0x58, 12 }, { 0x59, 12 }, { 0x2b, 12 }, { 0x2c, 12 }, { 0x5a, 12 }, { 0x66, 12 }, { 0x67, 12 },
+};
+
+local const Code black_make_up[27] = {
+	{ 0x0f, 10 }, { 0xc8, 12 }, { 0xc9, 12 }, { 0x5b, 12 }, { 0x33, 12 }, { 0x34, 12 }, { 0x35, 12 },
+	{ 0x6c, 13 }, { 0x6d, 13 }, { 0x4a, 13 }, { 0x4b, 13 }, { 0x4c, 13 }, { 0x4d, 13 }, { 0x72, 13 },
+	{ 0x73, 13 }, { 0x74, 13 }, { 0x75, 13 }, { 0x76, 13 }, { 0x77, 13 }, { 0x52, 13 }, { 0x53, 13 },
+	{ 0x54, 13 }, { 0x55, 13 }, { 0x5a, 13 }, { 0x5b, 13 }, { 0x64, 13 }, { 0x65, 13 },
+};
+
+// T.4 table 3a, make up codes 1792 - 2560 of both colors
+local const Code extended_make_up[13] = {
+	{ 0x08, 11 }, { 0x0c, 11 }, { 0x0d, 11 }, { 0x12, 12 }, { 0x13, 12 }, { 0x14, 12 }, { 0x15, 12 },
+	{ 0x16, 12 }, { 0x17, 12 }, { 0x1c, 12 }, { 0x1d, 12 }, { 0x1e, 12 }, { 0x1f, 12 },
+};
+
+#define EOL "000000000001"
+
+enum { WHITE, BLACK };
+
+local void put_code(BitWriter *w, Code c) {
+	put_bits(w, c.code, c.len);
+}
+
+local void put_run(BitWriter *w, u32 color, u32 run) {
+	while (run >= 2560) {
+		put_code(w, extended_make_up[12]);
+		run -= 2560;
+	}
+	if (run >= 64) {
+		u32 make_up = run / 64;
+		if (make_up > 27) put_code(w, extended_make_up[make_up - 28]);
+		else put_code(w, color == WHITE ? white_make_up[make_up - 1] : black_make_up[make_up - 1]);
+		run %= 64;
+	}
+	put_code(w, color == WHITE ? white_terminating[run] : black_terminating[run]);
+}
+
+// pixels are 0 (white) or 1 (black), x = -1 is the white pixel in front of the row
+local inline u32 pixel(const u8 *line, i32 x) {
+	return x < 0 ? WHITE : line[x];
+}
+
+// first changing element right of x, columns if there is none
+local i32 next_change(const u8 *line, i32 x, i32 columns) {
+	for (x = x + 1; x < columns; x++) {
+		if (pixel(line, x) != pixel(line, x - 1)) return x;
+	}
+	return columns;
+}
+
+// runs of alternating colors, the first one is white and empty if the row starts black
+local void encode_row_1d(BitWriter *w, const u8 *line, i32 columns) {
+	i32 a0 = 0;
+	u32 color = WHITE;
+	while (a0 < columns) {
+		i32 a1 = a0;
+		while (a1 < columns && line[a1] == color) a1++;
+		put_run(w, color, (u32)(a1 - a0));
+		a0 = a1;
+		color ^= 1;
+	}
+}
+
+// T.4 section 4.2.1.3.4, the coding procedure of the READ code
+local void encode_row_2d(BitWriter *w, const u8 *line, const u8 *ref, i32 columns) {
+	i32 a0 = -1;
+	u32 color = WHITE;
+	while (a0 < columns) {
+		i32 a1 = next_change(line, a0, columns);
+		i32 b1 = next_change(ref, a0, columns);
+		while (b1 < columns && pixel(ref, b1) == color) b1 = next_change(ref, b1, columns);
+		i32 b2 = next_change(ref, b1, columns);
+
+		if (b2 < a1) {
+			put_string(w, "0001");
+			a0 = b2;
+		}
+		else if (a1 - b1 >= -3 && a1 - b1 <= 3) {
+			static const char *vertical[] = { "0000010", "000010", "010", "1", "011", "000011", "0000011" };
+			put_string(w, vertical[a1 - b1 + 3]);
+			a0 = a1;
+			color ^= 1;
+		}
+		else {
+			i32 a2 = next_change(line, a1, columns);
+			put_string(w, "001");
+			put_run(w, color, (u32)(a1 - MAX(a0, 0)));
+			put_run(w, color ^ 1, (u32)(a2 - a1));
+			a0 = a2;
+		}
+	}
+}
+
+typedef struct EncodeOptions {
+	i32 k;
+	bool eol;        // EOL in front of every row (Group 3)
+	bool byte_align; // rows (with eol: EOLs) end on a byte boundary
+	bool end_block;  // RTC for Group 3, EOFB for Group 4
+} EncodeOptions;
+
+// the caller frees data with mem_free
+local BitWriter encode(const u8 *pixels, u32 columns, u32 rows, EncodeOptions o) {
+	BitWriter w = { .cap = (u64)rows * (columns + 8) + 64 };
+	w.data = mem_alloc(MEM_TAG_DECODE, w.cap);
+	memset(w.data, 0, w.cap);
+
+	u8 *white = mem_alloc(MEM_TAG_DECODE, columns);
+	memset(white, 0, columns);
+
+	for (u32 y = 0; y < rows; y++) {
+		const u8 *line = pixels + (u64)y * columns;
+		const u8 *ref = y == 0 ? white : line - columns;
+
+		if (o.k < 0) {
+			if (o.byte_align) pad_to_byte(&w);
+			encode_row_2d(&w, line, ref, (i32)columns);
+			continue;
+		}
+
+		if (o.eol) {
+			// fill bits so the EOL ends on a byte boundary
+			if (o.byte_align) w.n_bits += (8 - (w.n_bits + 12) % 8) % 8;
+			put_string(&w, EOL);
+		}
+		else if (o.byte_align) {
+			pad_to_byte(&w);
+		}
+
+		bool one_d = o.k == 0 || y % (u32)o.k == 0;
+		if (o.k > 0) put_bits(&w, one_d, 1);
+		if (one_d) encode_row_1d(&w, line, (i32)columns);
+		else encode_row_2d(&w, line, ref, (i32)columns);
+	}
+
+	if (o.end_block) {
+		if (o.k < 0) put_string(&w, EOL EOL);
+		else for (u32 i = 0; i < 6; i++) put_string(&w, o.k > 0 ? EOL "1" : EOL);
+	}
+
+	mem_free(white);
+	return w;
+}
+
+// pixels as ccitt_decode packs them, 0 is black unless black_is_1
+local u8 *pack_pixels(const u8 *pixels, u32 columns, u32 rows, bool black_is_1) {
+	u32 stride = (columns + 7) / 8;
+	u8 *out = mem_alloc(MEM_TAG_DECODE, (u64)stride * rows);
+	memset(out, 0, (u64)stride * rows);
+	for (u32 y = 0; y < rows; y++) {
+		for (u32 x = 0; x < columns; x++) {
+			u32 bit = pixels[(u64)y * columns + x] == BLACK ? black_is_1 : !black_is_1;
+			if (bit) out[(u64)y * stride + x / 8] |= (u8)(0x80 >> (x % 8));
+		}
+		// padding bits are white
+		for (u32 x = columns; x < stride * 8; x++) {
+			if (!black_is_1) out[(u64)y * stride + x / 8] |= (u8)(0x80 >> (x % 8));
+		}
+	}
+	return out;
+}
+
+enum Pattern {
+	PATTERN_WHITE,
+	PATTERN_BLACK,
+	PATTERN_STRIPES, // vertical stripes that shift between rows, all vertical modes
+	PATTERN_TEXT,    // blobs on white, mostly pass and vertical modes
+	PATTERN_NOISE,   // short random runs, mostly horizontal mode
+	PATTERN_LONG,    // runs over 2560 pixels, extended make up codes
+};
+
+local u8 *make_pixels(enum Pattern pattern, u32 columns, u32 rows) {
+	u8 *p = mem_alloc(MEM_TAG_DECODE, (u64)columns * rows);
+	memset(p, pattern == PATTERN_BLACK ? BLACK : WHITE, (u64)columns * rows);
+
+	for (u32 y = 0; y < rows; y++) {
+		u8 *line = p + (u64)y * columns;
+		switch (pattern) {
+		case PATTERN_WHITE:
+		case PATTERN_BLACK: break;
+
+		case PATTERN_STRIPES:
+			for (u32 x = 0; x < columns; x++) line[x] = ((x + y * (y % 7)) / 5) % 2;
+			break;
+
+		case PATTERN_TEXT:
+			if (y % 16 < 10) {
+				for (u32 x = 0; x < columns; x++) line[x] = (x / 3 + y / 2) % 9 < 2 && x % 50 < 40;
+			}
+			break;
+
+		case PATTERN_NOISE:
+			for (u32 x = 0; x < columns; x++) line[x] = rng_next() % 3 == 0;
+			break;
+
+		case PATTERN_LONG: {
+			u32 x = 0;
+			u32 color = y % 2;
+			while (x < columns) {
+				u32 run = rng_next() % 6000;
+				run = MIN(run, columns - x);
+				memset(line + x, color, run);
+				x += run;
+				color ^= 1;
+			}
+			break;
+		}
+		}
+	}
+	return p;
+}
+
+/// CHECKS ///
+
+local void check_decoded(const char *name, Buffer decoded, const u8 *expected, u64 expected_len) {
+	if (decoded.size != expected_len || memcmp(decoded.data, expected, expected_len) != 0) {
+		fprintf(stderr, "%s: %llu bytes decoded, %llu expected\n", name,
+			(unsigned long long)decoded.size, (unsigned long long)expected_len);
+		failures += 1;
+	}
+}
+
+// hand coded vectors, independent of the encoder above
+local void check_vectors(void) {
+	static const char *bitmap[] = {
+		"....########....",
+		".....########...",
+		"################",
+		"................",
+	};
+	u8 *expected = pack_rows(bitmap, 4, 16);
+	u8 data[64];
+
+	// Group 3 1D with EOLs: white 4, black 8, white 4 / white 5, black 8, white 3 / white 0, black 16 /
+	// white 16, then RTC
+	BitWriter w = { .data = data, .cap = sizeof(data) };
+	memset(data, 0, sizeof(data));
+	put_string(&w, EOL "1011 000101 1011");
+	put_string(&w, EOL "1100 000101 1000");
+	put_string(&w, EOL "00110101 0000010111");
+	put_string(&w, EOL "101010");
+	for (u32 i = 0; i < 6; i++) put_string(&w, EOL);
+	CCITTParams params = { .k = 0, .columns = 16 };
+	Buffer decoded = ccitt_decode(data, (w.n_bits + 7) / 8, params);
+	check_decoded("G3 1D vector", decoded, expected, 8);
+	buffer_pool_release(decoded.data);
+
+	// Group 4: H(white 4, black 8) V0 / VR1 VR1 V0 / H(white 0, black 16) / H(white 16, black 0), then EOFB
+	memset(data, 0, sizeof(data));
+	w = (BitWriter){ .data = data, .cap = sizeof(data) };
+	put_string(&w, "001 1011 000101 1");
+	put_string(&w, "011 011 1");
+	put_string(&w, "001 00110101 0000010111");
+	put_string(&w, "001 101010 0000110111");
+	put_string(&w, EOL EOL);
+	params = (CCITTParams){ .k = -1, .columns = 16 };
+	decoded = ccitt_decode(data, (w.n_bits + 7) / 8, params);
+	check_decoded("G4 vector", decoded, expected, 8);
+	buffer_pool_release(decoded.data);
+
+	// Group 3 mixed, K = 2: 1D row, 2D row, 1D row, 2D row, each behind an EOL and its tag bit
+	memset(data, 0, sizeof(data));
+	w = (BitWriter){ .data = data, .cap = sizeof(data) };
+	put_string(&w, EOL "1" "1011 000101 1011");
+	put_string(&w, EOL "0" "011 011 1");
+	put_string(&w, EOL "1" "00110101 0000010111");
+	put_string(&w, EOL "0" "001 101010 0000110111");
+	params = (CCITTParams){ .k = 2, .columns = 16 };
+	decoded = ccitt_decode(data, (w.n_bits + 7) / 8, params);
+	check_decoded("G3 2D vector", decoded, expected, 8);
+	buffer_pool_release(decoded.data);
+
+	// pass mode: the black run of the reference row ends before the coding row changes
+	static const char *pass_bitmap[] = { "..###...", "........" };
+	u8 *pass_expected = pack_rows(pass_bitmap, 2, 8);
+	memset(data, 0, sizeof(data));
+	w = (BitWriter){ .data = data, .cap = sizeof(data) };
+	put_string(&w, "001 0111 10 1");
+	put_string(&w, "0001 1");
+	params = (CCITTParams){ .k = -1, .columns = 8 };
+	decoded = ccitt_decode(data, (w.n_bits + 7) / 8, params);
+	check_decoded("G4 pass vector", decoded, pass_expected, 2);
+	buffer_pool_release(decoded.data);
+
+	mem_free(pass_expected);
+	mem_free(expected);
+}
+
+// the encoded bitmap has to decode to itself with and without /Rows, and a cut after half the rows has
+// to keep those rows and fill the rest with white when /Rows is known
+local void check_roundtrip(enum Pattern pattern, u32 columns, u32 rows, EncodeOptions o, bool black_is_1) {
+	u8 *pixels = make_pixels(pattern, columns, rows);
+	u8 *expected = pack_pixels(pixels, columns, rows, black_is_1);
+	u64 expected_len = (u64)((columns + 7) / 8) * rows;
+
+	BitWriter w = encode(pixels, columns, rows, o);
+	CCITTParams params = {
+		.k = o.k,
+		.columns = columns,
+		.black_is_1 = black_is_1,
+		.encoded_byte_align = o.byte_align,
+	};
+
+	char name[128];
+	snprintf(name, sizeof(name), "pattern %u, %u x %u, K %i%s%s%s%s", pattern, columns, rows, o.k,
+		o.eol ? ", EOL" : "", o.byte_align ? ", aligned" : "", o.end_block ? ", end of block" : "",
+		black_is_1 ? ", BlackIs1" : "");
+
+	Buffer decoded = ccitt_decode(w.data, (w.n_bits + 7) / 8, params);
+	check_decoded(name, decoded, expected, expected_len);
+	buffer_pool_release(decoded.data);
+
+	params.rows = rows;
+	decoded = ccitt_decode(w.data, (w.n_bits + 7) / 8, params);
+	check_decoded(name, decoded, expected, expected_len);
+	buffer_pool_release(decoded.data);
+
+	u32 half = rows / 2;
+	if (half > 0 && !o.end_block) {
+		BitWriter cut = encode(pixels, columns, half, o);
+		u64 cut_len = (cut.n_bits + 7) / 8;
+		u64 half_len = (u64)((columns + 7) / 8) * half;
+
+		// a /Rows that takes more bits than the data has is not trusted
+		if (rows <= cut_len * 8) {
+			u8 *white = make_pixels(PATTERN_WHITE, columns, rows - half);
+			u8 *white_rows = pack_pixels(white, columns, rows - half, black_is_1);
+			memcpy(expected + half_len, white_rows, expected_len - half_len);
+			mem_free(white_rows);
+			mem_free(white);
+		}
+		else {
+			expected_len = half_len;
+		}
+
+		decoded = ccitt_decode(cut.data, cut_len, params);
+		check_decoded(name, decoded, expected, expected_len);
+		buffer_pool_release(decoded.data);
+		mem_free(cut.data);
+	}
+
+	mem_free(w.data);
+	mem_free(expected);
+	mem_free(pixels);
+}
+
+int main(void) {
+	check_vectors();
+
+	static const EncodeOptions options[] = {
+		{ .k = 0 },
+		{ .k = 0, .eol = true },
+		{ .k = 0, .eol = true, .byte_align = true, .end_block = true },
+		{ .k = 0, .byte_align = true },
+		{ .k = 2, .eol = true },
+		{ .k = 4, .eol = true, .byte_align = true, .end_block = true },
+		{ .k = 3 },
+		{ .k = -1 },
+		{ .k = -1, .end_block = true },
+		{ .k = -1, .byte_align = true },
+	};
+	static const struct { u32 columns; u32 rows; } sizes[] = {
+		{ 1, 3 }, { 13, 7 }, { 64, 5 }, { 1728, 40 }, { 2551, 9 },
+	};
+
+	for (u32 o = 0; o < COUNT_OF(options); o++) {
+		for (u32 s = 0; s < COUNT_OF(sizes); s++) {
+			for (u32 pattern = PATTERN_WHITE; pattern <= PATTERN_NOISE; pattern++) {
+				check_roundtrip(pattern, sizes[s].columns, sizes[s].rows, options[o], (o + pattern) % 3 == 0);
+			}
+		}
+		check_roundtrip(PATTERN_LONG, 9000, 6, options[o], false);
+	}
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
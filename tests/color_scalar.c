@@ -0,0 +1,18 @@
+// color.c built with PTRAIL_NO_SIMD, every function renamed with a _scalar suffix. color_test checks
+// the SIMD kernels against it
+
+#define PTRAIL_NO_SIMD
+
+#define color_convert_image color_convert_image_scalar
+#define color_convert_region color_convert_region_scalar
+#define color_convert_row color_convert_row_scalar
+#define color_convert_span color_convert_span_scalar
+#define color_converter_init color_converter_init_scalar
+#define color_row_stride color_row_stride_scalar
+#define color_space_components color_space_components_scalar
+#define color_space_to_str color_space_to_str_scalar
+#define image_color_from_dict image_color_from_dict_scalar
+#define narrow_samples16 narrow_samples16_scalar
+#define unpack_samples unpack_samples_scalar
+
+#include "src/color.c"
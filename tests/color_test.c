@@ -0,0 +1,212 @@
+#include "src/color.h"
+#include "src/memory.h"
+#include "src/buffer_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the SIMD conversion and unpack kernels against the scalar build of color.c (color_scalar.c), on every
+// color space and bit depth with and without /Decode, spans that start inside a byte and rows longer than
+// a chunk. regions outside of an image convert to an empty image
+
+local u32 failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1; \
+    } \
+} while (0)
+
+// color.c built with PTRAIL_NO_SIMD
+void color_convert_span_scalar(const ColorConverter *cc, u8 *out, const u8 *row, u32 first, u32 width);
+void unpack_samples_scalar(u8 *out, const u8 *row, u64 first, u32 count, u32 bits, bool scale);
+
+/// INPUT ///
+
+local u64 rng_state = 0x9e3779b97f4a7c15ull;
+
+local u32 rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (u32)(rng_state >> 32);
+}
+
+local void fill_random(u8 *data, u64 len) {
+	for (u64 i = 0; i < len; i++) data[i] = (u8)rng_next();
+}
+
+enum DecodeKind {
+	DECODE_NONE,
+	DECODE_INVERT, // [1 0] for every component
+	DECODE_RANGE,  // a remapping that needs the lookup tables
+	DECODE_KIND_COUNT,
+};
+
+local const char *decode_names[] = { "no /Decode", "inverted", "remapped" };
+
+local ImageColor make_color(enum ColorSpace space, u32 bpc, enum DecodeKind decode) {
+	ImageColor color = {
+		.space = space,
+		.bits_per_component = bpc,
+		.has_decode = decode != DECODE_NONE,
+	};
+	f32 max = space == COLOR_SPACE_INDEXED ? (f32)((1u << bpc) - 1) : 1.0f;
+	for (u32 c = 0; c < COLOR_MAX_COMPONENTS; c++) {
+		color.decode[2 * c] = decode == DECODE_INVERT ? max : decode == DECODE_RANGE ? 0.2f * max : 0.0f;
+		color.decode[2 * c + 1] = decode == DECODE_INVERT ? 0.0f : decode == DECODE_RANGE ? 0.9f * max : max;
+	}
+	return color;
+}
+
+/// CHECKS ///
+
+// spans of a random row, from a few pixels to more than a chunk and from offsets inside a byte
+local void check_converter(const char *name, const ColorConverter *cc) {
+	static const u32 widths[] = { 1, 3, 8, 15, 16, 17, 33, 64, 255, 257, 700 };
+	static const u32 firsts[] = { 0, 1, 3, 7, 13 };
+
+	u32 max_width = widths[COUNT_OF(widths) - 1] + firsts[COUNT_OF(firsts) - 1];
+	u64 row_len = color_row_stride(cc, max_width);
+	u8 *row = mem_alloc(MEM_TAG_DECODE, row_len);
+	u8 *simd = mem_alloc(MEM_TAG_DECODE, (u64)max_width * 4);
+	u8 *scalar = mem_alloc(MEM_TAG_DECODE, (u64)max_width * 4);
+
+	for (u32 f = 0; f < COUNT_OF(firsts); f++) {
+		for (u32 w = 0; w < COUNT_OF(widths); w++) {
+			fill_random(row, row_len);
+			u64 size = (u64)widths[w] * 4;
+			color_convert_span(cc, simd, row, firsts[f], widths[w]);
+			color_convert_span_scalar(cc, scalar, row, firsts[f], widths[w]);
+			if (memcmp(simd, scalar, size) != 0) {
+				fprintf(stderr, "%s: %u pixels from %u differ from the scalar conversion\n", name, widths[w], firsts[f]);
+				failures += 1;
+			}
+		}
+	}
+
+	mem_free(scalar);
+	mem_free(simd);
+	mem_free(row);
+}
+
+local void check_device_spaces(void) {
+	static const enum ColorSpace spaces[] = { COLOR_SPACE_GRAY, COLOR_SPACE_RGB, COLOR_SPACE_CMYK };
+	static const u32 bpcs[] = { 1, 2, 4, 8, 16 };
+
+	for (u32 s = 0; s < COUNT_OF(spaces); s++) {
+		for (u32 b = 0; b < COUNT_OF(bpcs); b++) {
+			for (u32 d = 0; d < DECODE_KIND_COUNT; d++) {
+				ImageColor color = make_color(spaces[s], bpcs[b], d);
+				ColorConverter cc;
+				color_converter_init(&cc, &color);
+
+				char name[64];
+				snprintf(name, sizeof(name), "%s, %u bpc, %s", color_space_to_str(spaces[s]), bpcs[b], decode_names[d]);
+				check_converter(name, &cc);
+			}
+		}
+	}
+}
+
+local void check_indexed(void) {
+	static const enum ColorSpace bases[] = { COLOR_SPACE_GRAY, COLOR_SPACE_RGB, COLOR_SPACE_CMYK };
+	static const u32 bpcs[] = { 1, 2, 4, 8 };
+
+	for (u32 s = 0; s < COUNT_OF(bases); s++) {
+		for (u32 b = 0; b < COUNT_OF(bpcs); b++) {
+			for (u32 d = 0; d < DECODE_KIND_COUNT; d++) {
+				ImageColor color = make_color(COLOR_SPACE_INDEXED, bpcs[b], d);
+				color.base = bases[s];
+				// a palette smaller than the sample range, larger indices are clamped
+				color.hival = ((1u << bpcs[b]) - 1) * 3 / 4;
+				fill_random(color.lookup, sizeof(color.lookup));
+				ColorConverter cc;
+				color_converter_init(&cc, &color);
+
+				char name[64];
+				snprintf(name, sizeof(name), "Indexed %s, %u bpc, %s", color_space_to_str(bases[s]), bpcs[b], decode_names[d]);
+				check_converter(name, &cc);
+			}
+		}
+	}
+}
+
+local void check_image_mask(void) {
+	for (u32 d = DECODE_NONE; d <= DECODE_INVERT; d++) {
+		ImageColor color = make_color(COLOR_SPACE_GRAY, 1, d);
+		color.image_mask = true;
+		color.mask_color[0] = 200;
+		color.mask_color[1] = 30;
+		color.mask_color[2] = 90;
+		ColorConverter cc;
+		color_converter_init(&cc, &color);
+		check_converter(d == DECODE_NONE ? "image mask" : "inverted image mask", &cc);
+	}
+}
+
+// every start inside the first bytes and counts around the 16 sample blocks
+local void check_unpack(void) {
+	u8 row[128];
+	u8 simd[1024];
+	u8 scalar[1024];
+	fill_random(row, sizeof(row));
+
+	static const u32 bits[] = { 1, 2, 4 };
+	for (u32 b = 0; b < COUNT_OF(bits); b++) {
+		u32 n_samples = sizeof(row) * 8 / bits[b];
+		for (u32 first = 0; first < 24; first++) {
+			for (u32 count = 0; first + count <= n_samples && count < 200; count += 1 + count / 8) {
+				for (u32 scale = 0; scale < 2; scale++) {
+					unpack_samples(simd, row, first, count, bits[b], scale);
+					unpack_samples_scalar(scalar, row, first, count, bits[b], scale);
+					if (memcmp(simd, scalar, count) != 0) {
+						fprintf(stderr, "%u bit samples %u to %u%s differ from the scalar unpack\n",
+							bits[b], first, first + count, scale ? ", scaled" : "");
+						failures += 1;
+					}
+				}
+			}
+		}
+	}
+}
+
+local void check_empty_region(void) {
+	ImageColor color = make_color(COLOR_SPACE_GRAY, 8, DECODE_NONE);
+	ColorConverter cc;
+	color_converter_init(&cc, &color);
+	u8 samples[8 * 4];
+	fill_random(samples, sizeof(samples));
+
+	ImageRegion regions[] = {
+		{ 8, 0, 4, 4 }, // right of the image
+		{ 0, 9, 4, 4 }, // below it
+		{ 2, 2, 0, 3 },
+		{ 2, 2, 3, 0 },
+	};
+	for (u32 i = 0; i < COUNT_OF(regions); i++) {
+		RawImage image = color_convert_region(&cc, samples, 8, 4, regions[i], (ImageTarget){ 0 });
+		CHECK(!image.data && image.width == 0 && image.height == 0);
+	}
+
+	// clamped to the image
+	RawImage image = color_convert_region(&cc, samples, 8, 4, (ImageRegion){ 6, 3, 10, 10 }, (ImageTarget){ 0 });
+	CHECK(image.width == 2 && image.height == 1 && image.data);
+	CHECK(image.data && image.data[0] == samples[3 * 8 + 6] && image.data[4] == samples[3 * 8 + 7]);
+	buffer_pool_release(image.data);
+}
+
+int main(void) {
+	check_device_spaces();
+	check_indexed();
+	check_image_mask();
+	check_unpack();
+	check_empty_region();
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,259 @@
+#include "src/dct.h"
+#include "src/memory.h"
+#include "src/buffer_pool.h"
+#include "src/threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+
+// the parallel, region and progressive decoders against a serial decode of the same jpeg, on the chroma
+// subsamplings, gray and CMYK jpegs libjpeg writes, with restarts at MCU row boundaries, restarts inside
+// MCU rows and without restarts
+
+local u32 failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1; \
+    } \
+} while (0)
+
+/// INPUT ///
+
+// odd sizes, so the last MCU row and column are partial. just above DCT_PARALLEL_MIN_PIXELS at full scale
+#define WIDTH 1031
+#define HEIGHT 1049
+
+enum JPEGKind {
+	JPEG_420,
+	JPEG_422,
+	JPEG_444,
+	JPEG_GRAY,
+	JPEG_CMYK,
+	JPEG_KIND_COUNT,
+};
+
+enum Restarts {
+	RESTARTS_NONE,
+	RESTARTS_ROWS,   // one segment per MCU row
+	RESTARTS_7_MCUS, // segments end inside MCU rows
+	RESTARTS_COUNT,
+};
+
+local const char *jpeg_kind_names[] = { "4:2:0", "4:2:2", "4:4:4", "gray", "CMYK" };
+local const char *restart_names[] = { "no restarts", "row restarts", "7 MCU restarts" };
+
+// gradients with sharp edges in between, so the chroma upsampling has something to smooth across bands
+local u8 *make_pixels(u32 n_channels) {
+	u8 *pixels = mem_alloc(MEM_TAG_DECODE, (u64)WIDTH * HEIGHT * n_channels);
+	for (u32 y = 0; y < HEIGHT; y++) {
+		for (u32 x = 0; x < WIDTH; x++) {
+			u8 *p = pixels + ((u64)y * WIDTH + x) * n_channels;
+			bool edge = ((x / 37) + (y / 23)) % 2 == 0;
+			for (u32 c = 0; c < n_channels; c++) {
+				p[c] = (u8)(edge ? x * (c + 1) + y : 255 - y * (c + 2) / 3);
+			}
+		}
+	}
+	return pixels;
+}
+
+// compresses with libjpeg, the caller frees the result with free
+local u8 *encode_jpeg(enum JPEGKind kind, enum Restarts restarts, bool progressive, u64 *len) {
+	struct jpeg_compress_struct info;
+	struct jpeg_error_mgr err;
+	info.err = jpeg_std_error(&err);
+	jpeg_create_compress(&info);
+
+	u8 *out = NULL;
+	unsigned long out_len = 0;
+	jpeg_mem_dest(&info, &out, &out_len);
+
+	info.image_width = WIDTH;
+	info.image_height = HEIGHT;
+	switch (kind) {
+	case JPEG_GRAY: info.input_components = 1; info.in_color_space = JCS_GRAYSCALE; break;
+	case JPEG_CMYK: info.input_components = 4; info.in_color_space = JCS_CMYK; break;
+	default: info.input_components = 3; info.in_color_space = JCS_RGB; break;
+	}
+	jpeg_set_defaults(&info);
+	jpeg_set_quality(&info, 85, true);
+
+	u32 h_samp = kind == JPEG_420 || kind == JPEG_422 ? 2 : 1;
+	u32 v_samp = kind == JPEG_420 ? 2 : 1;
+	info.comp_info[0].h_samp_factor = (int)h_samp;
+	info.comp_info[0].v_samp_factor = (int)v_samp;
+	for (int c = 1; c < info.num_components; c++) {
+		info.comp_info[c].h_samp_factor = 1;
+		info.comp_info[c].v_samp_factor = 1;
+	}
+
+	if (restarts == RESTARTS_ROWS) info.restart_in_rows = 1;
+	if (restarts == RESTARTS_7_MCUS) info.restart_interval = 7;
+	if (progressive) jpeg_simple_progression(&info);
+
+	u32 n_channels = (u32)info.input_components;
+	u8 *pixels = make_pixels(n_channels);
+	jpeg_start_compress(&info, true);
+	while (info.next_scanline < info.image_height) {
+		JSAMPROW row = pixels + (u64)info.next_scanline * WIDTH * n_channels;
+		(void)jpeg_write_scanlines(&info, &row, 1);
+	}
+	jpeg_finish_compress(&info);
+	jpeg_destroy_compress(&info);
+	mem_free(pixels);
+
+	*len = out_len;
+	return out;
+}
+
+/// CHECKS ///
+
+local bool same_layout(const RawImage *a, const RawImage *b) {
+	return a->width == b->width && a->height == b->height && a->n_channels == b->n_channels
+		&& a->format == b->format && a->inverted == b->inverted;
+}
+
+local void check_same(const char *what, const char *name, const RawImage *image, const RawImage *expected) {
+	u64 size = (u64)expected->width * expected->height * expected->n_channels;
+	if (!image->data || !same_layout(image, expected) || memcmp(image->data, expected->data, size) != 0) {
+		fprintf(stderr, "%s: %s differs from the serial decode\n", name, what);
+		failures += 1;
+	}
+}
+
+// the region cut out of a full decode
+local void check_region(const char *name, const u8 *jpeg, u64 len, enum DCTScale scale, const RawImage *full, ImageRegion region) {
+	RawImage image = dct_decode_region(jpeg, len, scale, DCT_OUTPUT_NATIVE, region);
+
+	u32 x = MIN(region.x, full->width);
+	u32 y = MIN(region.y, full->height);
+	u32 width = MIN(region.width, full->width - x);
+	u32 height = MIN(region.height, full->height - y);
+	if (width == 0 || height == 0) {
+		// nothing of the region is inside the image
+		CHECK(!image.data && image.width == 0 && image.height == 0);
+		return;
+	}
+
+	u32 n = full->n_channels;
+	bool same = image.data && image.width == width && image.height == height && image.n_channels == n
+		&& image.format == full->format && image.inverted == full->inverted;
+	for (u32 row = 0; same && row < height; row++) {
+		const u8 *expected = full->data + ((u64)(y + row) * full->width + x) * n;
+		same = memcmp(image.data + (u64)row * width * n, expected, (u64)width * n) == 0;
+	}
+	if (!same) {
+		fprintf(stderr, "%s: region %u %u %u %u at %s differs from the full decode\n", name,
+			region.x, region.y, region.width, region.height, dct_scale_to_str(scale));
+		failures += 1;
+	}
+	buffer_pool_release(image.data);
+}
+
+typedef struct ScanCount {
+	u32 n_scans;
+	u32 width;
+	u32 height;
+} ScanCount;
+
+local bool count_scan(void *user_data, const RawImage *image, u32 scan) {
+	ScanCount *count = user_data;
+	CHECK(scan >= count->n_scans);
+	CHECK(image->width == count->width && image->height == count->height);
+	count->n_scans += 1;
+	return true;
+}
+
+local void check_jpeg(enum JPEGKind kind, enum Restarts restarts, bool progressive) {
+	char name[64];
+	snprintf(name, sizeof(name), "%s, %s%s", jpeg_kind_names[kind], restart_names[restarts], progressive ? ", progressive" : "");
+
+	u64 len = 0;
+	u8 *jpeg = encode_jpeg(kind, restarts, progressive, &len);
+
+	u32 width = 0, height = 0;
+	dct_read_size(jpeg, len, &width, &height);
+	CHECK(width == WIDTH && height == HEIGHT);
+
+	for (u32 scale = DCT_SCALE_FULL; scale < DCT_SCALE_COUNT; scale++) {
+		RawImage serial = dct_decode_image(jpeg, len, scale, DCT_OUTPUT_NATIVE);
+		CHECK(serial.width == dct_scaled_size(WIDTH, scale) && serial.height == dct_scaled_size(HEIGHT, scale));
+		CHECK(serial.inverted == (kind == JPEG_CMYK));
+
+		RawImage parallel = dct_decode_parallel(jpeg, len, scale, DCT_OUTPUT_NATIVE);
+		check_same("parallel decode", name, &parallel, &serial);
+		buffer_pool_release(parallel.data);
+
+		ScanCount count = { .width = serial.width, .height = serial.height };
+		RawImage final = dct_decode_progressive(jpeg, len, scale, DCT_OUTPUT_NATIVE, (DCTScanSink){ count_scan, &count });
+		check_same("progressive final image", name, &final, &serial);
+		CHECK(progressive ? count.n_scans > 1 : count.n_scans == 0);
+		buffer_pool_release(final.data);
+
+		if (scale == DCT_SCALE_FULL || scale == DCT_SCALE_QUARTER) {
+			u32 w = serial.width;
+			u32 h = serial.height;
+			ImageRegion regions[] = {
+				{ 0, 0, w, h },
+				{ 0, 0, 17, 9 },
+				{ w / 3 + 1, h / 5 + 3, w / 4 + 5, h / 3 },
+				{ w - 9, h - 5, 100, 100 },  // clamped
+				{ 33, h / 2, 1, 1 },
+				{ w, 0, 10, 10 },            // right of the image
+				{ 5, 5, 0, 3 },              // empty
+			};
+			for (u32 i = 0; i < COUNT_OF(regions); i++) {
+				check_region(name, jpeg, len, scale, &serial, regions[i]);
+			}
+		}
+
+		buffer_pool_release(serial.data);
+	}
+
+	// the 4 channel outputs come straight out of libjpeg's color conversion, in bands as well
+	if (kind != JPEG_CMYK) {
+		RawImage serial = dct_decode_image(jpeg, len, DCT_SCALE_FULL, DCT_OUTPUT_RGBA);
+		CHECK(serial.n_channels == 4 && serial.format == PIXEL_FORMAT_RGBA);
+		RawImage parallel = dct_decode_parallel(jpeg, len, DCT_SCALE_FULL, DCT_OUTPUT_RGBA);
+		check_same("parallel RGBA decode", name, &parallel, &serial);
+		buffer_pool_release(parallel.data);
+		buffer_pool_release(serial.data);
+	}
+
+	// the filter decodes at full scale in the native format
+	RawImage serial = dct_decode_image(jpeg, len, DCT_SCALE_FULL, DCT_OUTPUT_NATIVE);
+	Stream stream = { .slice = { .ptr = jpeg, .len = len } };
+	DecodedStream decoded = dct_decode(&stream);
+	CHECK(decoded.kind == STREAM_DATA_IMAGE);
+	check_same("filter decode", name, &decoded.data.image, &serial);
+	buffer_pool_release(decoded.data.image.data);
+	buffer_pool_release(serial.data);
+
+	free(jpeg);
+}
+
+int main(void) {
+	// parallel_for would run serially with a single core
+	threads_set_count(4);
+
+	for (u32 kind = 0; kind < JPEG_KIND_COUNT; kind++) {
+		for (u32 restarts = 0; restarts < RESTARTS_COUNT; restarts++) {
+			check_jpeg(kind, restarts, false);
+		}
+		check_jpeg(kind, RESTARTS_NONE, true);
+		check_jpeg(kind, RESTARTS_ROWS, true);
+	}
+
+	threads_shutdown();
+	threads_set_count(0);
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
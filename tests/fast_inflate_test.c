@@ -0,0 +1,234 @@
+#include "src/fast_inflate.h"
+#include "src/memory.h"
+#include "src/buffer_pool.h"
+#include "src/threads.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+// fast_zlib_inflate against zlib's uncompress, on the block types deflate produces and on broken input.
+// fast_zlib_inflate_parallel against fast_zlib_inflate, on more threads than a CI machine may have
+
+local u32 failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1; \
+    } \
+} while (0)
+
+/// INPUT ///
+
+local u64 rng_state = 0x9e3779b97f4a7c15ull;
+
+local u32 rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (u32)(rng_state >> 32);
+}
+
+local void fill_random(u8 *data, u64 len) {
+	for (u64 i = 0; i < len; i++) data[i] = (u8)rng_next();
+}
+
+// words from a small vocabulary with repeated phrases, compresses into dynamic huffman blocks
+local void fill_text(u8 *data, u64 len) {
+	static const char *words[] = {
+		"stream", "object", "page", "filter", "decode", "length", "xref", "trailer",
+		"font", "image", "width", "height", "0", "1", "2", "obj", "endobj", "R",
+	};
+	u64 i = 0;
+	while (i < len) {
+		if (i > 64 && rng_next() % 4 == 0) {
+			// a match from the window
+			u64 distance = 1 + rng_next() % MIN(i, 32768);
+			u64 count = 3 + rng_next() % 64;
+			count = MIN(count, len - i);
+			for (u64 k = 0; k < count; k++, i++) data[i] = data[i - distance];
+			continue;
+		}
+		const char *word = words[rng_next() % COUNT_OF(words)];
+		for (u64 k = 0; word[k] && i < len; k++) data[i++] = (u8)word[k];
+		if (i < len) data[i++] = rng_next() % 8 == 0 ? '\n' : ' ';
+	}
+}
+
+// zlib stream of data with the given level and strategy, the caller frees it with mem_free
+local u8 *compress_with(const u8 *data, u64 len, int level, int strategy, u64 *out_len) {
+	z_stream strm = { 0 };
+	int ret = deflateInit2(&strm, level, Z_DEFLATED, 15, 8, strategy);
+	ASSERT(ret == Z_OK);
+
+	u64 cap = deflateBound(&strm, (uLong)len);
+	u8 *out = mem_alloc(MEM_TAG_DECODE, cap);
+	strm.next_in = (u8 *)data;
+	strm.avail_in = (uInt)len;
+	strm.next_out = out;
+	strm.avail_out = (uInt)cap;
+	ret = deflate(&strm, Z_FINISH);
+	ASSERT(ret == Z_STREAM_END);
+
+	*out_len = strm.total_out;
+	deflateEnd(&strm);
+	return out;
+}
+
+/// CHECKS ///
+
+// both decoders have to give back data, exactly
+local void check_roundtrip(const char *name, const u8 *data, u64 len, int level, int strategy) {
+	u64 z_len = 0;
+	u8 *z = compress_with(data, len, level, strategy, &z_len);
+
+	u8 *expected = mem_alloc(MEM_TAG_DECODE, len + 1);
+	uLongf expected_len = (uLongf)len + 1;
+	CHECK(uncompress(expected, &expected_len, z, (uLong)z_len) == Z_OK);
+	CHECK(expected_len == len && memcmp(expected, data, len) == 0);
+
+	u8 *out = mem_alloc(MEM_TAG_DECODE, len + 1);
+	u64 out_len = 0;
+	enum FastInflateResult result = fast_zlib_inflate(z, z_len, out, len + 1, &out_len);
+	if (result != FAST_INFLATE_SUCCESS || out_len != expected_len || memcmp(out, expected, out_len) != 0) {
+		fprintf(stderr, "%s: %s, %llu of %llu bytes\n", name, fast_inflate_result_to_str(result),
+			(unsigned long long)out_len, (unsigned long long)len);
+		failures += 1;
+	}
+
+	// one byte less than the output has to be reported, not overrun
+	if (len > 0) {
+		CHECK(fast_zlib_inflate(z, z_len, out, len - 1, &out_len) == FAST_INFLATE_SHORT_OUTPUT);
+	}
+
+	mem_free(out);
+	mem_free(expected);
+	mem_free(z);
+}
+
+// broken streams have to be rejected by both decoders
+local void check_broken(const u8 *data, u64 len) {
+	u64 z_len = 0;
+	u8 *z = compress_with(data, len, Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY, &z_len);
+	u8 *out = mem_alloc(MEM_TAG_DECODE, len);
+	u64 out_len = 0;
+	uLongf zlib_len = (uLongf)len;
+
+	// truncated at every few bytes, the adler32 trailer included
+	for (u64 cut = 0; cut < z_len; cut += 1 + z_len / 97) {
+		CHECK(fast_zlib_inflate(z, cut, out, len, &out_len) == FAST_INFLATE_BAD_DATA);
+		zlib_len = (uLongf)len;
+		CHECK(uncompress(out, &zlib_len, z, (uLong)cut) != Z_OK);
+	}
+
+	// wrong checksum
+	z[z_len - 1] ^= 0x01;
+	CHECK(fast_zlib_inflate(z, z_len, out, len, &out_len) == FAST_INFLATE_BAD_DATA);
+	zlib_len = (uLongf)len;
+	CHECK(uncompress(out, &zlib_len, z, (uLong)z_len) == Z_DATA_ERROR);
+	z[z_len - 1] ^= 0x01;
+
+	// wrong header
+	z[0] ^= 0x01;
+	CHECK(fast_zlib_inflate(z, z_len, out, len, &out_len) == FAST_INFLATE_BAD_DATA);
+	z[0] ^= 0x01;
+
+	// reserved block type 3 in the first block header
+	u8 saved = z[2];
+	z[2] |= 0x06;
+	CHECK(fast_zlib_inflate(z, z_len, out, len, &out_len) == FAST_INFLATE_BAD_DATA);
+	zlib_len = (uLongf)len;
+	CHECK(uncompress(out, &zlib_len, z, (uLong)z_len) == Z_DATA_ERROR);
+	z[2] = saved;
+
+	// flipped bits in the compressed data may decode to anything, but never past out_cap and
+	// never to success with wrong data
+	for (u32 i = 0; i < 200; i++) {
+		u64 bit = 16 + rng_next() % ((z_len - 6) * 8);
+		z[bit / 8] ^= (u8)(1 << (bit % 8));
+		enum FastInflateResult result = fast_zlib_inflate(z, z_len, out, len, &out_len);
+		zlib_len = (uLongf)len;
+		int z_result = uncompress(out, &zlib_len, z, (uLong)z_len);
+		CHECK((result == FAST_INFLATE_SUCCESS) == (z_result == Z_OK));
+		z[bit / 8] ^= (u8)(1 << (bit % 8));
+	}
+
+	mem_free(out);
+	mem_free(z);
+}
+
+// a stream large enough to be split into PARALLEL_THREADS chunks has to inflate to the same bytes
+// in parallel as serially, and a wrong checksum has to be caught after the chunks were stitched
+#define PARALLEL_THREADS 4
+#define PARALLEL_LEN (40ull << 20)
+
+local void check_parallel(void) {
+	// parallel_for would run serially with a single core
+	threads_set_count(PARALLEL_THREADS);
+
+	// text with random bytes in between, dynamic and stored blocks that compress to ~2:1
+	u8 *data = mem_alloc(MEM_TAG_DECODE, PARALLEL_LEN);
+	for (u64 i = 0; i < PARALLEL_LEN; i += 4096) {
+		if ((i / 4096) % 2 == 0) fill_text(data + i, 4096);
+		else fill_random(data + i, 4096);
+	}
+	u64 z_len = 0;
+	u8 *z = compress_with(data, PARALLEL_LEN, Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY, &z_len);
+	CHECK(z_len >= FAST_INFLATE_PARALLEL_MIN_SIZE);
+
+	u8 *serial = mem_alloc(MEM_TAG_DECODE, PARALLEL_LEN);
+	u64 serial_len = 0;
+	CHECK(fast_zlib_inflate(z, z_len, serial, PARALLEL_LEN, &serial_len) == FAST_INFLATE_SUCCESS);
+	CHECK(serial_len == PARALLEL_LEN && memcmp(serial, data, PARALLEL_LEN) == 0);
+
+	u8 *parallel = NULL;
+	u64 parallel_len = 0;
+	enum FastInflateResult result = fast_zlib_inflate_parallel(z, z_len, &parallel, &parallel_len);
+	CHECK(result == FAST_INFLATE_SUCCESS);
+	if (result == FAST_INFLATE_SUCCESS) {
+		CHECK(parallel_len == serial_len && memcmp(parallel, serial, serial_len) == 0);
+		buffer_pool_release(parallel);
+	}
+
+	z[z_len - 1] ^= 0x01;
+	CHECK(fast_zlib_inflate_parallel(z, z_len, &parallel, &parallel_len) == FAST_INFLATE_BAD_DATA);
+
+	mem_free(serial);
+	mem_free(z);
+	mem_free(data);
+	threads_shutdown();
+	threads_set_count(0);
+}
+
+int main(void) {
+	u64 len = 1 << 20;
+	u8 *random = mem_alloc(MEM_TAG_DECODE, len);
+	u8 *text = mem_alloc(MEM_TAG_DECODE, len);
+	fill_random(random, len);
+	fill_text(text, len);
+
+	check_roundtrip("empty", text, 0, Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY);
+	check_roundtrip("random", random, len, Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY);
+	check_roundtrip("stored", text, len, 0, Z_DEFAULT_STRATEGY);
+	check_roundtrip("fixed", text, len, Z_DEFAULT_COMPRESSION, Z_FIXED);
+	check_roundtrip("dynamic", text, len, Z_BEST_COMPRESSION, Z_DEFAULT_STRATEGY);
+	check_roundtrip("rle", text, len, Z_DEFAULT_COMPRESSION, Z_RLE);
+	check_roundtrip("huffman only", text, len, Z_DEFAULT_COMPRESSION, Z_HUFFMAN_ONLY);
+	for (u64 small = 1; small < 300; small += 7) {
+		check_roundtrip("small", text, small, Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY);
+		check_roundtrip("small fixed", random, small, Z_DEFAULT_COMPRESSION, Z_FIXED);
+	}
+
+	check_broken(text, 64 << 10);
+	check_parallel();
+
+	mem_free(text);
+	mem_free(random);
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,292 @@
+#include "src/image_assembly.h"
+#include "src/memory.h"
+#include "src/buffer_pool.h"
+#include "src/threads.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// assembled images against a per pixel reference: soft masks of other sizes than their image sampled at the
+// nearest pixel, masks with a /Matte read from the mask stream, and the inverted CMYK of Adobe jpegs
+// with and without a /Decode of their own
+
+local u32 failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1; \
+    } \
+} while (0)
+
+/// INPUT ///
+
+// several bands of rows, and a width that is not a multiple of the chunks
+#define WIDTH 301
+#define HEIGHT 150
+
+local u64 rng_state = 0x9e3779b97f4a7c15ull;
+
+local u32 rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (u32)(rng_state >> 32);
+}
+
+local u8 *random_samples(u64 len) {
+	u8 *data = mem_alloc(MEM_TAG_DECODE, len);
+	for (u64 i = 0; i < len; i++) data[i] = (u8)rng_next();
+	return data;
+}
+
+local Name name_of(const char *str) {
+	return (Name){ .slice = { .ptr = (u8 *)str, .len = strlen(str) } };
+}
+
+local DictionaryEntry int_entry(const char *name, i64 value) {
+	return (DictionaryEntry){ name_of(name), obj_from_integer((Integer){ value }) };
+}
+
+local DictionaryEntry name_entry(const char *name, const char *value) {
+	return (DictionaryEntry){ name_of(name), obj_from_name(name_of(value)) };
+}
+
+local DictionaryEntry array_entry(const char *name, PDFObject *values, usize count) {
+	return (DictionaryEntry){ name_of(name), obj_from_array((ObjectArray){ values, count }) };
+}
+
+local ImageSamples rgb_image(void) {
+	return (ImageSamples){
+		.data = random_samples((u64)WIDTH * HEIGHT * 3),
+		.width = WIDTH,
+		.height = HEIGHT,
+		.color = { .space = COLOR_SPACE_RGB, .bits_per_component = 8 },
+	};
+}
+
+/// REFERENCE ///
+
+local u8 div255_ref(u32 x) {
+	return (u8)((x + 127) / 255);
+}
+
+local u32 nearest_ref(u32 i, u32 size, u32 src_size) {
+	return (u32)(((2 * (u64)i + 1) * src_size) / (2 * (u64)size));
+}
+
+// alpha of the mask pixel nearest to pixel x, y of the image, 4 bit masks are inverted by their /Decode
+local u8 mask_alpha_ref(const ImageSamples *mask, u32 x, u32 y) {
+	u32 mx = nearest_ref(x, WIDTH, mask->width);
+	u32 my = nearest_ref(y, HEIGHT, mask->height);
+	if (mask->color.bits_per_component == 8) return mask->data[(u64)my * mask->width + mx];
+
+	const u8 *row = mask->data + (u64)my * ((mask->width + 1) / 2);
+	u8 sample = (u8)(mx % 2 == 0 ? row[mx / 2] >> 4 : row[mx / 2] & 0x0f);
+	return (u8)(255 - sample * 17);
+}
+
+/// CHECKS ///
+
+local bool same_pixel(const u8 *pixel, u8 r, u8 g, u8 b, u8 a) {
+	return pixel[0] == r && pixel[1] == g && pixel[2] == b && pixel[3] == a;
+}
+
+local void check_resampled_mask(u32 mask_width, u32 mask_height, u32 bpc) {
+	ImageSamples image = rgb_image();
+	u64 mask_stride = ((u64)mask_width * bpc + 7) / 8;
+	SoftMask mask = {
+		.samples = {
+			.data = random_samples(mask_stride * mask_height),
+			.width = mask_width,
+			.height = mask_height,
+			.color = { .space = COLOR_SPACE_GRAY, .bits_per_component = bpc },
+		},
+	};
+	if (bpc == 4) {
+		mask.samples.color.has_decode = true;
+		mask.samples.color.decode[0] = 1.0f;
+		mask.samples.color.decode[1] = 0.0f;
+	}
+
+	RawImage out = image_assemble(&image, &mask, (ImageTarget){ 0 });
+	CHECK(out.width == WIDTH && out.height == HEIGHT && out.format == PIXEL_FORMAT_RGBA);
+
+	bool same = true;
+	for (u32 y = 0; y < HEIGHT && same; y++) {
+		for (u32 x = 0; x < WIDTH && same; x++) {
+			const u8 *rgb = image.data + ((u64)y * WIDTH + x) * 3;
+			u8 a = mask_alpha_ref(&mask.samples, x, y);
+			same = same_pixel(out.data + ((u64)y * WIDTH + x) * 4,
+				div255_ref(rgb[0] * a), div255_ref(rgb[1] * a), div255_ref(rgb[2] * a), a);
+		}
+	}
+	if (!same) {
+		fprintf(stderr, "%ux%u %u bit mask of a %ux%u image differs from the reference\n", mask_width, mask_height, bpc, WIDTH, HEIGHT);
+		failures += 1;
+	}
+
+	buffer_pool_release(out.data);
+	mem_free((u8 *)mask.samples.data);
+	mem_free((u8 *)image.data);
+}
+
+// the mask is object 1 of a document, with the /Matte in its stream dictionary
+local void check_matte(u32 mask_width, u32 mask_height, PDFObject *matte, usize n_matte) {
+	u8 *mask_data = random_samples((u64)mask_width * mask_height);
+	DictionaryEntry mask_entries[] = {
+		int_entry("Width", mask_width),
+		int_entry("Height", mask_height),
+		name_entry("ColorSpace", "DeviceGray"),
+		int_entry("BitsPerComponent", 8),
+		array_entry("Matte", matte, n_matte),
+	};
+	PDFObject mask_stream = obj_from_decoded_stream((DecodedStream){
+		.kind = STREAM_DATA_BUFFER,
+		.data.buffer = { .data = mask_data, .size = (u64)mask_width * mask_height },
+		.raw_stream.dict = { mask_entries, COUNT_OF(mask_entries) },
+	});
+	PDF pdf = { .xref_table = { .obj_count = 1 }, .object_buffer = &mask_stream };
+
+	DictionaryEntry image_entries[] = {
+		{ name_of("SMask"), obj_from_reference((Reference){ .object_num = 1 }) },
+	};
+	Dictionary image_dict = { image_entries, COUNT_OF(image_entries) };
+	SoftMask mask;
+	CHECK(soft_mask_from_dict(&pdf, &image_dict, &mask));
+	CHECK(mask.ref.object_num == 1 && mask.n_matte == n_matte);
+	CHECK(mask.samples.width == mask_width && mask.samples.height == mask_height);
+
+	ImageSamples image = rgb_image();
+	RawImage out = image_assemble(&image, &mask, (ImageTarget){ 0 });
+
+	// a /Matte needs a value per component of the image, otherwise the colors are only premultiplied
+	u8 m[3] = { 0 };
+	for (u32 c = 0; c < 3 && n_matte == 3; c++) {
+		f32 value = 0.0f;
+		(void)object_number(&matte[c], &value);
+		m[c] = (u8)CLAMP(lrintf(255.0f * value), 255, 0);
+	}
+
+	bool same = true;
+	for (u32 y = 0; y < HEIGHT && same; y++) {
+		for (u32 x = 0; x < WIDTH && same; x++) {
+			const u8 *rgb = image.data + ((u64)y * WIDTH + x) * 3;
+			u8 a = mask_alpha_ref(&mask.samples, x, y);
+			u8 expected[3];
+			for (u32 c = 0; c < 3; c++) {
+				// c' = m + a * (c - m) is unblended into a * c
+				i32 value = n_matte == 3 ? (i32)rgb[c] - div255_ref(m[c] * (255u - a)) : div255_ref(rgb[c] * a);
+				expected[c] = (u8)CLAMP(value, (i32)a, 0);
+			}
+			same = same_pixel(out.data + ((u64)y * WIDTH + x) * 4, expected[0], expected[1], expected[2], a);
+		}
+	}
+	if (!same) {
+		fprintf(stderr, "%ux%u mask with %zu /Matte values differs from the reference\n", mask_width, mask_height, n_matte);
+		failures += 1;
+	}
+
+	buffer_pool_release(out.data);
+	mem_free((u8 *)image.data);
+	mem_free(mask_data);
+}
+
+// a DCTDecode stream of a CMYK jpeg. Adobe jpegs store the inks inverted, which flips the /Decode of the
+// image dictionary as well
+local void check_adobe_cmyk(Dictionary dict, bool inverted, bool ink_inverted) {
+	u32 width = 37, height = 9;
+	RawImage jpeg = {
+		.data = random_samples((u64)width * height * 4),
+		.width = width,
+		.height = height,
+		.n_channels = 4,
+		.format = PIXEL_FORMAT_CMYK,
+		.inverted = inverted,
+	};
+	DecodedStream stream = {
+		.kind = STREAM_DATA_IMAGE,
+		.data.image = jpeg,
+		.raw_stream.dict = dict,
+	};
+
+	ImageSamples samples;
+	CHECK(image_samples_from_stream(NULL, &stream, &samples));
+	CHECK(samples.color.space == COLOR_SPACE_CMYK && samples.color.bits_per_component == 8);
+	CHECK(samples.width == width && samples.height == height && samples.data == jpeg.data);
+
+	RawImage out = image_assemble(&samples, NULL, (ImageTarget){ 0 });
+	bool same = out.width == width && out.height == height;
+	for (u64 i = 0; i < (u64)width * height && same; i++) {
+		u8 ink[4];
+		for (u32 c = 0; c < 4; c++) ink[c] = ink_inverted ? (u8)(255 - jpeg.data[4 * i + c]) : jpeg.data[4 * i + c];
+		u32 white = 255u - ink[3];
+		same = same_pixel(out.data + 4 * i, div255_ref((255u - ink[0]) * white), div255_ref((255u - ink[1]) * white),
+			div255_ref((255u - ink[2]) * white), 255);
+	}
+	if (!same) {
+		fprintf(stderr, "%s CMYK jpeg with %llu dictionary entries differs from the reference\n",
+			inverted ? "inverted" : "plain", (unsigned long long)dict.count);
+		failures += 1;
+	}
+
+	buffer_pool_release(out.data);
+	mem_free(jpeg.data);
+}
+
+local void check_adobe_cmyks(void) {
+	PDFObject flipped[8];
+	for (u32 i = 0; i < 8; i++) flipped[i] = obj_from_integer((Integer){ i % 2 == 0 ? 1 : 0 });
+	DictionaryEntry decode_entries[] = {
+		name_entry("ColorSpace", "DeviceCMYK"),
+		array_entry("Decode", flipped, 8),
+	};
+	DictionaryEntry rgb_entries[] = {
+		name_entry("ColorSpace", "DeviceRGB"),
+	};
+	Dictionary none = { 0 };
+	Dictionary decode = { decode_entries, COUNT_OF(decode_entries) };
+	Dictionary contradicting = { rgb_entries, COUNT_OF(rgb_entries) };
+
+	check_adobe_cmyk(none, false, false);
+	check_adobe_cmyk(none, true, true);
+	// the /Decode [1 0 ...] and the inversion cancel out
+	check_adobe_cmyk(decode, true, false);
+	check_adobe_cmyk(decode, false, true);
+	// the color space of the jpeg wins, its inversion still applies
+	check_adobe_cmyk(contradicting, true, true);
+}
+
+int main(void) {
+	threads_set_count(4);
+
+	// same size, smaller, larger, and scaled in one direction only
+	static const u32 mask_sizes[][2] = {
+		{ WIDTH, HEIGHT }, { 97, 41 }, { 640, 333 }, { WIDTH, 19 }, { 5, HEIGHT }, { 1, 1 },
+	};
+	for (u32 i = 0; i < COUNT_OF(mask_sizes); i++) {
+		check_resampled_mask(mask_sizes[i][0], mask_sizes[i][1], 8);
+		check_resampled_mask(mask_sizes[i][0], mask_sizes[i][1], 4);
+	}
+
+	PDFObject matte[3] = {
+		obj_from_real_number((RealNumber){ 0.5 }),
+		obj_from_real_number((RealNumber){ 0.25 }),
+		obj_from_integer((Integer){ 1 }),
+	};
+	check_matte(WIDTH, HEIGHT, matte, 3);
+	check_matte(120, 77, matte, 3);
+	check_matte(WIDTH, HEIGHT, matte, 1);
+
+	check_adobe_cmyks();
+
+	threads_shutdown();
+	threads_set_count(0);
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
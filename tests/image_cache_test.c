@@ -0,0 +1,211 @@
+#include "src/image_cache.h"
+#include "src/memory.h"
+#include "src/buffer_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the image cache with a decoder that counts its calls: hits, eviction of the least recently released
+// entries, referenced entries surviving any budget, and decoders that give no image
+
+local u32 failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1; \
+    } \
+} while (0)
+
+/// INPUT ///
+
+#define IMAGE_SIZE 16
+#define IMAGE_BYTES (IMAGE_SIZE * IMAGE_SIZE * 4)
+
+typedef struct CountingDecoder {
+	u32 n_calls;
+	bool fail;
+} CountingDecoder;
+
+// an RGBA image filled with its object number
+local RawImage decode_counting(void *user_data, const ImageKey *key) {
+	CountingDecoder *decoder = user_data;
+	decoder->n_calls += 1;
+	if (decoder->fail) return (RawImage){ 0 };
+
+	RawImage image = {
+		.width = IMAGE_SIZE,
+		.height = IMAGE_SIZE,
+		.n_channels = 4,
+		.format = PIXEL_FORMAT_RGBA,
+	};
+	image.data = buffer_pool_acquire(IMAGE_BYTES);
+	memset(image.data, (u8)key->ref.object_num, IMAGE_BYTES);
+	return image;
+}
+
+local ImageKey key_of(u64 object_num) {
+	return (ImageKey){
+		.ref = { .object_num = object_num },
+		.pipeline = IMAGE_PIPELINE_XOBJECT,
+		.output = DCT_OUTPUT_RGBA,
+	};
+}
+
+/// CHECKS ///
+
+local bool holds_pixels(const RawImage *image, u64 object_num) {
+	if (!image || !image->data) return false;
+	for (u32 i = 0; i < IMAGE_BYTES; i++) {
+		if (image->data[i] != (u8)object_num) return false;
+	}
+	return true;
+}
+
+// whether the image is cached, without decoding it. released entries are looked up in the eviction order,
+// so checking them does not move them
+local bool is_cached(ImageCache *cache, u64 object_num) {
+	for (ImageCacheEntry *e = cache->lru_first; e; e = e->lru_next) {
+		if (e->key.ref.object_num == object_num) return true;
+	}
+	const RawImage *image = image_cache_acquire(cache, key_of(object_num), (ImageDecoder){ 0 });
+	image_cache_release(cache, image);
+	return image != NULL;
+}
+
+local void check_hits(void) {
+	ImageCache cache;
+	image_cache_init(&cache, 8 * IMAGE_BYTES);
+	CountingDecoder counting = { 0 };
+	ImageDecoder decoder = { decode_counting, &counting };
+
+	const RawImage *a = image_cache_acquire(&cache, key_of(1), decoder);
+	const RawImage *b = image_cache_acquire(&cache, key_of(1), decoder);
+	CHECK(a && a == b && holds_pixels(a, 1));
+	CHECK(counting.n_calls == 1);
+	CHECK(cache.stats.hits == 1 && cache.stats.misses == 1);
+
+	// every part of the key tells entries apart
+	ImageKey scaled = key_of(1);
+	scaled.scale = DCT_SCALE_HALF;
+	ImageKey region = key_of(1);
+	region.region = (ImageRegion){ 0, 0, 8, 8 };
+	ImageKey native = key_of(1);
+	native.output = DCT_OUTPUT_NATIVE;
+	ImageKey masked = key_of(1);
+	masked.mask.object_num = 7;
+	ImageKey dct = key_of(1);
+	dct.pipeline = IMAGE_PIPELINE_DCT;
+	ImageKey keys[] = { scaled, region, native, masked, dct, key_of(2) };
+	for (u32 i = 0; i < COUNT_OF(keys); i++) {
+		const RawImage *other = image_cache_acquire(&cache, keys[i], decoder);
+		CHECK(other && other != a);
+		image_cache_release(&cache, other);
+	}
+	CHECK(counting.n_calls == 1 + COUNT_OF(keys));
+	CHECK(cache.n_entries == 1 + COUNT_OF(keys));
+
+	// released entries under the budget stay cached
+	image_cache_release(&cache, a);
+	image_cache_release(&cache, b);
+	const RawImage *again = image_cache_acquire(&cache, key_of(1), decoder);
+	CHECK(again == a && counting.n_calls == 1 + COUNT_OF(keys));
+	CHECK(cache.stats.hits == 2);
+	image_cache_release(&cache, again);
+
+	// more entries than the first bucket array holds
+	for (u64 i = 100; i < 300; i++) image_cache_release(&cache, image_cache_acquire(&cache, key_of(i), decoder));
+	CHECK(cache.bytes <= cache.budget);
+
+	image_cache_free(&cache);
+}
+
+local void check_eviction(void) {
+	ImageCache cache;
+	image_cache_init(&cache, 2 * IMAGE_BYTES);
+	CountingDecoder counting = { 0 };
+	ImageDecoder decoder = { decode_counting, &counting };
+
+	// referenced images are kept over the budget
+	const RawImage *images[5];
+	for (u64 i = 1; i <= 4; i++) images[i] = image_cache_acquire(&cache, key_of(i), decoder);
+	CHECK(cache.n_entries == 4 && cache.bytes == 4 * IMAGE_BYTES);
+	CHECK(cache.stats.evictions == 0);
+
+	// released while the cache is over the budget, they are freed right away
+	image_cache_release(&cache, images[2]);
+	image_cache_release(&cache, images[4]);
+	CHECK(cache.n_entries == 2 && cache.stats.evictions == 2);
+	CHECK(!is_cached(&cache, 2) && !is_cached(&cache, 4));
+
+	// at the budget, the released images stay. 1 is released after 3
+	image_cache_release(&cache, images[3]);
+	image_cache_release(&cache, images[1]);
+	CHECK(cache.n_entries == 2 && is_cached(&cache, 1) && is_cached(&cache, 3));
+
+	// 3 is the least recently released, a new image evicts it and not 1
+	const RawImage *five = image_cache_acquire(&cache, key_of(5), decoder);
+	CHECK(holds_pixels(five, 5));
+	CHECK(!is_cached(&cache, 3) && is_cached(&cache, 1));
+
+	// acquiring takes an entry out of the eviction order, releasing puts it at the end
+	const RawImage *one = image_cache_acquire(&cache, key_of(1), decoder);
+	CHECK(holds_pixels(one, 1));
+	image_cache_release(&cache, five);
+	image_cache_release(&cache, one);
+	const RawImage *six = image_cache_acquire(&cache, key_of(6), decoder);
+	CHECK(!is_cached(&cache, 5) && is_cached(&cache, 1));
+
+	// a smaller budget only evicts what is not referenced
+	image_cache_set_budget(&cache, 0);
+	CHECK(cache.n_entries == 1 && is_cached(&cache, 6) && holds_pixels(six, 6));
+	image_cache_release(&cache, six);
+	CHECK(cache.n_entries == 0 && cache.bytes == 0);
+
+	// an evicted image is decoded again
+	u32 n_calls = counting.n_calls;
+	image_cache_set_budget(&cache, 4 * IMAGE_BYTES);
+	const RawImage *three = image_cache_acquire(&cache, key_of(3), decoder);
+	CHECK(holds_pixels(three, 3) && counting.n_calls == n_calls + 1);
+	image_cache_release(&cache, three);
+
+	image_cache_trim(&cache);
+	CHECK(cache.n_entries == 0);
+	image_cache_free(&cache);
+}
+
+local void check_failed_decode(void) {
+	ImageCache cache;
+	image_cache_init(&cache, 8 * IMAGE_BYTES);
+	CountingDecoder counting = { .fail = true };
+	ImageDecoder decoder = { decode_counting, &counting };
+
+	CHECK(image_cache_acquire(&cache, key_of(1), decoder) == NULL);
+	CHECK(cache.n_entries == 0 && cache.bytes == 0);
+	// nothing was cached, so the decoder is asked again
+	CHECK(image_cache_acquire(&cache, key_of(1), decoder) == NULL);
+	CHECK(counting.n_calls == 2);
+
+	counting.fail = false;
+	const RawImage *image = image_cache_acquire(&cache, key_of(1), decoder);
+	CHECK(holds_pixels(image, 1));
+	image_cache_release(&cache, image);
+
+	// without a decoder only cached images are returned
+	CHECK(image_cache_acquire(&cache, key_of(2), (ImageDecoder){ 0 }) == NULL);
+	CHECK(counting.n_calls == 3);
+
+	image_cache_free(&cache);
+}
+
+int main(void) {
+	check_hits();
+	check_eviction();
+	check_failed_decode();
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
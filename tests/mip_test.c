@@ -0,0 +1,167 @@
+#include "src/mip.h"
+#include "src/memory.h"
+#include "src/buffer_pool.h"
+#include "src/threads.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// every level of a mip chain against a reference 2x2 box filter, on 1, 3 and 4 channels and on odd sizes
+// that leave a last row or column, images 1 pixel wide or high, and levels large enough to be reduced in bands
+
+local u32 failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1; \
+    } \
+} while (0)
+
+/// INPUT ///
+
+local u64 rng_state = 0x9e3779b97f4a7c15ull;
+
+local u32 rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (u32)(rng_state >> 32);
+}
+
+local RawImage make_image(u32 width, u32 height, u32 n_channels) {
+	RawImage image = {
+		.width = width,
+		.height = height,
+		.n_channels = (u8)n_channels,
+		.format = n_channels == 1 ? PIXEL_FORMAT_GRAY : n_channels == 3 ? PIXEL_FORMAT_RGB : PIXEL_FORMAT_RGBA,
+	};
+	u64 size = (u64)width * height * n_channels;
+	image.data = buffer_pool_acquire(size);
+	for (u64 i = 0; i < size; i++) image.data[i] = (u8)rng_next();
+	return image;
+}
+
+// the rounded average of a 2x2 block, a last row or column of an odd size is dropped and an image
+// 1 pixel wide or high averages the pixels it has twice
+local u8 box_filter(const RawImage *src, u32 x, u32 y, u32 c) {
+	u32 x0 = 2 * x;
+	u32 y0 = 2 * y;
+	u32 x1 = MIN(x0 + 1, src->width - 1);
+	u32 y1 = MIN(y0 + 1, src->height - 1);
+	u32 n = src->n_channels;
+	u32 sum = (u32)src->data[((u64)y0 * src->width + x0) * n + c] + src->data[((u64)y0 * src->width + x1) * n + c]
+		+ src->data[((u64)y1 * src->width + x0) * n + c] + src->data[((u64)y1 * src->width + x1) * n + c];
+	return (u8)((sum + 2) / 4);
+}
+
+/// CHECKS ///
+
+local bool is_reduced(const RawImage *src, const RawImage *dst) {
+	if (dst->width != MAX(src->width / 2, 1) || dst->height != MAX(src->height / 2, 1)) return false;
+	if (dst->n_channels != src->n_channels || dst->format != src->format) return false;
+	for (u32 y = 0; y < dst->height; y++) {
+		for (u32 x = 0; x < dst->width; x++) {
+			for (u32 c = 0; c < dst->n_channels; c++) {
+				if (dst->data[((u64)y * dst->width + x) * dst->n_channels + c] != box_filter(src, x, y, c)) return false;
+			}
+		}
+	}
+	return true;
+}
+
+typedef struct LevelOrder {
+	u32 n_levels;
+	u32 next; // index the next level has to have
+} LevelOrder;
+
+local bool check_level_order(void *user_data, const RawImage *level, u32 index) {
+	(void)level;
+	LevelOrder *order = user_data;
+	CHECK(index == order->next);
+	order->next -= 1;
+	order->n_levels += 1;
+	return true;
+}
+
+local void check_chain(u32 width, u32 height, u32 n_channels) {
+	RawImage image = make_image(width, height, n_channels);
+
+	LevelOrder order = { .next = mip_level_count(width, height) - 1 };
+	MipChain chain = mip_chain_build(&image, MIP_MAX_LEVELS, (ImageTarget){ 0 }, (MipSink){ check_level_order, &order });
+	CHECK(chain.n_levels == mip_level_count(width, height) && order.n_levels == chain.n_levels);
+	CHECK(chain.levels[0].data == image.data);
+	CHECK(chain.levels[chain.n_levels - 1].width == 1 && chain.levels[chain.n_levels - 1].height == 1);
+
+	for (u32 i = 1; i < chain.n_levels; i++) {
+		if (!is_reduced(&chain.levels[i - 1], &chain.levels[i])) {
+			fprintf(stderr, "level %u of %ux%u with %u channels differs from the box filter\n", i, width, height, n_channels);
+			failures += 1;
+		}
+	}
+
+	mip_chain_free(&chain);
+	buffer_pool_release(image.data);
+}
+
+// target with room for a single level, the others come from the buffer pool
+typedef struct OneLevelTarget {
+	u8 *data;
+	u64 size;
+	u32 n_calls;
+} OneLevelTarget;
+
+local u8 *one_level_alloc(void *user_data, const RawImage *layout, u64 size) {
+	(void)layout;
+	OneLevelTarget *target = user_data;
+	target->n_calls += 1;
+	if (target->n_calls != 2 || size > target->size) return NULL;
+	return target->data;
+}
+
+local void check_full_target(void) {
+	RawImage image = make_image(45, 31, 4);
+	u8 storage[11 * 7 * 4];
+	OneLevelTarget one = { .data = storage, .size = sizeof(storage) };
+
+	MipChain chain = mip_chain_build(&image, 4, (ImageTarget){ one_level_alloc, &one }, (MipSink){ 0 });
+	CHECK(chain.n_levels == 4 && one.n_calls == 3);
+	// level 2 is the one in the target, only 1 and 3 are released
+	CHECK(chain.levels[2].data == storage && chain.pooled == ((1u << 1) | (1u << 3)));
+	for (u32 i = 1; i < chain.n_levels; i++) CHECK(is_reduced(&chain.levels[i - 1], &chain.levels[i]));
+
+	mip_chain_free(&chain);
+	buffer_pool_release(image.data);
+}
+
+int main(void) {
+	// a single thread would reduce the large levels serially
+	threads_set_count(4);
+
+	CHECK(mip_level_count(1, 1) == 1);
+	CHECK(mip_level_count(2, 1) == 2);
+	CHECK(mip_level_count(1000, 3) == 10);
+	CHECK(mip_level_size(7, 2) == 1 && mip_level_size(7, 40) == 1 && mip_level_size(1024, 3) == 128);
+
+	static const u32 sizes[][2] = {
+		{ 1, 1 }, { 2, 2 }, { 1, 9 }, { 13, 1 }, { 3, 3 }, { 33, 17 },
+		{ 67, 130 }, { 301, 203 },
+		{ 733, 389 }, // the first level is reduced in bands
+	};
+	static const u32 channels[] = { 1, 3, 4 };
+	for (u32 c = 0; c < COUNT_OF(channels); c++) {
+		for (u32 s = 0; s < COUNT_OF(sizes); s++) {
+			check_chain(sizes[s][0], sizes[s][1], channels[c]);
+		}
+	}
+	check_full_target();
+
+	threads_shutdown();
+	threads_set_count(0);
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,240 @@
+#include "src/predictor.h"
+#include "src/memory.h"
+#include "src/buffer_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the streaming predictor against a plain encoder, for every PNG row filter and TIFF predictor 2,
+// on all /Colors and /BitsPerComponent combinations and fed in chunks that split rows anywhere
+
+local u32 failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1; \
+    } \
+} while (0)
+
+/// INPUT ///
+
+local u64 rng_state = 0x9e3779b97f4a7c15ull;
+
+local u32 rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (u32)(rng_state >> 32);
+}
+
+// smooth gradients with some noise, so Avg and Paeth pick from all three neighbours
+local void fill_image(u8 *data, u32 row_len, u32 rows) {
+	for (u32 y = 0; y < rows; y++) {
+		for (u32 x = 0; x < row_len; x++) {
+			u32 noise = rng_next() % 8 == 0 ? rng_next() : 0;
+			data[(u64)y * row_len + x] = (u8)(x * 3 + y * 5 + noise);
+		}
+	}
+}
+
+local u8 paeth_predictor(u8 a, u8 b, u8 c) {
+	i32 p = (i32)a + b - c;
+	i32 pa = p > a ? p - a : a - p;
+	i32 pb = p > b ? p - b : b - p;
+	i32 pc = p > c ? p - c : c - p;
+	if (pa <= pb && pa <= pc) return a;
+	if (pb <= pc) return b;
+	return c;
+}
+
+// PNG encoder, filter -1 picks a random filter for every row. the caller frees the result with mem_free
+local u8 *png_encode(const u8 *data, u32 row_len, u32 rows, u32 bpp, i32 filter, u64 *out_len) {
+	*out_len = (u64)(row_len + 1) * rows;
+	u8 *out = mem_alloc(MEM_TAG_DECODE, *out_len);
+	u8 *zero = mem_alloc(MEM_TAG_DECODE, row_len);
+	memset(zero, 0, row_len);
+
+	for (u32 y = 0; y < rows; y++) {
+		const u8 *row = data + (u64)y * row_len;
+		const u8 *prev = y == 0 ? zero : row - row_len;
+		u8 *enc = out + (u64)y * (row_len + 1);
+		u32 f = filter < 0 ? rng_next() % 5 : (u32)filter;
+		enc[0] = (u8)f;
+		for (u32 x = 0; x < row_len; x++) {
+			u8 a = x >= bpp ? row[x - bpp] : 0;
+			u8 b = prev[x];
+			u8 c = x >= bpp ? prev[x - bpp] : 0;
+			u8 predicted = 0;
+			switch (f) {
+			case PNG_FILTER_SUB: predicted = a; break;
+			case PNG_FILTER_UP: predicted = b; break;
+			case PNG_FILTER_AVG: predicted = (u8)(((u32)a + b) >> 1); break;
+			case PNG_FILTER_PAETH: predicted = paeth_predictor(a, b, c); break;
+			}
+			enc[1 + x] = (u8)(row[x] - predicted);
+		}
+	}
+
+	mem_free(zero);
+	return out;
+}
+
+local u32 get_sample(const u8 *row, u64 index, u32 bpc) {
+	u64 bit = index * bpc;
+	u32 shift = 8 - bpc - (u32)(bit & 7);
+	return (row[bit >> 3] >> shift) & ((1u << bpc) - 1);
+}
+
+local void set_sample(u8 *row, u64 index, u32 bpc, u32 value) {
+	u64 bit = index * bpc;
+	u32 shift = 8 - bpc - (u32)(bit & 7);
+	u32 mask = ((1u << bpc) - 1) << shift;
+	row[bit >> 3] = (u8)((row[bit >> 3] & ~mask) | ((value << shift) & mask));
+}
+
+// TIFF predictor 2 encoder, every sample minus the same component of the pixel before it.
+// the padding bits at the end of a row are samples too, like the decoder sees them
+local u8 *tiff_encode(const u8 *data, u32 row_len, u32 rows, u32 colors, u32 bpc, u64 *out_len) {
+	*out_len = (u64)row_len * rows;
+	u8 *out = mem_alloc(MEM_TAG_DECODE, *out_len);
+	memcpy(out, data, *out_len);
+
+	for (u32 y = 0; y < rows; y++) {
+		const u8 *row = data + (u64)y * row_len;
+		u8 *enc = out + (u64)y * row_len;
+		if (bpc == 16) {
+			for (u32 i = 2 * colors; i + 1 < row_len; i += 2) {
+				u32 value = (u32)row[i] << 8 | row[i + 1];
+				u32 left = (u32)row[i - 2 * colors] << 8 | row[i - 2 * colors + 1];
+				enc[i] = (u8)((value - left) >> 8);
+				enc[i + 1] = (u8)(value - left);
+			}
+			continue;
+		}
+		u64 n_samples = (u64)row_len * 8 / bpc;
+		for (u64 s = colors; s < n_samples; s++) {
+			set_sample(enc, s, bpc, get_sample(row, s, bpc) - get_sample(row, s - colors, bpc));
+		}
+	}
+
+	return out;
+}
+
+/// CHECKS ///
+
+typedef struct Collect {
+	u8 *data;
+	u64 len;
+	u64 cap;
+} Collect;
+
+local bool collect_write(void *user_data, const u8 *data, u64 len) {
+	Collect *c = user_data;
+	if (c->len + len > c->cap) return false;
+	memcpy(c->data + c->len, data, len);
+	c->len += len;
+	return true;
+}
+
+// encoded data fed to the predictor in random chunks has to give back data, exactly
+local void check_decode(const char *name, PredictorParams params, const u8 *data, u64 len, const u8 *encoded, u64 encoded_len) {
+	Collect collect = { .data = mem_alloc(MEM_TAG_DECODE, len), .cap = len };
+	Predictor p;
+	predictor_init(&p, params, (DecodeSink){ .fn = collect_write, .user_data = &collect });
+	DecodeSink sink = predictor_sink(&p);
+
+	bool ok = true;
+	for (u64 at = 0; at < encoded_len && ok;) {
+		// mostly short chunks that end inside a row, sometimes several rows at once
+		u64 n = rng_next() % 4 == 0 ? 1 + rng_next() % (4 * p.row_len + 4) : 1 + rng_next() % 7;
+		n = MIN(n, encoded_len - at);
+		ok = sink.fn(sink.user_data, encoded + at, n);
+		at += n;
+	}
+	CHECK(ok);
+	CHECK(predictor_finish(&p));
+
+	if (collect.len != len || memcmp(collect.data, data, len) != 0) {
+		fprintf(stderr, "%s: predictor %u, colors %u, bpc %u, columns %u\n", name,
+			params.predictor, params.colors, params.bits_per_component, params.columns);
+		failures += 1;
+	}
+
+	predictor_free(&p);
+	mem_free(collect.data);
+}
+
+local void check_params(u32 colors, u32 bpc, u32 columns, u32 rows) {
+	PredictorParams params = {
+		.colors = colors,
+		.bits_per_component = bpc,
+		.columns = columns,
+	};
+	u32 row_len = (u32)(((u64)columns * colors * bpc + 7) / 8);
+	u32 bpp = (colors * bpc + 7) / 8;
+	u64 len = (u64)row_len * rows;
+	u8 *data = mem_alloc(MEM_TAG_DECODE, len);
+	fill_image(data, row_len, rows);
+
+	u64 encoded_len = 0;
+	u8 *encoded = NULL;
+
+	// every filter on its own and mixed per row. the PNG predictor value does not select the filter
+	for (i32 filter = -1; filter <= PNG_FILTER_PAETH; filter++) {
+		params.predictor = PREDICTOR_PNG + (u32)(filter + 1);
+		encoded = png_encode(data, row_len, rows, bpp, filter, &encoded_len);
+		check_decode(filter < 0 ? "PNG mixed" : png_filter_to_str((enum PNGFilter)filter), params, data, len, encoded, encoded_len);
+		mem_free(encoded);
+	}
+
+	params.predictor = PREDICTOR_TIFF;
+	encoded = tiff_encode(data, row_len, rows, colors, bpc, &encoded_len);
+	check_decode("TIFF", params, data, len, encoded, encoded_len);
+	mem_free(encoded);
+
+	params.predictor = PREDICTOR_NONE;
+	check_decode("None", params, data, len, data, len);
+
+	mem_free(data);
+}
+
+// a last row that is cut short is passed on as far as it goes
+local void check_truncated(void) {
+	PredictorParams params = { .predictor = PREDICTOR_PNG, .colors = 3, .bits_per_component = 8, .columns = 33 };
+	u32 row_len = 99;
+	u8 data[99 * 4];
+	fill_image(data, row_len, 4);
+
+	u64 encoded_len = 0;
+	u8 *encoded = png_encode(data, row_len, 4, 3, PNG_FILTER_PAETH, &encoded_len);
+	u64 cut = 3 * (row_len + 1) + 1 + 40;
+	check_decode("PNG truncated", params, data, 3 * row_len + 40, encoded, cut);
+	mem_free(encoded);
+
+	params.predictor = PREDICTOR_TIFF;
+	encoded = tiff_encode(data, row_len, 4, 3, 8, &encoded_len);
+	check_decode("TIFF truncated", params, data, 3 * row_len + 40, encoded, 3 * row_len + 40);
+	mem_free(encoded);
+}
+
+int main(void) {
+	static const u32 bpcs[] = { 1, 2, 4, 8, 16 };
+
+	for (u32 colors = 1; colors <= 4; colors++) {
+		for (u32 b = 0; b < COUNT_OF(bpcs); b++) {
+			// widths around the SIMD block sizes, and one that leaves padding bits
+			check_params(colors, bpcs[b], 1, 5);
+			check_params(colors, bpcs[b], 7, 9);
+			check_params(colors, bpcs[b], 64, 17);
+			check_params(colors, bpcs[b], 301, 23);
+		}
+	}
+	check_truncated();
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
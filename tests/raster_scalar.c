@@ -0,0 +1,13 @@
+// raster.c built with PTRAIL_NO_SIMD, every function renamed with a _scalar suffix. raster_test checks
+// the SIMD coverage and compositing against it
+
+#define PTRAIL_NO_SIMD
+
+#define raster_page_tile raster_page_tile_scalar
+#define rasterizer_fill rasterizer_fill_scalar
+#define rasterizer_free rasterizer_free_scalar
+#define rasterizer_init rasterizer_init_scalar
+#define rasterizer_line rasterizer_line_scalar
+#define rasterizer_path rasterizer_path_scalar
+
+#include "src/raster.c"
@@ -0,0 +1,222 @@
+#include "src/raster.h"
+#include "src/memory.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ext/stb_ds.h>
+
+// the fill rules on overlapping paths, exact coverage of whole and half pixels, and the SIMD build of
+// raster.c against the scalar one (raster_scalar.c) on random paths, tile sizes and colors
+
+local u32 failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1; \
+    } \
+} while (0)
+
+// raster.c built with PTRAIL_NO_SIMD
+void raster_page_tile_scalar(const PagePaths *paths, f32 page_height, f32 scale, u32 x, u32 y, u32 width, u32 height, u8 *rgba);
+
+/// INPUT ///
+
+local u64 rng_state = 0x9e3779b97f4a7c15ull;
+
+local u32 rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (u32)(rng_state >> 32);
+}
+
+local const u8 BLACK[4] = { 0, 0, 0, 255 };
+
+// a clockwise rectangle, or a counterclockwise one
+local void add_rect(Rasterizer *r, f32 x0, f32 y0, f32 x1, f32 y1, bool clockwise) {
+	f32 xs[4] = { x0, x1, x1, x0 };
+	f32 ys[4] = { y0, y0, y1, y1 };
+	for (u32 i = 0; i < 4; i++) {
+		u32 a = clockwise ? i : 3 - i;
+		u32 b = clockwise ? (i + 1) % 4 : (6 - i) % 4;
+		rasterizer_line(r, xs[a], ys[a], xs[b], ys[b]);
+	}
+}
+
+// white pixels of a width x height image
+local u8 *white_image(u32 width, u32 height) {
+	u8 *rgba = mem_alloc(MEM_TAG_DECODE, (u64)width * height * 4);
+	memset(rgba, 255, (u64)width * height * 4);
+	return rgba;
+}
+
+local const u8 *pixel_at(const u8 *rgba, u32 width, u32 x, u32 y) {
+	return rgba + ((u64)y * width + x) * 4;
+}
+
+local bool is_gray(const u8 *pixel, u8 value) {
+	return pixel[0] == value && pixel[1] == value && pixel[2] == value && pixel[3] == 255;
+}
+
+/// CHECKS ///
+
+// two squares that overlap in [30, 50), the overlap has a winding of 2 or 0
+local void check_fill_rules(void) {
+	u32 size = 80;
+	for (u32 same_direction = 0; same_direction < 2; same_direction++) {
+		for (u32 rule = FILL_RULE_NONZERO; rule <= FILL_RULE_EVEN_ODD; rule++) {
+			Rasterizer r;
+			rasterizer_init(&r, size, size);
+			u8 *rgba = white_image(size, size);
+			add_rect(&r, 10.0f, 10.0f, 50.0f, 50.0f, true);
+			add_rect(&r, 30.0f, 30.0f, 70.0f, 70.0f, same_direction);
+			rasterizer_fill(&r, rule, BLACK, rgba, size * 4);
+
+			// a winding of 2 is inside for nonzero only, 0 is outside for both
+			bool overlap_filled = same_direction && rule == FILL_RULE_NONZERO;
+			CHECK(is_gray(pixel_at(rgba, size, 20, 20), 0));
+			CHECK(is_gray(pixel_at(rgba, size, 60, 60), 0));
+			CHECK(is_gray(pixel_at(rgba, size, 40, 40), overlap_filled ? 0 : 255));
+			CHECK(is_gray(pixel_at(rgba, size, 30, 30), overlap_filled ? 0 : 255));
+			CHECK(is_gray(pixel_at(rgba, size, 29, 30), 0));
+			CHECK(is_gray(pixel_at(rgba, size, 75, 40), 255));
+			CHECK(is_gray(pixel_at(rgba, size, 5, 5), 255));
+
+			mem_free(rgba);
+			rasterizer_free(&r);
+		}
+	}
+
+	// a pentagram through the content stream parser, its center is wound twice
+	static const char star[] = "0 g 50 95 m 76 15 l 8 65 l 92 65 l 24 15 l h f\n0 g 50 95 m 76 15 l 8 65 l 92 65 l 24 15 l h f*\n";
+	PagePaths paths = { 0 };
+	CHECK(content_paths_parse((const u8 *)star, sizeof(star) - 1, &paths));
+	CHECK(arrlen(paths.paths) == 2);
+	for (u32 i = 0; i < 2 && i < (u32)arrlen(paths.paths); i++) {
+		Rasterizer r;
+		rasterizer_init(&r, 100, 100);
+		u8 *rgba = white_image(100, 100);
+		rasterizer_path(&r, &paths, &paths.paths[i], (Matrix){ 1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 100.0f });
+		rasterizer_fill(&r, paths.paths[i].rule, paths.paths[i].color, rgba, 100 * 4);
+		// the center, and a point in the top arm
+		CHECK(is_gray(pixel_at(rgba, 100, 50, 50), i == 0 ? 0 : 255));
+		CHECK(is_gray(pixel_at(rgba, 100, 50, 15), 0));
+		CHECK(is_gray(pixel_at(rgba, 100, 3, 3), 255));
+		mem_free(rgba);
+		rasterizer_free(&r);
+	}
+	page_paths_free(&paths);
+}
+
+// pixels inside a path with whole pixel edges are fully covered, the ones outside not at all
+local void check_coverage(void) {
+	u32 size = 40;
+	Rasterizer r;
+	rasterizer_init(&r, size, size);
+	u8 *rgba = white_image(size, size);
+
+	add_rect(&r, 4.0f, 4.0f, 12.0f, 12.0f, true);
+	// the right half of column 20, rows 4 and 5
+	add_rect(&r, 20.5f, 4.0f, 24.0f, 6.0f, true);
+	// reaching past the right side, the rows fill up to the last column
+	add_rect(&r, 30.0f, 20.0f, 100.0f, 22.0f, true);
+	rasterizer_fill(&r, FILL_RULE_NONZERO, BLACK, rgba, size * 4);
+
+	bool exact = true;
+	for (u32 y = 0; y < size; y++) {
+		for (u32 x = 0; x < size; x++) {
+			bool inside = (x >= 4 && x < 12 && y >= 4 && y < 12) || (x >= 21 && x < 24 && y >= 4 && y < 6)
+				|| (x >= 30 && y >= 20 && y < 22);
+			bool half = x == 20 && y >= 4 && y < 6;
+			// half of 255 rounds to an alpha of 128, white under it is 255 * 127 / 255
+			u8 expected = inside ? 0 : half ? 127 : 255;
+			if (!is_gray(pixel_at(rgba, size, x, y), expected)) exact = false;
+		}
+	}
+	CHECK(exact);
+
+	// the cells are all zero after a fill, the next one starts from nothing
+	memset(rgba, 255, (u64)size * size * 4);
+	add_rect(&r, 0.0f, 0.0f, 1.0f, 1.0f, true);
+	rasterizer_fill(&r, FILL_RULE_EVEN_ODD, BLACK, rgba, size * 4);
+	CHECK(is_gray(pixel_at(rgba, size, 0, 0), 0));
+	CHECK(is_gray(pixel_at(rgba, size, 1, 0), 255) && is_gray(pixel_at(rgba, size, 5, 5), 255));
+
+	mem_free(rgba);
+	rasterizer_free(&r);
+}
+
+// random polygons and curves, partly off the tile, in colors with and without alpha
+local void random_paths(PagePaths *paths, f32 extent) {
+	for (u32 p = 0; p < 12; p++) {
+		FilledPath path = {
+			.first_verb = (u32)arrlen(paths->verbs),
+			.first_point = (u32)arrlen(paths->points),
+			.rule = rng_next() % 2 ? FILL_RULE_EVEN_ODD : FILL_RULE_NONZERO,
+		};
+		u8 alpha = rng_next() % 3 == 0 ? 255 : (u8)rng_next();
+		for (u32 c = 0; c < 3; c++) path.color[c] = (u8)(rng_next() % (alpha + 1u));
+		path.color[3] = alpha;
+
+		u32 n = 3 + rng_next() % 6;
+		for (u32 i = 0; i < n; i++) {
+			enum PathVerb verb = i == 0 ? PATH_MOVE : rng_next() % 4 == 0 ? PATH_CUBIC : PATH_LINE;
+			u32 n_points = verb == PATH_CUBIC ? 3 : 1;
+			arrput(paths->verbs, (u8)verb);
+			for (u32 k = 0; k < n_points; k++) {
+				PathPoint point = {
+					(f32)(rng_next() % 10000) / 10000.0f * extent * 1.4f - extent * 0.2f,
+					(f32)(rng_next() % 10000) / 10000.0f * extent * 1.4f - extent * 0.2f,
+				};
+				arrput(paths->points, point);
+			}
+		}
+		arrput(paths->verbs, (u8)PATH_CLOSE);
+		path.n_verbs = (u32)arrlen(paths->verbs) - path.first_verb;
+		path.n_points = (u32)arrlen(paths->points) - path.first_point;
+		arrput(paths->paths, path);
+	}
+}
+
+local void check_simd(void) {
+	// widths around the SIMD blocks, a full tile and tiles of one pixel
+	static const u32 sizes[][2] = {
+		{ 1, 1 }, { 3, 17 }, { 16, 16 }, { 17, 5 }, { 33, 40 }, { 100, 61 }, { 256, 256 }, { 255, 1 },
+	};
+
+	for (u32 round = 0; round < 8; round++) {
+		for (u32 s = 0; s < COUNT_OF(sizes); s++) {
+			u32 width = sizes[s][0], height = sizes[s][1];
+			PagePaths paths = { 0 };
+			random_paths(&paths, (f32)MAX(width, height) / 2.0f);
+
+			u64 size = (u64)width * height * 4;
+			u8 *simd = mem_alloc(MEM_TAG_DECODE, size);
+			u8 *scalar = mem_alloc(MEM_TAG_DECODE, size);
+			// the tile at 2 pixels per point, shifted off the page origin
+			raster_page_tile(&paths, (f32)height, 2.0f, 3, 5, width, height, simd);
+			raster_page_tile_scalar(&paths, (f32)height, 2.0f, 3, 5, width, height, scalar);
+			if (memcmp(simd, scalar, size) != 0) {
+				fprintf(stderr, "%ux%u tile of round %u differs from the scalar render\n", width, height, round);
+				failures += 1;
+			}
+
+			mem_free(scalar);
+			mem_free(simd);
+			page_paths_free(&paths);
+		}
+	}
+}
+
+int main(void) {
+	check_fill_rules();
+	check_coverage();
+	check_simd();
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,287 @@
+#include "src/tile_cache.h"
+#include "src/memory.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <ext/stb_ds.h>
+
+// the slot cache: hits, discarded slots, the least recently drawn slot being reused first, slots of this
+// frame and slots waiting for their upload never being reused. the visible tiles of pages turned by each
+// quarter against the tiles of the whole page
+
+local u32 failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1; \
+    } \
+} while (0)
+
+/// INPUT ///
+
+local u64 rng_state = 0x9e3779b97f4a7c15ull;
+
+local u32 rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (u32)(rng_state >> 32);
+}
+
+local TileKey key_of(u32 page) {
+	return (TileKey){ .page = page, .zoom_level = 0 };
+}
+
+// every slot holds a tile used in frame 1, the tile of page i in slot slots[i]
+local void fill_cache(TileCache *cache, u32 *slots) {
+	tile_cache_init(cache);
+	for (u32 i = 0; i < TILE_ATLAS_SLOTS; i++) {
+		bool miss = false;
+		slots[i] = tile_cache_acquire(cache, key_of(i), &miss);
+		CHECK(miss && slots[i] < TILE_ATLAS_SLOTS);
+		cache->slots[slots[i]].state = TEXTURE_STATE_READY;
+	}
+}
+
+/// CACHE ///
+
+local void check_acquire(void) {
+	TileCache cache;
+	tile_cache_init(&cache);
+
+	bool miss = false;
+	u32 slot = tile_cache_acquire(&cache, key_of(1), &miss);
+	CHECK(slot < TILE_ATLAS_SLOTS && miss);
+	CHECK(tile_cache_acquire(&cache, key_of(1), &miss) == slot && !miss);
+
+	// every field of the key tells tiles apart
+	TileKey keys[] = {
+		{ .page = 2 },
+		{ .page = 1, .zoom_level = -1 },
+		{ .page = 1, .x = 1 },
+		{ .page = 1, .y = 1 },
+	};
+	for (u32 i = 0; i < COUNT_OF(keys); i++) {
+		u32 other = tile_cache_acquire(&cache, keys[i], &miss);
+		CHECK(miss && other != slot && other < TILE_ATLAS_SLOTS);
+	}
+	CHECK(cache.stats.hits == 1 && cache.stats.misses == 1 + COUNT_OF(keys) && cache.stats.evictions == 0);
+
+	// a discarded slot is empty and reused first, for any tile
+	tile_cache_discard(&cache, slot);
+	CHECK(!cache.slots[slot].occupied && cache.lru_first == &cache.slots[slot]);
+	CHECK(tile_cache_acquire(&cache, key_of(3), &miss) == slot && miss);
+	CHECK(tile_cache_acquire(&cache, key_of(1), &miss) != slot && miss);
+	CHECK(cache.stats.evictions == 0);
+}
+
+local void check_eviction_order(void) {
+	TileCache cache;
+	u32 slots[TILE_ATLAS_SLOTS];
+	fill_cache(&cache, slots);
+
+	// every slot is drawn in this frame
+	bool miss = false;
+	CHECK(tile_cache_acquire(&cache, key_of(TILE_ATLAS_SLOTS), &miss) == U32_MAX);
+
+	// 0 and 2 are drawn again, 1 becomes the least recently drawn tile
+	tile_cache_next_frame(&cache);
+	CHECK(tile_cache_acquire(&cache, key_of(0), &miss) == slots[0] && !miss);
+	CHECK(tile_cache_acquire(&cache, key_of(2), &miss) == slots[2] && !miss);
+
+	u32 next = TILE_ATLAS_SLOTS;
+	CHECK(tile_cache_acquire(&cache, key_of(next++), &miss) == slots[1] && miss);
+	CHECK(tile_cache_acquire(&cache, key_of(next++), &miss) == slots[3] && miss);
+	CHECK(tile_cache_acquire(&cache, key_of(next++), &miss) == slots[4] && miss);
+	CHECK(cache.stats.evictions == 3);
+
+	// the evicted tile is rendered again, into the next least recently drawn slot
+	CHECK(tile_cache_acquire(&cache, key_of(1), &miss) == slots[5] && miss);
+
+	// the rest of the frame 1 tiles go in order, then the ones of this frame are left
+	for (u32 i = 6; i < TILE_ATLAS_SLOTS; i++) {
+		CHECK(tile_cache_acquire(&cache, key_of(next++), &miss) == slots[i] && miss);
+	}
+	CHECK(tile_cache_acquire(&cache, key_of(next++), &miss) == U32_MAX);
+	CHECK(tile_cache_acquire(&cache, key_of(0), &miss) == slots[0] && !miss);
+}
+
+local void check_uploading_slots(void) {
+	TileCache cache;
+	u32 slots[TILE_ATLAS_SLOTS];
+	fill_cache(&cache, slots);
+	tile_cache_next_frame(&cache);
+
+	// the two least recently drawn slots wait for their uploads
+	cache.slots[slots[0]].state = TEXTURE_STATE_QUEUED;
+	cache.slots[slots[1]].state = TEXTURE_STATE_UPLOADING;
+
+	bool miss = false;
+	u32 next = TILE_ATLAS_SLOTS;
+	CHECK(tile_cache_acquire(&cache, key_of(next++), &miss) == slots[2] && miss);
+	CHECK(tile_cache_acquire(&cache, key_of(0), &miss) == slots[0] && !miss);
+
+	// with every other slot uploading or used in this frame nothing is free
+	tile_cache_next_frame(&cache);
+	for (u32 i = 2; i < TILE_ATLAS_SLOTS; i++) cache.slots[slots[i]].state = TEXTURE_STATE_UPLOADING;
+	CHECK(tile_cache_acquire(&cache, key_of(next++), &miss) == U32_MAX);
+	CHECK(cache.slots[slots[1]].key.page == 1 && cache.slots[slots[1]].occupied);
+
+	// an upload that finished makes its slot reusable
+	cache.slots[slots[1]].state = TEXTURE_STATE_READY;
+	CHECK(tile_cache_acquire(&cache, key_of(next++), &miss) == slots[1] && miss);
+	CHECK(tile_cache_acquire(&cache, key_of(1), &miss) == U32_MAX);
+}
+
+/// VISIBLE TILES ///
+
+#define PAGE_WIDTH 600.0f
+#define PAGE_HEIGHT 400.0f
+#define EPSILON 1e-3f
+
+local bool near(f32 a, f32 b) {
+	return fabsf(a - b) < EPSILON;
+}
+
+local bool overlaps(const PageInstance *a, f32 left, f32 top, f32 right, f32 bottom) {
+	return a->x < right && left < a->x + a->width && a->y < bottom && top < a->y + a->height;
+}
+
+local const VisibleTile *find_tile(const VisibleTile *tiles, TileKey key) {
+	for (u32 i = 0; i < arrlen(tiles); i++) {
+		const TileKey *k = &tiles[i].key;
+		if (k->page == key.page && k->zoom_level == key.zoom_level && k->x == key.x && k->y == key.y) return &tiles[i];
+	}
+	return NULL;
+}
+
+// the tiles of the whole page cover its box without overlapping, the first one of the unturned page is
+// in the corner the turn moves the top left corner to
+local void check_whole_page(const PageLayout *layout, u32 page, i32 zoom_level) {
+	const PageInstance *box = &layout->instances[page];
+	VisibleTile *tiles = NULL;
+	tile_layout_visible(layout, (PageRange){ page, 1 }, zoom_level, box->x, box->y, box->x + box->width, box->y + box->height, &tiles);
+
+	f32 scale = tile_zoom_scale(zoom_level);
+	u32 columns = (u32)ceilf(PAGE_WIDTH * scale / TILE_SIZE);
+	u32 rows = (u32)ceilf(PAGE_HEIGHT * scale / TILE_SIZE);
+	CHECK(arrlen(tiles) == columns * rows);
+
+	f32 area = 0.0f;
+	for (u32 i = 0; i < arrlen(tiles); i++) {
+		const VisibleTile *tile = &tiles[i];
+		const PageInstance *in = &tile->instance;
+		CHECK(tile->key.page == page && tile->key.zoom_level == zoom_level);
+		CHECK(tile->key.x < columns && tile->key.y < rows);
+		CHECK(in->x >= box->x - EPSILON && in->y >= box->y - EPSILON);
+		CHECK(in->x + in->width <= box->x + box->width + EPSILON && in->y + in->height <= box->y + box->height + EPSILON);
+		CHECK(in->rotation == box->rotation);
+		// a sideways tile is drawn with its sides swapped
+		bool sideways = lrintf(box->rotation / (3.14159265f / 2.0f)) % 2 == 1;
+		CHECK(near((sideways ? in->height : in->width) * scale, (f32)tile->width));
+		CHECK(near((sideways ? in->width : in->height) * scale, (f32)tile->height));
+		area += in->width * in->height;
+	}
+	CHECK(fabsf(area - box->width * box->height) < 1.0f);
+
+	const VisibleTile *first = find_tile(tiles, (TileKey){ .page = page, .zoom_level = zoom_level });
+	CHECK(first != NULL);
+	if (first) {
+		f32 extent = TILE_SIZE / scale;
+		f32 right = box->x + box->width - extent;
+		f32 bottom = box->y + box->height - extent;
+		u32 turns = (u32)lrintf(box->rotation / (3.14159265f / 2.0f)) % 4;
+		f32 x = turns == 1 || turns == 2 ? right : box->x;
+		f32 y = turns == 2 || turns == 3 ? bottom : box->y;
+		if (!near(first->instance.x, x) || !near(first->instance.y, y)) {
+			fprintf(stderr, "page %u: first tile at %.2f %.2f, not %.2f %.2f\n", page, first->instance.x, first->instance.y, x, y);
+			failures += 1;
+		}
+	}
+
+	arrfree(tiles);
+}
+
+// a part of the page gives the tiles of the whole page that overlap it
+local void check_part(const PageLayout *layout, u32 page, i32 zoom_level) {
+	const PageInstance *box = &layout->instances[page];
+	VisibleTile *all = NULL;
+	tile_layout_visible(layout, (PageRange){ page, 1 }, zoom_level, box->x, box->y, box->x + box->width, box->y + box->height, &all);
+
+	for (u32 n = 0; n < 50; n++) {
+		// off the tile edges, which are at whole layout units at these levels
+		f32 left = box->x - 20.0f + (f32)(rng_next() % (u32)box->width) + 0.37f;
+		f32 top = box->y - 20.0f + (f32)(rng_next() % (u32)box->height) + 0.61f;
+		f32 right = left + 1.0f + (f32)(rng_next() % 300);
+		f32 bottom = top + 1.0f + (f32)(rng_next() % 300);
+
+		VisibleTile *part = NULL;
+		tile_layout_visible(layout, (PageRange){ page, 1 }, zoom_level, left, top, right, bottom, &part);
+
+		u32 n_expected = 0;
+		bool same = true;
+		for (u32 i = 0; i < arrlen(all); i++) {
+			if (!overlaps(&all[i].instance, left, top, right, bottom)) continue;
+			n_expected += 1;
+			const VisibleTile *tile = find_tile(part, all[i].key);
+			same = same && tile && near(tile->instance.x, all[i].instance.x) && near(tile->instance.y, all[i].instance.y);
+		}
+		if (!same || arrlen(part) != n_expected) {
+			fprintf(stderr, "page %u: %u tiles in %.2f %.2f %.2f %.2f, not %u\n", page, (u32)arrlen(part),
+				left, top, right, bottom, n_expected);
+			failures += 1;
+		}
+		arrfree(part);
+	}
+
+	arrfree(all);
+}
+
+local void check_visible(void) {
+	PageSize sizes[] = {
+		{ PAGE_WIDTH, PAGE_HEIGHT, 0 },
+		{ PAGE_WIDTH, PAGE_HEIGHT, 90 },
+		{ PAGE_WIDTH, PAGE_HEIGHT, 180 },
+		{ PAGE_WIDTH, PAGE_HEIGHT, 270 },
+		{ PAGE_WIDTH, PAGE_HEIGHT, -90 },
+	};
+	PageLayout layout;
+	page_layout_init(&layout, sizes, COUNT_OF(sizes), 12.0f);
+
+	for (u32 page = 0; page < COUNT_OF(sizes); page++) {
+		// the last row and column are partial at both levels
+		for (i32 level = 0; level <= 1; level++) {
+			check_whole_page(&layout, page, level);
+			check_part(&layout, page, level);
+		}
+	}
+
+	// the tiles of several pages come page by page, nothing of the gaps between them
+	VisibleTile *tiles = NULL;
+	tile_layout_visible(&layout, (PageRange){ 0, layout.n_pages }, 0, 0.0f, 0.0f, layout.width, layout.height, &tiles);
+	CHECK(arrlen(tiles) == layout.n_pages * 6);
+	for (u32 i = 1; i < arrlen(tiles); i++) CHECK(tiles[i].key.page >= tiles[i - 1].key.page);
+	arrfree(tiles);
+
+	// a rectangle in the gap above the second page has no tiles
+	const PageInstance *second = &layout.instances[1];
+	tile_layout_visible(&layout, (PageRange){ 0, 2 }, 0, 0.0f, second->y - 10.0f, layout.width, second->y - 2.0f, &tiles);
+	CHECK(arrlen(tiles) == 0);
+	arrfree(tiles);
+
+	page_layout_free(&layout);
+}
+
+int main(void) {
+	check_acquire();
+	check_eviction_order();
+	check_uploading_slots();
+	check_visible();
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}